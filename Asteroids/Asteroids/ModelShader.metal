@@ -10,11 +10,11 @@ using namespace metal;
 
 #include "ModelShaderType.h"
 
+// the packed layout of VertexPacking, the vertex fetch converts to float
 typedef struct Vertex
 {
-    float3 position [[attribute(ModelVertexAttributePosition)]];
+    float4 position [[attribute(ModelVertexAttributePosition)]];
     float2 texCoord [[attribute(ModelVertexAttributeTexcoord)]];
-    float3 normal   [[attribute(ModelVertexAttributeNormal)]];
 } Vertex;
 
 struct RasterizerData
@@ -23,30 +23,32 @@ struct RasterizerData
     float2 texCoords;
 };
 
-vertex RasterizerData vertexShader(uint vertexID [[vertex_id]],
-                                   constant Vertex *vertices [[buffer(ModelVertexInputIndexPosition)]],
-                                   constant Uniforms &uniforms [[buffer(ModelVertexInputIndexUniforms)]]
+vertex RasterizerData vertexShader(Vertex in [[stage_in]],
+                                   constant Uniforms &uniforms [[buffer(ModelVertexInputIndexUniforms)]],
+                                   constant PackingConstants &packing [[buffer(ModelVertexInputIndexPacking)]]
                                    )
 {
     RasterizerData out;
     
-    out.position = uniforms.projectionMatrix * uniforms.viewMatrix *uniforms.modelMatrix * float4(vertices[vertexID].position, 1.0);
-    out.texCoords = vertices[vertexID].texCoord;
+    float4 position = in.position * packing.positionScale + packing.positionOffset;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix *uniforms.modelMatrix * position;
+    out.texCoords = in.texCoord;
     
     return out;
 }
 
-vertex RasterizerData rockVertexShader(uint vertexID [[vertex_id]],
+vertex RasterizerData rockVertexShader(Vertex in [[stage_in]],
                                    uint instanceID [[instance_id]],
-                                   constant Vertex *vertices   [[buffer(ModelVertexInputIndexPosition)]],
                                    constant RockUniforms &uniforms [[buffer(ModelVertexInputIndexUniforms)]],
-                                   constant RockModel *models  [[buffer(ModelVertexInputIndexModels)]]
+                                   constant RockModel *models  [[buffer(ModelVertexInputIndexModels)]],
+                                   constant PackingConstants &packing [[buffer(ModelVertexInputIndexPacking)]]
                                    )
 {
     RasterizerData out;
     
-    out.position = uniforms.projectionMatrix * uniforms.viewMatrix *models[instanceID].modelMatrix * float4(vertices[vertexID].position, 1.0);
-    out.texCoords = vertices[vertexID].texCoord;
+    float4 position = in.position * packing.positionScale + packing.positionOffset;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix *models[instanceID].modelMatrix * position;
+    out.texCoords = in.texCoord;
     
     return out;
 }
@@ -24,6 +24,7 @@ typedef enum ModelVertexInputIndex {
     ModelVertexInputIndexPosition = 0,
     ModelVertexInputIndexUniforms = 1,
     ModelVertexInputIndexModels   = 2,
+    ModelVertexInputIndexPacking  = 3,
 } ModelVertexInputIndex;
 
 typedef struct Uniforms
@@ -42,4 +43,10 @@ typedef struct RockUniforms {
     matrix_float4x4 projectionMatrix;
 } RockUniforms;
 
+// Same layout as vertex_packing_constants of common/VertexPacking.h.
+typedef struct PackingConstants {
+    vector_float4 positionScale;
+    vector_float4 positionOffset;
+} PackingConstants;
+
 #endif /* ModelShaderType_h */
@@ -18,14 +18,22 @@ class Renderer: NSObject {
     private var depthStencilState: MTLDepthStencilState!
     private var renderPipelineState: MTLRenderPipelineState!
     private var rockPipelineState: MTLRenderPipelineState!
-    private var planetMesh: MetalMesh!
-    private var rockMesh: MetalMesh!
-    private var rockModelsBuffer: MTLBuffer!
+    private var planetMesh: ModelIOMesh!
+    private var rockMesh: ModelIOMesh!
+    /// Visible rocks grouped by level of detail, culled every frame.
+    private var rockCuller: InstanceCuller!
+    private let cullPool = JobPool()
+    private let maxFramesInFlight = 3
+    private var inFlightSemaphore: DispatchSemaphore!
+    /// Pixels a unit length covers a unit in front of the camera.
+    private var projectionScale: Float = 1.0
     private var commandQueue: MTLCommandQueue!
     private var viewPort: MTLViewport!
     private var uniforms: Uniforms!
     private var rockUniform: RockUniforms!
     private let rocksAmount: Int = 10000
+    /// Screen space error a rock level may have, in pixels.
+    private let rockErrorPixels: Float = 1.0
     
     init(metalView: MTKView) {
         super.init()
@@ -47,46 +55,24 @@ class Renderer: NSObject {
         
         depthStencilState = device.makeDepthStencilState(descriptor: depthStencilDescriptor)!
         
-        let mtlVertexDescriptor = MTLVertexDescriptor()
-        // position
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributePosition.rawValue)].format = .float3
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributePosition.rawValue)].offset = 0
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributePosition.rawValue)].bufferIndex = Int(ModelVertexInputIndexPosition.rawValue);
-        
-        // texture coordinate
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributeTexcoord.rawValue)].format = .float2
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributeTexcoord.rawValue)].offset = 16
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributeTexcoord.rawValue)].bufferIndex = Int(ModelVertexInputIndexPosition.rawValue)
-        
-        // normal
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributeNormal.rawValue)].format = .float3
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributeNormal.rawValue)].offset = 32
-        mtlVertexDescriptor.attributes[Int(ModelVertexAttributeNormal.rawValue)].bufferIndex = Int(ModelVertexInputIndexPosition.rawValue)
-        
-        // layout
-        mtlVertexDescriptor.layouts[Int(ModelVertexInputIndexPosition.rawValue)].stride = 48
-        mtlVertexDescriptor.layouts[Int(ModelVertexInputIndexPosition.rawValue)].stepRate = 1
-        mtlVertexDescriptor.layouts[Int(ModelVertexInputIndexPosition.rawValue)].stepFunction = .perVertex
+        // 16 byte packed vertices instead of the 48 byte float layout, the
+        // belt draws the rock ten thousand times
+        let packing = VertexPacking(positionFormat: VertexPackingPositionSnorm16,
+                                    positionAttribute: Int(ModelVertexAttributePosition.rawValue),
+                                    texcoordAttribute: Int(ModelVertexAttributeTexcoord.rawValue),
+                                    normalAttribute: Int(ModelVertexAttributeNormal.rawValue),
+                                    bufferIndex: Int(ModelVertexInputIndexPosition.rawValue))
+        let mtlVertexDescriptor = packing.vertexDescriptor
 
         let planetUrl = Bundle.common.url(forResource: "planet.obj", withExtension: nil, subdirectory: "planet")!
-
-        planetMesh = try! ModelIOMesh(withUrl: planetUrl,
-                               device: device,
-                               mtlVertexDescriptor: mtlVertexDescriptor,
-                               attributeMap: [
-                                Int(ModelVertexAttributePosition.rawValue) : MDLVertexAttributePosition,
-                                Int(ModelVertexAttributeTexcoord.rawValue) : MDLVertexAttributeTextureCoordinate,
-                                Int(ModelVertexAttributeNormal.rawValue)   : MDLVertexAttributeNormal
-                               ])
+        planetMesh = try! ModelIOMesh(withUrl: planetUrl, device: device, packing: packing)
         
         let rockUrl = Bundle.common.url(forResource: "rock.obj", withExtension: nil, subdirectory: "rock")!
+        // the belt draws thousands of rocks, far ones take coarser levels
         rockMesh = try! ModelIOMesh(withUrl: rockUrl,
-                                  device: device,
-                                  mtlVertexDescriptor: mtlVertexDescriptor,
-                                  attributeMap: [
-                                    Int(ModelVertexAttributePosition.rawValue) : MDLVertexAttributePosition,
-                                    Int(ModelVertexAttributeTexcoord.rawValue) : MDLVertexAttributeTextureCoordinate,
-                                    Int(ModelVertexAttributeNormal.rawValue)   : MDLVertexAttributeNormal])
+                                    device: device,
+                                    packing: packing,
+                                    lodErrorTargets: MeshSimplifier.defaultErrorTargets)
         
         let library = device.makeDefaultLibrary()!
         let vertexFunc = library.makeFunction(name: "vertexShader")!
@@ -114,6 +100,7 @@ class Renderer: NSObject {
         rockPipelineState = try! device.makeRenderPipelineState(descriptor: rockRenderPipelineDescriptor)
     
         commandQueue = device.makeCommandQueue()!
+        inFlightSemaphore = DispatchSemaphore(value: maxFramesInFlight)
         
         viewPort = MTLViewport(originX: 0.0, originY: 0.0,
                                width: Double(metalView.frame.width),
@@ -129,7 +116,8 @@ class Renderer: NSObject {
                             projectionMatrix: matrix_perspective_left_hand(Float.pi / 4.0, width / height, 0.1, 1000.0))
         rockUniform = RockUniforms(viewMatrix: camera.getViewMatrix(),
                                    projectionMatrix: matrix_perspective_left_hand(Float.pi / 4.0, width / height, 0.1, 1000.0))
-        fillModelsBuffer()
+        projectionScale = mesh_lod_projection_scale(Float.pi / 4.0, height)
+        fillModels()
     }
     
     func handleCameraEvent(deltaX: Float, deltaY: Float) -> Void {
@@ -139,41 +127,50 @@ class Renderer: NSObject {
         rockUniform.viewMatrix = camera.getViewMatrix()
     }
     
-    private func fillModelsBuffer() {
-        var models : [RockModel] = [RockModel]()
+    private func fillModels() {
+        var translations = [vector_float3]()
+        var rotations = [quaternion_float]()
+        var scales = [vector_float3]()
+        translations.reserveCapacity(rocksAmount)
+        rotations.reserveCapacity(rocksAmount)
+        scales.reserveCapacity(rocksAmount)
+        
         let radius : Float = 150.0
         let offset : Float = 25.0
+        let rotAxis = simd_normalize(vector_float3(0.4, 0.6, 0.8))
+        
+        // fixed seed so the belt looks the same every run, one stream per attribute
+        var displacements = [vector_float3](repeating: vector_float3(), count: rocksAmount)
+        var rockScales = [Float](repeating: 0.0, count: rocksAmount)
+        var rotAngles = [Float](repeating: 0.0, count: rocksAmount)
+        var stream = random_stream()
+        random_stream_init(&stream, 0x4173746572, 0)
+        random_stream_fill_float3(&stream, &displacements, rocksAmount, -offset, offset)
+        random_stream_init(&stream, 0x4173746572, 1)
+        random_stream_fill_float(&stream, &rockScales, rocksAmount, 0.05, 0.45)
+        random_stream_init(&stream, 0x4173746572, 2)
+        random_stream_fill_float(&stream, &rotAngles, rocksAmount, 0.0, 2.0 * Float.pi)
+        
         for i in 0..<rocksAmount {
             let angle = Float(i) / Float(rocksAmount) * 360.0
-            var displacement = Float(Int.random(in: 0..<(2 * Int(offset) * 100))) / 100.0 - offset
-            let x = sin(angle) * radius + displacement
-            displacement = Float(Int.random(in: 0..<(2 * Int(offset) * 100))) / 100.0 - offset
-            let y = displacement * 0.4
-            displacement = Float(Int.random(in: 0..<(2 * Int(offset) * 100))) / 100.0 - offset
-            let z = cos(angle) * radius + displacement
+            let displacement = displacements[i]
+            let x = sin(angle) * radius + displacement.x
+            let y = displacement.y * 0.4
+            let z = cos(angle) * radius + displacement.z
             
-            let scale = Float(Int.random(in: 0..<40)) / 100.0 + 0.05
-            let rotAngle = Float(Int.random(in: 0..<360)) / 360.0 * 2.0 * Float.pi
-            
-            let model = matrix_multiply(matrix4x4_translation(x, y, z),
-                                        matrix_multiply(matrix4x4_scale(scale, scale, scale),
-                                                        matrix4x4_rotation(rotAngle, vector_float3(0.4, 0.6, 0.8))))
-            models.append(RockModel(modelMatrix: model))
+            // uniform scale commutes with the rotation, so T * S * R == T * R * S
+            translations.append(vector_float3(x, y, z))
+            rotations.append(quaternion_from_axis_angle(rotAxis, rotAngles[i]))
+            scales.append(vector_float3(repeating: rockScales[i]))
         }
         
-        let tmpBuffer = device.makeBuffer(bytes: models,
-                                             length: MemoryLayout<RockModel>.stride * models.count,
-                                             options: .storageModeShared)!
-        rockModelsBuffer = device.makeBuffer(length: tmpBuffer.length, options: .storageModePrivate)!
-        
-        rockModelsBuffer.label = "Rocks Models"
-        
-        let commandBuffer = commandQueue.makeCommandBuffer()!
-        let blitEncoder = commandBuffer.makeBlitCommandEncoder()!
-        blitEncoder.copy(from: tmpBuffer, sourceOffset: 0, to: rockModelsBuffer, destinationOffset: 0, size: tmpBuffer.length)
-        blitEncoder.endEncoding()
-        commandBuffer.commit()
-        commandBuffer.waitUntilCompleted()
+        var rockModels = [matrix_float4x4](repeating: matrix_float4x4(), count: rocksAmount)
+        matrix4x4_compose_trs_n(&rockModels, translations, rotations, scales, rocksAmount)
+        rockCuller = InstanceCuller(device: device,
+                                    models: rockModels,
+                                    boundingSphere: rockMesh.boundingSphere,
+                                    framesInFlight: maxFramesInFlight,
+                                    pool: cullPool)
     }
 }
 
@@ -188,10 +185,17 @@ extension Renderer : MTKViewDelegate {
                                          0.1,
                                          1000.0)
         rockUniform.projectionMatrix = uniforms.projectionMatrix
+        projectionScale = mesh_lod_projection_scale(Float.pi / 4.0, Float(size.height))
     }
     
     func draw(in view: MTKView) {
+        // the culled rocks go to a ring of buffers, one per frame in flight
+        inFlightSemaphore.wait()
         let commandBuffer = commandQueue.makeCommandBuffer()!
+        let semaphore = inFlightSemaphore!
+        commandBuffer.addCompletedHandler { _ in
+            semaphore.signal()
+        }
         
         let renderDescriptor = view.currentRenderPassDescriptor!
         let renderEncoder = commandBuffer.makeRenderCommandEncoder(descriptor: renderDescriptor)!
@@ -206,7 +210,21 @@ extension Renderer : MTKViewDelegate {
         renderEncoder.setVertexBytes(&uniforms,
                                      length: MemoryLayout<Uniforms>.stride,
                                      index: Int(ModelVertexInputIndexUniforms.rawValue))
-        renderEncoder.drawMesh(planetMesh, textureHandler: { (type, texture, _) -> Void in
+        var planetPacking = planetMesh.packingConstants
+        renderEncoder.setVertexBytes(&planetPacking,
+                                     length: MemoryLayout<vertex_packing_constants>.stride,
+                                     index: Int(ModelVertexInputIndexPacking.rawValue))
+        // clusters outside the view or facing away from the camera are skipped,
+        // the test runs in the planet's model space
+        let planetMVP = matrix_multiply(uniforms.projectionMatrix,
+                                        matrix_multiply(uniforms.viewMatrix, uniforms.modelMatrix))
+        let eye = camera.cameraPosition
+        let modelCamera = matrix_multiply(matrix4x4_trs_inverse(uniforms.modelMatrix),
+                                          vector_float4(eye.x, eye.y, eye.z, 1.0))
+        planetMesh.drawVisibleClusters(renderEncoder: renderEncoder,
+                                       modelViewProjection: planetMVP,
+                                       cameraPosition: vector_float3(modelCamera.x, modelCamera.y, modelCamera.z),
+                                       textureHandler: { (type, texture, _) -> Void in
             if type == .baseColor {
                 renderEncoder.setFragmentTexture(texture, index: Int(FragmentInputIndexDiffuseTexture.rawValue))
             }
@@ -217,19 +235,36 @@ extension Renderer : MTKViewDelegate {
 
         renderEncoder.setVertexMesh(rockMesh, index: Int(ModelVertexInputIndexPosition.rawValue))
         renderEncoder.setVertexBytes(&rockUniform, length: MemoryLayout<RockUniforms>.stride, index: Int(ModelVertexInputIndexUniforms.rawValue))
-        renderEncoder.setVertexBuffer(rockModelsBuffer, offset: 0, index: Int(ModelVertexInputIndexModels.rawValue))
+        rockCuller.cull(viewProjection: matrix_multiply(rockUniform.projectionMatrix, rockUniform.viewMatrix),
+                        cameraPosition: camera.cameraPosition,
+                        levelErrors: rockMesh.lodErrors,
+                        projectionScale: projectionScale,
+                        thresholdPixels: rockErrorPixels)
+        renderEncoder.setVertexBuffer(rockCuller.buffer, offset: rockCuller.offset, index: Int(ModelVertexInputIndexModels.rawValue))
+        var rockPacking = rockMesh.packingConstants
+        renderEncoder.setVertexBytes(&rockPacking,
+                                     length: MemoryLayout<vertex_packing_constants>.stride,
+                                     index: Int(ModelVertexInputIndexPacking.rawValue))
 
-        renderEncoder.drawMesh(rockMesh, instanceCount: rocksAmount, textureHandler: { (type, texture, _) ->
-            Void in
-            if type == .baseColor {
-                renderEncoder.setFragmentTexture(texture, index: Int(FragmentInputIndexDiffuseTexture.rawValue))
-            }
-        })
+        // rocks outside the view are skipped, distant ones use coarser levels,
+        // one instanced draw per level
+        var baseInstance = 0
+        for (level, count) in rockCuller.levelCounts.enumerated() where count > 0 {
+            rockMesh.drawLOD(level,
+                             renderEncoder: renderEncoder,
+                             instanceCount: count,
+                             baseInstance: baseInstance,
+                             textureHandler: { (type, texture, _) -> Void in
+                if type == .baseColor {
+                    renderEncoder.setFragmentTexture(texture, index: Int(FragmentInputIndexDiffuseTexture.rawValue))
+                }
+            })
+            baseInstance += count
+        }
 
         renderEncoder.endEncoding()
         
         commandBuffer.present(view.currentDrawable!)
         commandBuffer.commit()
-        commandBuffer.waitUntilCompleted()
     }
 }
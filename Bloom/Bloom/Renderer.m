@@ -218,15 +218,13 @@
                                           matrix4x4_rotation(M_PI * 124.0 / 180.0, 1.0, 0.0, 1.0));
         modelsMatrixes[6] = matrix_multiply(matrix4x4_translation(-3.0, 0.0, 0.0),
                                           matrix4x4_scale(0.5, 0.5, 0.5));
-        for(int i = 0; i < 7; i++) {
-            normalMatrixes[i] = simd_transpose(simd_inverse(matrix3x3_upper_left(modelsMatrixes[i])));
-        }
+        matrix3x3_trs_normal_n(normalMatrixes, modelsMatrixes, 7);
         
         for(int i = 0; i < 4; i++) {
             lightModelMatrixes[i] = matrix_multiply(matrix4x4_translation(_lights[i].position),
                                                     matrix4x4_scale(0.25));
-            lightNormalMatrixes[i] = simd_transpose(simd_inverse(matrix3x3_upper_left(lightModelMatrixes[i])));
         }
+        matrix3x3_trs_normal_n(lightNormalMatrixes, lightModelMatrixes, 4);
         
         _commandQueue = [_device newCommandQueue];
     }
@@ -109,7 +109,7 @@ class Renderer: NSObject {
         uniforms = Uniforms(modelMatrix: modelMatrix,
                             viewMatrix: camera.getViewMatrix(),
                             projectionMatrix: projectionMatrix,
-                            normalMatrix: matrix3x3_upper_left(modelMatrix).inverse.transpose)
+                            normalMatrix: matrix3x3_trs_normal(modelMatrix))
         
         lightCubeUniforms = LightCubeUniforms(modelMatrix: matrix4x4_identity(),
                                               viewMatrix: camera.getViewMatrix(),
@@ -182,17 +182,24 @@ class Renderer: NSObject {
             let matrix = matrix_multiply(matrix4x4_translation($0),
                                          matrix4x4_scale(0.5, 0.5, 0.5))
             modelsMatrixes.append(matrix)
-            normalsMatrixes.append(matrix3x3_upper_left(matrix).inverse.transpose)
+            normalsMatrixes.append(matrix3x3_trs_normal(matrix))
         }
         
-        for _ in 0..<32 {
-            let xPos = Float.random(in: 0.0..<1.0) * 6.0 - 3.0
-            let yPos = Float.random(in: 0.0..<1.0) * 6.0 - 4.0
-            let zPos = Float.random(in: 0.0..<1.0) * 6.0 - 3.0
+        var lightPositions = [vector_float3](repeating: vector_float3(), count: 32)
+        var lightColors = [vector_float3](repeating: vector_float3(), count: 32)
+        var stream = random_stream()
+        random_stream_init(&stream, 0x4C69676874, 0)
+        random_stream_fill_float3(&stream, &lightPositions, 32, 0.0, 6.0)
+        random_stream_fill_float3(&stream, &lightColors, 32, 0.5, 1.0)
+        
+        for i in 0..<32 {
+            let xPos = lightPositions[i].x - 3.0
+            let yPos = lightPositions[i].y - 4.0
+            let zPos = lightPositions[i].z - 3.0
             
-            let rColor = Float.random(in: 0.5..<1.0)
-            let gColor = Float.random(in: 0.5..<1.0)
-            let bColor = Float.random(in: 0.5..<1.0)
+            let rColor = lightColors[i].x
+            let gColor = lightColors[i].y
+            let bColor = lightColors[i].z
             
             let constant: Float = 1.0
             let linear: Float = 0.7
@@ -272,7 +279,7 @@ class Renderer: NSObject {
     }
     
     private func buildNormalMatrix() {
-        uniforms.normalMatrix = matrix3x3_upper_left(uniforms.modelMatrix).inverse.transpose
+        uniforms.normalMatrix = matrix3x3_trs_normal(uniforms.modelMatrix)
     }
 }
 
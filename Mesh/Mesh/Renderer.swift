@@ -181,22 +181,22 @@ class Renderer: NSObject {
         commandQueue = device.makeCommandQueue()!
         
         sphereModelMatrix = matrix4x4_translation(1.0, 1.0, 0.0)
-        sphereNormalMatrix = matrix3x3_upper_left(sphereModelMatrix).inverse.transpose
+        sphereNormalMatrix = matrix3x3_trs_normal(sphereModelMatrix)
         
         icosahedronModelMatrix = matrix4x4_translation(-1.0, 1.0, 0.0)
-        icosahedronNormalMatrix = matrix3x3_upper_left(icosahedronModelMatrix).inverse.transpose
+        icosahedronNormalMatrix = matrix3x3_trs_normal(icosahedronModelMatrix)
         
         cylinderModelMatrix = matrix4x4_translation(1.0, -1.0, 0.0)
-        cylinderNormalMatrix = matrix3x3_upper_left(cylinderModelMatrix).inverse.transpose
+        cylinderNormalMatrix = matrix3x3_trs_normal(cylinderModelMatrix)
         
         ellipticalConeModelMatrix = matrix4x4_translation(-1.0, -1.0, 0.0)
-        ellipticalConeNormalMatrix = matrix3x3_upper_left(ellipticalConeModelMatrix).inverse.transpose
+        ellipticalConeNormalMatrix = matrix3x3_trs_normal(ellipticalConeModelMatrix)
         
         capsuleModelMatrix = matrix4x4_translation(3.0, 1.0, 0.0)
-        capsuleNormalMatrix = matrix3x3_upper_left(capsuleModelMatrix).inverse.transpose
+        capsuleNormalMatrix = matrix3x3_trs_normal(capsuleModelMatrix)
         
         torusModelMatrix = matrix4x4_translation(3.0, -1.0, 0.0)
-        torusNormalMatrix = matrix3x3_upper_left(torusModelMatrix).inverse.transpose
+        torusNormalMatrix = matrix3x3_trs_normal(torusModelMatrix)
     }
     
     func handleCameraEvent(deltaX: Float, deltaY: Float) {
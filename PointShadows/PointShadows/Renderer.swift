@@ -175,32 +175,32 @@ class Renderer: NSObject {
             Uniforms(modelMatrix: containerModelUniform.modelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: containerModelUniform.modelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(containerModelUniform.modelMatrix),
                      isContainer: 1),
             Uniforms(modelMatrix: cubesModelUniforms[0].modelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cubesModelUniforms[0].modelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cubesModelUniforms[0].modelMatrix),
                      isContainer: 0),
             Uniforms(modelMatrix: cubesModelUniforms[1].modelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cubesModelUniforms[1].modelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cubesModelUniforms[1].modelMatrix),
                      isContainer: 0),
             Uniforms(modelMatrix: cubesModelUniforms[2].modelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cubesModelUniforms[2].modelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cubesModelUniforms[2].modelMatrix),
                      isContainer: 0),
             Uniforms(modelMatrix: cubesModelUniforms[3].modelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cubesModelUniforms[3].modelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cubesModelUniforms[3].modelMatrix),
                      isContainer: 0),
             Uniforms(modelMatrix: cubesModelUniforms[4].modelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cubesModelUniforms[4].modelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cubesModelUniforms[4].modelMatrix),
                      isContainer: 0),
         ]
         
@@ -154,19 +154,23 @@
         _uniforms.viewMatrix = [_camera getViewMatrix];
         _cubeModelMatrix = matrix_multiply(matrix4x4_translation(0.0, 7.0, 0.0),
                                            matrix4x4_scale(7.5, 7.5, 7.5));
-        _cubeNormalMatrix = simd_transpose(simd_inverse(matrix3x3_upper_left(_cubeModelMatrix)));
+        _cubeNormalMatrix = matrix3x3_trs_normal(_cubeModelMatrix);
         
         _meshModelMatrix = matrix_multiply(matrix4x4_translation(0.0, 0.5, 0.0),
                                            matrix4x4_rotation(-M_PI/2.0, 1.0, 0.0, 0.0));
-        _meshNormalMatrix = simd_transpose(simd_inverse(matrix3x3_upper_left(_meshModelMatrix)));
+        _meshNormalMatrix = matrix3x3_trs_normal(_meshModelMatrix);
     
+        random_stream stream;
+        random_stream_init(&stream, 0x5353414F, 0);
+        
         for (int i = 0; i < 64; i++) {
-            vector_float3 sample = {
-                [self randomFloatBetween:-1.0 and:1.0],
-                [self randomFloatBetween:-1.0 and:1.0],
-                [self randomFloatBetween:0.0 and:1.0]};
+            // one draw per statement, the order of initializer list calls is unspecified
+            float x = random_stream_next_float(&stream, -1.0, 1.0);
+            float y = random_stream_next_float(&stream, -1.0, 1.0);
+            float z = random_stream_next_float(&stream, 0.0, 1.0);
+            vector_float3 sample = {x, y, z};
             sample = simd_normalize(sample);
-            sample *= [self randomFloatBetween:0.0 and:1.0];
+            sample *= random_stream_next_float(&stream, 0.0, 1.0);
             float scale = (float) i / 64.0;
             
             scale = [self lerp:0.1 :1.0 :scale*scale];
@@ -178,11 +182,9 @@
         
         vector_float4 ssaoNoise[16];
         for (int i = 0; i < 16; i++) {
-            vector_float4 noise = {
-                [self randomFloatBetween:-1.0 and:1.0],
-                [self randomFloatBetween:-1.0 and:1.0],
-                0.0, 0.0
-            };
+            float x = random_stream_next_float(&stream, -1.0, 1.0);
+            float y = random_stream_next_float(&stream, -1.0, 1.0);
+            vector_float4 noise = {x, y, 0.0, 0.0};
             ssaoNoise[i] = noise;
         }
         _noiseTexture = [self createColorTextureWithWidth:4
@@ -504,10 +506,5 @@
     _uniforms.projectionMatrix = _projectionMatrix;
 }
 
-- (float)randomFloatBetween:(float)smallNumber and:(float)bigNumber {
-    float diff = bigNumber - smallNumber;
-    return (((float) (arc4random() % ((unsigned)RAND_MAX + 1)) / RAND_MAX) * diff) + smallNumber;
-}
-
 
 @end
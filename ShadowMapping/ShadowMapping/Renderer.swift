@@ -186,7 +186,7 @@ class Renderer: NSObject {
         uniform = Uniforms(modelMatrix: modelMatrix,
                            viewMatrix: camera.getViewMatrix(),
                            projectionMatrix: projectionMatrix,
-                           inverseModelMatrix: modelMatrix.inverse,
+                           inverseModelMatrix: matrix4x4_trs_inverse(modelMatrix),
                            lightSpaceMatrix: lightSpaceMatrix,
                            texCoordScale: 25.0)
         
@@ -202,19 +202,19 @@ class Renderer: NSObject {
             Uniforms(modelMatrix: cube1ModelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cube1ModelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cube1ModelMatrix),
                      lightSpaceMatrix: lightSpaceMatrix,
                      texCoordScale: 1.0),
             Uniforms(modelMatrix: cube2ModelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cube2ModelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cube2ModelMatrix),
                      lightSpaceMatrix: lightSpaceMatrix,
                      texCoordScale: 1.0),
             Uniforms(modelMatrix: cube3ModelMatrix,
                      viewMatrix: camera.getViewMatrix(),
                      projectionMatrix: projectionMatrix,
-                     inverseModelMatrix: cube3ModelMatrix.inverse,
+                     inverseModelMatrix: matrix4x4_trs_inverse(cube3ModelMatrix),
                      lightSpaceMatrix: lightSpaceMatrix,
                      texCoordScale: 1.0)
         ]
@@ -9,6 +9,8 @@
 #define JsonAnimationMesh_h
 
 @import MetalKit;
+#import <common/common.h>
+#import "ShaderType.h"
 
 @interface JsonAnimationMesh : NSObject
 
@@ -17,10 +19,21 @@
 @property (readonly) id<MTLBuffer> _Nonnull geometryBuffer;
 @property (readonly) int vertexCount;
 
-@property (readonly) id<MTLTexture> _Nonnull boneTexture;
+/// Skinning transforms of the current frame, bind buffer at offset.
+@property (readonly) BonePaletteBuffer * _Nonnull bonePalette;
+/// Matrices for linear blend skinning, dual quaternions for dual quaternion
+/// skinning. Changing it replaces bonePalette from the next update on.
+@property (nonatomic) BonePaletteFormat bonePaletteFormat;
 @property (readonly) id<MTLTexture> _Nonnull diffuseTexture;
 
-@property (readonly) int boneTextureSize;
+/// Plays the clip from vertexAnimationBuffer instead of skinning, the clip is
+/// baked on the first switch.
+@property (nonatomic) BOOL playsVertexAnimation;
+/// Skinned positions and normals of every key, see vertex_animation. nil until
+/// playsVertexAnimation is first set.
+@property (readonly) id<MTLBuffer> _Nullable vertexAnimationBuffer;
+/// Baked frames to blend for the current update.
+@property (readonly) VertexAnimationFrames vertexAnimationFrames;
 
 - (nonnull instancetype)initWithDevice:(nonnull id<MTLDevice>)device
                                jsonUrl:(nonnull NSURL*)jsonUrl
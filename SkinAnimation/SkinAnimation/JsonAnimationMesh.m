@@ -10,24 +10,25 @@
 #import "ShaderType.h"
 #import <common/common.h>
 
-@interface InverseMatrix : NSObject
-
-@property matrix_float4x4 inverseMatrix;
-
-@end
-
-@implementation InverseMatrix
-
-@end
-
 @implementation JsonAnimationMesh {
+    id<MTLDevice> _device;
     Transform *_root;
     NSArray<Transform*> *_bones;
-    NSArray<InverseMatrix*> *_inverseMatrix;
+    // flat store the bones are handles into, updated in one linear sweep
+    TransformHierarchy *_hierarchy;
+    // per bone, in _bones order
+    matrix_float4x4 *_inverseBindMatrices;
+    int32_t *_boneNodes;
     // animations
-    NSArray *_frames;
-    int _duration;
-    float _elapsed;
+    AnimationClip *_clip;
+    pose_sampler *_sampler;
+    CFTimeInterval _startTime;
+    // sampled pose, one entry per bone
+    vector_float3 *_poseTranslations;
+    quaternion_float *_poseRotations;
+    vector_float3 *_poseScales;
+    // skins the baked frames, created on the first bake
+    job_pool *_jobPool;
 }
 
 - (nonnull instancetype)initWithDevice:(nonnull id<MTLDevice>)device
@@ -42,91 +43,88 @@
                                                         options:NSDataReadingMappedIfSafe
                                                           error:&error];
         NSAssert(jsonData, @"json Url convert to NSData error %@", error);
-        id jsonObjects = [NSJSONSerialization JSONObjectWithData:jsonData
-                                                         options:NSJSONReadingMutableContainers
-                                                           error:&error];
-        NSAssert(jsonObjects, @"JSONSerialization error: %@", error);
-        NSAssert([jsonObjects isKindOfClass:[NSDictionary class]], @"json objects should be a dictionary");
-        NSDictionary *dict = (NSDictionary*)jsonObjects;
-        NSArray *positions = dict[@"position"];
-        NSArray *uvs = dict[@"uv"];
-        NSArray *normals = dict[@"normal"];
-        NSArray *skinIndex = dict[@"skinIndex"];
-        NSArray *skinWeight = dict[@"skinWeight"];
-        
-//        NSLog(@"%lu, %d, %d, %d, %lu", (unsigned long)[positions count], [uvs count], [normals count], [skinIndex count], (unsigned long)[skinWeight count]);
-        
+        // the vertex arrays are decoded straight from the file bytes, only the rig goes through NSJSONSerialization
+        json_member members[16];
+        ptrdiff_t memberCount = json_index_members(jsonData.bytes, jsonData.length, members, 16);
+        NSAssert(memberCount >= 0, @"%@ is not a JSON object", jsonUrl.path);
+        memberCount = MIN(memberCount, 16);
+        const json_member *positions = json_find_member(members, memberCount, "position");
+        const json_member *uvs = json_find_member(members, memberCount, "uv");
+        const json_member *normals = json_find_member(members, memberCount, "normal");
+        const json_member *skinIndex = json_find_member(members, memberCount, "skinIndex");
+        const json_member *skinWeight = json_find_member(members, memberCount, "skinWeight");
+        const json_member *rig = json_find_member(members, memberCount, "rig");
+        NSAssert(positions && positions->isFloatArray && positions->floatCount % 3 == 0, @"no position array");
+        int vertexCount = (int)positions->floatCount / 3;
+        NSAssert(uvs && uvs->isFloatArray && uvs->floatCount == vertexCount * 2, @"no uv per vertex");
+        NSAssert(normals && normals->isFloatArray && normals->floatCount == vertexCount * 3, @"no normal per vertex");
+        NSAssert(skinIndex && skinIndex->isFloatArray && skinIndex->floatCount == vertexCount * 4, @"no skinIndex per vertex");
+        NSAssert(skinWeight && skinWeight->isFloatArray && skinWeight->floatCount == vertexCount * 4, @"no skinWeight per vertex");
+        NSAssert(rig, @"no rig");
         
         MTLVertexDescriptor *mtlVertexDescriptor = [[MTLVertexDescriptor alloc] init];
         // position
         mtlVertexDescriptor.attributes[ModelVertexAttributePosition].format = MTLVertexFormatFloat3;
-        mtlVertexDescriptor.attributes[ModelVertexAttributePosition].offset = 0;
+        mtlVertexDescriptor.attributes[ModelVertexAttributePosition].offset = offsetof(skinned_vertex, position);
         mtlVertexDescriptor.attributes[ModelVertexAttributePosition].bufferIndex = ModelVertexInputIndexPosition;
         
         // texture coordinate
-        mtlVertexDescriptor.attributes[ModelVertexAttributeTexcoord].format = MTLVertexFormatFloat2;
-        mtlVertexDescriptor.attributes[ModelVertexAttributeTexcoord].offset = 16;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeTexcoord].format = MTLVertexFormatHalf2;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeTexcoord].offset = offsetof(skinned_vertex, texCoord);
         mtlVertexDescriptor.attributes[ModelVertexAttributeTexcoord].bufferIndex = ModelVertexInputIndexPosition;
         
         // normal
-        mtlVertexDescriptor.attributes[ModelVertexAttributeNormal].format = MTLVertexFormatFloat3;
-        mtlVertexDescriptor.attributes[ModelVertexAttributeNormal].offset = 32;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeNormal].format = MTLVertexFormatShort4Normalized;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeNormal].offset = offsetof(skinned_vertex, normal);
         mtlVertexDescriptor.attributes[ModelVertexAttributeNormal].bufferIndex = ModelVertexInputIndexPosition;
         
         // skin index
-        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinIndex].format = MTLVertexFormatFloat4;
-        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinIndex].offset = 48;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinIndex].format = MTLVertexFormatUChar4;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinIndex].offset = offsetof(skinned_vertex, joints);
         mtlVertexDescriptor.attributes[ModelVertexAttributeSkinIndex].bufferIndex = ModelVertexInputIndexPosition;
         
         // skin Weight
-        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinWeight].format = MTLVertexFormatFloat4;
-        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinWeight].offset = 64;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinWeight].format = MTLVertexFormatUChar4Normalized;
+        mtlVertexDescriptor.attributes[ModelVertexAttributeSkinWeight].offset = offsetof(skinned_vertex, weights);
         mtlVertexDescriptor.attributes[ModelVertexAttributeSkinWeight].bufferIndex = ModelVertexInputIndexPosition;
         
         // layout
-        mtlVertexDescriptor.layouts[ModelVertexInputIndexPosition].stride = 80;
+        mtlVertexDescriptor.layouts[ModelVertexInputIndexPosition].stride = sizeof(skinned_vertex);
         mtlVertexDescriptor.layouts[ModelVertexInputIndexPosition].stepRate = 1;
         mtlVertexDescriptor.layouts[ModelVertexInputIndexPosition].stepFunction = MTLVertexStepFunctionPerVertex;
         
         _mtlVertexDescriptor = mtlVertexDescriptor;
         
-        int vertexCount = (int)positions.count / 3;
         _vertexCount = vertexCount;
         
-        float vertexData[vertexCount * 4 * 5];
+        // one attribute per array, then packed straight into the buffer one vertex at a time
+        float *attributes = malloc(sizeof(float) * vertexCount * 16);
+        float *position = attributes;
+        float *normal = position + vertexCount * 3;
+        float *texCoord = normal + vertexCount * 3;
+        float *joints = texCoord + vertexCount * 2;
+        float *weights = joints + vertexCount * 4;
+        BOOL decoded = json_decode_floats(positions, position, 3, sizeof(float) * 3) == positions->floatCount &&
+                       json_decode_floats(normals, normal, 3, sizeof(float) * 3) == normals->floatCount &&
+                       json_decode_floats(uvs, texCoord, 2, sizeof(float) * 2) == uvs->floatCount &&
+                       json_decode_floats(skinIndex, joints, 4, sizeof(float) * 4) == skinIndex->floatCount &&
+                       json_decode_floats(skinWeight, weights, 4, sizeof(float) * 4) == skinWeight->floatCount;
+        NSAssert(decoded, @"%@ has a malformed number", jsonUrl.path);
+        
+        _geometryBuffer = [device newBufferWithLength:sizeof(skinned_vertex) * vertexCount
+                                              options:MTLResourceStorageModeShared];
+        skinned_vertex *vertices = (skinned_vertex *)_geometryBuffer.contents;
         for (int i = 0; i < vertexCount; i++) {
-            // position
-            vertexData[i * 20] = [positions[i * 3] floatValue];
-            vertexData[i * 20 + 1] = [positions[i * 3 + 1] floatValue];
-            vertexData[i * 20 + 2] = [positions[i * 3 + 2] floatValue];
-            
-            // texture coordinate
-            vertexData[i * 20 + 4] = [uvs[i * 2] floatValue];
-            vertexData[i * 20 + 5] = 1.0 - [uvs[i * 2 + 1] floatValue];
-            
-            // normal
-            vertexData[i * 20 + 8] = [normals[i * 3] floatValue];
-            vertexData[i * 20 + 9] = [normals[i * 3 + 1] floatValue];
-            vertexData[i * 20 + 10] = [normals[i * 3 + 2] floatValue];
-            
-            // skin index
-            vertexData[i * 20 + 12] = [skinIndex[i * 4] floatValue];
-            vertexData[i * 20 + 13] = [skinIndex[i * 4 + 1] floatValue];
-            vertexData[i * 20 + 14] = [skinIndex[i * 4 + 2] floatValue];
-            vertexData[i * 20 + 15] = [skinIndex[i * 4 + 3] floatValue];
-            
-            // skin weight
-            vertexData[i * 20 + 16] = [skinWeight[i * 4] floatValue];
-            vertexData[i * 20 + 17] = [skinWeight[i * 4 + 1] floatValue];
-            vertexData[i * 20 + 18] = [skinWeight[i * 4 + 2] floatValue];
-            vertexData[i * 20 + 19] = [skinWeight[i * 4 + 3] floatValue];
+            texCoord[i * 2 + 1] = 1.0 - texCoord[i * 2 + 1];
+            BOOL packed = skinned_vertex_pack(&vertices[i], position + i * 3, normal + i * 3, texCoord + i * 2,
+                                              joints + i * 4, weights + i * 4);
+            NSAssert(packed, @"vertex %d references a joint above %d", i, SKINNED_VERTEX_MAX_JOINT);
         }
+        free(attributes);
         
-        _geometryBuffer = [device newBufferWithBytes:vertexData
-                                              length:sizeof(vertexData)
-                                             options:MTLResourceStorageModeShared];
-        
-        NSDictionary *rigDict = dict[@"rig"];
+        NSData *rigData = [NSData dataWithBytesNoCopy:(void *)rig->value length:rig->valueLength freeWhenDone:NO];
+        NSDictionary *rigDict = [NSJSONSerialization JSONObjectWithData:rigData options:0 error:&error];
+        NSAssert([rigDict isKindOfClass:[NSDictionary class]], @"rig should be a dictionary: %@", error);
         NSArray *bones = rigDict[@"bones"];
         NSDictionary *bindPose = rigDict[@"bindPose"];
         
@@ -140,7 +138,12 @@
             bindPosition:bindPosition
           bindQuaternion:bindQuaternion
                bindScale:bindScale];
-        [self createBoneTexture:bones device:device];
+        _device = device;
+        _bonePaletteFormat = BonePaletteFormatMatrix;
+        _bonePalette = [[BonePaletteBuffer alloc] initWithDevice:device
+                                                       boneCount:_bones.count
+                                                  framesInFlight:3
+                                                          format:_bonePaletteFormat];
         
         // animation
         [self createAnimation:animationUrl];
@@ -196,159 +199,130 @@
         }
     }
     
-    [_root forceCalculateModelMatrix];
+    NSError *error;
+    _hierarchy = [[TransformHierarchy alloc] initWithRoot:_root error:&error];
+    NSAssert(_hierarchy, @"Failed to bind the bones: %@", error);
+    [_hierarchy update];
     
-    NSMutableArray<InverseMatrix*> *mutableInverseMatrix = [NSMutableArray new];
-    // inverse
-    for (int i = 0; i < _bones.count; i++) {
-        matrix_float4x4 inverseMat = matrix_invert(_bones[i].modelMatrix);
-        InverseMatrix *mat = [InverseMatrix new];
-        mat.inverseMatrix = inverseMat;
-        [mutableInverseMatrix addObject:mat];
+    // inverse, bind poses are affine so the batched affine inverse replaces matrix_invert
+    NSUInteger boneCount = _bones.count;
+    _inverseBindMatrices = malloc(sizeof(matrix_float4x4) * boneCount);
+    _boneNodes = malloc(sizeof(int32_t) * boneCount);
+    for (int i = 0; i < boneCount; i++) {
+        _inverseBindMatrices[i] = _bones[i].modelMatrix;
+        _boneNodes[i] = (int32_t)[_hierarchy indexOf:_bones[i]];
     }
-    
-    _inverseMatrix = mutableInverseMatrix;
+    matrix4x4_affine_inverse_n(_inverseBindMatrices, _inverseBindMatrices, boneCount);
 }
 
-- (void) createBoneTexture:(NSArray*)bones
-                    device:(nonnull id<MTLDevice>)device {
-    if (bones.count <= 0) return;
-    
-    int size = MAX(4, pow(2, ceil(log(sqrt(bones.count * 4)) / M_LN2)));
-    MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor new];
-    textureDescriptor.textureType = MTLTextureType2D;
-    textureDescriptor.width = size;
-    textureDescriptor.height = size;
-    textureDescriptor.pixelFormat = MTLPixelFormatRGBA32Float;
-    textureDescriptor.storageMode = MTLStorageModeManaged;
-    textureDescriptor.mipmapLevelCount = 1;
-    textureDescriptor.usage = MTLTextureUsageShaderRead;
+- (void) createAnimation:(nonnull NSURL*)animationUrl {
+    NSError *error;
+    // the JSON has no key rate, 6 keys per second matches the original 0.1 key step at 60 fps
+    AnimationClip *clip = [AnimationClip compiledFromJSON:animationUrl framesPerSecond:6 error:&error];
+    NSAssert(clip, @"animation clip error %@", error);
+    NSAssert(clip.boneCount == _bones.count, @"animation has %ld bones, rig has %lu",
+             (long)clip.boneCount, (unsigned long)_bones.count);
     
-    id<MTLTexture> texture = [device newTextureWithDescriptor:textureDescriptor];
+    _clip = clip;
+    // the last key repeats the first one, so the looping sampler plays it seamlessly
+    _sampler = pose_sampler_create(clip.clip);
+    _startTime = 0;
     
-    _boneTextureSize = size;
-    _boneTexture = texture;
+    _poseTranslations = malloc(sizeof(vector_float3) * clip.boneCount);
+    _poseRotations = malloc(sizeof(quaternion_float) * clip.boneCount);
+    _poseScales = malloc(sizeof(vector_float3) * clip.boneCount);
 }
 
-- (void) createAnimation:(nonnull NSURL*)animationUrl {
-    NSError *error;
-    NSData *animData = [[NSData alloc] initWithContentsOfURL:animationUrl
-                                                    options:NSDataReadingMappedIfSafe
-                                                      error:&error];
-    NSAssert(animData, @"animation Url convert to NSData error %@", error);
-    id animObjects = [NSJSONSerialization JSONObjectWithData:animData
-                                                     options:NSJSONReadingMutableContainers
-                                                       error:&error];
-    NSAssert(animObjects, @"JSONSerialization error: %@", error);
-    NSAssert([animObjects isKindOfClass:[NSDictionary class]], @"anim objects should be a dictionary");
-    NSDictionary *dict = (NSDictionary*)animObjects;
+- (void) setBonePaletteFormat:(BonePaletteFormat)bonePaletteFormat {
+    if (bonePaletteFormat == _bonePaletteFormat) {
+        return;
+    }
     
-    NSArray *frames = dict[@"frames"];
-    int duration = (int) (frames.count - 1);
-    _frames = frames;
-    _duration = duration;
-    _elapsed = 0;
+    _bonePaletteFormat = bonePaletteFormat;
+    // frames in flight keep the old buffer alive until they complete
+    _bonePalette = [[BonePaletteBuffer alloc] initWithDevice:_device
+                                                   boneCount:_bones.count
+                                              framesInFlight:_bonePalette.framesInFlight
+                                                      format:bonePaletteFormat];
 }
 
-- (void) update {
-    _elapsed += 0.1;
-    if (_elapsed >= _duration) {
-        _elapsed = _elapsed - _duration;
+- (void) setPlaysVertexAnimation:(BOOL)playsVertexAnimation {
+    if (playsVertexAnimation && !_vertexAnimationBuffer) {
+        [self bakeVertexAnimation];
     }
-    
-    int floorFrame = floorf(_elapsed);
-    float blend = _elapsed - floorFrame;
-    NSDictionary *preKey = _frames[floorFrame];
-    NSDictionary *nextKey =_frames[(floorFrame + 1) % _duration];
-    
-    vector_float3 prePos;
-    vector_float4 preRot;
-    vector_float3 preScl;
-    
-    vector_float3 nextPos;
-    vector_float4 nextRot;
-    vector_float3 nextScl;
-    
+    _playsVertexAnimation = playsVertexAnimation;
+}
+
+- (void) packPalette:(matrix_float4x4 *)palette ofKey:(uint32_t)key {
+    animation_clip_sample(_clip.clip, key, _poseTranslations, _poseRotations, _poseScales);
     for (int i = 0 ; i < _bones.count; i++) {
-        // pre keyframe
-        prePos.x = [preKey[@"position"][i * 3] floatValue];
-        prePos.y = [preKey[@"position"][i * 3 + 1] floatValue];
-        prePos.z = [preKey[@"position"][i * 3 + 2] floatValue];
-        
-        preRot.x = [preKey[@"quaternion"][i * 4] floatValue];
-        preRot.y = [preKey[@"quaternion"][i * 4 + 1] floatValue];
-        preRot.z = [preKey[@"quaternion"][i * 4 + 2] floatValue];
-        preRot.w = [preKey[@"quaternion"][i * 4 + 3] floatValue];
-        
-        preScl.x = [preKey[@"scale"][i * 3] floatValue];
-        preScl.y = [preKey[@"scale"][i * 3 + 1] floatValue];
-        preScl.z = [preKey[@"scale"][i * 3 + 2] floatValue];
-        
-        // next keyframe
-        nextPos.x = [nextKey[@"position"][i * 3] floatValue];
-        nextPos.y = [nextKey[@"position"][i * 3 + 1] floatValue];
-        nextPos.z = [nextKey[@"position"][i * 3 + 2] floatValue];
-        
-        nextRot.x = [nextKey[@"quaternion"][i * 4] floatValue];
-        nextRot.y = [nextKey[@"quaternion"][i * 4 + 1] floatValue];
-        nextRot.z = [nextKey[@"quaternion"][i * 4 + 2] floatValue];
-        nextRot.w = [nextKey[@"quaternion"][i * 4 + 3] floatValue];
-        
-        nextScl.x = [nextKey[@"scale"][i * 3] floatValue];
-        nextScl.y = [nextKey[@"scale"][i * 3 + 1] floatValue];
-        nextScl.z = [nextKey[@"scale"][i * 3 + 2] floatValue];
-        
-        prePos = vector_lerp(prePos, nextPos, blend);
-        preRot = vector_lerp(preRot, nextRot, blend);
-        preScl = vector_lerp(preScl, nextScl, blend);
-        
-//        _bones[i].position = vector_lerp(_bones[i].position, prePos, 1);
-//        _bones[i].quaternionVect = vector_lerp(_bones[i].quaternionVect, preRot, 1);
-//        _bones[i].scale = vector_lerp(_bones[i].scale, preScl, 1);
-        _bones[i].position = prePos;
-        _bones[i].quaternionVect = preRot;
-        _bones[i].scale = preScl;
+        [_bones[i] setTRSWithPosition:_poseTranslations[i] quaternion:_poseRotations[i] scale:_poseScales[i]];
     }
+    [_hierarchy update];
+    bone_palette_pack(palette, _hierarchy.store->worldMatrices, _boneNodes, _inverseBindMatrices, _bones.count);
+}
+
+static void bakePalette(void *context, uint32_t frame, matrix_float4x4 *palette) {
+    [(__bridge JsonAnimationMesh *)context packPalette:palette ofKey:frame];
+}
+
+// Skins every key of the clip once, posed through the same bone hierarchy the
+// skinned pipelines use, so both play the same animation.
+- (void) bakeVertexAnimation {
+    animation_clip *clip = _clip.clip;
+    if (!_jobPool) {
+        _jobPool = job_pool_create(0);
+    }
+    vertex_animation *animation = vertex_animation_bake_palettes(_geometryBuffer.contents, _vertexCount, _bones.count,
+                                                                 clip->frameCount, clip->framesPerSecond,
+                                                                 bakePalette, (__bridge void *)self, _jobPool);
+    NSAssert(animation, @"out of memory for %u baked frames", clip->frameCount);
     
-    [_root forceCalculateModelMatrix];
-    
-    float *boneMatrices = (float*) malloc(sizeof(float) * 4 * _boneTextureSize * _boneTextureSize);
-    
-    for (int i = 0; i < _bones.count; i++) {
-        matrix_float4x4 mat = matrix_multiply(_bones[i].modelMatrix, _inverseMatrix[i].inverseMatrix);
+    _vertexAnimationBuffer = [_device newBufferWithBytes:animation->frames
+                                                  length:sizeof(vertex_animation_vertex) * _vertexCount * clip->frameCount
+                                                 options:MTLResourceStorageModeShared];
+    vertex_animation_destroy(animation);
+}
 
-//        NSLog(@"boneMatrices %d: %f, %f, %f", i, mat.columns[0][0], mat.columns[0][1], mat.columns[0][2]);
-        
-        float *p = boneMatrices + i * 16;
-        
-        for (int j = 0; j < 16; j++) {
-            p[j] = mat.columns[j % 4][j / 4];
-        }
-//        memcpy(p, mat.columns, 16 * 4);
+- (void) dealloc {
+    job_pool_destroy(_jobPool);
+    pose_sampler_destroy(_sampler);
+    free(_inverseBindMatrices);
+    free(_boneNodes);
+    free(_poseTranslations);
+    free(_poseRotations);
+    free(_poseScales);
+}
+
+- (void) update {
+    // wall clock time, so playback speed doesn't depend on the frame rate
+    CFTimeInterval now = CACurrentMediaTime();
+    if (_startTime == 0) {
+        _startTime = now;
     }
+    float seconds = (float) fmod(now - _startTime, pose_sampler_duration(_sampler));
     
-    // flipY
-//    for (int i = 0; i < _boneTextureSize / 2; i++) {
-//        int j = _boneTextureSize - 1 - i;
-//
-//        if (i < j) {
-//            float *up = boneMatrices + i * _boneTextureSize * 4;
-//            float *down = boneMatrices + j * _boneTextureSize * 4;
-//
-//            for (int t = 0; t < _boneTextureSize * 4; t++) {
-//                float tmp = up[t];
-//                up[t] = down[t];
-//                down[t] = tmp;
-//            }
-//        }
-//    }
+    if (_playsVertexAnimation) {
+        // the frames are the clip's keys, blend the two around the current time
+        uint32_t last = _clip.clip->frameCount - 1;
+        float frame = fminf(seconds * _clip.clip->framesPerSecond, last);
+        uint32_t first = (uint32_t)frame;
+        uint32_t second = first < last ? first + 1 : last;
+        _vertexAnimationFrames = (VertexAnimationFrames) {
+            first * _vertexCount, second * _vertexCount, frame - first };
+        return;
+    }
     
-    [_boneTexture replaceRegion:MTLRegionMake2D(0, 0, _boneTextureSize, _boneTextureSize)
-                    mipmapLevel:0
-                      withBytes:boneMatrices
-                    bytesPerRow:_boneTextureSize * 16];
+    pose_sampler_sample(_sampler, seconds, _poseTranslations, _poseRotations, _poseScales);
+    
+    for (int i = 0 ; i < _bones.count; i++) {
+        [_bones[i] setTRSWithPosition:_poseTranslations[i] quaternion:_poseRotations[i] scale:_poseScales[i]];
+    }
     
-    free(boneMatrices);
+    [_hierarchy update];
+    [_bonePalette uploadWithWorld:_hierarchy.store->worldMatrices
+                            nodes:_boneNodes
+              inverseBindMatrices:_inverseBindMatrices];
 }
 
 @end
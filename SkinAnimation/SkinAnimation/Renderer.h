@@ -14,6 +14,10 @@
 
 - (nonnull instancetype)initWithMetalKitView:(nonnull MTKView*)mtkView;
 - (void) handleMouseScrollDeltaX:(float) deltaX deltaY:(float) deltaY;
+/// Switches between linear blend and dual quaternion skinning.
+- (void) toggleSkinningMode;
+/// Switches between skinning and playing the baked vertex animation.
+- (void) toggleVertexAnimation;
 
 @end
 
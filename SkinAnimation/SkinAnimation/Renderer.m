@@ -14,6 +14,8 @@
 @implementation Renderer {
     id<MTLDevice> _device;
     id<MTLRenderPipelineState> _pipelineState;
+    id<MTLRenderPipelineState> _dualQuaternionPipelineState;
+    id<MTLRenderPipelineState> _vertexAnimationPipelineState;
     id<MTLCommandQueue> _commandQueue;
     id<MTLDepthStencilState> _depthState;
     JsonAnimationMesh *_mesh;
@@ -21,6 +23,8 @@
     SatelliteCameraController *_satelliteController;
     Uniforms _uniforms;
     MTLViewport _viewPort;
+    // one per bone palette slot, the CPU never writes a palette still in use
+    dispatch_semaphore_t _inFlightSemaphore;
 }
 
 - (nonnull instancetype)initWithMetalKitView:(nonnull MTKView*)mtkView {
@@ -76,7 +80,20 @@
         
         NSAssert(_pipelineState, @"Failed to create pipeline state: %@", error);
         
+        pipelineStateDescriptor.label = @"Dual quaternion model pipeline";
+        pipelineStateDescriptor.vertexFunction = [library newFunctionWithName:@"vertexShaderDualQuaternion"];
+        _dualQuaternionPipelineState = [_device newRenderPipelineStateWithDescriptor:pipelineStateDescriptor error:&error];
+        
+        NSAssert(_dualQuaternionPipelineState, @"Failed to create pipeline state: %@", error);
+        
+        pipelineStateDescriptor.label = @"Vertex animation model pipeline";
+        pipelineStateDescriptor.vertexFunction = [library newFunctionWithName:@"vertexShaderVertexAnimation"];
+        _vertexAnimationPipelineState = [_device newRenderPipelineStateWithDescriptor:pipelineStateDescriptor error:&error];
+        
+        NSAssert(_vertexAnimationPipelineState, @"Failed to create pipeline state: %@", error);
+        
         _commandQueue = [_device newCommandQueue];
+        _inFlightSemaphore = dispatch_semaphore_create(_mesh.bonePalette.framesInFlight);
         
         float width = mtkView.frame.size.width;
         float height = mtkView.frame.size.height;
@@ -85,7 +102,7 @@
         _uniforms.viewMatrix = [_camera getViewMatrix];
         _uniforms.projectionMatrix = matrix_perspective_left_hand(M_PI / 4.0, width / height, 0.1, 1000.0);
         
-        _uniforms.normalMatrix = simd_transpose(simd_inverse(matrix3x3_upper_left(matrix_multiply(_uniforms.viewMatrix, _uniforms.modelMatrix))));
+        _uniforms.normalMatrix = matrix3x3_trs_normal(matrix_multiply(_uniforms.viewMatrix, _uniforms.modelMatrix));
         
         _viewPort = (MTLViewport) {0.0, 0.0, width, height, 0.0, 1.0};
     }
@@ -97,13 +114,27 @@
     [_satelliteController rotateCameraAroundTargetWithDeltaPhi:deltaX deltaTheta:deltaY];
     _uniforms.viewMatrix = [_camera getViewMatrix];
     
-    _uniforms.normalMatrix = simd_transpose(simd_inverse(matrix3x3_upper_left(matrix_multiply(_uniforms.viewMatrix, _uniforms.modelMatrix))));
+    _uniforms.normalMatrix = matrix3x3_trs_normal(matrix_multiply(_uniforms.viewMatrix, _uniforms.modelMatrix));
+}
+
+- (void) toggleSkinningMode {
+    _mesh.bonePaletteFormat = _mesh.bonePaletteFormat == BonePaletteFormatMatrix ?
+        BonePaletteFormatDualQuaternion : BonePaletteFormatMatrix;
+}
+
+- (void) toggleVertexAnimation {
+    _mesh.playsVertexAnimation = !_mesh.playsVertexAnimation;
 }
 
 - (void)drawInMTKView:(nonnull MTKView *)view {
+    dispatch_semaphore_wait(_inFlightSemaphore, DISPATCH_TIME_FOREVER);
     [_mesh update];
     
     id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
+    __block dispatch_semaphore_t semaphore = _inFlightSemaphore;
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> buffer) {
+        dispatch_semaphore_signal(semaphore);
+    }];
     
     MTLRenderPassDescriptor *descriptor = [view currentRenderPassDescriptor];
 
@@ -111,7 +142,19 @@
     [renderEncoder setLabel:@"Model RenderEncoder"];
         
     [renderEncoder setViewport:_viewPort];
-    [renderEncoder setRenderPipelineState:_pipelineState];
+    if (_mesh.playsVertexAnimation) {
+        VertexAnimationFrames frames = _mesh.vertexAnimationFrames;
+        [renderEncoder setRenderPipelineState:_vertexAnimationPipelineState];
+        [renderEncoder setVertexBuffer:_mesh.vertexAnimationBuffer
+                                offset:0
+                               atIndex:ModelVertexInputIndexVertexAnimation];
+        [renderEncoder setVertexBytes:&frames
+                               length:sizeof(frames)
+                              atIndex:ModelVertexInputIndexVertexAnimationFrames];
+    } else {
+        [renderEncoder setRenderPipelineState:_mesh.bonePaletteFormat == BonePaletteFormatMatrix ?
+                                              _pipelineState : _dualQuaternionPipelineState];
+    }
     [renderEncoder setDepthStencilState:_depthState];
     
     [renderEncoder setVertexBuffer:_mesh.geometryBuffer
@@ -120,11 +163,9 @@
     [renderEncoder setVertexBytes:&_uniforms
                            length:sizeof(_uniforms)
                           atIndex:ModelVertexInputIndexUniforms];
-    [renderEncoder setVertexTexture:_mesh.boneTexture atIndex:ModelVertexInputIndexBoneTexture];
-    int boneTextureSize = _mesh.boneTextureSize;
-    [renderEncoder setVertexBytes:&boneTextureSize
-                           length:sizeof(boneTextureSize)
-                          atIndex:ModelVertexInputIndexBoneTextureSize];
+    [renderEncoder setVertexBuffer:_mesh.bonePalette.buffer
+                            offset:_mesh.bonePalette.offset
+                           atIndex:ModelVertexInputIndexBonePalette];
     
     [renderEncoder setFragmentTexture:_mesh.diffuseTexture
                               atIndex:FragmentInputIndexDiffuseTexture];
@@ -136,7 +177,6 @@
     
     [commandBuffer presentDrawable:view.currentDrawable];
     [commandBuffer commit];
-    [commandBuffer waitUntilCompleted];
 }
 
 - (void)mtkView:(nonnull MTKView *)view drawableSizeWillChange:(CGSize)size {
@@ -18,8 +18,8 @@ typedef struct Vertex
 {
     float3 position [[attribute(ModelVertexAttributePosition)]];
     float2 texCoord [[attribute(ModelVertexAttributeTexcoord)]];
-    float3 normal   [[attribute(ModelVertexAttributeNormal)]];
-    float4 skinIndex [[attribute(ModelVertexAttributeSkinIndex)]];
+    float4 normal   [[attribute(ModelVertexAttributeNormal)]];
+    ushort4 skinIndex [[attribute(ModelVertexAttributeSkinIndex)]];
     float4 skinWeight [[attribute(ModelVertexAttributeSkinWeight)]];
 } Vertex;
 
@@ -30,46 +30,19 @@ struct RasterizerData
     float3 normal;
 };
 
-float4x4 getBoneMatrix(const float i,
-                       texture2d<float> boneTexture,
-                       const int boneTextureSize) {
-    float j = i * 4.0;
-    float size = float(boneTextureSize);
-    
-//    float x = j - size * floor(j / size);
-    float x = modf(j, size);
-//    float y = floor(j / float(boneTextureSize));
-    float y = floor(j / size);
-
-    float dx = 1.0 / float(boneTextureSize);
-    float dy = 1.0 / float(boneTextureSize);
-    
-    y = (dy * (y + 0.5));
-    
-    float4 v1 = boneTexture.sample(Const::linearSampler, float2(dx * (x + 0.5), y));
-    float4 v2 = boneTexture.sample(Const::linearSampler, float2(dx * (x + 1.5), y));
-    float4 v3 = boneTexture.sample(Const::linearSampler, float2(dx * (x + 2.5), y));
-    float4 v4 = boneTexture.sample(Const::linearSampler, float2(dx * (x + 3.5), y));
-    
-    return float4x4(v1, v2, v3, v4);
-}
-
-vertex RasterizerData vertexShader(uint vertexID [[vertex_id]],
-                                   constant Vertex *vertices [[buffer(ModelVertexInputIndexPosition)]],
+vertex RasterizerData vertexShader(Vertex vert [[stage_in]],
                                    constant Uniforms &uniforms [[buffer(ModelVertexInputIndexUniforms)]],
-                                   texture2d<float> boneTexture [[texture(ModelVertexInputIndexBoneTexture)]],
-                                   constant int &boneTextureSize [[buffer(ModelVertexInputIndexBoneTextureSize)]]
+                                   constant float4x4 *bonePalette [[buffer(ModelVertexInputIndexBonePalette)]]
                                    )
 {
     RasterizerData out;
-    Vertex vert = vertices[vertexID];
     out.texCoords = vert.texCoord;
-    out.normal = normalize(uniforms.normalMatrix * vert.normal);
     
-    float4x4 boneMatX = getBoneMatrix(vert.skinIndex.x, boneTexture, boneTextureSize);
-    float4x4 boneMatY = getBoneMatrix(vert.skinIndex.y, boneTexture, boneTextureSize);
-    float4x4 boneMatZ = getBoneMatrix(vert.skinIndex.z, boneTexture, boneTextureSize);
-    float4x4 boneMatW = getBoneMatrix(vert.skinIndex.w, boneTexture, boneTextureSize);
+    // Same math as skinning_linear_blend in common, keep the two in sync.
+    float4x4 boneMatX = bonePalette[vert.skinIndex.x];
+    float4x4 boneMatY = bonePalette[vert.skinIndex.y];
+    float4x4 boneMatZ = bonePalette[vert.skinIndex.z];
+    float4x4 boneMatW = bonePalette[vert.skinIndex.w];
     
     // update normal
     float4x4 skinMatrix = float4x4(float4(0.0), float4(0.0), float4(0.0), float4(0.0));
@@ -78,7 +51,8 @@ vertex RasterizerData vertexShader(uint vertexID [[vertex_id]],
     skinMatrix += vert.skinWeight.y * boneMatY;
     skinMatrix += vert.skinWeight.z * boneMatZ;
     skinMatrix += vert.skinWeight.w * boneMatW;
-    out.normal = (skinMatrix * float4(out.normal, 0.0)).xyz;
+    float3 skinnedNormal = (skinMatrix * float4(vert.normal.xyz, 0.0)).xyz;
+    out.normal = normalize(uniforms.normalMatrix * skinnedNormal);
     
     // update position
     float4 bindPos = float4(vert.position, 1.0);
@@ -98,6 +72,73 @@ vertex RasterizerData vertexShader(uint vertexID [[vertex_id]],
     return out;
 }
 
+// Rotates v by the unit quaternion q.
+float3 quaternionRotate(float4 q, float3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Same math as skinning_dual_quaternion in common, keep the two in sync.
+vertex RasterizerData vertexShaderDualQuaternion(Vertex vert [[stage_in]],
+                                                 constant Uniforms &uniforms [[buffer(ModelVertexInputIndexUniforms)]],
+                                                 constant DualQuaternion *bonePalette [[buffer(ModelVertexInputIndexBonePalette)]]
+                                                 )
+{
+    RasterizerData out;
+    out.texCoords = vert.texCoord;
+    
+    DualQuaternion dqX = bonePalette[vert.skinIndex.x];
+    DualQuaternion dqY = bonePalette[vert.skinIndex.y];
+    DualQuaternion dqZ = bonePalette[vert.skinIndex.z];
+    DualQuaternion dqW = bonePalette[vert.skinIndex.w];
+    
+    // q and -q are the same rotation, blend on the hemisphere of the first joint
+    float4 weights = vert.skinWeight;
+    weights.y *= sign(dot(dqX.real, dqY.real) + 1e-30);
+    weights.z *= sign(dot(dqX.real, dqZ.real) + 1e-30);
+    weights.w *= sign(dot(dqX.real, dqW.real) + 1e-30);
+    
+    float4 real = weights.x * dqX.real + weights.y * dqY.real + weights.z * dqZ.real + weights.w * dqW.real;
+    float4 dual = weights.x * dqX.dual + weights.y * dqY.dual + weights.z * dqZ.dual + weights.w * dqW.dual;
+    float inverseLength = rsqrt(dot(real, real));
+    real *= inverseLength;
+    dual *= inverseLength;
+    
+    // update normal
+    float3 skinnedNormal = quaternionRotate(real, vert.normal.xyz);
+    out.normal = normalize(uniforms.normalMatrix * skinnedNormal);
+    
+    // update position
+    float3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    float3 pos = quaternionRotate(real, vert.position) + translation;
+    
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * uniforms.modelMatrix * float4(pos, 1.0);
+    
+    return out;
+}
+
+// Same math as vertex_animation_sample in common, keep the two in sync. Every
+// baked vertex is a half4 position followed by a half4 normal.
+vertex RasterizerData vertexShaderVertexAnimation(Vertex vert [[stage_in]],
+                                                  uint vertexID [[vertex_id]],
+                                                  constant Uniforms &uniforms [[buffer(ModelVertexInputIndexUniforms)]],
+                                                  device const half4 *bakedFrames [[buffer(ModelVertexInputIndexVertexAnimation)]],
+                                                  constant VertexAnimationFrames &frames [[buffer(ModelVertexInputIndexVertexAnimationFrames)]]
+                                                  )
+{
+    RasterizerData out;
+    out.texCoords = vert.texCoord;
+    
+    uint first = (frames.first + vertexID) * 2;
+    uint second = (frames.second + vertexID) * 2;
+    float3 pos = mix(float3(bakedFrames[first].xyz), float3(bakedFrames[second].xyz), frames.blend);
+    float3 normal = mix(float3(bakedFrames[first + 1].xyz), float3(bakedFrames[second + 1].xyz), frames.blend);
+    out.normal = normalize(uniforms.normalMatrix * normal);
+    
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * uniforms.modelMatrix * float4(pos, 1.0);
+    
+    return out;
+}
+
 fragment float4 fragmentShader(RasterizerData in [[stage_in]],
                                texture2d<half> diffuseTexture[[texture(FragmentInputIndexDiffuseTexture)]])
 {
@@ -26,8 +26,9 @@ typedef enum FragmentInputIndex {
 typedef enum ModelVertexInputIndex {
     ModelVertexInputIndexPosition = 0,
     ModelVertexInputIndexUniforms = 1,
-    ModelVertexInputIndexBoneTexture = 2,
-    ModelVertexInputIndexBoneTextureSize = 3,
+    ModelVertexInputIndexBonePalette = 2,
+    ModelVertexInputIndexVertexAnimation = 3,
+    ModelVertexInputIndexVertexAnimationFrames = 4,
 } ModelVertexInputIndex;
 
 typedef struct Uniforms
@@ -38,4 +39,21 @@ typedef struct Uniforms
     matrix_float3x3 normalMatrix;
 } Uniforms;
 
+/// Bone palette entry of the dual quaternion pipeline, same layout as
+/// dual_quaternion in common.
+typedef struct DualQuaternion
+{
+    vector_float4 real;
+    vector_float4 dual;
+} DualQuaternion;
+
+/// The two baked frames the vertex animation pipeline blends, as offsets in
+/// vertices from the start of the frames of vertex_animation in common.
+typedef struct VertexAnimationFrames
+{
+    uint first;
+    uint second;
+    float blend;
+} VertexAnimationFrames;
+
 #endif /* ShaderType_h */
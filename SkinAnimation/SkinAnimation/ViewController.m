@@ -30,6 +30,11 @@
     [metalView setClearColor:MTLClearColorMake(1.0, 1.0, 1.0, 1.0)];
     
     renderer = [[Renderer alloc] initWithMetalKitView:metalView];
+    
+    [NSEvent addLocalMonitorForEventsMatchingMask:NSEventMaskKeyDown handler:^NSEvent *(NSEvent *event) {
+        [self handleKeyDown:event];
+        return event;
+    }];
 }
 
 
@@ -50,4 +55,15 @@
     }
 }
 
+- (void)handleKeyDown:(NSEvent *)event {
+    // d switches between linear blend and dual quaternion skinning
+    if ([event.characters isEqualToString:@"d"]) {
+        [renderer toggleSkinningMode];
+    }
+    // v switches between skinning and the baked vertex animation
+    if ([event.characters isEqualToString:@"v"]) {
+        [renderer toggleVertexAnimation];
+    }
+}
+
 @end
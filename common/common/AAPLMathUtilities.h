@@ -35,7 +35,8 @@ inline static float AAPL_SIMD_OVERLOAD  random_float(float min, float max)
 /// Generate a random three-component vector with values between min and max.
 vector_float3 AAPL_SIMD_OVERLOAD generate_random_vector(float min, float max);
 
-/// Fast random seed.
+/// Fast random seed. Shares one global state, use random_stream (RandomStream.h) for
+/// reproducible or per-thread sequences.
 void AAPL_SIMD_OVERLOAD seedRand(uint32_t seed);
 
 /// Fast integer random.
@@ -187,6 +188,20 @@ matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_perspective_frustum_right_hand(float l
 /// Returns the inverse of the transpose of the given matrix.
 matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_inverse_transpose(matrix_float4x4 m);
 
+/// Returns the inverse of a translation * rotation * scale matrix without shear.
+/// Much cheaper than simd_inverse, the batched version is matrix4x4_trs_inverse_n.
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix4x4_trs_inverse(matrix_float4x4 m);
+
+/// Returns the inverse of an affine matrix, one whose last row is (0, 0, 0, 1).
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix4x4_affine_inverse(matrix_float4x4 m);
+
+/// Returns the normal matrix, the inverse transpose of the upper-left 3x3, of a
+/// translation * rotation * scale matrix without shear.
+matrix_float3x3 AAPL_SIMD_OVERLOAD matrix3x3_trs_normal(matrix_float4x4 m);
+
+/// Returns the normal matrix, the inverse transpose of the upper-left 3x3, of an affine matrix.
+matrix_float3x3 AAPL_SIMD_OVERLOAD matrix3x3_affine_normal(matrix_float4x4 m);
+
 /// Constructs an identity quaternion.
 quaternion_float AAPL_SIMD_OVERLOAD quaternion_identity(void);
 
@@ -385,6 +385,58 @@ matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_inverse_transpose(matrix_float4x4 m) {
     return matrix_invert(matrix_transpose(m));
 }
 
+// Rows of the inverse upper-left 3x3. The columns of a TRS matrix are orthogonal,
+// so each row is a column divided by its squared length.
+static void trs_inverse_rows(matrix_float4x4 m, vector_float3 *x, vector_float3 *y, vector_float3 *z) {
+    *x = m.columns[0].xyz / vector_length_squared(m.columns[0].xyz);
+    *y = m.columns[1].xyz / vector_length_squared(m.columns[1].xyz);
+    *z = m.columns[2].xyz / vector_length_squared(m.columns[2].xyz);
+}
+
+// Rows of the inverse upper-left 3x3 of any invertible matrix: the cross products
+// of the other two columns over the determinant.
+static void affine_inverse_rows(matrix_float4x4 m, vector_float3 *x, vector_float3 *y, vector_float3 *z) {
+    vector_float3 c0 = m.columns[0].xyz;
+    vector_float3 c1 = m.columns[1].xyz;
+    vector_float3 c2 = m.columns[2].xyz;
+    vector_float3 r0 = vector_cross(c1, c2);
+    float invDet = 1.0f / vector_dot(c0, r0);
+    *x = r0 * invDet;
+    *y = vector_cross(c2, c0) * invDet;
+    *z = vector_cross(c0, c1) * invDet;
+}
+
+static matrix_float4x4 inverse_from_rows(vector_float3 x, vector_float3 y, vector_float3 z, vector_float3 t) {
+    return matrix_make_rows(x.x, x.y, x.z, -vector_dot(x, t),
+                            y.x, y.y, y.z, -vector_dot(y, t),
+                            z.x, z.y, z.z, -vector_dot(z, t),
+                              0,   0,   0,               1);
+}
+
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix4x4_trs_inverse(matrix_float4x4 m) {
+    vector_float3 x, y, z;
+    trs_inverse_rows(m, &x, &y, &z);
+    return inverse_from_rows(x, y, z, m.columns[3].xyz);
+}
+
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix4x4_affine_inverse(matrix_float4x4 m) {
+    vector_float3 x, y, z;
+    affine_inverse_rows(m, &x, &y, &z);
+    return inverse_from_rows(x, y, z, m.columns[3].xyz);
+}
+
+matrix_float3x3 AAPL_SIMD_OVERLOAD matrix3x3_trs_normal(matrix_float4x4 m) {
+    vector_float3 x, y, z;
+    trs_inverse_rows(m, &x, &y, &z);
+    return matrix_make_columns(x, y, z);
+}
+
+matrix_float3x3 AAPL_SIMD_OVERLOAD matrix3x3_affine_normal(matrix_float4x4 m) {
+    vector_float3 x, y, z;
+    affine_inverse_rows(m, &x, &y, &z);
+    return matrix_make_columns(x, y, z);
+}
+
 quaternion_float AAPL_SIMD_OVERLOAD quaternion(vector_float3 v, float w) {
     return (quaternion_float){ v.x, v.y, v.z, w };
 }
@@ -0,0 +1,159 @@
+//
+//  AnimationClip.c
+//  common
+//
+
+#include "AnimationClip.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline uint64_t align16(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+// Section offsets and total size of a clip, shared by create and the loader
+// checks. Returns 0 when the sections of that many keys can't be addressed.
+static uint64_t layout(animation_clip_header *header) {
+    uint64_t keys = (uint64_t)header->boneCount * header->frameCount;
+    // 10 floats per key and the header can't wrap below this
+    if (keys > UINT64_MAX / 64) return 0;
+    header->translationsOffset = align16(sizeof(animation_clip_header));
+    header->rotationsOffset = align16(header->translationsOffset + keys * 3 * sizeof(float));
+    header->scalesOffset = align16(header->rotationsOffset + keys * 4 * sizeof(float));
+    return align16(header->scalesOffset + keys * 3 * sizeof(float));
+}
+
+static void bind_storage(animation_clip *clip) {
+    const animation_clip_header *header = clip->storage;
+    char *base = clip->storage;
+    clip->boneCount = header->boneCount;
+    clip->frameCount = header->frameCount;
+    clip->framesPerSecond = header->framesPerSecond;
+    clip->translations = (float *)(base + header->translationsOffset);
+    clip->rotations = (float *)(base + header->rotationsOffset);
+    clip->scales = (float *)(base + header->scalesOffset);
+}
+
+animation_clip *animation_clip_create(uint32_t boneCount, uint32_t frameCount, float framesPerSecond) {
+    animation_clip_header header = {
+        .magic = ANIMATION_CLIP_MAGIC,
+        .version = ANIMATION_CLIP_VERSION,
+        .boneCount = boneCount,
+        .frameCount = frameCount,
+        .framesPerSecond = framesPerSecond,
+    };
+    uint64_t size = layout(&header);
+    if (size == 0) return NULL;
+
+    animation_clip *clip = calloc(1, sizeof(animation_clip));
+    if (!clip) return NULL;
+    if (size > SIZE_MAX - 15 || !(clip->storage = aligned_alloc(16, ((size_t)size + 15) & ~(size_t)15))) {
+        free(clip);
+        return NULL;
+    }
+    memset(clip->storage, 0, (size_t)size);
+    memcpy(clip->storage, &header, sizeof(header));
+    clip->storageSize = (size_t)size;
+    bind_storage(clip);
+
+    size_t keys = (size_t)boneCount * frameCount;
+    for (size_t k = 0; k < keys; k++) {
+        clip->rotations[k * 4 + 3] = 1;
+        clip->scales[k * 3] = clip->scales[k * 3 + 1] = clip->scales[k * 3 + 2] = 1;
+    }
+    return clip;
+}
+
+animation_clip *animation_clip_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(animation_clip_header)) {
+        mapping = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    // the offsets are recomputed instead of trusted, a file can only describe
+    // the layout this version writes
+    const animation_clip_header *stored = mapping;
+    animation_clip_header expected = *stored;
+    uint64_t size = layout(&expected);
+    if (stored->magic != ANIMATION_CLIP_MAGIC ||
+        stored->version != ANIMATION_CLIP_VERSION ||
+        memcmp(stored, &expected, sizeof(expected)) != 0 ||
+        size == 0 || size > (uint64_t)st.st_size) {
+        munmap(mapping, (size_t)st.st_size);
+        return NULL;
+    }
+
+    animation_clip *clip = calloc(1, sizeof(animation_clip));
+    if (!clip) {
+        munmap(mapping, (size_t)st.st_size);
+        return NULL;
+    }
+    clip->storage = mapping;
+    clip->storageSize = (size_t)st.st_size;
+    clip->mapped = true;
+    bind_storage(clip);
+    return clip;
+}
+
+bool animation_clip_write(const animation_clip *clip, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(clip->storage, 1, clip->storageSize, file) == clip->storageSize;
+    return fclose(file) == 0 && ok;
+}
+
+void animation_clip_destroy(animation_clip *clip) {
+    if (!clip) return;
+    if (clip->mapped) {
+        munmap(clip->storage, clip->storageSize);
+    } else {
+        free(clip->storage);
+    }
+    free(clip);
+}
+
+void animation_clip_sample(const animation_clip *clip,
+                           float frame,
+                           vector_float3 *translations,
+                           quaternion_float *rotations,
+                           vector_float3 *scales) {
+    const uint32_t frameCount = clip->frameCount;
+    if (frameCount == 0) return;
+
+    float last = (float)(frameCount - 1);
+    frame = frame < 0 ? 0 : (frame > last ? last : frame);
+    uint32_t k0 = (uint32_t)floorf(frame);
+    uint32_t k1 = k0 + 1 < frameCount ? k0 + 1 : k0;
+    float blend = frame - (float)k0;
+
+    for (uint32_t b = 0; b < clip->boneCount; b++) {
+        const float *t = clip->translations + ((size_t)b * frameCount) * 3;
+        const float *r = clip->rotations + ((size_t)b * frameCount) * 4;
+        const float *s = clip->scales + ((size_t)b * frameCount) * 3;
+
+        translations[b].x = t[k0 * 3] + (t[k1 * 3] - t[k0 * 3]) * blend;
+        translations[b].y = t[k0 * 3 + 1] + (t[k1 * 3 + 1] - t[k0 * 3 + 1]) * blend;
+        translations[b].z = t[k0 * 3 + 2] + (t[k1 * 3 + 2] - t[k0 * 3 + 2]) * blend;
+
+        rotations[b].x = r[k0 * 4] + (r[k1 * 4] - r[k0 * 4]) * blend;
+        rotations[b].y = r[k0 * 4 + 1] + (r[k1 * 4 + 1] - r[k0 * 4 + 1]) * blend;
+        rotations[b].z = r[k0 * 4 + 2] + (r[k1 * 4 + 2] - r[k0 * 4 + 2]) * blend;
+        rotations[b].w = r[k0 * 4 + 3] + (r[k1 * 4 + 3] - r[k0 * 4 + 3]) * blend;
+
+        scales[b].x = s[k0 * 3] + (s[k1 * 3] - s[k0 * 3]) * blend;
+        scales[b].y = s[k0 * 3 + 1] + (s[k1 * 3 + 1] - s[k0 * 3 + 1]) * blend;
+        scales[b].z = s[k0 * 3 + 2] + (s[k1 * 3 + 2] - s[k0 * 3 + 2]) * blend;
+    }
+}
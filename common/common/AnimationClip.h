@@ -0,0 +1,74 @@
+//
+//  AnimationClip.h
+//  common
+//
+//  Compiled skeletal animation clips.
+//
+//  Keyframes are stored per bone and channel as contiguous float tracks, so
+//  sampling a pose reads a few flat arrays instead of walking JSON containers.
+//  The file layout is the in-memory layout: a header followed by the
+//  translation, rotation and scale sections, each 16-byte aligned. Loading
+//  maps the file and points the tracks into the mapping. The format is
+//  little endian, which covers every platform the samples run on.
+//
+
+#ifndef AnimationClip_h
+#define AnimationClip_h
+
+#include <stdbool.h>
+#include <common/MathTypes.h>
+
+#define ANIMATION_CLIP_MAGIC 0x43414D4Cu // "LMAC"
+#define ANIMATION_CLIP_VERSION 1
+
+typedef struct animation_clip_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t boneCount;
+    uint32_t frameCount;
+    float framesPerSecond;
+    uint32_t reserved;
+    /// Byte offsets of the sections from the start of the file.
+    uint64_t translationsOffset;
+    uint64_t rotationsOffset;
+    uint64_t scalesOffset;
+} animation_clip_header;
+
+typedef struct animation_clip {
+    uint32_t boneCount;
+    uint32_t frameCount;
+    float framesPerSecond;
+    /// Track of bone b starts at translations + b * frameCount * 3, xyz per key.
+    float *translations;
+    /// Track of bone b starts at rotations + b * frameCount * 4, xyzw per key.
+    float *rotations;
+    /// Track of bone b starts at scales + b * frameCount * 3, xyz per key.
+    float *scales;
+    /// Header and sections, either allocated or a private file mapping.
+    void *storage;
+    size_t storageSize;
+    bool mapped;
+} animation_clip;
+
+/// Returns a clip with identity keys to be filled by a converter, NULL if out of
+/// memory or the key count is too large to address.
+animation_clip *animation_clip_create(uint32_t boneCount, uint32_t frameCount, float framesPerSecond);
+
+/// Maps a compiled clip file. Returns NULL if the file can't be mapped or is not
+/// a valid clip. The mapping is copy-on-write, edits never reach the file.
+animation_clip *animation_clip_load(const char *path);
+
+/// Writes the clip to `path`, returns false on an I/O error.
+bool animation_clip_write(const animation_clip *clip, const char *path);
+
+void animation_clip_destroy(animation_clip *clip);
+
+/// Samples every bone at `frame`, blending the two surrounding keys linearly.
+/// `frame` is clamped to [0, frameCount - 1].
+void animation_clip_sample(const animation_clip *clip,
+                           float frame,
+                           vector_float3 *translations,
+                           quaternion_float *rotations,
+                           vector_float3 *scales);
+
+#endif /* AnimationClip_h */
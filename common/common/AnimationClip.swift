@@ -0,0 +1,126 @@
+//
+//  AnimationClip.swift
+//  common
+//
+
+import Foundation
+
+/// A compiled animation_clip, either converted from a keyframe JSON file or
+/// mapped from a compiled clip file.
+@objc
+open class AnimationClip: NSObject {
+    
+    @objc
+    public let clip: UnsafeMutablePointer<animation_clip>
+    
+    /// Maps a compiled clip file written by write(to:).
+    @objc
+    public init(contentsOf url: URL) throws {
+        guard let clip = animation_clip_load(url.path) else {
+            throw Errors.runtimeError("\(url.path) is not a compiled animation clip.")
+        }
+        self.clip = clip
+        super.init()
+    }
+    
+    /// Converts the three.js style keyframe JSON used by the skin animation
+    /// sample: { "frames": [ { "position": [], "quaternion": [], "scale": [] } ] }
+    /// with the keys of every bone packed in each array.
+    @objc
+    public init(jsonURL: URL, framesPerSecond: Float) throws {
+        let data = try Data(contentsOf: jsonURL, options: .mappedIfSafe)
+        guard let dict = try JSONSerialization.jsonObject(with: data) as? [String: Any],
+              let frames = dict["frames"] as? [[String: [NSNumber]]],
+              let boneCount = frames.first?["position"].map({ $0.count / 3 }) else {
+            throw Errors.runtimeError("\(jsonURL.path) has no keyframes.")
+        }
+        
+        guard let clip = animation_clip_create(UInt32(boneCount), UInt32(frames.count), framesPerSecond) else {
+            throw Errors.runtimeError("out of memory for \(boneCount) x \(frames.count) keys.")
+        }
+        self.clip = clip
+        super.init()
+        
+        let frameCount = frames.count
+        let channels: [(key: String, width: Int, track: UnsafeMutablePointer<Float>)] = [
+            ("position", 3, clip.pointee.translations),
+            ("quaternion", 4, clip.pointee.rotations),
+            ("scale", 3, clip.pointee.scales),
+        ]
+        for (frameIndex, frame) in frames.enumerated() {
+            for channel in channels {
+                guard let values = frame[channel.key], values.count == boneCount * channel.width else {
+                    throw Errors.runtimeError("frame \(frameIndex) of \(jsonURL.path) has a bad \(channel.key) array.")
+                }
+                for bone in 0..<boneCount {
+                    let key = channel.track + (bone * frameCount + frameIndex) * channel.width
+                    for c in 0..<channel.width {
+                        key[c] = values[bone * channel.width + c].floatValue
+                    }
+                }
+            }
+        }
+    }
+    
+    deinit {
+        animation_clip_destroy(clip)
+    }
+    
+    /// Converts `jsonURL` once into the caches directory and maps the compiled
+    /// clip. The cached file is named by a hash of the JSON's full path and the
+    /// frame rate, so clips of the same name or rate don't share it, and is
+    /// rebuilt when the JSON is newer.
+    @objc
+    public static func compiled(fromJSON jsonURL: URL, framesPerSecond: Float) throws -> AnimationClip {
+        let fileManager = FileManager.default
+        let cacheDirectory = try fileManager.url(for: .cachesDirectory, in: .userDomainMask,
+                                                 appropriateFor: nil, create: true)
+            .appendingPathComponent("LearnMetal", isDirectory: true)
+        try fileManager.createDirectory(at: cacheDirectory, withIntermediateDirectories: true)
+        let key = "\(jsonURL.standardizedFileURL.path)|\(framesPerSecond.bitPattern)"
+        let keyHash = key.utf8CString.withUnsafeBytes { bytes in
+            mesh_cache_hash(bytes.baseAddress, bytes.count, 0)
+        }
+        let clipURL = cacheDirectory.appendingPathComponent(
+            jsonURL.deletingPathExtension().lastPathComponent + String(format: "-%016llx.lmclip", keyHash))
+        
+        let jsonDate = try jsonURL.resourceValues(forKeys: [.contentModificationDateKey]).contentModificationDate
+        let clipDate = try? clipURL.resourceValues(forKeys: [.contentModificationDateKey]).contentModificationDate
+        if let clipDate = clipDate, let jsonDate = jsonDate, clipDate >= jsonDate,
+           let clip = try? AnimationClip(contentsOf: clipURL),
+           clip.clip.pointee.framesPerSecond == framesPerSecond {
+            return clip
+        }
+        
+        let clip = try AnimationClip(jsonURL: jsonURL, framesPerSecond: framesPerSecond)
+        // a read-only caches directory still leaves a usable in-memory clip
+        try? clip.write(to: clipURL)
+        return clip
+    }
+    
+    @objc
+    public func write(to url: URL) throws {
+        if !animation_clip_write(clip, url.path) {
+            throw Errors.runtimeError("failed to write the animation clip to \(url.path).")
+        }
+    }
+    
+    @objc
+    public var boneCount: Int {
+        return Int(clip.pointee.boneCount)
+    }
+    
+    @objc
+    public var frameCount: Int {
+        return Int(clip.pointee.frameCount)
+    }
+    
+    /// Samples every bone at a fractional key index, see animation_clip_sample.
+    @objc
+    public func sample(atFrame frame: Float,
+                       translations: UnsafeMutablePointer<vector_float3>,
+                       rotations: UnsafeMutablePointer<vector_float4>,
+                       scales: UnsafeMutablePointer<vector_float3>) {
+        animation_clip_sample(clip, frame, translations, rotations, scales)
+    }
+}
@@ -0,0 +1,106 @@
+//
+//  BonePalette.c
+//  common
+//
+
+#include "BonePalette.h"
+#include <common/MatrixBatch.h>
+#include <math.h>
+
+enum {
+    // palettes are gathered on the stack in chunks of this many bones
+    ChunkSize = 64,
+};
+
+void bone_palette_pack(matrix_float4x4 *palette,
+                       const matrix_float4x4 *world,
+                       const int32_t *nodes,
+                       const matrix_float4x4 *inverseBind,
+                       size_t count) {
+    if (!nodes) {
+        matrix4x4_multiply_n(palette, world, inverseBind, count);
+        return;
+    }
+
+    // gather a chunk of world matrices on the stack, then one batched multiply
+    matrix_float4x4 gathered[ChunkSize];
+    for (size_t start = 0; start < count; start += ChunkSize) {
+        size_t n = count - start < ChunkSize ? count - start : ChunkSize;
+        for (size_t i = 0; i < n; i++) {
+            gathered[i] = world[nodes[start + i]];
+        }
+        matrix4x4_multiply_n(palette + start, gathered, inverseBind + start, n);
+    }
+}
+
+void dual_quaternion_from_matrix_n(dual_quaternion *out, const matrix_float4x4 *m, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *c = (const float *)&m[i];
+        // r<row><column> of the rotation, columns normalized to drop the scale
+        float sx = 1.0f / sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+        float sy = 1.0f / sqrtf(c[4] * c[4] + c[5] * c[5] + c[6] * c[6]);
+        float sz = 1.0f / sqrtf(c[8] * c[8] + c[9] * c[9] + c[10] * c[10]);
+        float r00 = c[0] * sx, r10 = c[1] * sx, r20 = c[2] * sx;
+        float r01 = c[4] * sy, r11 = c[5] * sy, r21 = c[6] * sy;
+        float r02 = c[8] * sz, r12 = c[9] * sz, r22 = c[10] * sz;
+
+        // Shepperd's method, divides by the largest of the four components
+        float x, y, z, w;
+        float trace = r00 + r11 + r22;
+        if (trace > 0.0f) {
+            float s = 0.5f / sqrtf(trace + 1.0f);
+            w = 0.25f / s;
+            x = (r21 - r12) * s;
+            y = (r02 - r20) * s;
+            z = (r10 - r01) * s;
+        } else if (r00 > r11 && r00 > r22) {
+            float s = 0.5f / sqrtf(1.0f + r00 - r11 - r22);
+            x = 0.25f / s;
+            y = (r01 + r10) * s;
+            z = (r02 + r20) * s;
+            w = (r21 - r12) * s;
+        } else if (r11 > r22) {
+            float s = 0.5f / sqrtf(1.0f + r11 - r00 - r22);
+            y = 0.25f / s;
+            x = (r01 + r10) * s;
+            z = (r12 + r21) * s;
+            w = (r02 - r20) * s;
+        } else {
+            float s = 0.5f / sqrtf(1.0f + r22 - r00 - r11);
+            z = 0.25f / s;
+            x = (r02 + r20) * s;
+            y = (r12 + r21) * s;
+            w = (r10 - r01) * s;
+        }
+        float length = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+        x *= length; y *= length; z *= length; w *= length;
+
+        // 0.5 * (t, 0) * q
+        float tx = c[12], ty = c[13], tz = c[14];
+        out[i].real.x = x;
+        out[i].real.y = y;
+        out[i].real.z = z;
+        out[i].real.w = w;
+        out[i].dual.x = 0.5f * (w * tx + ty * z - tz * y);
+        out[i].dual.y = 0.5f * (w * ty + tz * x - tx * z);
+        out[i].dual.z = 0.5f * (w * tz + tx * y - ty * x);
+        out[i].dual.w = -0.5f * (tx * x + ty * y + tz * z);
+    }
+}
+
+void bone_palette_pack_dual_quaternion(dual_quaternion *palette,
+                                       const matrix_float4x4 *world,
+                                       const int32_t *nodes,
+                                       const matrix_float4x4 *inverseBind,
+                                       size_t count) {
+    matrix_float4x4 matrices[ChunkSize];
+    for (size_t start = 0; start < count; start += ChunkSize) {
+        size_t n = count - start < ChunkSize ? count - start : ChunkSize;
+        if (nodes) {
+            bone_palette_pack(matrices, world, nodes + start, inverseBind + start, n);
+        } else {
+            matrix4x4_multiply_n(matrices, world + start, inverseBind + start, n);
+        }
+        dual_quaternion_from_matrix_n(palette + start, matrices, n);
+    }
+}
@@ -0,0 +1,50 @@
+//
+//  BonePalette.h
+//  common
+//
+//  Skinning matrix palettes.
+//
+//  A palette entry is world * inverse bind of one bone, column major, exactly
+//  the float4x4 a Metal shader reads from a constant buffer. Packing writes
+//  straight into the destination, such as the contents of a shared MTLBuffer,
+//  without a transpose or an intermediate copy.
+//
+//  Dual quaternion palettes hold the rigid part of the same transforms in 8
+//  floats per bone, half of a matrix, for skinning without the volume loss of
+//  linear blending on twisting joints.
+//
+
+#ifndef BonePalette_h
+#define BonePalette_h
+
+#include <common/MathTypes.h>
+
+/// palette[i] = world[nodes[i]] * inverseBind[i] for `count` bones. `nodes` maps
+/// bones to entries of `world`, such as transform_hierarchy nodes, NULL maps
+/// bone i to world[i].
+void bone_palette_pack(matrix_float4x4 *palette,
+                       const matrix_float4x4 *world,
+                       const int32_t *nodes,
+                       const matrix_float4x4 *inverseBind,
+                       size_t count);
+
+/// Unit dual quaternion of a rigid transform, `real` is the rotation and `dual`
+/// is 0.5 * (t, 0) * real. Quaternions are (x, y, z, w).
+typedef struct dual_quaternion {
+    quaternion_float real;
+    quaternion_float dual;
+} dual_quaternion;
+
+/// Rigid part of `count` affine matrices. Scale is divided out of the columns,
+/// shear and mirroring are not representable and give undefined rotations.
+void dual_quaternion_from_matrix_n(dual_quaternion *out, const matrix_float4x4 *m, size_t count);
+
+/// Dual quaternion palette of the transforms bone_palette_pack would write,
+/// same `nodes` mapping.
+void bone_palette_pack_dual_quaternion(dual_quaternion *palette,
+                                       const matrix_float4x4 *world,
+                                       const int32_t *nodes,
+                                       const matrix_float4x4 *inverseBind,
+                                       size_t count);
+
+#endif /* BonePalette_h */
@@ -0,0 +1,80 @@
+//
+//  BonePaletteBuffer.swift
+//  common
+//
+
+import Metal
+
+/// Entry type of a bone palette.
+@objc
+public enum BonePaletteFormat: Int {
+    /// `float4x4` skinning matrices, see bone_palette_pack.
+    case matrix
+    /// Rigid transforms as two `float4`, see bone_palette_pack_dual_quaternion.
+    case dualQuaternion
+}
+
+/// Ring of bone palettes in one shared MTLBuffer, one palette per frame in flight.
+///
+/// Every upload packs the skinning transforms straight into the next slot, so
+/// the CPU never writes a palette the GPU may still be reading. Bind `buffer` at
+/// `offset` as a `constant float4x4 *`, or a dual quaternion array, after each upload.
+@objc
+open class BonePaletteBuffer: NSObject {
+    
+    @objc
+    public let buffer: MTLBuffer
+    
+    @objc
+    public let boneCount: Int
+    
+    @objc
+    public let format: BonePaletteFormat
+    
+    /// Number of palettes, renderers should keep at most this many frames in flight.
+    @objc
+    public let framesInFlight: Int
+    
+    /// Byte offset of the palette written by the last upload.
+    @objc
+    public private(set) var offset: Int = 0
+    
+    private let slotLength: Int
+    private var slot: Int = 0
+    
+    @objc
+    public convenience init(device: MTLDevice, boneCount: Int, framesInFlight: Int = 3) {
+        self.init(device: device, boneCount: boneCount, framesInFlight: framesInFlight, format: .matrix)
+    }
+    
+    @objc
+    public init(device: MTLDevice, boneCount: Int, framesInFlight: Int, format: BonePaletteFormat) {
+        self.boneCount = boneCount
+        self.framesInFlight = framesInFlight
+        self.format = format
+        let entryLength = format == .matrix ? MemoryLayout<matrix_float4x4>.stride : MemoryLayout<dual_quaternion>.stride
+        // constant buffer offsets must be 256-byte aligned on macOS
+        slotLength = (max(boneCount, 1) * entryLength + 255) & ~255
+        buffer = device.makeBuffer(length: slotLength * framesInFlight, options: .storageModeShared)!
+        buffer.label = "Bone Palette"
+        super.init()
+    }
+    
+    /// Packs world[nodes[i]] * inverseBind[i] for every bone into the next slot,
+    /// as matrices or dual quaternions depending on `format`.
+    @objc
+    public func upload(world: UnsafePointer<matrix_float4x4>,
+                       nodes: UnsafePointer<Int32>?,
+                       inverseBindMatrices: UnsafePointer<matrix_float4x4>) {
+        slot = (slot + 1) % framesInFlight
+        offset = slot * slotLength
+        switch format {
+        case .matrix:
+            let palette = (buffer.contents() + offset).bindMemory(to: matrix_float4x4.self, capacity: boneCount)
+            bone_palette_pack(palette, world, nodes, inverseBindMatrices, boneCount)
+        case .dualQuaternion:
+            let palette = (buffer.contents() + offset).bindMemory(to: dual_quaternion.self, capacity: boneCount)
+            bone_palette_pack_dual_quaternion(palette, world, nodes, inverseBindMatrices, boneCount)
+        }
+    }
+}
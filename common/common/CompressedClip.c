@@ -0,0 +1,369 @@
+//
+//  CompressedClip.c
+//  common
+//
+
+#include "CompressedClip.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Components other than the largest of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)].
+#define SMALLEST_THREE_RANGE 0.70710678118654752f
+#define SMALLEST_THREE_STEPS 32767.0f
+#define RANGE_STEPS 65535.0f
+
+static const int kChannelWidth[CompressedTrackChannelCount] = { 3, 4, 3 };
+
+animation_compression_settings animation_compression_settings_default(void) {
+    animation_compression_settings settings = {
+        .translationTolerance = 0.01f,
+        .rotationTolerance = 0.0005f,
+        .scaleTolerance = 0.0001f,
+    };
+    return settings;
+}
+
+//------------------------------------------------------------------------------
+// quantization
+
+static inline uint16_t quantize(float value, float steps) {
+    value = value < 0 ? 0 : (value > 1 ? 1 : value);
+    return (uint16_t)lrintf(value * steps);
+}
+
+static void encode_rotation(const float *q, uint16_t out[3]) {
+    int largest = 0;
+    for (int c = 1; c < 4; c++) {
+        if (fabsf(q[c]) > fabsf(q[largest])) largest = c;
+    }
+    // q and -q are the same rotation, flip so the dropped component is positive
+    float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+    for (int c = 0, k = 0; c < 4; c++) {
+        if (c == largest) continue;
+        float unit = (sign * q[c] + SMALLEST_THREE_RANGE) / (2 * SMALLEST_THREE_RANGE);
+        out[k++] = quantize(unit, SMALLEST_THREE_STEPS);
+    }
+    out[0] |= (uint16_t)((largest >> 1) << 15);
+    out[1] |= (uint16_t)((largest & 1) << 15);
+}
+
+// Position of every component in { first, second, third, largest }, by largest index.
+static const uint8_t kSmallestThreeOrder[4][4] = {
+    { 3, 0, 1, 2 }, { 0, 3, 1, 2 }, { 0, 1, 3, 2 }, { 0, 1, 2, 3 },
+};
+
+static inline void decode_rotation(const uint16_t in[3], float q[4]) {
+    int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+    const float scale = (2 * SMALLEST_THREE_RANGE) / SMALLEST_THREE_STEPS;
+    float v[4];
+    v[0] = (float)(in[0] & 0x7FFF) * scale - SMALLEST_THREE_RANGE;
+    v[1] = (float)(in[1] & 0x7FFF) * scale - SMALLEST_THREE_RANGE;
+    v[2] = (float)(in[2] & 0x7FFF) * scale - SMALLEST_THREE_RANGE;
+    v[3] = sqrtf(fmaxf(0.0f, 1.0f - v[0] * v[0] - v[1] * v[1] - v[2] * v[2]));
+    // branch free, the largest component changes from key to key
+    const uint8_t *order = kSmallestThreeOrder[largest];
+    q[0] = v[order[0]];
+    q[1] = v[order[1]];
+    q[2] = v[order[2]];
+    q[3] = v[order[3]];
+}
+
+static void encode_range(const float *v, const compressed_track *track, uint16_t out[3]) {
+    for (int c = 0; c < 3; c++) {
+        float unit = track->extent[c] > 0 ? (v[c] - track->minimum[c]) / track->extent[c] : 0;
+        out[c] = quantize(unit, RANGE_STEPS);
+    }
+}
+
+static inline void decode_range(const uint16_t in[3], const compressed_track *track, float v[3]) {
+    for (int c = 0; c < 3; c++) {
+        v[c] = track->minimum[c] + (float)in[c] * (1.0f / RANGE_STEPS) * track->extent[c];
+    }
+}
+
+static inline void decode_key(int channel, const compressed_key *key, const compressed_track *track, float *v) {
+    if (channel == CompressedTrackRotation) {
+        decode_rotation(key->value, v);
+    } else {
+        decode_range(key->value, track, v);
+    }
+}
+
+//------------------------------------------------------------------------------
+// interpolation and error, shared by the compressor and the sampler
+
+static inline void interpolate(int channel, const float *a, const float *b, float t, float *out) {
+    if (channel != CompressedTrackRotation) {
+        for (int c = 0; c < 3; c++) {
+            out[c] = a[c] + (b[c] - a[c]) * t;
+        }
+        return;
+    }
+
+    // shortest path nlerp
+    float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    float tb = dot < 0 ? -t : t;
+    float lengthSquared = 0;
+    for (int c = 0; c < 4; c++) {
+        out[c] = a[c] * (1 - t) + b[c] * tb;
+        lengthSquared += out[c] * out[c];
+    }
+    float inverseLength = 1.0f / sqrtf(lengthSquared);
+    for (int c = 0; c < 4; c++) {
+        out[c] *= inverseLength;
+    }
+}
+
+static float key_error(int channel, const float *sampled, const float *source) {
+    if (channel == CompressedTrackRotation) {
+        // |a - b| = 2 sin(angle / 4) for unit quaternions on the same side, unlike
+        // acos of the dot product it stays accurate for tiny angles
+        float dot = sampled[0] * source[0] + sampled[1] * source[1] + sampled[2] * source[2] + sampled[3] * source[3];
+        float sign = dot < 0 ? -1.0f : 1.0f;
+        float chordSquared = 0;
+        for (int c = 0; c < 4; c++) {
+            float d = sampled[c] - sign * source[c];
+            chordSquared += d * d;
+        }
+        return 4 * asinf(fminf(0.5f * sqrtf(chordSquared), 1.0f));
+    }
+    if (channel == CompressedTrackTranslation) {
+        float dx = sampled[0] - source[0], dy = sampled[1] - source[1], dz = sampled[2] - source[2];
+        return sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+    return fmaxf(fabsf(sampled[0] - source[0]), fmaxf(fabsf(sampled[1] - source[1]), fabsf(sampled[2] - source[2])));
+}
+
+//------------------------------------------------------------------------------
+// compression
+
+// Quantizes one track and appends its kept keys. `source` holds the normalized
+// keys, `decoded` is scratch for frameCount quantized keys.
+static void compress_track(int channel,
+                           const float *source,
+                           uint32_t frameCount,
+                           float tolerance,
+                           compressed_track *track,
+                           compressed_key *keys,
+                           size_t *keyCount,
+                           compressed_key *quantized,
+                           float *decoded) {
+    const int width = kChannelWidth[channel];
+
+    if (channel != CompressedTrackRotation) {
+        for (int c = 0; c < 3; c++) {
+            float lo = source[c], hi = source[c];
+            for (uint32_t f = 1; f < frameCount; f++) {
+                lo = fminf(lo, source[f * 3 + c]);
+                hi = fmaxf(hi, source[f * 3 + c]);
+            }
+            track->minimum[c] = lo;
+            track->extent[c] = hi - lo;
+        }
+    } else {
+        memset(track->minimum, 0, sizeof(track->minimum));
+        memset(track->extent, 0, sizeof(track->extent));
+    }
+
+    for (uint32_t f = 0; f < frameCount; f++) {
+        quantized[f].frame = (uint16_t)f;
+        if (channel == CompressedTrackRotation) {
+            encode_rotation(source + f * 4, quantized[f].value);
+        } else {
+            encode_range(source + f * 3, track, quantized[f].value);
+        }
+        decode_key(channel, &quantized[f], track, decoded + f * 4);
+    }
+
+    // Greedy: from every kept key, reach as far as interpolation to a later key
+    // reproduces all the keys in between.
+    track->firstKey = (uint32_t)*keyCount;
+    keys[(*keyCount)++] = quantized[0];
+    uint32_t kept = 0;
+    while (kept + 1 < frameCount) {
+        uint32_t end = kept + 1;
+        for (uint32_t candidate = kept + 2; candidate < frameCount; candidate++) {
+            bool fits = true;
+            for (uint32_t f = kept + 1; f < candidate && fits; f++) {
+                float sampled[4];
+                float t = (float)(f - kept) / (float)(candidate - kept);
+                interpolate(channel, decoded + kept * 4, decoded + candidate * 4, t, sampled);
+                fits = key_error(channel, sampled, source + f * width) <= tolerance;
+            }
+            if (!fits) break;
+            end = candidate;
+        }
+        keys[(*keyCount)++] = quantized[end];
+        kept = end;
+    }
+
+    // a constant track needs a single key
+    if (*keyCount - track->firstKey == 2 &&
+        memcmp(keys[*keyCount - 1].value, keys[*keyCount - 2].value, sizeof(keys->value)) == 0) {
+        (*keyCount)--;
+    }
+    track->keyCount = (uint32_t)(*keyCount - track->firstKey);
+}
+
+compressed_clip *compressed_clip_create(const animation_clip *clip,
+                                        const animation_compression_settings *settings) {
+    const uint32_t frameCount = clip->frameCount;
+    if (frameCount == 0 || frameCount > 65536) return NULL;
+
+    const size_t trackCount = (size_t)clip->boneCount * CompressedTrackChannelCount;
+    compressed_clip *compressed = calloc(1, sizeof(compressed_clip));
+    float *source = malloc(sizeof(float) * 4 * frameCount);
+    float *decoded = malloc(sizeof(float) * 4 * frameCount);
+    compressed_key *quantized = malloc(sizeof(compressed_key) * frameCount);
+    if (compressed) {
+        compressed->tracks = malloc(sizeof(compressed_track) * (trackCount > 0 ? trackCount : 1));
+        compressed->keys = malloc(sizeof(compressed_key) * (trackCount > 0 ? trackCount : 1) * frameCount);
+    }
+    if (!compressed || !compressed->tracks || !compressed->keys || !source || !decoded || !quantized) {
+        compressed_clip_destroy(compressed);
+        free(source);
+        free(decoded);
+        free(quantized);
+        return NULL;
+    }
+
+    compressed->boneCount = clip->boneCount;
+    compressed->frameCount = frameCount;
+    compressed->framesPerSecond = clip->framesPerSecond;
+    const float tolerances[CompressedTrackChannelCount] = {
+        settings->translationTolerance, settings->rotationTolerance, settings->scaleTolerance,
+    };
+
+    for (uint32_t b = 0; b < clip->boneCount; b++) {
+        for (int channel = 0; channel < CompressedTrackChannelCount; channel++) {
+            const int width = kChannelWidth[channel];
+            const float *tracks[CompressedTrackChannelCount] = { clip->translations, clip->rotations, clip->scales };
+            memcpy(source, tracks[channel] + (size_t)b * frameCount * width, sizeof(float) * width * frameCount);
+            if (channel == CompressedTrackRotation) {
+                for (uint32_t f = 0; f < frameCount; f++) {
+                    float *q = source + f * 4;
+                    float inverseLength = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+                    for (int c = 0; c < 4; c++) q[c] *= inverseLength;
+                }
+            }
+            compress_track(channel, source, frameCount, tolerances[channel],
+                           &compressed->tracks[(size_t)b * CompressedTrackChannelCount + channel],
+                           compressed->keys, &compressed->keyCount, quantized, decoded);
+        }
+    }
+
+    void *keys = realloc(compressed->keys, sizeof(compressed_key) * (compressed->keyCount > 0 ? compressed->keyCount : 1));
+    if (keys) compressed->keys = keys;
+    free(source);
+    free(decoded);
+    free(quantized);
+    return compressed;
+}
+
+void compressed_clip_destroy(compressed_clip *clip) {
+    if (!clip) return;
+    free(clip->tracks);
+    free(clip->keys);
+    free(clip);
+}
+
+size_t compressed_clip_size(const compressed_clip *clip) {
+    return sizeof(compressed_track) * clip->boneCount * CompressedTrackChannelCount +
+           sizeof(compressed_key) * clip->keyCount;
+}
+
+//------------------------------------------------------------------------------
+// sampling
+
+// Index of the last key at or before `whole`. With a cursor, sequential playback
+// steps forward from the previous key instead of searching.
+static inline uint32_t find_key(const compressed_key *keys, uint32_t count, uint32_t whole, uint32_t *cursor) {
+    if (cursor) {
+        uint32_t k = *cursor < count && keys[*cursor].frame <= whole ? *cursor : 0;
+        while (k + 1 < count && keys[k + 1].frame <= whole) {
+            k++;
+        }
+        *cursor = k;
+        return k;
+    }
+
+    // branch free, tracks have few keys
+    uint32_t lo = 0;
+    for (uint32_t step = count / 2; step > 0; count -= step, step = count / 2) {
+        lo = keys[lo + step].frame <= whole ? lo + step : lo;
+    }
+    return lo;
+}
+
+static inline void sample_track(const compressed_clip *clip, int channel, const compressed_track *track,
+                                float frame, uint32_t *cursor, float *out) {
+    const compressed_key *keys = clip->keys + track->firstKey;
+    const uint32_t count = track->keyCount;
+    uint32_t lo = find_key(keys, count, (uint32_t)frame, cursor);
+
+    float a[4], b[4];
+    decode_key(channel, &keys[lo], track, a);
+    if (lo + 1 == count) {
+        memcpy(out, a, sizeof(float) * kChannelWidth[channel]);
+        return;
+    }
+    decode_key(channel, &keys[lo + 1], track, b);
+    float t = (frame - keys[lo].frame) / (float)(keys[lo + 1].frame - keys[lo].frame);
+    interpolate(channel, a, b, t, out);
+}
+
+void compressed_clip_sample_bones(const compressed_clip *clip,
+                                  uint32_t *cursors,
+                                  float frame,
+                                  uint32_t boneCount,
+                                  vector_float3 *translations,
+                                  quaternion_float *rotations,
+                                  vector_float3 *scales) {
+    float last = (float)(clip->frameCount - 1);
+    frame = frame < 0 ? 0 : (frame > last ? last : frame);
+    boneCount = boneCount < clip->boneCount ? boneCount : clip->boneCount;
+
+    for (uint32_t b = 0; b < boneCount; b++) {
+        const compressed_track *tracks = clip->tracks + (size_t)b * CompressedTrackChannelCount;
+        uint32_t *cursor = cursors ? cursors + (size_t)b * CompressedTrackChannelCount : NULL;
+        float v[4];
+
+        sample_track(clip, CompressedTrackTranslation, &tracks[CompressedTrackTranslation], frame,
+                     cursor ? &cursor[CompressedTrackTranslation] : NULL, v);
+        translations[b].x = v[0];
+        translations[b].y = v[1];
+        translations[b].z = v[2];
+
+        sample_track(clip, CompressedTrackRotation, &tracks[CompressedTrackRotation], frame,
+                     cursor ? &cursor[CompressedTrackRotation] : NULL, v);
+        rotations[b].x = v[0];
+        rotations[b].y = v[1];
+        rotations[b].z = v[2];
+        rotations[b].w = v[3];
+
+        sample_track(clip, CompressedTrackScale, &tracks[CompressedTrackScale], frame,
+                     cursor ? &cursor[CompressedTrackScale] : NULL, v);
+        scales[b].x = v[0];
+        scales[b].y = v[1];
+        scales[b].z = v[2];
+    }
+}
+
+void compressed_clip_sample_cursors(const compressed_clip *clip,
+                                    uint32_t *cursors,
+                                    float frame,
+                                    vector_float3 *translations,
+                                    quaternion_float *rotations,
+                                    vector_float3 *scales) {
+    compressed_clip_sample_bones(clip, cursors, frame, clip->boneCount, translations, rotations, scales);
+}
+
+void compressed_clip_sample(const compressed_clip *clip,
+                            float frame,
+                            vector_float3 *translations,
+                            quaternion_float *rotations,
+                            vector_float3 *scales) {
+    compressed_clip_sample_cursors(clip, NULL, frame, translations, rotations, scales);
+}
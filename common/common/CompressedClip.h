@@ -0,0 +1,103 @@
+//
+//  CompressedClip.h
+//  common
+//
+//  Lossy compression of animation_clip.
+//
+//  Every bone track keeps only the keys that linear interpolation can't
+//  reproduce within the channel tolerance. The kept keys are quantized to 48 bits:
+//  rotations as smallest-three quaternions (2-bit index plus three 15-bit
+//  components), translations and scales as three 16-bit fractions of the
+//  track's range. A key and its frame index pack into 8 bytes, and the keys of
+//  a track are contiguous, so sampling a track reads one short run of memory.
+//
+
+#ifndef CompressedClip_h
+#define CompressedClip_h
+
+#include <common/AnimationClip.h>
+
+typedef struct animation_compression_settings {
+    /// Largest distance between a sampled and a source translation.
+    float translationTolerance;
+    /// Largest angle, in radians, between a sampled and a source rotation.
+    float rotationTolerance;
+    /// Largest per-axis difference between a sampled and a source scale.
+    float scaleTolerance;
+} animation_compression_settings;
+
+typedef struct compressed_key {
+    uint16_t frame;
+    uint16_t value[3];
+} compressed_key;
+
+typedef enum {
+    CompressedTrackTranslation,
+    CompressedTrackRotation,
+    CompressedTrackScale,
+    CompressedTrackChannelCount,
+} compressed_track_channel;
+
+typedef struct compressed_track {
+    uint32_t firstKey;
+    uint32_t keyCount;
+    /// Range the 16-bit translation and scale values are fractions of.
+    float minimum[3];
+    float extent[3];
+} compressed_track;
+
+typedef struct compressed_clip {
+    uint32_t boneCount;
+    uint32_t frameCount;
+    float framesPerSecond;
+    /// boneCount * CompressedTrackChannelCount tracks, bone major.
+    compressed_track *tracks;
+    compressed_key *keys;
+    size_t keyCount;
+} compressed_clip;
+
+/// Tolerances that keep the snout rig visually identical.
+animation_compression_settings animation_compression_settings_default(void);
+
+/// Compresses `clip`. At every source key the sampled error of a track stays
+/// within the tolerance or the quantization error of the track, whichever is
+/// larger. Between keys the curve can deviate a little more.
+/// Returns NULL if out of memory or the clip has more than 65536 frames.
+compressed_clip *compressed_clip_create(const animation_clip *clip,
+                                        const animation_compression_settings *settings);
+
+void compressed_clip_destroy(compressed_clip *clip);
+
+/// Bytes used by the tracks and keys.
+size_t compressed_clip_size(const compressed_clip *clip);
+
+/// Samples every bone at `frame`, clamped to [0, frameCount - 1]. Rotations use a
+/// shortest-path normalized lerp between the surrounding kept keys.
+void compressed_clip_sample(const compressed_clip *clip,
+                            float frame,
+                            vector_float3 *translations,
+                            quaternion_float *rotations,
+                            vector_float3 *scales);
+
+/// Same as compressed_clip_sample. `cursors` holds one key index per track,
+/// boneCount * CompressedTrackChannelCount zeros initially. The indices are kept
+/// between calls so sequential playback steps to the next key in O(1) instead
+/// of searching. Seeking backwards restarts from the first key.
+void compressed_clip_sample_cursors(const compressed_clip *clip,
+                                    uint32_t *cursors,
+                                    float frame,
+                                    vector_float3 *translations,
+                                    quaternion_float *rotations,
+                                    vector_float3 *scales);
+
+/// compressed_clip_sample_cursors for the first `boneCount` bones only, the
+/// other bones and their cursors are left untouched.
+void compressed_clip_sample_bones(const compressed_clip *clip,
+                                  uint32_t *cursors,
+                                  float frame,
+                                  uint32_t boneCount,
+                                  vector_float3 *translations,
+                                  quaternion_float *rotations,
+                                  vector_float3 *scales);
+
+#endif /* CompressedClip_h */
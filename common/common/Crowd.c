@@ -0,0 +1,288 @@
+//
+//  Crowd.c
+//  common
+//
+
+#include "Crowd.h"
+#include <common/BonePalette.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    // instances per job, a 70 bone character takes a few microseconds
+    InstanceGrain = 4,
+};
+
+crowd_skeleton *crowd_skeleton_create(const int32_t *parents,
+                                      const matrix_float4x4 *inverseBind,
+                                      size_t boneCount) {
+    for (size_t i = 0; i < boneCount; i++) {
+        if (parents[i] < -1 || parents[i] >= (int32_t)i) {
+            return NULL;
+        }
+    }
+
+    crowd_skeleton *skeleton = calloc(1, sizeof(crowd_skeleton));
+    if (!skeleton) {
+        return NULL;
+    }
+    skeleton->boneCount = boneCount;
+    skeleton->parents = malloc(sizeof(int32_t) * (boneCount > 0 ? boneCount : 1));
+    skeleton->depths = malloc(sizeof(uint32_t) * (boneCount > 0 ? boneCount : 1));
+    skeleton->inverseBind = malloc(sizeof(matrix_float4x4) * (boneCount > 0 ? boneCount : 1));
+    if (!skeleton->parents || !skeleton->depths || !skeleton->inverseBind) {
+        crowd_skeleton_destroy(skeleton);
+        return NULL;
+    }
+    memcpy(skeleton->parents, parents, sizeof(int32_t) * boneCount);
+    memcpy(skeleton->inverseBind, inverseBind, sizeof(matrix_float4x4) * boneCount);
+    for (size_t i = 0; i < boneCount; i++) {
+        skeleton->depths[i] = parents[i] < 0 ? 0 : skeleton->depths[parents[i]] + 1;
+    }
+    return skeleton;
+}
+
+void crowd_skeleton_destroy(crowd_skeleton *skeleton) {
+    if (!skeleton) return;
+    free(skeleton->parents);
+    free(skeleton->depths);
+    free(skeleton->inverseBind);
+    free(skeleton);
+}
+
+crowd *crowd_create(const crowd_skeleton *skeleton, size_t capacity) {
+    crowd *c = calloc(1, sizeof(crowd));
+    if (!c) {
+        return NULL;
+    }
+    c->skeleton = skeleton;
+    c->capacity = capacity > 0 ? capacity : 16;
+    c->instances = malloc(sizeof(crowd_instance) * c->capacity);
+    if (!c->instances) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void crowd_destroy(crowd *c) {
+    if (!c) return;
+    for (size_t i = 0; i < c->count; i++) {
+        pose_sampler_destroy(c->instances[i].sampler);
+        transform_hierarchy_destroy(c->instances[i].pose);
+        free(c->instances[i].keyPalettes);
+    }
+    free(c->instances);
+    free(c->bands);
+    free(c->bandBoneCounts);
+    free(c->bandAncestors);
+    free(c);
+}
+
+static size_t sampler_bone_count(const pose_sampler *sampler) {
+    return sampler->clip ? sampler->clip->boneCount : sampler->compressed->boneCount;
+}
+
+int32_t crowd_add_instance(crowd *c, pose_sampler *sampler, float time, float speed) {
+    const crowd_skeleton *skeleton = c->skeleton;
+    if (sampler_bone_count(sampler) != skeleton->boneCount || c->count >= INT32_MAX) {
+        return -1;
+    }
+    if (c->count == c->capacity) {
+        crowd_instance *instances = realloc(c->instances, sizeof(crowd_instance) * c->capacity * 2);
+        if (!instances) {
+            return -1;
+        }
+        c->instances = instances;
+        c->capacity *= 2;
+    }
+
+    transform_hierarchy *pose = transform_hierarchy_create(skeleton->boneCount);
+    // both key palettes in one block
+    matrix_float4x4 *keyPalettes = malloc(sizeof(matrix_float4x4) * (skeleton->boneCount > 0 ? skeleton->boneCount : 1) * 2);
+    if (!pose || !keyPalettes) {
+        transform_hierarchy_destroy(pose);
+        free(keyPalettes);
+        return -1;
+    }
+    for (size_t i = 0; i < skeleton->boneCount; i++) {
+        transform_hierarchy_add(pose, skeleton->parents[i]);
+    }
+
+    crowd_instance *instance = &c->instances[c->count];
+    memset(instance, 0, sizeof(crowd_instance));
+    instance->sampler = sampler;
+    instance->time = time;
+    instance->speed = speed;
+    instance->pose = pose;
+    instance->keyPalettes = keyPalettes;
+    return (int32_t)c->count++;
+}
+
+bool crowd_set_lod_bands(crowd *c, const crowd_lod_band *bands, size_t bandCount) {
+    const crowd_skeleton *skeleton = c->skeleton;
+    size_t boneCount = skeleton->boneCount;
+    crowd_lod_band *newBands = malloc(sizeof(crowd_lod_band) * (bandCount > 0 ? bandCount : 1));
+    uint32_t *boneCounts = malloc(sizeof(uint32_t) * (bandCount > 0 ? bandCount : 1));
+    int32_t *ancestors = malloc(sizeof(int32_t) * (bandCount * boneCount > 0 ? bandCount * boneCount : 1));
+    if (!newBands || !boneCounts || !ancestors) {
+        free(newBands);
+        free(boneCounts);
+        free(ancestors);
+        return false;
+    }
+
+    for (size_t band = 0; band < bandCount; band++) {
+        newBands[band] = bands[band];
+        uint32_t evaluated = 0;
+        while (evaluated < boneCount && skeleton->depths[evaluated] <= bands[band].maxBoneDepth) {
+            evaluated++;
+        }
+        boneCounts[band] = evaluated;
+
+        int32_t *bandAncestors = ancestors + band * boneCount;
+        for (size_t bone = 0; bone < boneCount; bone++) {
+            int32_t ancestor = (int32_t)bone;
+            while (ancestor >= (int32_t)evaluated) {
+                ancestor = skeleton->parents[ancestor];
+            }
+            bandAncestors[bone] = ancestor;
+        }
+    }
+
+    free(c->bands);
+    free(c->bandBoneCounts);
+    free(c->bandAncestors);
+    c->bands = newBands;
+    c->bandBoneCounts = boneCounts;
+    c->bandAncestors = ancestors;
+    c->bandCount = bandCount;
+    // key palettes of the old bands don't apply anymore
+    for (size_t i = 0; i < c->count; i++) {
+        c->instances[i].interval = 0;
+    }
+    return true;
+}
+
+typedef struct crowd_job {
+    crowd *crowd;
+    float deltaTime;
+    matrix_float4x4 *palette;
+} crowd_job;
+
+static const matrix_float4x4 kIdentity = { {
+    { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 },
+} };
+
+static size_t evaluated_bones(const crowd *c, size_t band) {
+    return c->bandCount > 0 ? c->bandBoneCounts[band] : c->skeleton->boneCount;
+}
+
+// Samples and packs the evaluated bones of the pose at `time`.
+static void evaluate(const crowd *c, crowd_instance *instance, size_t band, float time,
+                     matrix_float4x4 *palette) {
+    size_t evaluated = evaluated_bones(c, band);
+
+    // the sampler writes the pose straight into the hierarchy's TRS arrays
+    transform_hierarchy *pose = instance->pose;
+    pose_sampler_sample_bones(instance->sampler, time, (uint32_t)evaluated,
+                              pose->translations, pose->rotations, pose->scales);
+    pose->needsUpdate = true;
+    transform_hierarchy_update_first(pose, evaluated);
+    bone_palette_pack(palette, pose->worldMatrices, NULL, c->skeleton->inverseBind, evaluated);
+}
+
+// The bones a band skips copy the entry of their closest evaluated ancestor.
+static void collapse(const crowd *c, size_t band, matrix_float4x4 *palette) {
+    size_t boneCount = c->skeleton->boneCount;
+    for (size_t bone = evaluated_bones(c, band); bone < boneCount; bone++) {
+        int32_t ancestor = c->bandAncestors[band * boneCount + bone];
+        palette[bone] = ancestor < 0 ? kIdentity : palette[ancestor];
+    }
+}
+
+static size_t band_of(const crowd *c, float distance) {
+    size_t band = 0;
+    while (band + 1 < c->bandCount && distance > c->bands[band].maxDistance) {
+        band++;
+    }
+    return band;
+}
+
+// out = a + (b - a) * t, element-wise. One matrix at a time through a local,
+// so the compiler can vectorize the fixed size body without alias checks.
+static void lerp_palette(matrix_float4x4 *out, const matrix_float4x4 *a, const matrix_float4x4 *b,
+                         float t, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *fa = (const float *)&a[i];
+        const float *fb = (const float *)&b[i];
+        float lerped[16];
+        for (int k = 0; k < 16; k++) {
+            lerped[k] = fa[k] + (fb[k] - fa[k]) * t;
+        }
+        memcpy(&out[i], lerped, sizeof(lerped));
+    }
+}
+
+static void update_instances(void *context, size_t begin, size_t end) {
+    const crowd_job *job = context;
+    const crowd *c = job->crowd;
+    size_t boneCount = c->skeleton->boneCount;
+
+    for (size_t i = begin; i < end; i++) {
+        crowd_instance *instance = &job->crowd->instances[i];
+        float duration = pose_sampler_duration(instance->sampler);
+        float time = instance->time + job->deltaTime * instance->speed;
+        // keep the clock inside the clip, so it doesn't lose precision over a long run
+        if (instance->sampler->loops && duration > 0.0f) {
+            time = fmodf(time, duration);
+            time = time < 0.0f ? time + duration : time;
+        } else {
+            time = time < 0.0f ? 0.0f : (time > duration ? duration : time);
+        }
+        instance->time = time;
+
+        matrix_float4x4 *palette = job->palette + i * boneCount;
+        size_t band = band_of(c, instance->lodDistance);
+        uint32_t updateInterval = c->bandCount > 0 ? c->bands[band].updateInterval : 1;
+        if (updateInterval <= 1) {
+            evaluate(c, instance, band, time, palette);
+            collapse(c, band, palette);
+            instance->interval = 0;
+            continue;
+        }
+
+        if (instance->interval == 0 || instance->band != band || instance->phase >= instance->interval) {
+            uint32_t interval = updateInterval;
+            if (instance->interval != 0 && instance->band == band) {
+                // the pose at the end of the last span starts the next one
+                instance->lastKey ^= 1;
+            } else {
+                instance->lastKey = 0;
+                evaluate(c, instance, band, time, instance->keyPalettes);
+                // a shorter first span staggers the evaluations of a band over its frames
+                interval -= (uint32_t)(i % updateInterval);
+            }
+            evaluate(c, instance, band, time + interval * job->deltaTime * instance->speed,
+                     instance->keyPalettes + (instance->lastKey ^ 1) * boneCount);
+            instance->band = (uint32_t)band;
+            instance->interval = interval;
+            instance->phase = 0;
+        }
+
+        // the key palettes only hold the evaluated bones, blending and then
+        // copying the skipped ones keeps the cost of a collapsed band down
+        lerp_palette(palette,
+                     instance->keyPalettes + instance->lastKey * boneCount,
+                     instance->keyPalettes + (instance->lastKey ^ 1) * boneCount,
+                     (float)instance->phase / instance->interval, evaluated_bones(c, band));
+        collapse(c, band, palette);
+        instance->phase++;
+    }
+}
+
+void crowd_update(crowd *c, float deltaTime, matrix_float4x4 *palette, job_pool *pool) {
+    crowd_job job = { c, deltaTime, palette };
+    job_pool_parallel_for(pool, c->count, InstanceGrain, update_instances, &job);
+}
@@ -0,0 +1,118 @@
+//
+//  Crowd.h
+//  common
+//
+//  Many instances of one skinned character.
+//
+//  The skeleton and the clips are shared, every instance only keeps its own
+//  playback state and pose. An update advances all instances, evaluates their
+//  poses in parallel and packs every palette into one array, instance i owning
+//  entries [i * boneCount, (i + 1) * boneCount), so a single buffer can be
+//  indexed by instance id in the vertex shader.
+//
+//  Optional distance bands keep the cost of far characters down: a band can
+//  evaluate the pose only every few frames, blending the palettes of the last
+//  and the next evaluation in between, and can stop at a bone depth, deeper
+//  bones then follow their closest evaluated ancestor rigidly.
+//
+
+#ifndef Crowd_h
+#define Crowd_h
+
+#include <stdbool.h>
+#include <common/MathTypes.h>
+#include <common/JobPool.h>
+#include <common/PoseSampler.h>
+#include <common/TransformHierarchy.h>
+
+/// Bone tree and bind pose shared by every instance of a character.
+typedef struct crowd_skeleton {
+    size_t boneCount;
+    /// Parent bone of every bone, -1 for roots. parents[i] < i.
+    int32_t *parents;
+    /// Number of ancestors of every bone, roots are at depth 0.
+    uint32_t *depths;
+    matrix_float4x4 *inverseBind;
+} crowd_skeleton;
+
+/// Level of detail of the characters up to a distance.
+typedef struct crowd_lod_band {
+    /// The band applies up to this distance, bands are sorted by it. The last
+    /// band also applies beyond it.
+    float maxDistance;
+    /// Frames from one pose evaluation to the next, 1 evaluates every frame.
+    /// Assumes a steady frame time, the next pose is evaluated ahead of time.
+    uint32_t updateInterval;
+    /// Deepest evaluated bone. Evaluation stops at the first bone deeper than
+    /// this, which is every bone within the depth for breadth first skeletons.
+    /// Skipped bones reuse the palette entry of their closest evaluated
+    /// ancestor, the identity if they have none. UINT32_MAX evaluates all bones.
+    uint32_t maxBoneDepth;
+} crowd_lod_band;
+
+typedef struct crowd_instance {
+    /// Samples the instance's clip, owned by the crowd.
+    pose_sampler *sampler;
+    /// Playback position in seconds.
+    float time;
+    /// Playback rate, 1 plays the clip at its own speed.
+    float speed;
+    /// Current pose, one node per bone.
+    transform_hierarchy *pose;
+    /// Camera distance that picks the LOD band, set by the caller.
+    float lodDistance;
+    /// Two palettes, the last and the next evaluation of a throttled band.
+    matrix_float4x4 *keyPalettes;
+    /// Which of the two key palettes holds the last evaluation.
+    uint32_t lastKey;
+    /// Band of the current key palettes, the frames they span and the frames
+    /// already played. interval is 0 while no key palettes are in use.
+    uint32_t band;
+    uint32_t interval;
+    uint32_t phase;
+} crowd_instance;
+
+typedef struct crowd {
+    const crowd_skeleton *skeleton;
+    size_t count;
+    size_t capacity;
+    crowd_instance *instances;
+    size_t bandCount;
+    crowd_lod_band *bands;
+    /// Evaluated bones of every band.
+    uint32_t *bandBoneCounts;
+    /// For every band, boneCount entries: the bone whose palette entry each bone uses.
+    int32_t *bandAncestors;
+} crowd;
+
+/// Copies the skeleton. Returns NULL if a parent doesn't come before its child
+/// or if out of memory.
+crowd_skeleton *crowd_skeleton_create(const int32_t *parents,
+                                      const matrix_float4x4 *inverseBind,
+                                      size_t boneCount);
+
+void crowd_skeleton_destroy(crowd_skeleton *skeleton);
+
+/// Returns an empty crowd of `skeleton`, which must outlive it.
+crowd *crowd_create(const crowd_skeleton *skeleton, size_t capacity);
+
+/// Destroys the crowd and the samplers of its instances.
+void crowd_destroy(crowd *crowd);
+
+/// Adds an instance playing `sampler` from `time` at `speed` and returns its id.
+/// The crowd takes ownership of the sampler, whose clip must animate exactly
+/// the skeleton's bones. Returns -1, leaving the sampler to the caller, if the
+/// bone counts differ or if out of memory.
+int32_t crowd_add_instance(crowd *crowd, pose_sampler *sampler, float time, float speed);
+
+/// Replaces the LOD bands, no bands evaluates every bone of every instance
+/// every frame. Returns false, keeping the old bands, if out of memory.
+bool crowd_set_lod_bands(crowd *crowd, const crowd_lod_band *bands, size_t bandCount);
+
+/// Advances every instance by `deltaTime` seconds times its speed and writes
+/// all palettes, see bone_palette_pack, to `palette`, which must hold
+/// count * boneCount matrices. Instances are evaluated on `pool`, the result is
+/// bit-identical for any thread count. `pool` may be NULL.
+void crowd_update(crowd *crowd, float deltaTime, matrix_float4x4 *palette, job_pool *pool);
+
+#endif /* Crowd_h */
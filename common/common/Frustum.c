@@ -0,0 +1,35 @@
+//
+//  Frustum.c
+//  common
+//
+
+#include "Frustum.h"
+#include <math.h>
+
+static vector_float4 plane(float x, float y, float z, float w) {
+    float length = sqrtf(x * x + y * y + z * z);
+    float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+    vector_float4 result;
+    result.x = x * inverse;
+    result.y = y * inverse;
+    result.z = z * inverse;
+    result.w = w * inverse;
+    return result;
+}
+
+void frustum_planes_from_matrix(vector_float4 planes[FRUSTUM_PLANE_COUNT], matrix_float4x4 matrix) {
+    // rows of the column-major matrix, clip = (row0 . p, row1 . p, row2 . p, row3 . p)
+    const vector_float4 *c = matrix.columns;
+    float r0[4] = { c[0].x, c[1].x, c[2].x, c[3].x };
+    float r1[4] = { c[0].y, c[1].y, c[2].y, c[3].y };
+    float r2[4] = { c[0].z, c[1].z, c[2].z, c[3].z };
+    float r3[4] = { c[0].w, c[1].w, c[2].w, c[3].w };
+
+    // -w <= x <= w, -w <= y <= w, 0 <= z <= w
+    planes[0] = plane(r3[0] + r0[0], r3[1] + r0[1], r3[2] + r0[2], r3[3] + r0[3]);
+    planes[1] = plane(r3[0] - r0[0], r3[1] - r0[1], r3[2] - r0[2], r3[3] - r0[3]);
+    planes[2] = plane(r3[0] + r1[0], r3[1] + r1[1], r3[2] + r1[2], r3[3] + r1[3]);
+    planes[3] = plane(r3[0] - r1[0], r3[1] - r1[1], r3[2] - r1[2], r3[3] - r1[3]);
+    planes[4] = plane(r2[0], r2[1], r2[2], r2[3]);
+    planes[5] = plane(r3[0] - r2[0], r3[1] - r2[1], r3[2] - r2[2], r3[3] - r2[3]);
+}
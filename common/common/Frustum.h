@@ -0,0 +1,37 @@
+//
+//  Frustum.h
+//  common
+//
+//  View frustum planes and sphere tests for CPU culling.
+//
+//  Planes are extracted from a projection * view (* model) matrix, so they
+//  live in whatever space the matrix maps from: world space for a view
+//  projection, a mesh's model space when the model matrix is included. A
+//  plane is (n, d) with n pointing into the frustum, a point p is inside
+//  when dot(n, p) + d >= 0.
+//
+
+#ifndef Frustum_h
+#define Frustum_h
+
+#include <stdbool.h>
+#include <common/MathTypes.h>
+
+/// Left, right, bottom, top, near, far.
+#define FRUSTUM_PLANE_COUNT 6
+
+/// Extracts the normalized planes of the clip volume of `matrix`, Metal clip
+/// space with 0 <= z <= w.
+void frustum_planes_from_matrix(vector_float4 planes[FRUSTUM_PLANE_COUNT], matrix_float4x4 matrix);
+
+/// Returns false only if the sphere is entirely outside one of the planes.
+/// Spheres near a frustum corner can pass while outside, never the reverse.
+static inline bool frustum_contains_sphere(const vector_float4 planes[FRUSTUM_PLANE_COUNT],
+                                           float x, float y, float z, float radius) {
+    for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+        if (planes[p].x * x + planes[p].y * y + planes[p].z * z + planes[p].w < -radius) return false;
+    }
+    return true;
+}
+
+#endif /* Frustum_h */
@@ -119,10 +119,12 @@ extension MTKMesh {
             (modelIOVertexDescriptor.attributes[attr.key] as! MDLVertexAttribute).name = attr.value
         }
         
-        let torusMesh = MDLMesh(vertexBuffer: vertexBuffer,
-                                vertexCount: num,
-                                descriptor: modelIOVertexDescriptor,
-                                submeshes: [submesh])
+        // the grid order reuses only the previous ring, optimizing lets the cache hold both
+        let torusMesh = MeshOptimizer.optimize(MDLMesh(vertexBuffer: vertexBuffer,
+                                                       vertexCount: num,
+                                                       descriptor: modelIOVertexDescriptor,
+                                                       submeshes: [submesh]),
+                                               allocator: metalAllocator)
         
         return try MTKMesh(mesh: torusMesh, device: device)
     }
@@ -29,7 +29,9 @@ public class HDRTextureLoader: NSObject {
         var bytesPerPixel = bytesPerComponent * pixelChannelCount
         var textureFormat : MTLPixelFormat = .rgba32Float
         if bytesPerComponent == 4 {
-            textureFormat = .rgba32Float
+            // store 32-bit float radiance as half floats, half the memory and bandwidth
+            textureFormat = .rgba16Float
+            bytesPerPixel = pixelChannelCount * 2
         } else if bytesPerComponent == 2 {
             textureFormat = .rgba16Float
         } else if bytesPerComponent == 1 {
@@ -57,6 +59,8 @@ public class HDRTextureLoader: NSObject {
 
         if textureFormat == .rgba8Unorm {
             ImageUtils.drawRGBA8Bitmap(to: rawData, fromImage: hdrCGImage)
+        } else if bytesPerComponent == 4 {
+            try ImageUtils.copyBitmapAsHalfFloat(to: rawData, dstChannelCount: pixelChannelCount, fromImage: hdrCGImage)
         } else {
             try ImageUtils.copyBitmap(to: rawData, dstChannelCount: pixelChannelCount, fromImage: hdrCGImage)
         }
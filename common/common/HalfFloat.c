@@ -0,0 +1,229 @@
+//
+//  HalfFloat.c
+//  common
+//
+
+#include "HalfFloat.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HALF_FLOAT_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HALF_FLOAT_NEON 1
+#endif
+
+//------------------------------------------------------------------------------
+// scalar, bit-exact with the F16C / NEON instructions
+
+static inline uint32_t bits_from_float(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float float_from_bits(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline uint16_t half_from_float(float value) {
+    uint32_t f = bits_from_float(value);
+    uint32_t sign = (f >> 16) & 0x8000;
+    f &= 0x7FFFFFFF;
+
+    if (f >= 0x7F800000) {
+        // Inf stays Inf, NaN keeps the top of its payload and becomes quiet.
+        return sign | (f == 0x7F800000 ? 0x7C00 : (0x7E00 | ((f >> 13) & 0x3FF)));
+    }
+    if (f >= 0x47800000) {
+        // >= 65536 overflows. 65520 up to 65536 overflows through the rounding below.
+        return sign | 0x7C00;
+    }
+    if (f < 0x38800000) {
+        // Below the smallest normal half: let the FPU do the rounding by adding a
+        // magic number that pushes the half mantissa into the low float bits.
+        const uint32_t magic = (127 - 15 + 23 - 10 + 1) << 23;
+        float sum = float_from_bits(f) + float_from_bits(magic);
+        return sign | (uint16_t)(bits_from_float(sum) - magic);
+    }
+
+    // Normal: rebias the exponent, round to nearest even on the 13 dropped bits.
+    uint32_t mantissaOdd = (f >> 13) & 1;
+    f += ((uint32_t)(15 - 127) << 23) + 0xFFF + mantissaOdd;
+    return sign | (uint16_t)(f >> 13);
+}
+
+static inline float float_from_half(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+
+    if (exponent == 0x1F) {
+        return float_from_bits(sign | 0x7F800000 | (mantissa ? 0x400000 | (mantissa << 13) : 0));
+    }
+    if (exponent == 0) {
+        // zero or subnormal, mantissa * 2^-24 is exact in float
+        float magnitude = (float)mantissa * 5.9604644775390625e-8f;
+        return float_from_bits(sign | bits_from_float(magnitude));
+    }
+    return float_from_bits(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+static void float16_from_float32_scalar(uint16_t *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = half_from_float(src[i]);
+    }
+}
+
+static void float32_from_float16_scalar(float *dst, const uint16_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = float_from_half(src[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+// F16C / AVX-512
+
+#if HALF_FLOAT_X86
+
+__attribute__((target("avx,f16c")))
+static void float16_from_float32_f16c(uint16_t *dst, const float *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(dst + i), h);
+    }
+    float16_from_float32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx,f16c")))
+static void float32_from_float16_f16c(float *dst, const uint16_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    float32_from_float16_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void float16_from_float32_avx512(uint16_t *dst, const float *src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256((__m256i *)(dst + i), h);
+    }
+    float16_from_float32_f16c(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void float32_from_float16_avx512(float *dst, const uint16_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+    }
+    float32_from_float16_f16c(dst + i, src + i, count - i);
+}
+
+enum { HalfFloatScalar, HalfFloatF16C, HalfFloatAVX512 };
+
+static int half_float_isa(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        if (__builtin_cpu_supports("avx512f")) {
+            cached = HalfFloatAVX512;
+        } else if (__builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx")) {
+            cached = HalfFloatF16C;
+        } else {
+            cached = HalfFloatScalar;
+        }
+    }
+    return cached;
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// NEON
+
+#if HALF_FLOAT_NEON
+
+static void float16_from_float32_neon(uint16_t *dst, const float *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float16x4_t lo = vcvt_f16_f32(vld1q_f32(src + i));
+        float16x8_t h = vcvt_high_f16_f32(lo, vld1q_f32(src + i + 4));
+        vst1q_u16(dst + i, vreinterpretq_u16_f16(h));
+    }
+    float16_from_float32_scalar(dst + i, src + i, count - i);
+}
+
+static void float32_from_float16_neon(float *dst, const uint16_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float16x8_t h = vreinterpretq_f16_u16(vld1q_u16(src + i));
+        vst1q_f32(dst + i, vcvt_f32_f16(vget_low_f16(h)));
+        vst1q_f32(dst + i + 4, vcvt_high_f32_f16(h));
+    }
+    float32_from_float16_scalar(dst + i, src + i, count - i);
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+void float16_from_float32_n(uint16_t *dst, const float *src, size_t count) {
+#if HALF_FLOAT_X86
+    switch (half_float_isa()) {
+        case HalfFloatAVX512:
+            float16_from_float32_avx512(dst, src, count);
+            return;
+        case HalfFloatF16C:
+            float16_from_float32_f16c(dst, src, count);
+            return;
+    }
+#elif HALF_FLOAT_NEON
+    float16_from_float32_neon(dst, src, count);
+    return;
+#endif
+    float16_from_float32_scalar(dst, src, count);
+}
+
+void float16_from_float32_clamped_n(uint16_t *dst, const float *src, size_t count) {
+    const float largest = 65504.0f;
+    float block[256];
+    while (count > 0) {
+        size_t n = count < 256 ? count : 256;
+        for (size_t i = 0; i < n; i++) {
+            // comparisons are false for NaN, so it passes through
+            float value = src[i];
+            value = value > largest ? largest : value;
+            block[i] = value < -largest ? -largest : value;
+        }
+        float16_from_float32_n(dst, block, n);
+        dst += n;
+        src += n;
+        count -= n;
+    }
+}
+
+void float32_from_float16_n(float *dst, const uint16_t *src, size_t count) {
+#if HALF_FLOAT_X86
+    switch (half_float_isa()) {
+        case HalfFloatAVX512:
+            float32_from_float16_avx512(dst, src, count);
+            return;
+        case HalfFloatF16C:
+            float32_from_float16_f16c(dst, src, count);
+            return;
+    }
+#elif HALF_FLOAT_NEON
+    float32_from_float16_neon(dst, src, count);
+    return;
+#endif
+    float32_from_float16_scalar(dst, src, count);
+}
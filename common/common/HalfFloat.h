@@ -0,0 +1,32 @@
+//
+//  HalfFloat.h
+//  common
+//
+//  Array conversions between 32-bit floats and IEEE 754 binary16 halfs, the
+//  bulk counterparts of float16_from_float32 and float32_from_float16.
+//
+//  Rounding is round-to-nearest-even, overflow goes to infinity, subnormals are
+//  kept, and NaNs stay NaN (quieted, top payload bits preserved). Uses AVX-512F
+//  or F16C on x86_64 when the CPU has it, NEON on arm64, and a bit-exact scalar
+//  fallback everywhere else.
+//
+
+#ifndef HalfFloat_h
+#define HalfFloat_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Converts `count` floats to halfs. `dst` and `src` must not overlap.
+void float16_from_float32_n(uint16_t *dst, const float *src, size_t count);
+
+/// Converts `count` floats to halfs like float16_from_float32_n, but clamps
+/// finite values and infinities to +-65504, the largest half, instead of
+/// letting them overflow to infinity. NaNs stay NaN. For HDR radiance, where
+/// an infinite texel poisons every filter tap that reads it.
+void float16_from_float32_clamped_n(uint16_t *dst, const float *src, size_t count);
+
+/// Converts `count` halfs to floats. `dst` and `src` must not overlap.
+void float32_from_float16_n(float *dst, const uint16_t *src, size_t count);
+
+#endif /* HalfFloat_h */
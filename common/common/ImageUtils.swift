@@ -81,4 +81,54 @@ public class ImageUtils: NSObject {
         
         return
     }
+    
+    /// Converts a 32-bit float bitmap to half floats in bulk. When dstChannelCount is one more
+    /// than the source channel count, the last channel is filled with 1.0. Values beyond the
+    /// largest half, 65504, are clamped to it rather than becoming infinity.
+    public class func copyBitmapAsHalfFloat(to dstData: UnsafeMutableRawPointer,
+                                            dstChannelCount: Int,
+                                            fromImage image: CGImage) throws -> Void {
+        if image.bitsPerComponent != 32 {
+            throw Errors.runtimeError("unsupported bitsPerComponent \(image.bitsPerComponent), expect 32-bit float")
+        }
+        
+        let width = image.width
+        let height = image.height
+        let srcChannelCount = image.bitsPerPixel / image.bitsPerComponent
+        let srcBytesPerRow = image.bytesPerRow
+        let srcRowCount = width * srcChannelCount
+        let dstRowCount = width * dstChannelCount
+        
+        let srcCFData = image.dataProvider!.data!
+        let srcData = UnsafeRawPointer(CFDataGetBytePtr(srcCFData)!)
+        let dst = dstData.bindMemory(to: UInt16.self, capacity: dstRowCount * height)
+        
+        if srcChannelCount == dstChannelCount {
+            for row in 0..<height {
+                let src = srcData.advanced(by: row * srcBytesPerRow).assumingMemoryBound(to: Float.self)
+                float16_from_float32_clamped_n(dst.advanced(by: row * dstRowCount), src, srcRowCount)
+            }
+        } else if dstChannelCount == srcChannelCount + 1 {
+            let alpha16Fill = float16_from_float32(1.0)
+            let rowHalfs = UnsafeMutablePointer<UInt16>.allocate(capacity: srcRowCount)
+            defer {
+                rowHalfs.deallocate()
+            }
+            
+            for row in 0..<height {
+                let src = srcData.advanced(by: row * srcBytesPerRow).assumingMemoryBound(to: Float.self)
+                float16_from_float32_clamped_n(rowHalfs, src, srcRowCount)
+                
+                let dstRow = dst.advanced(by: row * dstRowCount)
+                for x in 0..<width {
+                    for c in 0..<srcChannelCount {
+                        dstRow[x * dstChannelCount + c] = rowHalfs[x * srcChannelCount + c]
+                    }
+                    dstRow[x * dstChannelCount + srcChannelCount] = alpha16Fill
+                }
+            }
+        } else {
+            throw Errors.runtimeError("can not convert \(srcChannelCount) channels to \(dstChannelCount) channels")
+        }
+    }
 }
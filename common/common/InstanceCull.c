@@ -0,0 +1,289 @@
+//
+//  InstanceCull.c
+//  common
+//
+//  The plane tests have SSE (x86_64) and NEON (arm64) kernels, four spheres
+//  per register against one plane at a time, and a scalar fallback doing the
+//  same arithmetic as frustum_contains_sphere.
+//
+
+#include "InstanceCull.h"
+#include <common/MeshSimplifier.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INSTANCE_CULL_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define INSTANCE_CULL_NEON 1
+#endif
+
+enum {
+    // instances per job, a multiple of the SIMD width; testing a chunk takes
+    // a few microseconds, the scatter far less for a mostly culled chunk
+    CullGrain = 4096,
+};
+
+static size_t chunk_count(size_t count) {
+    return count > 0 ? (count + CullGrain - 1) / CullGrain : 1;
+}
+
+instance_cull *instance_cull_create(size_t capacity) {
+    instance_cull *cull = calloc(1, sizeof(instance_cull));
+    if (!cull) {
+        return NULL;
+    }
+    size_t allocated = capacity > 0 ? capacity : 1;
+    cull->capacity = capacity;
+    cull->centerX = malloc(sizeof(float) * allocated);
+    cull->centerY = malloc(sizeof(float) * allocated);
+    cull->centerZ = malloc(sizeof(float) * allocated);
+    cull->radius = malloc(sizeof(float) * allocated);
+    cull->visible = malloc(sizeof(uint32_t) * allocated);
+    cull->levels = malloc(allocated);
+    cull->chunkVisible = malloc(sizeof(uint32_t) * chunk_count(capacity));
+    cull->chunkLevels = malloc(sizeof(uint32_t) * chunk_count(capacity) * INSTANCE_CULL_MAX_LEVELS);
+    if (!cull->centerX || !cull->centerY || !cull->centerZ || !cull->radius ||
+        !cull->visible || !cull->levels || !cull->chunkVisible || !cull->chunkLevels ||
+        capacity > UINT32_MAX) {
+        instance_cull_destroy(cull);
+        return NULL;
+    }
+    return cull;
+}
+
+void instance_cull_destroy(instance_cull *cull) {
+    if (!cull) return;
+    free(cull->centerX);
+    free(cull->centerY);
+    free(cull->centerZ);
+    free(cull->radius);
+    free(cull->visible);
+    free(cull->levels);
+    free(cull->chunkVisible);
+    free(cull->chunkLevels);
+    free(cull);
+}
+
+bool instance_cull_set_bounds(instance_cull *cull,
+                              const matrix_float4x4 *models,
+                              size_t count,
+                              vector_float4 sphere) {
+    if (count > cull->capacity || !(sphere.w > 0.0f)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const vector_float4 *c = models[i].columns;
+        float scale = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            scale = fmaxf(scale, c[k].x * c[k].x + c[k].y * c[k].y + c[k].z * c[k].z);
+        }
+        cull->centerX[i] = c[0].x * sphere.x + c[1].x * sphere.y + c[2].x * sphere.z + c[3].x;
+        cull->centerY[i] = c[0].y * sphere.x + c[1].y * sphere.y + c[2].y * sphere.z + c[3].y;
+        cull->centerZ[i] = c[0].z * sphere.x + c[1].z * sphere.y + c[2].z * sphere.z + c[3].z;
+        cull->radius[i] = sphere.w * sqrtf(scale);
+    }
+    cull->count = count;
+    cull->sphereRadius = sphere.w;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// plane tests, each writes the indices of the spheres in [begin, end) that are
+// inside all planes to `visible` and returns how many
+
+static size_t test_spheres_scalar(uint32_t *visible,
+                                  const instance_cull *cull,
+                                  const vector_float4 *planes,
+                                  size_t begin,
+                                  size_t end) {
+    size_t n = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (frustum_contains_sphere(planes, cull->centerX[i], cull->centerY[i], cull->centerZ[i], cull->radius[i])) {
+            visible[n++] = (uint32_t)i;
+        }
+    }
+    return n;
+}
+
+#if INSTANCE_CULL_X86
+
+static size_t test_spheres_sse(uint32_t *visible,
+                               const instance_cull *cull,
+                               const vector_float4 *planes,
+                               size_t begin,
+                               size_t end) {
+    __m128 px[FRUSTUM_PLANE_COUNT], py[FRUSTUM_PLANE_COUNT], pz[FRUSTUM_PLANE_COUNT], pw[FRUSTUM_PLANE_COUNT];
+    for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+        px[p] = _mm_set1_ps(planes[p].x);
+        py[p] = _mm_set1_ps(planes[p].y);
+        pz[p] = _mm_set1_ps(planes[p].z);
+        pw[p] = _mm_set1_ps(planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t n = 0, i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(cull->centerX + i);
+        __m128 y = _mm_loadu_ps(cull->centerY + i);
+        __m128 z = _mm_loadu_ps(cull->centerZ + i);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(cull->radius + i));
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                                             _mm_mul_ps(pz[p], z)), pw[p]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negativeRadius));
+        }
+        for (int mask = _mm_movemask_ps(inside); mask; mask &= mask - 1) {
+            visible[n++] = (uint32_t)(i + __builtin_ctz(mask));
+        }
+    }
+    return n + test_spheres_scalar(visible + n, cull, planes, i, end);
+}
+
+#elif INSTANCE_CULL_NEON
+
+static size_t test_spheres_neon(uint32_t *visible,
+                                const instance_cull *cull,
+                                const vector_float4 *planes,
+                                size_t begin,
+                                size_t end) {
+    float32x4_t px[FRUSTUM_PLANE_COUNT], py[FRUSTUM_PLANE_COUNT], pz[FRUSTUM_PLANE_COUNT], pw[FRUSTUM_PLANE_COUNT];
+    for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+        px[p] = vdupq_n_f32(planes[p].x);
+        py[p] = vdupq_n_f32(planes[p].y);
+        pz[p] = vdupq_n_f32(planes[p].z);
+        pw[p] = vdupq_n_f32(planes[p].w);
+    }
+    const uint32x4_t lanes = { 1, 2, 4, 8 };
+
+    size_t n = 0, i = begin;
+    for (; i + 4 <= end; i += 4) {
+        float32x4_t x = vld1q_f32(cull->centerX + i);
+        float32x4_t y = vld1q_f32(cull->centerY + i);
+        float32x4_t z = vld1q_f32(cull->centerZ + i);
+        float32x4_t negativeRadius = vnegq_f32(vld1q_f32(cull->radius + i));
+        uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            float32x4_t d = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(px[p], x), vmulq_f32(py[p], y)),
+                                                vmulq_f32(pz[p], z)), pw[p]);
+            inside = vandq_u32(inside, vcgeq_f32(d, negativeRadius));
+        }
+        for (uint32_t mask = vaddvq_u32(vandq_u32(inside, lanes)); mask; mask &= mask - 1) {
+            visible[n++] = (uint32_t)(i + __builtin_ctz(mask));
+        }
+    }
+    return n + test_spheres_scalar(visible + n, cull, planes, i, end);
+}
+
+#endif
+
+static size_t test_spheres(uint32_t *visible,
+                           const instance_cull *cull,
+                           const vector_float4 *planes,
+                           size_t begin,
+                           size_t end) {
+#if INSTANCE_CULL_X86
+    return test_spheres_sse(visible, cull, planes, begin, end);
+#elif INSTANCE_CULL_NEON
+    return test_spheres_neon(visible, cull, planes, begin, end);
+#else
+    return test_spheres_scalar(visible, cull, planes, begin, end);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// passes
+
+typedef struct cull_job {
+    instance_cull *cull;
+    matrix_float4x4 *instances;
+    const matrix_float4x4 *models;
+    const instance_cull_view *view;
+} cull_job;
+
+// Tests a chunk and counts its visible instances per level.
+static void test_job(void *context, size_t begin, size_t end) {
+    const cull_job *job = context;
+    instance_cull *cull = job->cull;
+    const instance_cull_view *view = job->view;
+    // without a pool the range is every chunk at once
+    for (size_t first = begin; first < end; first += CullGrain) {
+        size_t last = first + CullGrain < end ? first + CullGrain : end;
+        size_t chunk = first / CullGrain;
+        uint32_t *visible = cull->visible + first;
+        uint32_t *counts = cull->chunkLevels + chunk * INSTANCE_CULL_MAX_LEVELS;
+        size_t n = test_spheres(visible, cull, view->planes, first, last);
+        memset(counts, 0, sizeof(uint32_t) * INSTANCE_CULL_MAX_LEVELS);
+        // the spheres have what the level needs, the models are only read once to copy them
+        for (size_t j = 0; j < n; j++) {
+            uint32_t i = visible[j];
+            float dx = cull->centerX[i] - view->cameraPosition.x;
+            float dy = cull->centerY[i] - view->cameraPosition.y;
+            float dz = cull->centerZ[i] - view->cameraPosition.z;
+            uint32_t level = mesh_lod_select(view->levelErrors, view->levelCount,
+                                             cull->radius[i] / cull->sphereRadius, sqrtf(dx * dx + dy * dy + dz * dz),
+                                             view->projectionScale, view->thresholdPixels);
+            cull->levels[first + j] = (uint8_t)level;
+            counts[level]++;
+        }
+        cull->chunkVisible[chunk] = (uint32_t)n;
+    }
+}
+
+// Copies the visible models of a chunk to their slots, the counts are output
+// offsets by now.
+static void scatter_job(void *context, size_t begin, size_t end) {
+    const cull_job *job = context;
+    instance_cull *cull = job->cull;
+    for (size_t first = begin; first < end; first += CullGrain) {
+        size_t chunk = first / CullGrain;
+        uint32_t *offsets = cull->chunkLevels + chunk * INSTANCE_CULL_MAX_LEVELS;
+        for (uint32_t j = 0; j < cull->chunkVisible[chunk]; j++) {
+            job->instances[offsets[cull->levels[first + j]]++] = job->models[cull->visible[first + j]];
+        }
+    }
+}
+
+size_t instance_cull_run(instance_cull *cull,
+                         matrix_float4x4 *instances,
+                         uint32_t *levelCounts,
+                         const matrix_float4x4 *models,
+                         const instance_cull_view *view,
+                         job_pool *pool) {
+    if (view->levelCount == 0 || view->levelCount > INSTANCE_CULL_MAX_LEVELS) {
+        return 0;
+    }
+    memset(levelCounts, 0, sizeof(uint32_t) * view->levelCount);
+    if (cull->count == 0) {
+        return 0;
+    }
+
+    cull_job job = { cull, instances, models, view };
+    job_pool_parallel_for(pool, cull->count, CullGrain, test_job, &job);
+
+    // levels are back to back, within a level the chunks are in order
+    size_t chunkCount = chunk_count(cull->count);
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        for (uint32_t level = 0; level < view->levelCount; level++) {
+            levelCounts[level] += cull->chunkLevels[chunk * INSTANCE_CULL_MAX_LEVELS + level];
+        }
+    }
+    uint32_t levelStart = 0;
+    for (uint32_t level = 0; level < view->levelCount; level++) {
+        uint32_t offset = levelStart;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+            uint32_t *slot = &cull->chunkLevels[chunk * INSTANCE_CULL_MAX_LEVELS + level];
+            uint32_t count = *slot;
+            *slot = offset;
+            offset += count;
+        }
+        levelStart += levelCounts[level];
+    }
+
+    job_pool_parallel_for(pool, cull->count, CullGrain, scatter_job, &job);
+    return levelStart;
+}
@@ -0,0 +1,95 @@
+//
+//  InstanceCull.h
+//  common
+//
+//  Per-frame frustum culling and level of detail bucketing of mesh instances.
+//
+//  The bounding spheres of the instances are kept in world space, one array
+//  per component, so the plane tests load four instances per register and
+//  read 16 bytes of every instance instead of its 64 byte model matrix. Only
+//  the visible instances go on to pick a level (see MeshSimplifier.h), from
+//  the distance to their sphere and its scale, and to have their model
+//  copied, grouped by level, into an instance buffer that takes one instanced
+//  draw per level. Past the plane tests the cost follows the visible count,
+//  not the instance count.
+//
+//  A run is two parallel passes over chunks of instances: the first tests
+//  and picks levels, keeping each chunk's visible instances in its own slice
+//  of the scratch arrays, the second scatters them after a prefix sum of the
+//  chunk counts. Instances keep their order within a level, so the output is
+//  the same for any thread count.
+//
+
+#ifndef InstanceCull_h
+#define InstanceCull_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <common/MathTypes.h>
+#include <common/Frustum.h>
+#include <common/JobPool.h>
+
+/// Most levels of detail a run buckets instances into.
+#define INSTANCE_CULL_MAX_LEVELS 8
+
+typedef struct instance_cull {
+    size_t count;
+    size_t capacity;
+    /// World space bounding spheres of the instances.
+    float *centerX;
+    float *centerY;
+    float *centerZ;
+    float *radius;
+    /// Model space radius the spheres were scaled from.
+    float sphereRadius;
+    /// Visible instances of every chunk at the start of its slice, and their levels.
+    uint32_t *visible;
+    uint8_t *levels;
+    /// Visible instances of every chunk, then per level of every chunk the
+    /// count and, after the prefix sum, the first output slot.
+    uint32_t *chunkVisible;
+    uint32_t *chunkLevels;
+} instance_cull;
+
+/// What a run tests the instances against.
+typedef struct instance_cull_view {
+    /// World space planes, see frustum_planes_from_matrix.
+    vector_float4 planes[FRUSTUM_PLANE_COUNT];
+    vector_float3 cameraPosition;
+    /// Errors of the levels in model units, ascending, see mesh_lod_select.
+    const float *levelErrors;
+    uint32_t levelCount;
+    float projectionScale;
+    float thresholdPixels;
+} instance_cull_view;
+
+/// Returns a culler for up to `capacity` instances, NULL if out of memory.
+instance_cull *instance_cull_create(size_t capacity);
+
+void instance_cull_destroy(instance_cull *cull);
+
+/// Sets the spheres of `count` instances to `sphere`, a model space center
+/// and radius, placed by each of `models` and grown by its largest axis
+/// scale. Call it again when instances move. Returns false if `count` is
+/// above the capacity or the radius isn't positive.
+bool instance_cull_set_bounds(instance_cull *cull,
+                              const matrix_float4x4 *models,
+                              size_t count,
+                              vector_float4 sphere);
+
+/// Writes the models of the instances whose sphere is inside the planes of
+/// `view` to `instances`, grouped by level, and the instance count of each of
+/// the view's levels to `levelCounts`. The level is mesh_lod_select's for the
+/// distance from the camera to the sphere's center and the sphere's scale.
+/// `models` are the ones the bounds were set from. Returns the visible count,
+/// 0 if the view has no level or more than INSTANCE_CULL_MAX_LEVELS. `pool`
+/// may be NULL.
+size_t instance_cull_run(instance_cull *cull,
+                         matrix_float4x4 *instances,
+                         uint32_t *levelCounts,
+                         const matrix_float4x4 *models,
+                         const instance_cull_view *view,
+                         job_pool *pool);
+
+#endif /* InstanceCull_h */
@@ -0,0 +1,99 @@
+//
+//  InstanceCuller.swift
+//  common
+//
+
+import Metal
+
+/// Frustum culls instances of a mesh and groups the visible ones by level of
+/// detail, see InstanceCull.h, into a ring of instance buffers in one shared
+/// MTLBuffer, one slot per frame in flight.
+///
+/// Every `cull` writes the next slot, so the CPU never writes models the GPU
+/// may still be reading. Bind `buffer` at `offset` as a `constant float4x4 *`
+/// indexed by instance id, then draw level i with `levelCounts[i]` instances
+/// starting after the instances of the levels before it.
+@objc
+open class InstanceCuller: NSObject {
+
+    @objc
+    public let buffer: MTLBuffer
+
+    @objc
+    public let instanceCount: Int
+
+    /// Number of slots, renderers should keep at most this many frames in flight.
+    @objc
+    public let framesInFlight: Int
+
+    /// Byte offset of the slot written by the last cull.
+    @objc
+    public private(set) var offset: Int = 0
+
+    /// Visible instances of every level in the last cull.
+    @objc
+    public private(set) var levelCounts: [Int] = []
+
+    @objc
+    public private(set) var visibleCount: Int = 0
+
+    private let state: UnsafeMutablePointer<instance_cull>
+    private let models: [matrix_float4x4]
+    private let pool: JobPool?
+    private let slotLength: Int
+    private var slot: Int = 0
+
+    /// `boundingSphere` is the mesh's center and radius in model space, see
+    /// ModelIOMesh.boundingSphere. The instances are culled on `pool` when given.
+    /// Swift only, Objective-C has no array of matrices.
+    public init(device: MTLDevice,
+                models: [matrix_float4x4],
+                boundingSphere: vector_float4,
+                framesInFlight: Int = 3,
+                pool: JobPool?) {
+        self.models = models
+        self.pool = pool
+        self.framesInFlight = framesInFlight
+        instanceCount = models.count
+        state = instance_cull_create(models.count)!
+        _ = instance_cull_set_bounds(state, models, models.count, boundingSphere)
+        // constant buffer offsets must be 256-byte aligned on macOS
+        slotLength = (max(models.count, 1) * MemoryLayout<matrix_float4x4>.stride + 255) & ~255
+        buffer = device.makeBuffer(length: slotLength * framesInFlight, options: .storageModeShared)!
+        buffer.label = "Culled Instances"
+        super.init()
+    }
+
+    deinit {
+        instance_cull_destroy(state)
+    }
+
+    /// Culls the instances against the frustum of `viewProjection` and picks
+    /// their levels from `levelErrors`, see mesh_lod_select, into the next slot.
+    @objc
+    public func cull(viewProjection: matrix_float4x4,
+                     cameraPosition: vector_float3,
+                     levelErrors: [Float],
+                     projectionScale: Float,
+                     thresholdPixels: Float) {
+        slot = (slot + 1) % framesInFlight
+        offset = slot * slotLength
+
+        var view = instance_cull_view()
+        withUnsafeMutableBytes(of: &view.planes) { planes in
+            frustum_planes_from_matrix(planes.baseAddress!.assumingMemoryBound(to: vector_float4.self), viewProjection)
+        }
+        view.cameraPosition = cameraPosition
+        view.levelCount = UInt32(levelErrors.count)
+        view.projectionScale = projectionScale
+        view.thresholdPixels = thresholdPixels
+
+        var counts = [UInt32](repeating: 0, count: levelErrors.count)
+        let instances = (buffer.contents() + offset).bindMemory(to: matrix_float4x4.self, capacity: instanceCount)
+        visibleCount = levelErrors.withUnsafeBufferPointer { errors in
+            view.levelErrors = errors.baseAddress
+            return instance_cull_run(state, instances, &counts, models, &view, pool?.pool)
+        }
+        levelCounts = counts.map { Int($0) }
+    }
+}
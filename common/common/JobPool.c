@@ -0,0 +1,228 @@
+//
+//  JobPool.c
+//  common
+//
+
+#include "JobPool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Chunk indices [begin, end) still owned by one thread. The owner takes from the
+// front, thieves take the back half.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+} __attribute__((aligned(64))) work_queue;
+
+struct job_pool {
+    unsigned threadCount;
+    pthread_t *threads;
+    work_queue *queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t generation;
+    unsigned busyWorkers;
+    bool shutdown;
+
+    // current loop
+    job_range_function function;
+    void *context;
+    size_t count;
+    size_t grain;
+};
+
+typedef struct {
+    job_pool *pool;
+    unsigned slot;
+} worker_start;
+
+static bool take_chunk(work_queue *queue, size_t *chunk) {
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->begin < queue->end) {
+        *chunk = queue->begin++;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Moves the back half of a victim's chunks into `slot`'s queue.
+static bool steal_chunks(job_pool *pool, unsigned slot) {
+    for (unsigned i = 1; i < pool->threadCount; i++) {
+        work_queue *victim = &pool->queues[(slot + i) % pool->threadCount];
+        size_t begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->begin < victim->end) {
+            end = victim->end;
+            begin = victim->begin + (victim->end - victim->begin) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end) {
+            work_queue *own = &pool->queues[slot];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_chunks(job_pool *pool, unsigned slot) {
+    size_t chunk;
+    do {
+        while (take_chunk(&pool->queues[slot], &chunk)) {
+            size_t begin = chunk * pool->grain;
+            size_t end = begin + pool->grain < pool->count ? begin + pool->grain : pool->count;
+            pool->function(pool->context, begin, end);
+        }
+    } while (steal_chunks(pool, slot));
+}
+
+static void *worker_main(void *argument) {
+    worker_start start = *(worker_start *)argument;
+    free(argument);
+    job_pool *pool = start.pool;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_chunks(pool, start.slot);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busyWorkers == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+job_pool *job_pool_create(unsigned threadCount) {
+    if (threadCount == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = online > 0 ? (unsigned)online : 1;
+    }
+
+    job_pool *pool = calloc(1, sizeof(job_pool));
+    if (!pool) return NULL;
+    pool->threadCount = threadCount;
+    pool->threads = calloc(threadCount, sizeof(pthread_t));
+    // C11 aligned_alloc, the size is a multiple of 64 since work_queue is aligned to it
+    pool->queues = aligned_alloc(64, sizeof(work_queue) * threadCount);
+    if (!pool->threads || !pool->queues) {
+        free(pool->threads);
+        free(pool->queues);
+        free(pool);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < threadCount; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+        pool->queues[i].begin = pool->queues[i].end = 0;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // slot 0 belongs to the thread calling job_pool_parallel_for
+    for (unsigned i = 1; i < threadCount; i++) {
+        worker_start *start = malloc(sizeof(worker_start));
+        if (start) {
+            start->pool = pool;
+            start->slot = i;
+        }
+        if (!start || pthread_create(&pool->threads[i], NULL, worker_main, start) != 0) {
+            free(start);
+            pool->threadCount = i;
+            job_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void job_pool_destroy(job_pool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 1; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (unsigned i = 0; i < pool->threadCount; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->queues);
+    free(pool);
+}
+
+unsigned job_pool_thread_count(const job_pool *pool) {
+    return pool ? pool->threadCount : 1;
+}
+
+void job_pool_parallel_for(job_pool *pool,
+                           size_t count,
+                           size_t grain,
+                           job_range_function function,
+                           void *context) {
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+
+    size_t chunkCount = (count + grain - 1) / grain;
+    if (!pool || pool->threadCount == 1 || chunkCount == 1) {
+        function(context, 0, count);
+        return;
+    }
+
+    pool->function = function;
+    pool->context = context;
+    pool->count = count;
+    pool->grain = grain;
+    // no worker is running here, so the queues can be filled without their locks
+    for (unsigned i = 0; i < pool->threadCount; i++) {
+        pool->queues[i].begin = chunkCount * i / pool->threadCount;
+        pool->queues[i].end = chunkCount * (i + 1) / pool->threadCount;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busyWorkers = pool->threadCount - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_chunks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busyWorkers > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
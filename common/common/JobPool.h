@@ -0,0 +1,43 @@
+//
+//  JobPool.h
+//  common
+//
+//  Small pthread pool for data-parallel loops.
+//
+//  job_pool_parallel_for cuts [0, count) into chunks of `grain` items. Every
+//  thread starts with an even, contiguous share of the chunks and steals half of
+//  another thread's remaining chunks when it runs dry, so uneven chunks still
+//  balance out. The calling thread takes part and the call returns once every
+//  chunk is done. Chunk boundaries are always multiples of `grain`, so kernels
+//  whose results depend on alignment within a batch stay deterministic.
+//
+
+#ifndef JobPool_h
+#define JobPool_h
+
+#include <stddef.h>
+
+typedef struct job_pool job_pool;
+
+/// Processes items [begin, end) of a parallel loop.
+typedef void (*job_range_function)(void *context, size_t begin, size_t end);
+
+/// Creates a pool of `threadCount` threads including the caller, 0 uses one per
+/// online CPU. Returns NULL if the threads can't be started.
+job_pool *job_pool_create(unsigned threadCount);
+
+void job_pool_destroy(job_pool *pool);
+
+/// Number of threads that take part in a loop, including the caller.
+unsigned job_pool_thread_count(const job_pool *pool);
+
+/// Runs `function` over [0, count) in chunks of `grain` and waits for all of them.
+/// `pool` may be NULL to run on the calling thread. Not reentrant: `function`
+/// must not call job_pool_parallel_for on the same pool.
+void job_pool_parallel_for(job_pool *pool,
+                           size_t count,
+                           size_t grain,
+                           job_range_function function,
+                           void *context);
+
+#endif /* JobPool_h */
@@ -0,0 +1,34 @@
+//
+//  JobPool.swift
+//  common
+//
+
+import Foundation
+
+/// Owns a job_pool worker set, the parallel batch updates split their loops across it.
+@objc
+open class JobPool: NSObject {
+    
+    public let pool: OpaquePointer
+    
+    /// `threadCount` includes the calling thread, 0 uses one thread per online CPU.
+    @objc
+    public init(threadCount: Int) {
+        pool = job_pool_create(UInt32(max(threadCount, 0)))!
+        super.init()
+    }
+    
+    @objc
+    public convenience override init() {
+        self.init(threadCount: 0)
+    }
+    
+    deinit {
+        job_pool_destroy(pool)
+    }
+    
+    @objc
+    public var threadCount: Int {
+        return Int(job_pool_thread_count(pool))
+    }
+}
@@ -0,0 +1,411 @@
+//
+//  JsonFloatParser.c
+//  common
+//
+
+#include "JsonFloatParser.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest number handed to strtof, JSON from mesh exporters never comes close.
+enum { MaxFallbackLength = 127 };
+
+static const float kFloatPowersOfTen[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+static const double kDoublePowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool is_digit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline const char *skip_space(const char *p, const char *end) {
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+//------------------------------------------------------------------------------
+// numbers
+
+// The eight bytes at p as a little endian word.
+static inline uint64_t load_eight(const char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+static const uint64_t kIntegerPowersOfTen[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+};
+
+// Value of eight digits, already offset by '0', the first one in the lowest
+// byte. Combines them pairwise in three multiplies.
+static inline uint32_t parse_eight_digits(uint64_t digits) {
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 0x000F424000000064ull; // 100 + (1000000ull << 32)
+    const uint64_t mul2 = 0x0000271000000001ull; // 1 + (10000ull << 32)
+    digits = (digits * 10) + (digits >> 8);
+    digits = (((digits & mask) * mul1) + (((digits >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)digits;
+}
+
+// Accumulates the digits at p into *mantissa while it has room for them,
+// digits beyond 19 only count towards *dropped. Returns the end of the digits.
+static inline __attribute__((always_inline))
+const char *parse_digits(const char *p, const char *end,
+                         uint64_t *mantissa, int *digits, int *dropped) {
+    // leading zeros don't take up room
+    if (*digits == 0) {
+        while (p < end && *p == '0') {
+            p++;
+        }
+    }
+
+    // Eight bytes at a time: bytes below '0' have the top bit set after the
+    // subtraction, bytes above '9' once 0x76 is added. Borrows and carries only
+    // reach the bytes after the first non-digit, which don't count.
+    while (end - p >= 8) {
+        uint64_t word = load_eight(p) - 0x3030303030303030ull;
+        uint64_t nonDigits = (word | (word + 0x7676767676767676ull)) & 0x8080808080808080ull;
+        int run = nonDigits ? __builtin_ctzll(nonDigits) >> 3 : 8;
+        if (run == 0) {
+            return p;
+        }
+        if (*digits + run > 19) {
+            break;
+        }
+        // the run's digits move to the top bytes, zeros lead
+        word = run == 8 ? word : word << (64 - 8 * run);
+        *mantissa = *mantissa * kIntegerPowersOfTen[run] + parse_eight_digits(word);
+        *digits += run;
+        p += run;
+        if (run < 8) {
+            return p;
+        }
+    }
+
+    while (p < end && is_digit(*p)) {
+        if (*digits < 19) {
+            *mantissa = *mantissa * 10 + (uint64_t)(*p - '0');
+            *digits += 1;
+        } else {
+            *dropped += 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+static __attribute__((noinline))
+const char *parse_float_fallback(const char *begin, const char *end, float *value) {
+    char buffer[MaxFallbackLength + 1];
+    size_t length = (size_t)(end - begin);
+    if (length > MaxFallbackLength) {
+        return NULL;
+    }
+    memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+    *value = strtof(buffer, NULL);
+    return end;
+}
+
+// json_parse_float, inlined into the decode loop.
+static inline __attribute__((always_inline))
+const char *parse_float(const char *begin, const char *end, float *value) {
+    const char *p = begin;
+    bool negative = p < end && *p == '-';
+    p += negative;
+
+    // JSON: int part is 0 or starts with 1-9, the fraction and exponent need digits
+    if (p == end || !is_digit(*p)) {
+        return NULL;
+    }
+    if (*p == '0' && p + 1 < end && is_digit(p[1])) {
+        return NULL;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int dropped = 0;
+    p = parse_digits(p, end, &mantissa, &digits, &dropped);
+    int64_t exponent = dropped;
+
+    if (p < end && *p == '.') {
+        const char *fraction = ++p;
+        int fractionDropped = 0;
+        p = parse_digits(p, end, &mantissa, &digits, &fractionDropped);
+        if (p == fraction) {
+            return NULL;
+        }
+        exponent -= (p - fraction) - fractionDropped;
+        dropped += fractionDropped;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = p < end && *p == '-';
+        p += p < end && (*p == '-' || *p == '+');
+        if (p == end || !is_digit(*p)) {
+            return NULL;
+        }
+        int64_t written = 0;
+        while (p < end && is_digit(*p)) {
+            // saturate, anything this far out is zero or infinity anyway
+            written = written < 100000 ? written * 10 + (*p - '0') : written;
+            p++;
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+
+    if (mantissa == 0) {
+        *value = negative ? -0.0f : 0.0f;
+        return p;
+    }
+    if (dropped > 0) {
+        return parse_float_fallback(begin, p, value);
+    }
+
+    // both operands exact, so the single rounding of the divide or multiply is correct
+    if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+        float f = (float)mantissa;
+        f = exponent < 0 ? f / kFloatPowersOfTen[-exponent] : f * kFloatPowersOfTen[exponent];
+        *value = negative ? -f : f;
+        return p;
+    }
+
+    // the correctly rounded double rounds to the correct float unless it lands
+    // exactly halfway between two floats or below the normal float range
+    if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double d = (double)mantissa;
+        d = exponent < 0 ? d / kDoublePowersOfTen[-exponent] : d * kDoublePowersOfTen[exponent];
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        bool halfway = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+        if (!halfway && d >= 0x1p-126) {
+            float f = (float)d;
+            *value = negative ? -f : f;
+            return p;
+        }
+    }
+    return parse_float_fallback(begin, p, value);
+}
+
+const char *json_parse_float(const char *begin, const char *end, float *value) {
+    return parse_float(begin, end, value);
+}
+
+//------------------------------------------------------------------------------
+// structure
+
+// Skips the string starting at the quote at p, returns the byte after the closing quote.
+static const char *skip_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+enum {
+    ByteComma = 1,
+    // starts a string, container or literal, so the array holds more than numbers
+    ByteNotNumber = 2,
+    ByteNotSpace = 4,
+};
+
+static const uint8_t kByteClasses[256] = {
+    ['0'] = ByteNotSpace, ['1'] = ByteNotSpace, ['2'] = ByteNotSpace, ['3'] = ByteNotSpace,
+    ['4'] = ByteNotSpace, ['5'] = ByteNotSpace, ['6'] = ByteNotSpace, ['7'] = ByteNotSpace,
+    ['8'] = ByteNotSpace, ['9'] = ByteNotSpace, ['-'] = ByteNotSpace, ['+'] = ByteNotSpace,
+    ['.'] = ByteNotSpace, ['e'] = ByteNotSpace, ['E'] = ByteNotSpace,
+    [','] = ByteComma | ByteNotSpace,
+    ['"'] = ByteNotNumber | ByteNotSpace, ['['] = ByteNotNumber | ByteNotSpace,
+    ['{'] = ByteNotNumber | ByteNotSpace, ['t'] = ByteNotNumber | ByteNotSpace,
+    ['f'] = ByteNotNumber | ByteNotSpace, ['n'] = ByteNotNumber | ByteNotSpace,
+};
+
+// Counts the numbers of the array [begin, close) without branching per byte.
+// Returns SIZE_MAX if the array holds anything else.
+static size_t count_numbers(const char *begin, const char *close) {
+    size_t commas = 0;
+    unsigned classes = 0;
+    for (const char *p = begin; p < close; p++) {
+        unsigned byteClass = kByteClasses[(unsigned char)*p];
+        commas += byteClass & ByteComma;
+        classes |= byteClass;
+    }
+    if (classes & ByteNotNumber) {
+        return SIZE_MAX;
+    }
+    return classes & ByteNotSpace ? commas + 1 : 0;
+}
+
+// Skips the value at p, returns the byte after it. Arrays that only hold
+// numbers set *floatCount to their length, anything else sets it to SIZE_MAX.
+static const char *skip_value(const char *p, const char *end, size_t *floatCount) {
+    *floatCount = SIZE_MAX;
+    if (p == end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        return skip_string(p, end);
+    }
+    if (*p != '[' && *p != '{') {
+        // number or literal, validated by whoever decodes it
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_space(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    // the first closing bracket ends a flat array, the usual vertex attribute
+    if (*p == '[') {
+        const char *close = memchr(p, ']', (size_t)(end - p));
+        if (!close) return NULL;
+        size_t count = count_numbers(p + 1, close);
+        if (count != SIZE_MAX) {
+            *floatCount = count;
+            return close + 1;
+        }
+    }
+
+    // Containers are matched by depth. Arrays count their commas at depth one,
+    // which is the element count as long as no element is itself a container or a string.
+    bool numbersOnly = *p == '[';
+    bool empty = true;
+    size_t commas = 0;
+    int depth = 0;
+    for (; p < end; p++) {
+        char c = *p;
+        if (c == '"') {
+            p = skip_string(p, end);
+            if (!p) return NULL;
+            p--;
+            numbersOnly = false;
+        } else if (c == '[' || c == '{') {
+            numbersOnly = numbersOnly && depth == 0;
+            depth++;
+        } else if (c == ']' || c == '}') {
+            if (--depth == 0) {
+                if (numbersOnly) {
+                    *floatCount = empty ? 0 : commas + 1;
+                }
+                return p + 1;
+            }
+        } else if (c == ',') {
+            commas += depth == 1;
+        } else if (!is_space(c)) {
+            empty = false;
+            // true, false and null are not numbers
+            numbersOnly = numbersOnly && c != 't' && c != 'f' && c != 'n';
+        }
+    }
+    return NULL;
+}
+
+ptrdiff_t json_index_members(const char *json, size_t length, json_member *members, size_t capacity) {
+    const char *end = json + length;
+    const char *p = skip_space(json, end);
+    if (p == end || *p != '{') {
+        return -1;
+    }
+    p = skip_space(p + 1, end);
+    if (p < end && *p == '}') {
+        return 0;
+    }
+
+    size_t count = 0;
+    while (p < end) {
+        if (*p != '"') return -1;
+        const char *key = p + 1;
+        p = skip_string(p, end);
+        if (!p) return -1;
+        size_t keyLength = (size_t)(p - 1 - key);
+
+        p = skip_space(p, end);
+        if (p == end || *p != ':') return -1;
+        const char *value = skip_space(p + 1, end);
+        size_t floatCount;
+        p = skip_value(value, end, &floatCount);
+        if (!p || p == value) return -1;
+
+        if (count < capacity) {
+            json_member *member = &members[count];
+            member->key = key;
+            member->keyLength = keyLength;
+            member->value = value;
+            member->valueLength = (size_t)(p - value);
+            member->isFloatArray = floatCount != SIZE_MAX;
+            member->floatCount = member->isFloatArray ? floatCount : 0;
+        }
+        count++;
+
+        p = skip_space(p, end);
+        if (p < end && *p == '}') {
+            return (ptrdiff_t)count;
+        }
+        if (p == end || *p != ',') return -1;
+        p = skip_space(p + 1, end);
+    }
+    return -1;
+}
+
+const json_member *json_find_member(const json_member *members, size_t count, const char *key) {
+    size_t keyLength = strlen(key);
+    for (size_t i = 0; i < count; i++) {
+        if (members[i].keyLength == keyLength && memcmp(members[i].key, key, keyLength) == 0) {
+            return &members[i];
+        }
+    }
+    return NULL;
+}
+
+size_t json_decode_floats(const json_member *member, void *destination, size_t width, size_t stride) {
+    if (!member->isFloatArray || width == 0) {
+        return 0;
+    }
+
+    const char *end = member->value + member->valueLength;
+    const char *p = member->value + 1;
+    char *tuple = destination;
+    size_t component = 0;
+    size_t decoded = 0;
+    while (decoded < member->floatCount) {
+        p = skip_space(p, end);
+        float value;
+        p = parse_float(p, end, &value);
+        if (!p) {
+            break;
+        }
+        ((float *)tuple)[component] = value;
+        decoded++;
+        if (++component == width) {
+            component = 0;
+            tuple += stride;
+        }
+        p = skip_space(p, end);
+        if (p < end && *p == ',') {
+            p++;
+        } else if (decoded < member->floatCount) {
+            break;
+        }
+    }
+    return decoded;
+}
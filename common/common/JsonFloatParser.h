@@ -0,0 +1,60 @@
+//
+//  JsonFloatParser.h
+//  common
+//
+//  Streaming decoder for the numeric arrays of JSON mesh files.
+//
+//  Mesh JSON is a top-level object whose large members are flat arrays of
+//  numbers. Indexing scans the object once and records where every member's
+//  value is and how many numbers its array holds, without allocating. Decoding
+//  then parses an array straight into caller memory, interleaved at any stride,
+//  so vertex data goes from the file bytes to the vertex buffer with no
+//  intermediate objects. Other members, such as a nested rig, can be handed to
+//  a full JSON parser by their value range.
+//
+//  Numbers are parsed eight digits at a time and converted with exact float or
+//  double arithmetic when the digits allow it, which covers all the numbers
+//  mesh exporters write. Anything else falls back to strtof, the result is
+//  correctly rounded either way. The fallback assumes the C locale.
+//
+
+#ifndef JsonFloatParser_h
+#define JsonFloatParser_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Member of the top-level object.
+typedef struct json_member {
+    /// Key bytes between the quotes, escapes are left as they are.
+    const char *key;
+    size_t keyLength;
+    /// The value from its first to its last byte.
+    const char *value;
+    size_t valueLength;
+    /// Set when the value is an array of numbers only, possibly empty.
+    bool isFloatArray;
+    /// Numbers in the array, 0 unless isFloatArray.
+    size_t floatCount;
+} json_member;
+
+/// Indexes the members of the top-level object of `json`, up to `capacity` of
+/// them. Returns the number of members, which may exceed `capacity`, or -1 if
+/// `json` is not a well-formed object.
+ptrdiff_t json_index_members(const char *json, size_t length, json_member *members, size_t capacity);
+
+/// Returns the member called `key`, NULL if there is none.
+const json_member *json_find_member(const json_member *members, size_t count, const char *key);
+
+/// Decodes the numbers of a float array member into `destination`: number i
+/// goes to component i % width of tuple i / width, and tuples are `stride`
+/// bytes apart. Returns the count of numbers written, which is less than
+/// floatCount only if a number is malformed.
+size_t json_decode_floats(const json_member *member, void *destination, size_t width, size_t stride);
+
+/// Parses the JSON number at `begin`, correctly rounded to float. Returns the
+/// first byte after it, NULL if there is no well-formed number before `end`.
+const char *json_parse_float(const char *begin, const char *end, float *value);
+
+#endif /* JsonFloatParser_h */
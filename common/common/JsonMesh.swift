@@ -17,21 +17,32 @@ public class JsonMesh: NSObject {
     
     public private(set) var specularTextures: [String : MTLTexture]! = [:]
     
+    @objc
+    public convenience init(withJson jsonURL: URL,
+                            withTexture textureURL: URL,
+                            device: MTLDevice,
+                            mtlVertexDescriptor: MTLVertexDescriptor,
+                            attributesMap: [Int : String]) throws {
+        try self.init(withJson: jsonURL,
+                      withTexture: textureURL,
+                      device: device,
+                      mtlVertexDescriptor: mtlVertexDescriptor,
+                      attributesMap: attributesMap,
+                      weldEpsilon: 0)
+    }
+    
+    /// The file stores one vertex per triangle corner, equal corners are welded
+    /// into one indexed vertex. With `weldEpsilon` 0 corners must be equal bit
+    /// for bit, otherwise attributes within about `weldEpsilon` weld too.
     @objc
     public init(withJson jsonURL: URL,
                 withTexture textureURL: URL,
                 device: MTLDevice,
                 mtlVertexDescriptor: MTLVertexDescriptor,
-                attributesMap: [Int : String]) throws {
+                attributesMap: [Int : String],
+                weldEpsilon: Float) throws {
         let jsonData = try Data(contentsOf: jsonURL, options: .mappedIfSafe)
-        let jsonResult = try JSONSerialization.jsonObject(with: jsonData, options: .mutableLeaves)
-        
-        let dict = jsonResult as! Dictionary<String, AnyObject>
         
-        let positions = dict["position"] as! Array<NSNumber>
-        let uvs = dict["uv"] as! Array<NSNumber>
-        let normals = dict["normal"] as! Array<NSNumber>
-                
         let textureLoader = MTKTextureLoader(device: device)
         let colorTexture = try textureLoader.newTexture(URL: textureURL, options: nil)
         baseColorTextures[jsonURL.path] = colorTexture
@@ -48,65 +59,121 @@ public class JsonMesh: NSObject {
         
         let metalAllocator = MTKMeshBufferAllocator(device: device)
         
-        let vertiesCount = positions.count / 3
-        let vertiesPtr = UnsafeMutableRawPointer.allocate(byteCount: vertiesCount * 16 * attributesMap.count, alignment: 1)
-        defer {
-            vertiesPtr.deallocate()
+        let modelIOVertexDescriptor = MTKModelIOVertexDescriptorFromMetal(mtlVertexDescriptor)
+        for attr in attributesMap {
+            (modelIOVertexDescriptor.attributes[attr.key] as! MDLVertexAttribute).name = attr.value
         }
         
-        for i in 0..<vertiesCount {
-            let dataPtr = vertiesPtr.advanced(by: i * 16 * attributesMap.count)
-            for j in 0..<attributesMap.count {
-                if attributesMap[j] == MDLVertexAttributePosition {
-                    let x = positions[i * 3].floatValue
-                    let y = positions[i * 3 + 1].floatValue
-                    let z = positions[i * 3 + 2].floatValue
-                    let position = vector_float3(x, y, z)
-                    withUnsafePointer(to: position) {
-                        dataPtr.advanced(by: j * 16).copyMemory(from: $0,
-                                                                byteCount: MemoryLayout<vector_float3>.stride)
+        let cacheKey = MeshCache.key(source: jsonData, vertexDescriptor: modelIOVertexDescriptor, loader: "JsonMesh weld \(weldEpsilon) optimized")
+        let mdlMesh: MDLMesh
+        if let cached = MeshCache.load(cacheKey,
+                                       vertexDescriptor: modelIOVertexDescriptor,
+                                       allocator: metalAllocator,
+                                       relativeTo: jsonURL.deletingLastPathComponent()) {
+            mdlMesh = cached.mesh
+            // textures are keyed by the path, which changes when the app moves
+            for case let submesh as MDLSubmesh in mdlMesh.submeshes ?? [] {
+                submesh.name = jsonURL.path
+            }
+        } else {
+            let (cornerCount, corners) = try JsonMesh.decodeVertices(json: jsonData,
+                                                                     path: jsonURL.path,
+                                                                     attributesMap: attributesMap)
+            
+            let stride = 16 * attributesMap.count
+            var remap = [UInt32](repeating: 0, count: cornerCount)
+            let vertiesCount = corners.withUnsafeBytes { bytes in
+                vertex_weld_remap(&remap, bytes.baseAddress, cornerCount, stride, weldEpsilon)
+            }
+            if vertiesCount == 0 && cornerCount > 0 {
+                throw Errors.runtimeError("out of memory welding \(jsonURL.path).")
+            }
+            
+            let vertexBuffer = metalAllocator.newBuffer(vertiesCount * stride, type: .vertex)
+            corners.withUnsafeBytes { bytes in
+                vertex_weld_apply(vertexBuffer.map().bytes, bytes.baseAddress, cornerCount, stride, remap)
+            }
+            
+            // 16-bit indices halve the index buffer whenever they can address
+            // every vertex, 0xFFFF is left alone as Metal's primitive restart index
+            let indexBuffer: MDLMeshBuffer
+            let indexType: MDLIndexBitDepth
+            if vertiesCount <= Int(UInt16.max) {
+                let indices = remap.map { UInt16(truncatingIfNeeded: $0) }
+                indexBuffer = metalAllocator.newBuffer(with: Data(bytes: indices, count: MemoryLayout<UInt16>.stride * indices.count), type: .index)
+                indexType = .uInt16
+            } else {
+                indexBuffer = metalAllocator.newBuffer(with: Data(bytes: remap, count: MemoryLayout<UInt32>.stride * remap.count), type: .index)
+                indexType = .uInt32
+            }
+            
+            let submesh = MDLSubmesh(indexBuffer: indexBuffer, indexCount: cornerCount, indexType: indexType, geometryType: .triangles, material: nil)
+            submesh.name = jsonURL.path
+            
+            mdlMesh = MeshOptimizer.optimize(MDLMesh(vertexBuffer: vertexBuffer,
+                                                     vertexCount: vertiesCount,
+                                                     descriptor: modelIOVertexDescriptor,
+                                                     submeshes: [submesh]),
+                                             allocator: metalAllocator)
+            MeshCache.store(mdlMesh, key: cacheKey, relativeTo: jsonURL.deletingLastPathComponent())
+        }
+        mtkMesh = try MTKMesh(mesh: mdlMesh, device: device)
+    }
+    
+    /// Decodes the position, normal and uv arrays straight from the file bytes
+    /// into zeroed triangle corners, 16 bytes per attribute in attributesMap order.
+    private static func decodeVertices(json: Data,
+                                       path: String,
+                                       attributesMap: [Int : String]) throws -> (Int, Data) {
+        return try json.withUnsafeBytes { (bytes: UnsafeRawBufferPointer) -> (Int, Data) in
+            var members = [json_member](repeating: json_member(), count: 8)
+            let memberCount = json_index_members(bytes.baseAddress?.assumingMemoryBound(to: CChar.self),
+                                                 bytes.count, &members, members.count)
+            if memberCount < 0 {
+                throw Errors.runtimeError("\(path) is not a JSON object.")
+            }
+            
+            func floatArray(_ key: String, width: Int) throws -> json_member {
+                guard let member = json_find_member(members, min(memberCount, members.count), key),
+                      member.pointee.isFloatArray, member.pointee.floatCount % width == 0 else {
+                    throw Errors.runtimeError("\(path) has no \(key) array of \(width) component vectors.")
+                }
+                return member.pointee
+            }
+            let arrays: [String : (member: json_member, width: Int)] = [
+                MDLVertexAttributePosition: (try floatArray("position", width: 3), 3),
+                MDLVertexAttributeNormal: (try floatArray("normal", width: 3), 3),
+                MDLVertexAttributeTextureCoordinate: (try floatArray("uv", width: 2), 2),
+            ]
+            let vertiesCount = arrays[MDLVertexAttributePosition]!.member.floatCount / 3
+            
+            let stride = 16 * attributesMap.count
+            var corners = Data(count: vertiesCount * stride)
+            try corners.withUnsafeMutableBytes { (cornerBytes: UnsafeMutableRawBufferPointer) in
+                for j in 0..<attributesMap.count {
+                    guard let name = attributesMap[j], let array = arrays[name] else {
+                        continue
+                    }
+                    var member = array.member
+                    let width = array.width
+                    if member.floatCount != vertiesCount * width {
+                        throw Errors.runtimeError("\(path) has \(member.floatCount / width) \(name) values for \(vertiesCount) vertices.")
                     }
-                } else if attributesMap[j] == MDLVertexAttributeNormal {
-                    let x = normals[i * 3].floatValue
-                    let y = normals[i * 3 + 1].floatValue
-                    let z = normals[i * 3 + 2].floatValue
-                    let normal = vector_float3(x, y, z)
-                    withUnsafePointer(to: normal) {
-                        dataPtr.advanced(by: j * 16).copyMemory(from: $0, byteCount: MemoryLayout<vector_float3>.stride)
+                    let attribute = cornerBytes.baseAddress!.advanced(by: j * 16)
+                    if json_decode_floats(&member, attribute, width, stride) != member.floatCount {
+                        throw Errors.runtimeError("\(path) has a malformed number in its \(name) array.")
                     }
-                } else if attributesMap[j] == MDLVertexAttributeTextureCoordinate {
-                    let x = uvs[i * 2].floatValue
-                    let y = 1.0 - uvs[i * 2 + 1].floatValue
-                    let uv = vector_float2(x, y)
-                    withUnsafePointer(to: uv) {
-                        dataPtr.advanced(by: j * 16).copyMemory(from: $0, byteCount: MemoryLayout<vector_float2>.stride)
+                    
+                    if name == MDLVertexAttributeTextureCoordinate {
+                        for i in 0..<vertiesCount {
+                            let v = attribute.advanced(by: i * stride + 4).assumingMemoryBound(to: Float.self)
+                            v.pointee = 1.0 - v.pointee
+                        }
                     }
                 }
             }
+            return (vertiesCount, corners)
         }
-        
-        let vertiesData = Data(bytes: vertiesPtr, count: vertiesCount * 16 * attributesMap.count)
-        
-        let vertexBuffer = metalAllocator.newBuffer(with: vertiesData, type: .vertex)
-        
-        let numIndices = vertiesCount
-        let indices: [UInt32] = Array(UInt32(0)..<UInt32(numIndices))
-        let indexData = Data(bytes: indices, count: MemoryLayout<Int32>.stride * indices.count)
-        let indexBuffer = metalAllocator.newBuffer(with: indexData, type: .index)
-        
-        let submesh = MDLSubmesh(indexBuffer: indexBuffer, indexCount: indices.count, indexType: .uInt32, geometryType: .triangles, material: nil)
-        submesh.name = jsonURL.path
-        
-        let modelIOVertexDescriptor = MTKModelIOVertexDescriptorFromMetal(mtlVertexDescriptor)
-        for attr in attributesMap {
-            (modelIOVertexDescriptor.attributes[attr.key] as! MDLVertexAttribute).name = attr.value
-        }
-        
-        let mdlMesh = MDLMesh(vertexBuffer: vertexBuffer,
-                                vertexCount: vertiesCount,
-                                descriptor: modelIOVertexDescriptor,
-                                submeshes: [submesh])
-        mtkMesh = try MTKMesh(mesh: mdlMesh, device: device)
     }
 }
 
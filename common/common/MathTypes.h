@@ -0,0 +1,42 @@
+//
+//  MathTypes.h
+//  common
+//
+//  Vector and matrix types shared by the plain C batch kernels.
+//
+//  On Apple platforms these are the <simd/simd.h> types, so arrays can be passed
+//  straight from Swift and Objective-C. Elsewhere layout-compatible structs are
+//  declared instead, which lets the kernels build and run on Linux.
+//
+
+#ifndef MathTypes_h
+#define MathTypes_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __has_include(<simd/simd.h>)
+
+#include <simd/simd.h>
+
+#else
+
+typedef struct { float x, y; } __attribute__((aligned(8))) vector_float2;
+
+/// Same 16 byte stride as the simd vector_float3.
+typedef struct { float x, y, z, _pad; } __attribute__((aligned(16))) vector_float3;
+
+typedef struct { float x, y, z, w; } __attribute__((aligned(16))) vector_float4;
+
+/// Column-major, same layout as the simd matrix_float3x3.
+typedef struct { vector_float3 columns[3]; } matrix_float3x3;
+
+/// Column-major, same layout as the simd matrix_float4x4.
+typedef struct { vector_float4 columns[4]; } matrix_float4x4;
+
+#endif
+
+/// A single-precision quaternion type.
+typedef vector_float4 quaternion_float;
+
+#endif /* MathTypes_h */
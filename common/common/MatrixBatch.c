@@ -0,0 +1,649 @@
+//
+//  MatrixBatch.c
+//  common
+//
+//  Metal uses column-major matrices, the m<column><row> names below follow
+//  AAPLMathUtilities.m. The SIMD kernels work on 4 (SSE, NEON) or 8 (AVX2)
+//  transforms at once: inputs are transposed into one register per component,
+//  the math is done lane-wise, and the columns are transposed back on store.
+//
+
+#include "MatrixBatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_BATCH_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MATRIX_BATCH_NEON 1
+#endif
+
+// Rotation-scale terms of T * R(q) * S. Works on scalars and on SIMD registers
+// that support the arithmetic operators (SSE, AVX and NEON all do in clang/gcc).
+#define TRS_TERMS(qx, qy, qz, qw, sx, sy, sz, one, two)                           \
+    xx = qx * qx; xy = qx * qy; xz = qx * qz; xw = qx * qw;                       \
+    yy = qy * qy; yz = qy * qz; yw = qy * qw;                                     \
+    zz = qz * qz; zw = qz * qw;                                                   \
+    m00 = (one - two * (yy + zz)) * sx;                                           \
+    m01 = two * (xy + zw) * sx;                                                   \
+    m02 = two * (xz - yw) * sx;                                                   \
+    m10 = two * (xy - zw) * sy;                                                   \
+    m11 = (one - two * (xx + zz)) * sy;                                           \
+    m12 = two * (yz + xw) * sy;                                                   \
+    m20 = two * (xz + yw) * sz;                                                   \
+    m21 = two * (yz - xw) * sz;                                                   \
+    m22 = (one - two * (xx + yy)) * sz;
+
+// Upper 3x3 of the inverse, i<column><row>, from the m<column><row> terms of an
+// affine matrix. A TRS block has orthogonal columns, so the rows of its inverse
+// are just the columns divided by their squared length.
+#define TRS_INVERSE_TERMS(one)                                                    \
+    r0 = one / (m00 * m00 + m01 * m01 + m02 * m02);                               \
+    r1 = one / (m10 * m10 + m11 * m11 + m12 * m12);                               \
+    r2 = one / (m20 * m20 + m21 * m21 + m22 * m22);                               \
+    i00 = m00 * r0; i10 = m01 * r0; i20 = m02 * r0;                               \
+    i01 = m10 * r1; i11 = m11 * r1; i21 = m12 * r1;                               \
+    i02 = m20 * r2; i12 = m21 * r2; i22 = m22 * r2;
+
+// General affine: the rows of the inverse are the cross products of the other
+// two columns over the determinant.
+#define AFFINE_INVERSE_TERMS(one)                                                 \
+    i00 = m11 * m22 - m12 * m21;                                                  \
+    i10 = m12 * m20 - m10 * m22;                                                  \
+    i20 = m10 * m21 - m11 * m20;                                                  \
+    i01 = m21 * m02 - m22 * m01;                                                  \
+    i11 = m22 * m00 - m20 * m02;                                                  \
+    i21 = m20 * m01 - m21 * m00;                                                  \
+    i02 = m01 * m12 - m02 * m11;                                                  \
+    i12 = m02 * m10 - m00 * m12;                                                  \
+    i22 = m00 * m11 - m01 * m10;                                                  \
+    r0 = one / (m00 * i00 + m01 * i10 + m02 * i20);                               \
+    i00 = i00 * r0; i10 = i10 * r0; i20 = i20 * r0;                               \
+    i01 = i01 * r0; i11 = i11 * r0; i21 = i21 * r0;                               \
+    i02 = i02 * r0; i12 = i12 * r0; i22 = i22 * r0;
+
+// Translation of the inverse, -inverse(upper 3x3) * t.
+#define INVERSE_TRANSLATION_TERMS(zero)                                           \
+    i30 = zero - (i00 * m30 + i10 * m31 + i20 * m32);                             \
+    i31 = zero - (i01 * m30 + i11 * m31 + i21 * m32);                             \
+    i32 = zero - (i02 * m30 + i12 * m31 + i22 * m32);
+
+//------------------------------------------------------------------------------
+// scalar
+
+static void compose_trs_scalar(matrix_float4x4 *out,
+                               const vector_float3 *t,
+                               const quaternion_float *q,
+                               const vector_float3 *s,
+                               size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float xx, xy, xz, xw, yy, yz, yw, zz, zw;
+        float m00, m01, m02, m10, m11, m12, m20, m21, m22;
+        TRS_TERMS(q[i].x, q[i].y, q[i].z, q[i].w, s[i].x, s[i].y, s[i].z, 1.0f, 2.0f)
+
+        out[i].columns[0] = (vector_float4){ m00, m01, m02, 0 };
+        out[i].columns[1] = (vector_float4){ m10, m11, m12, 0 };
+        out[i].columns[2] = (vector_float4){ m20, m21, m22, 0 };
+        out[i].columns[3] = (vector_float4){ t[i].x, t[i].y, t[i].z, 1 };
+    }
+}
+
+// Writes the inverse and/or the normal matrix (transpose of the inverse upper
+// 3x3), either output may be NULL.
+static void affine_inverse_scalar(matrix_float4x4 *inverse,
+                                  matrix_float3x3 *normal,
+                                  const matrix_float4x4 *m,
+                                  size_t count,
+                                  int trs) {
+    for (size_t k = 0; k < count; k++) {
+        float m00 = m[k].columns[0].x, m01 = m[k].columns[0].y, m02 = m[k].columns[0].z;
+        float m10 = m[k].columns[1].x, m11 = m[k].columns[1].y, m12 = m[k].columns[1].z;
+        float m20 = m[k].columns[2].x, m21 = m[k].columns[2].y, m22 = m[k].columns[2].z;
+        float m30 = m[k].columns[3].x, m31 = m[k].columns[3].y, m32 = m[k].columns[3].z;
+        float i00, i01, i02, i10, i11, i12, i20, i21, i22, i30, i31, i32;
+        float r0, r1, r2;
+        if (trs) {
+            TRS_INVERSE_TERMS(1.0f)
+        } else {
+            AFFINE_INVERSE_TERMS(1.0f)
+        }
+        (void)r1; (void)r2;
+
+        if (inverse) {
+            INVERSE_TRANSLATION_TERMS(0.0f)
+            inverse[k].columns[0] = (vector_float4){ i00, i01, i02, 0 };
+            inverse[k].columns[1] = (vector_float4){ i10, i11, i12, 0 };
+            inverse[k].columns[2] = (vector_float4){ i20, i21, i22, 0 };
+            inverse[k].columns[3] = (vector_float4){ i30, i31, i32, 1 };
+        }
+        if (normal) {
+            normal[k].columns[0].x = i00; normal[k].columns[0].y = i10; normal[k].columns[0].z = i20;
+            normal[k].columns[1].x = i01; normal[k].columns[1].y = i11; normal[k].columns[1].z = i21;
+            normal[k].columns[2].x = i02; normal[k].columns[2].y = i12; normal[k].columns[2].z = i22;
+        }
+    }
+}
+
+#if !MATRIX_BATCH_X86 && !MATRIX_BATCH_NEON
+static void multiply_scalar(matrix_float4x4 *out,
+                            const matrix_float4x4 *a,
+                            const matrix_float4x4 *b,
+                            size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *ma = (const float *)&a[i];
+        const float *mb = (const float *)&b[i];
+        float r[16];
+        for (int c = 0; c < 4; c++) {
+            for (int k = 0; k < 4; k++) {
+                r[c * 4 + k] = ma[k]      * mb[c * 4]
+                             + ma[4 + k]  * mb[c * 4 + 1]
+                             + ma[8 + k]  * mb[c * 4 + 2]
+                             + ma[12 + k] * mb[c * 4 + 3];
+            }
+        }
+        float *mo = (float *)&out[i];
+        for (int j = 0; j < 16; j++) {
+            mo[j] = r[j];
+        }
+    }
+}
+#endif
+
+//------------------------------------------------------------------------------
+// SSE / AVX2
+
+#if MATRIX_BATCH_X86
+
+static int has_avx2_fma(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        cached = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return cached;
+}
+
+static void compose_trs_sse(matrix_float4x4 *out,
+                            const vector_float3 *t,
+                            const quaternion_float *q,
+                            const vector_float3 *s,
+                            size_t count) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 qx = _mm_loadu_ps((const float *)&q[i]);
+        __m128 qy = _mm_loadu_ps((const float *)&q[i + 1]);
+        __m128 qz = _mm_loadu_ps((const float *)&q[i + 2]);
+        __m128 qw = _mm_loadu_ps((const float *)&q[i + 3]);
+        _MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+
+        __m128 sx = _mm_loadu_ps((const float *)&s[i]);
+        __m128 sy = _mm_loadu_ps((const float *)&s[i + 1]);
+        __m128 sz = _mm_loadu_ps((const float *)&s[i + 2]);
+        __m128 sw = _mm_loadu_ps((const float *)&s[i + 3]);
+        _MM_TRANSPOSE4_PS(sx, sy, sz, sw);
+
+        __m128 xx, xy, xz, xw, yy, yz, yw, zz, zw;
+        __m128 m00, m01, m02, m10, m11, m12, m20, m21, m22;
+        TRS_TERMS(qx, qy, qz, qw, sx, sy, sz, one, two)
+
+        __m128 m03 = zero, m13 = zero, m23 = zero;
+        _MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+        _MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+        _MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+
+        const __m128 cols[4][3] = {
+            { m00, m10, m20 }, { m01, m11, m21 }, { m02, m12, m22 }, { m03, m13, m23 },
+        };
+        for (int k = 0; k < 4; k++) {
+            float *dst = (float *)&out[i + k];
+            _mm_storeu_ps(dst, cols[k][0]);
+            _mm_storeu_ps(dst + 4, cols[k][1]);
+            _mm_storeu_ps(dst + 8, cols[k][2]);
+            _mm_storeu_ps(dst + 12, _mm_setr_ps(t[i + k].x, t[i + k].y, t[i + k].z, 1.0f));
+        }
+    }
+
+    compose_trs_scalar(out + i, t + i, q + i, s + i, count - i);
+}
+
+static void multiply_sse(matrix_float4x4 *out,
+                         const matrix_float4x4 *a,
+                         const matrix_float4x4 *b,
+                         size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *ma = (const float *)&a[i];
+        const float *mb = (const float *)&b[i];
+        __m128 a0 = _mm_loadu_ps(ma);
+        __m128 a1 = _mm_loadu_ps(ma + 4);
+        __m128 a2 = _mm_loadu_ps(ma + 8);
+        __m128 a3 = _mm_loadu_ps(ma + 12);
+        __m128 b0 = _mm_loadu_ps(mb);
+        __m128 b1 = _mm_loadu_ps(mb + 4);
+        __m128 b2 = _mm_loadu_ps(mb + 8);
+        __m128 b3 = _mm_loadu_ps(mb + 12);
+
+        const __m128 bs[4] = { b0, b1, b2, b3 };
+        float *mo = (float *)&out[i];
+        for (int c = 0; c < 4; c++) {
+            __m128 col = _mm_mul_ps(a0, _mm_shuffle_ps(bs[c], bs[c], 0x00));
+            col = _mm_add_ps(col, _mm_mul_ps(a1, _mm_shuffle_ps(bs[c], bs[c], 0x55)));
+            col = _mm_add_ps(col, _mm_mul_ps(a2, _mm_shuffle_ps(bs[c], bs[c], 0xAA)));
+            col = _mm_add_ps(col, _mm_mul_ps(a3, _mm_shuffle_ps(bs[c], bs[c], 0xFF)));
+            _mm_storeu_ps(mo + c * 4, col);
+        }
+    }
+}
+
+// Loads column `col` of four matrices starting at p[k] as x, y, z and w registers.
+#define LOAD_COLUMN_SSE(p, k, col, x, y, z, w) do {                               \
+    x = _mm_loadu_ps((const float *)&(p)[k].columns[col]);                        \
+    y = _mm_loadu_ps((const float *)&(p)[(k) + 1].columns[col]);                  \
+    z = _mm_loadu_ps((const float *)&(p)[(k) + 2].columns[col]);                  \
+    w = _mm_loadu_ps((const float *)&(p)[(k) + 3].columns[col]);                  \
+    _MM_TRANSPOSE4_PS(x, y, z, w);                                                \
+} while (0)
+
+// Stores three or four registers as the columns of the matrix at `dst`.
+#define STORE3_COLUMNS_SSE(dst, c0, c1, c2) do {                                  \
+    float *f = (float *)(dst);                                                    \
+    _mm_storeu_ps(f, c0);                                                         \
+    _mm_storeu_ps(f + 4, c1);                                                     \
+    _mm_storeu_ps(f + 8, c2);                                                     \
+} while (0)
+
+#define STORE4_COLUMNS_SSE(dst, c0, c1, c2, c3) do {                              \
+    float *f = (float *)(dst);                                                    \
+    _mm_storeu_ps(f, c0);                                                         \
+    _mm_storeu_ps(f + 4, c1);                                                     \
+    _mm_storeu_ps(f + 8, c2);                                                     \
+    _mm_storeu_ps(f + 12, c3);                                                    \
+} while (0)
+
+static void affine_inverse_sse(matrix_float4x4 *inverse,
+                               matrix_float3x3 *normal,
+                               const matrix_float4x4 *m,
+                               size_t count,
+                               int trs) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 m00, m01, m02, m03, m10, m11, m12, m13, m20, m21, m22, m23, m30, m31, m32, m33;
+        LOAD_COLUMN_SSE(m, i, 0, m00, m01, m02, m03);
+        LOAD_COLUMN_SSE(m, i, 1, m10, m11, m12, m13);
+        LOAD_COLUMN_SSE(m, i, 2, m20, m21, m22, m23);
+        LOAD_COLUMN_SSE(m, i, 3, m30, m31, m32, m33);
+
+        __m128 i00, i01, i02, i10, i11, i12, i20, i21, i22, i30, i31, i32;
+        __m128 r0, r1, r2;
+        if (trs) {
+            TRS_INVERSE_TERMS(one)
+        } else {
+            AFFINE_INVERSE_TERMS(one)
+        }
+        (void)r1; (void)r2;
+
+        if (inverse) {
+            INVERSE_TRANSLATION_TERMS(zero)
+            __m128 i03 = zero, i13 = zero, i23 = zero, i33 = one;
+            _MM_TRANSPOSE4_PS(i00, i01, i02, i03);
+            _MM_TRANSPOSE4_PS(i10, i11, i12, i13);
+            _MM_TRANSPOSE4_PS(i20, i21, i22, i23);
+            _MM_TRANSPOSE4_PS(i30, i31, i32, i33);
+
+            STORE4_COLUMNS_SSE(&inverse[i],     i00, i10, i20, i30);
+            STORE4_COLUMNS_SSE(&inverse[i + 1], i01, i11, i21, i31);
+            STORE4_COLUMNS_SSE(&inverse[i + 2], i02, i12, i22, i32);
+            STORE4_COLUMNS_SSE(&inverse[i + 3], i03, i13, i23, i33);
+        } else {
+            // the normal matrix columns are the rows of the inverse
+            __m128 n03 = zero, n13 = zero, n23 = zero;
+            _MM_TRANSPOSE4_PS(i00, i10, i20, n03);
+            _MM_TRANSPOSE4_PS(i01, i11, i21, n13);
+            _MM_TRANSPOSE4_PS(i02, i12, i22, n23);
+
+            STORE3_COLUMNS_SSE(&normal[i],     i00, i01, i02);
+            STORE3_COLUMNS_SSE(&normal[i + 1], i10, i11, i12);
+            STORE3_COLUMNS_SSE(&normal[i + 2], i20, i21, i22);
+            STORE3_COLUMNS_SSE(&normal[i + 3], n03, n13, n23);
+        }
+    }
+
+    affine_inverse_scalar(inverse ? inverse + i : NULL, normal ? normal + i : NULL,
+                          m + i, count - i, trs);
+}
+
+// 4x4 transpose inside each 128 bit lane of four ymm registers.
+#define TRANSPOSE4_LANES_256(r0, r1, r2, r3) do {                                 \
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);                                       \
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);                                       \
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);                                       \
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);                                       \
+    r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));                      \
+    r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));                      \
+    r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));                      \
+    r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));                      \
+} while (0)
+
+// Loads element k and k + 4 into the low and high lane.
+#define LOAD_PAIR_256(p, k) \
+    _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps((const float *)&(p)[k])), \
+                         _mm_loadu_ps((const float *)&(p)[(k) + 4]), 1)
+
+__attribute__((target("avx2,fma")))
+static void compose_trs_avx2(matrix_float4x4 *out,
+                             const vector_float3 *t,
+                             const quaternion_float *q,
+                             const vector_float3 *s,
+                             size_t count) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 qx = LOAD_PAIR_256(q, i);
+        __m256 qy = LOAD_PAIR_256(q, i + 1);
+        __m256 qz = LOAD_PAIR_256(q, i + 2);
+        __m256 qw = LOAD_PAIR_256(q, i + 3);
+        TRANSPOSE4_LANES_256(qx, qy, qz, qw);
+
+        __m256 sx = LOAD_PAIR_256(s, i);
+        __m256 sy = LOAD_PAIR_256(s, i + 1);
+        __m256 sz = LOAD_PAIR_256(s, i + 2);
+        __m256 sw = LOAD_PAIR_256(s, i + 3);
+        TRANSPOSE4_LANES_256(sx, sy, sz, sw);
+
+        __m256 xx, xy, xz, xw, yy, yz, yw, zz, zw;
+        __m256 m00, m01, m02, m10, m11, m12, m20, m21, m22;
+        TRS_TERMS(qx, qy, qz, qw, sx, sy, sz, one, two)
+
+        __m256 m03 = zero, m13 = zero, m23 = zero;
+        TRANSPOSE4_LANES_256(m00, m01, m02, m03);
+        TRANSPOSE4_LANES_256(m10, m11, m12, m13);
+        TRANSPOSE4_LANES_256(m20, m21, m22, m23);
+
+        const __m256 cols[4][3] = {
+            { m00, m10, m20 }, { m01, m11, m21 }, { m02, m12, m22 }, { m03, m13, m23 },
+        };
+        for (int k = 0; k < 4; k++) {
+            float *lo = (float *)&out[i + k];
+            float *hi = (float *)&out[i + k + 4];
+            for (int c = 0; c < 3; c++) {
+                _mm_storeu_ps(lo + c * 4, _mm256_castps256_ps128(cols[k][c]));
+                _mm_storeu_ps(hi + c * 4, _mm256_extractf128_ps(cols[k][c], 1));
+            }
+            _mm_storeu_ps(lo + 12, _mm_setr_ps(t[i + k].x, t[i + k].y, t[i + k].z, 1.0f));
+            _mm_storeu_ps(hi + 12, _mm_setr_ps(t[i + k + 4].x, t[i + k + 4].y, t[i + k + 4].z, 1.0f));
+        }
+    }
+
+    compose_trs_sse(out + i, t + i, q + i, s + i, count - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void multiply_avx2(matrix_float4x4 *out,
+                          const matrix_float4x4 *a,
+                          const matrix_float4x4 *b,
+                          size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *ma = (const float *)&a[i];
+        const float *mb = (const float *)&b[i];
+        // Each column of a is duplicated in both lanes, two columns of b are
+        // handled per register.
+        __m256 a0 = _mm256_broadcast_ps((const __m128 *)ma);
+        __m256 a1 = _mm256_broadcast_ps((const __m128 *)(ma + 4));
+        __m256 a2 = _mm256_broadcast_ps((const __m128 *)(ma + 8));
+        __m256 a3 = _mm256_broadcast_ps((const __m128 *)(ma + 12));
+        __m256 b01 = _mm256_loadu_ps(mb);
+        __m256 b23 = _mm256_loadu_ps(mb + 8);
+
+        __m256 c01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+        c01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), c01);
+        c01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xAA), c01);
+        c01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xFF), c01);
+
+        __m256 c23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+        c23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), c23);
+        c23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xAA), c23);
+        c23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xFF), c23);
+
+        float *mo = (float *)&out[i];
+        _mm256_storeu_ps(mo, c01);
+        _mm256_storeu_ps(mo + 8, c23);
+    }
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// NEON
+
+#if MATRIX_BATCH_NEON
+
+static inline void transpose4_neon(float32x4_t *r0, float32x4_t *r1, float32x4_t *r2, float32x4_t *r3) {
+    float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+    float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+    *r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+static void compose_trs_neon(matrix_float4x4 *out,
+                             const vector_float3 *t,
+                             const quaternion_float *q,
+                             const vector_float3 *s,
+                             size_t count) {
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t two = vdupq_n_f32(2.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // vld4q de-interleaves four float4 elements into x, y, z and w registers.
+        float32x4x4_t qv = vld4q_f32((const float *)&q[i]);
+        float32x4x4_t sv = vld4q_f32((const float *)&s[i]);
+
+        float32x4_t xx, xy, xz, xw, yy, yz, yw, zz, zw;
+        float32x4_t m00, m01, m02, m10, m11, m12, m20, m21, m22;
+        TRS_TERMS(qv.val[0], qv.val[1], qv.val[2], qv.val[3],
+                  sv.val[0], sv.val[1], sv.val[2], one, two)
+
+        float32x4_t m03 = zero, m13 = zero, m23 = zero;
+        transpose4_neon(&m00, &m01, &m02, &m03);
+        transpose4_neon(&m10, &m11, &m12, &m13);
+        transpose4_neon(&m20, &m21, &m22, &m23);
+
+        const float32x4_t cols[4][3] = {
+            { m00, m10, m20 }, { m01, m11, m21 }, { m02, m12, m22 }, { m03, m13, m23 },
+        };
+        for (int k = 0; k < 4; k++) {
+            float *dst = (float *)&out[i + k];
+            vst1q_f32(dst, cols[k][0]);
+            vst1q_f32(dst + 4, cols[k][1]);
+            vst1q_f32(dst + 8, cols[k][2]);
+            const float col3[4] = { t[i + k].x, t[i + k].y, t[i + k].z, 1.0f };
+            vst1q_f32(dst + 12, vld1q_f32(col3));
+        }
+    }
+
+    compose_trs_scalar(out + i, t + i, q + i, s + i, count - i);
+}
+
+static void multiply_neon(matrix_float4x4 *out,
+                          const matrix_float4x4 *a,
+                          const matrix_float4x4 *b,
+                          size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *ma = (const float *)&a[i];
+        const float *mb = (const float *)&b[i];
+        float32x4_t a0 = vld1q_f32(ma);
+        float32x4_t a1 = vld1q_f32(ma + 4);
+        float32x4_t a2 = vld1q_f32(ma + 8);
+        float32x4_t a3 = vld1q_f32(ma + 12);
+        float32x4_t bs[4] = { vld1q_f32(mb), vld1q_f32(mb + 4), vld1q_f32(mb + 8), vld1q_f32(mb + 12) };
+
+        float *mo = (float *)&out[i];
+        for (int c = 0; c < 4; c++) {
+            float32x4_t col = vmulq_laneq_f32(a0, bs[c], 0);
+            col = vfmaq_laneq_f32(col, a1, bs[c], 1);
+            col = vfmaq_laneq_f32(col, a2, bs[c], 2);
+            col = vfmaq_laneq_f32(col, a3, bs[c], 3);
+            vst1q_f32(mo + c * 4, col);
+        }
+    }
+}
+
+// Loads column `col` of four matrices starting at p[k] as x, y, z and w registers.
+#define LOAD_COLUMN_NEON(p, k, col, x, y, z, w) do {                              \
+    x = vld1q_f32((const float *)&(p)[k].columns[col]);                           \
+    y = vld1q_f32((const float *)&(p)[(k) + 1].columns[col]);                     \
+    z = vld1q_f32((const float *)&(p)[(k) + 2].columns[col]);                     \
+    w = vld1q_f32((const float *)&(p)[(k) + 3].columns[col]);                     \
+    transpose4_neon(&x, &y, &z, &w);                                              \
+} while (0)
+
+// Stores three or four registers as the columns of the matrix at `dst`.
+#define STORE3_COLUMNS_NEON(dst, c0, c1, c2) do {                                 \
+    float *f = (float *)(dst);                                                    \
+    vst1q_f32(f, c0);                                                             \
+    vst1q_f32(f + 4, c1);                                                         \
+    vst1q_f32(f + 8, c2);                                                         \
+} while (0)
+
+#define STORE4_COLUMNS_NEON(dst, c0, c1, c2, c3) do {                             \
+    float *f = (float *)(dst);                                                    \
+    vst1q_f32(f, c0);                                                             \
+    vst1q_f32(f + 4, c1);                                                         \
+    vst1q_f32(f + 8, c2);                                                         \
+    vst1q_f32(f + 12, c3);                                                        \
+} while (0)
+
+static void affine_inverse_neon(matrix_float4x4 *inverse,
+                                matrix_float3x3 *normal,
+                                const matrix_float4x4 *m,
+                                size_t count,
+                                int trs) {
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t m00, m01, m02, m03, m10, m11, m12, m13, m20, m21, m22, m23, m30, m31, m32, m33;
+        LOAD_COLUMN_NEON(m, i, 0, m00, m01, m02, m03);
+        LOAD_COLUMN_NEON(m, i, 1, m10, m11, m12, m13);
+        LOAD_COLUMN_NEON(m, i, 2, m20, m21, m22, m23);
+        LOAD_COLUMN_NEON(m, i, 3, m30, m31, m32, m33);
+
+        float32x4_t i00, i01, i02, i10, i11, i12, i20, i21, i22, i30, i31, i32;
+        float32x4_t r0, r1, r2;
+        if (trs) {
+            TRS_INVERSE_TERMS(one)
+        } else {
+            AFFINE_INVERSE_TERMS(one)
+        }
+        (void)r1; (void)r2;
+
+        if (inverse) {
+            INVERSE_TRANSLATION_TERMS(zero)
+            float32x4_t i03 = zero, i13 = zero, i23 = zero, i33 = one;
+            transpose4_neon(&i00, &i01, &i02, &i03);
+            transpose4_neon(&i10, &i11, &i12, &i13);
+            transpose4_neon(&i20, &i21, &i22, &i23);
+            transpose4_neon(&i30, &i31, &i32, &i33);
+
+            STORE4_COLUMNS_NEON(&inverse[i],     i00, i10, i20, i30);
+            STORE4_COLUMNS_NEON(&inverse[i + 1], i01, i11, i21, i31);
+            STORE4_COLUMNS_NEON(&inverse[i + 2], i02, i12, i22, i32);
+            STORE4_COLUMNS_NEON(&inverse[i + 3], i03, i13, i23, i33);
+        } else {
+            // the normal matrix columns are the rows of the inverse
+            float32x4_t n03 = zero, n13 = zero, n23 = zero;
+            transpose4_neon(&i00, &i10, &i20, &n03);
+            transpose4_neon(&i01, &i11, &i21, &n13);
+            transpose4_neon(&i02, &i12, &i22, &n23);
+
+            STORE3_COLUMNS_NEON(&normal[i],     i00, i01, i02);
+            STORE3_COLUMNS_NEON(&normal[i + 1], i10, i11, i12);
+            STORE3_COLUMNS_NEON(&normal[i + 2], i20, i21, i22);
+            STORE3_COLUMNS_NEON(&normal[i + 3], n03, n13, n23);
+        }
+    }
+
+    affine_inverse_scalar(inverse ? inverse + i : NULL, normal ? normal + i : NULL,
+                          m + i, count - i, trs);
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+void matrix4x4_compose_trs_n(matrix_float4x4 *out,
+                             const vector_float3 *translations,
+                             const quaternion_float *rotations,
+                             const vector_float3 *scales,
+                             size_t count) {
+#if MATRIX_BATCH_X86
+    if (has_avx2_fma()) {
+        compose_trs_avx2(out, translations, rotations, scales, count);
+    } else {
+        compose_trs_sse(out, translations, rotations, scales, count);
+    }
+#elif MATRIX_BATCH_NEON
+    compose_trs_neon(out, translations, rotations, scales, count);
+#else
+    compose_trs_scalar(out, translations, rotations, scales, count);
+#endif
+}
+
+void matrix4x4_multiply_n(matrix_float4x4 *out,
+                          const matrix_float4x4 *a,
+                          const matrix_float4x4 *b,
+                          size_t count) {
+#if MATRIX_BATCH_X86
+    if (has_avx2_fma()) {
+        multiply_avx2(out, a, b, count);
+    } else {
+        multiply_sse(out, a, b, count);
+    }
+#elif MATRIX_BATCH_NEON
+    multiply_neon(out, a, b, count);
+#else
+    multiply_scalar(out, a, b, count);
+#endif
+}
+
+static void affine_inverse(matrix_float4x4 *inverse,
+                           matrix_float3x3 *normal,
+                           const matrix_float4x4 *m,
+                           size_t count,
+                           int trs) {
+#if MATRIX_BATCH_X86
+    affine_inverse_sse(inverse, normal, m, count, trs);
+#elif MATRIX_BATCH_NEON
+    affine_inverse_neon(inverse, normal, m, count, trs);
+#else
+    affine_inverse_scalar(inverse, normal, m, count, trs);
+#endif
+}
+
+void matrix4x4_trs_inverse_n(matrix_float4x4 *out, const matrix_float4x4 *m, size_t count) {
+    affine_inverse(out, NULL, m, count, 1);
+}
+
+void matrix4x4_affine_inverse_n(matrix_float4x4 *out, const matrix_float4x4 *m, size_t count) {
+    affine_inverse(out, NULL, m, count, 0);
+}
+
+void matrix3x3_trs_normal_n(matrix_float3x3 *out, const matrix_float4x4 *m, size_t count) {
+    affine_inverse(NULL, out, m, count, 1);
+}
+
+void matrix3x3_affine_normal_n(matrix_float3x3 *out, const matrix_float4x4 *m, size_t count) {
+    affine_inverse(NULL, out, m, count, 0);
+}
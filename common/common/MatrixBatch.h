@@ -0,0 +1,47 @@
+//
+//  MatrixBatch.h
+//  common
+//
+//  Batched matrix builders over contiguous arrays.
+//
+//  Compose and multiply have SSE/AVX2 (x86_64) and NEON (arm64) kernels, the
+//  inverses and normal matrices SSE and NEON ones, and every entry point has a
+//  scalar fallback, so the results match the one-at-a-time functions in
+//  AAPLMathUtilities.h up to floating point rounding.
+//
+
+#ifndef MatrixBatch_h
+#define MatrixBatch_h
+
+#include <common/MathTypes.h>
+
+/// Composes translation * rotation * scale for `count` transforms.
+/// Equivalent to matrix4x4_translation(t) * matrix4x4_from_quaternion(q) * matrix4x4_scale(s);
+/// the quaternions must be unit-norm.
+void matrix4x4_compose_trs_n(matrix_float4x4 *out,
+                             const vector_float3 *translations,
+                             const quaternion_float *rotations,
+                             const vector_float3 *scales,
+                             size_t count);
+
+/// Multiplies `count` matrix pairs, out[i] = a[i] * b[i]. `out` may alias `a` or `b`.
+void matrix4x4_multiply_n(matrix_float4x4 *out,
+                          const matrix_float4x4 *a,
+                          const matrix_float4x4 *b,
+                          size_t count);
+
+/// Inverts `count` translation * rotation * scale matrices (orthogonal upper 3x3
+/// columns, no shear). Costs three reciprocals instead of a general inverse.
+/// `out` may alias `m`.
+void matrix4x4_trs_inverse_n(matrix_float4x4 *out, const matrix_float4x4 *m, size_t count);
+
+/// Inverts `count` affine matrices (last row 0, 0, 0, 1). `out` may alias `m`.
+void matrix4x4_affine_inverse_n(matrix_float4x4 *out, const matrix_float4x4 *m, size_t count);
+
+/// Normal matrices, the inverse transpose of the upper 3x3, of `count` TRS matrices.
+void matrix3x3_trs_normal_n(matrix_float3x3 *out, const matrix_float4x4 *m, size_t count);
+
+/// Normal matrices, the inverse transpose of the upper 3x3, of `count` affine matrices.
+void matrix3x3_affine_normal_n(matrix_float3x3 *out, const matrix_float4x4 *m, size_t count);
+
+#endif /* MatrixBatch_h */
@@ -0,0 +1,315 @@
+//
+//  MeshCache.c
+//  common
+//
+
+#include "MeshCache.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t Prime3 = 0x165667B19E3779F9ull;
+static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * Prime2;
+    return rotl64(accumulator, 31) * Prime1;
+}
+
+static inline uint64_t hash_merge(uint64_t hash, uint64_t accumulator) {
+    hash ^= hash_round(0, accumulator);
+    return hash * Prime1 + Prime4;
+}
+
+uint64_t mesh_cache_hash(const void *bytes, size_t length, uint64_t seed) {
+    const uint8_t *p = bytes;
+    const uint8_t *end = p + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        // four independent lanes of 8 bytes, the loop runs at memory speed
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = hash_round(v1, read64(p));
+            v2 = hash_round(v2, read64(p + 8));
+            v3 = hash_round(v3, read64(p + 16));
+            v4 = hash_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = hash_merge(hash, v1);
+        hash = hash_merge(hash, v2);
+        hash = hash_merge(hash, v3);
+        hash = hash_merge(hash, v4);
+    } else {
+        hash = seed + Prime5;
+    }
+    hash += (uint64_t)length;
+
+    for (; p + 8 <= end; p += 8) {
+        hash ^= hash_round(0, read64(p));
+        hash = rotl64(hash, 27) * Prime1 + Prime4;
+    }
+    if (p + 4 <= end) {
+        hash ^= (uint64_t)read32(p) * Prime1;
+        hash = rotl64(hash, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * Prime5;
+        hash = rotl64(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static inline uint64_t align16(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+// Section offsets and total size of a cache, shared by create and the loader
+// checks. Lengths that would overflow the offsets give UINT64_MAX.
+static uint64_t layout(mesh_cache_header *header, mesh_cache_buffer *buffers) {
+    header->buffersOffset = align16(sizeof(mesh_cache_header));
+    header->submeshesOffset = align16(header->buffersOffset + (uint64_t)header->bufferCount * sizeof(mesh_cache_buffer));
+    header->clustersOffset = align16(header->submeshesOffset + (uint64_t)header->submeshCount * sizeof(mesh_cache_submesh));
+    header->stringsOffset = align16(header->clustersOffset + (uint64_t)header->clusterCount * sizeof(meshlet));
+    uint64_t cursor = align16(header->stringsOffset + header->stringsLength);
+    for (uint32_t b = 0; b < header->bufferCount; b++) {
+        if (buffers[b].length > UINT64_MAX / 2 - cursor) return UINT64_MAX;
+        buffers[b].offset = cursor;
+        cursor = align16(cursor + buffers[b].length);
+    }
+    header->indicesOffset = cursor;
+    if (header->indicesLength > UINT64_MAX / 2 - cursor) return UINT64_MAX;
+    return align16(cursor + header->indicesLength);
+}
+
+static bool valid_string(const mesh_cache_header *header, uint32_t offset) {
+    return offset == MESH_CACHE_NO_STRING || offset < header->stringsLength;
+}
+
+// Checks what the offsets can't: vertex buffers hold every vertex, submeshes
+// stay inside the indices, clusters and strings with a known level of
+// detail, clusters inside their submesh, and the last string is terminated.
+static bool validate(const mesh_cache_header *header,
+                     const mesh_cache_buffer *buffers,
+                     const mesh_cache_submesh *submeshes,
+                     const meshlet *clusters,
+                     const char *strings) {
+    if (header->bufferCount > MESH_CACHE_MAX_BUFFERS) return false;
+    if (header->stringsLength > 0 && strings[header->stringsLength - 1] != '\0') return false;
+    for (uint32_t b = 0; b < header->bufferCount; b++) {
+        if (buffers[b].length < (uint64_t)buffers[b].stride * header->vertexCount) return false;
+    }
+    for (uint32_t s = 0; s < header->submeshCount; s++) {
+        const mesh_cache_submesh *submesh = &submeshes[s];
+        if (submesh->indexSize != 2 && submesh->indexSize != 4) return false;
+        if (submesh->indexOffset % submesh->indexSize != 0 ||
+            submesh->indexOffset > header->indicesLength ||
+            (uint64_t)submesh->indexCount * submesh->indexSize > header->indicesLength - submesh->indexOffset) {
+            return false;
+        }
+        if (!valid_string(header, submesh->name) ||
+            !valid_string(header, submesh->baseColorTexture) ||
+            !valid_string(header, submesh->specularTexture)) {
+            return false;
+        }
+        if (submesh->lod > header->lodCount) return false;
+        if (submesh->clusterOffset > header->clusterCount ||
+            submesh->clusterCount > header->clusterCount - submesh->clusterOffset) {
+            return false;
+        }
+        for (uint32_t c = submesh->clusterOffset; c < submesh->clusterOffset + submesh->clusterCount; c++) {
+            if (clusters[c].indexOffset > submesh->indexCount ||
+                (uint64_t)clusters[c].triangleCount * 3 > submesh->indexCount - clusters[c].indexOffset) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void bind_storage(mesh_cache *cache) {
+    const mesh_cache_header *header = cache->storage;
+    char *base = cache->storage;
+    cache->sourceHash = header->sourceHash;
+    cache->layoutHash = header->layoutHash;
+    cache->vertexCount = header->vertexCount;
+    cache->bufferCount = header->bufferCount;
+    cache->submeshCount = header->submeshCount;
+    cache->clusterCount = header->clusterCount;
+    cache->lodCount = header->lodCount;
+    memcpy(cache->boundsMin, header->boundsMin, sizeof(cache->boundsMin));
+    memcpy(cache->boundsMax, header->boundsMax, sizeof(cache->boundsMax));
+    cache->buffers = (const mesh_cache_buffer *)(base + header->buffersOffset);
+    cache->submeshes = (const mesh_cache_submesh *)(base + header->submeshesOffset);
+    cache->clusters = (const meshlet *)(base + header->clustersOffset);
+    cache->strings = base + header->stringsOffset;
+    for (uint32_t b = 0; b < header->bufferCount; b++) {
+        cache->vertices[b] = base + cache->buffers[b].offset;
+    }
+    cache->indices = base + header->indicesOffset;
+    cache->indicesLength = header->indicesLength;
+}
+
+mesh_cache *mesh_cache_create(const mesh_cache_desc *desc) {
+    if (desc->bufferCount > MESH_CACHE_MAX_BUFFERS) return NULL;
+
+    mesh_cache_header header = {
+        .magic = MESH_CACHE_MAGIC,
+        .version = MESH_CACHE_VERSION,
+        .sourceHash = desc->sourceHash,
+        .layoutHash = desc->layoutHash,
+        .vertexCount = desc->vertexCount,
+        .bufferCount = desc->bufferCount,
+        .submeshCount = desc->submeshCount,
+        .stringsLength = desc->stringsLength,
+        .clusterCount = desc->clusterCount,
+        .lodCount = desc->lodCount,
+        .indicesLength = desc->indicesLength,
+    };
+    memcpy(header.boundsMin, desc->boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, desc->boundsMax, sizeof(header.boundsMax));
+    mesh_cache_buffer buffers[MESH_CACHE_MAX_BUFFERS];
+    memcpy(buffers, desc->buffers, sizeof(mesh_cache_buffer) * desc->bufferCount);
+    uint64_t size = layout(&header, buffers);
+    if (size > SIZE_MAX - 15 || !validate(&header, buffers, desc->submeshes, desc->clusters, desc->strings)) return NULL;
+
+    mesh_cache *cache = calloc(1, sizeof(mesh_cache));
+    if (!cache) return NULL;
+    if (!(cache->storage = aligned_alloc(16, ((size_t)size + 15) & ~(size_t)15))) {
+        free(cache);
+        return NULL;
+    }
+    char *base = cache->storage;
+    memset(base, 0, (size_t)size);
+    memcpy(base, &header, sizeof(header));
+    memcpy(base + header.buffersOffset, buffers, sizeof(mesh_cache_buffer) * header.bufferCount);
+    memcpy(base + header.submeshesOffset, desc->submeshes, sizeof(mesh_cache_submesh) * header.submeshCount);
+    if (header.clusterCount > 0) {
+        memcpy(base + header.clustersOffset, desc->clusters, sizeof(meshlet) * header.clusterCount);
+    }
+    memcpy(base + header.stringsOffset, desc->strings, header.stringsLength);
+    cache->storageSize = (size_t)size;
+    bind_storage(cache);
+    return cache;
+}
+
+mesh_cache *mesh_cache_load(const char *path, uint64_t sourceHash, uint64_t layoutHash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(mesh_cache_header)) {
+        mapping = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    // as for clips, the offsets are recomputed instead of trusted; the tables
+    // are bounds checked before they are read
+    const char *base = mapping;
+    const mesh_cache_header *stored = mapping;
+    mesh_cache_header expected = *stored;
+    mesh_cache_buffer buffers[MESH_CACHE_MAX_BUFFERS] = { 0 };
+    bool valid = stored->magic == MESH_CACHE_MAGIC &&
+                 stored->version == MESH_CACHE_VERSION &&
+                 stored->sourceHash == sourceHash &&
+                 stored->layoutHash == layoutHash &&
+                 stored->bufferCount <= MESH_CACHE_MAX_BUFFERS;
+    if (valid) {
+        layout(&expected, buffers);
+        valid = expected.stringsOffset + expected.stringsLength <= (uint64_t)st.st_size;
+    }
+    if (valid) {
+        memcpy(buffers, base + expected.buffersOffset, sizeof(mesh_cache_buffer) * expected.bufferCount);
+        uint64_t size = layout(&expected, buffers);
+        valid = memcmp(stored, &expected, sizeof(expected)) == 0 &&
+                memcmp(base + expected.buffersOffset, buffers, sizeof(mesh_cache_buffer) * expected.bufferCount) == 0 &&
+                size <= (uint64_t)st.st_size &&
+                validate(&expected, buffers,
+                         (const mesh_cache_submesh *)(base + expected.submeshesOffset),
+                         (const meshlet *)(base + expected.clustersOffset),
+                         base + expected.stringsOffset);
+    }
+    if (!valid) {
+        munmap(mapping, (size_t)st.st_size);
+        return NULL;
+    }
+
+    mesh_cache *cache = calloc(1, sizeof(mesh_cache));
+    if (!cache) {
+        munmap(mapping, (size_t)st.st_size);
+        return NULL;
+    }
+    cache->storage = mapping;
+    cache->storageSize = (size_t)st.st_size;
+    cache->mapped = true;
+    bind_storage(cache);
+    return cache;
+}
+
+bool mesh_cache_write(const mesh_cache *cache, const char *path) {
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid()) >= (int)sizeof(temporary)) {
+        return false;
+    }
+    FILE *file = fopen(temporary, "wb");
+    if (!file) return false;
+    bool ok = fwrite(cache->storage, 1, cache->storageSize, file) == cache->storageSize;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+void mesh_cache_destroy(mesh_cache *cache) {
+    if (!cache) return;
+    if (cache->mapped) {
+        munmap(cache->storage, cache->storageSize);
+    } else {
+        free(cache->storage);
+    }
+    free(cache);
+}
+
+const char *mesh_cache_string(const mesh_cache *cache, uint32_t offset) {
+    return offset == MESH_CACHE_NO_STRING ? NULL : cache->strings + offset;
+}
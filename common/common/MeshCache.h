@@ -0,0 +1,162 @@
+//
+//  MeshCache.h
+//  common
+//
+//  Binary mesh cache for the text mesh loaders.
+//
+//  A cache file holds a mesh as the loaders hand it to Metal: the vertex
+//  buffers in the layout of the requested vertex descriptor, the index data,
+//  the submeshes with their names, texture paths and triangle clusters (see
+//  Meshlet.h), the simplified submeshes of every level of detail (see
+//  MeshSimplifier.h), and the bounds. It is
+//  keyed by a hash of the source file's content and a hash of the vertex
+//  layout, so an edited asset or a different descriptor is a miss and never a
+//  stale mesh.
+//
+//  The file layout is the in-memory layout, a header followed by the buffer
+//  table, the submesh table, the clusters, the strings, every vertex buffer
+//  and the indices,
+//  each 16-byte aligned, as for compiled animation clips. Loading maps the
+//  file, so a warm start pages the mesh in instead of parsing text.
+//
+
+#ifndef MeshCache_h
+#define MeshCache_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <common/Meshlet.h>
+
+#define MESH_CACHE_MAGIC 0x434D4D4Cu // "LMMC"
+#define MESH_CACHE_VERSION 3
+
+/// Vertex buffers are bound by index like Metal buffer arguments, so there are at most 31.
+#define MESH_CACHE_MAX_BUFFERS 31
+/// String offset of an absent name or texture.
+#define MESH_CACHE_NO_STRING UINT32_MAX
+
+/// Vertex buffer of the layout at the same index of the vertex descriptor.
+typedef struct mesh_cache_buffer {
+    uint32_t stride;
+    uint32_t reserved;
+    uint64_t length;
+    /// Byte offset of the vertices from the start of the file, set by the cache.
+    uint64_t offset;
+} mesh_cache_buffer;
+
+typedef struct mesh_cache_submesh {
+    /// MDLGeometryType of the indices.
+    uint32_t geometryType;
+    /// Bytes per index, 2 or 4.
+    uint32_t indexSize;
+    uint32_t indexCount;
+    /// Offsets into the strings, or MESH_CACHE_NO_STRING.
+    uint32_t name;
+    uint32_t baseColorTexture;
+    uint32_t specularTexture;
+    /// First cluster and count, the clusters' index offsets are relative to
+    /// the submesh. 0 clusters when the submesh wasn't clustered.
+    uint32_t clusterOffset;
+    uint32_t clusterCount;
+    /// Level of detail, 0 for the full mesh. Levels share its vertices.
+    uint32_t lod;
+    /// Error of the level in model units, 0 for the full mesh.
+    float lodError;
+    /// Byte offset of the first index from the start of the indices.
+    uint64_t indexOffset;
+} mesh_cache_submesh;
+
+typedef struct mesh_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t layoutHash;
+    uint32_t vertexCount;
+    uint32_t bufferCount;
+    uint32_t submeshCount;
+    uint32_t stringsLength;
+    uint32_t clusterCount;
+    uint32_t lodCount;
+    uint64_t indicesLength;
+    float boundsMin[3];
+    float boundsMax[3];
+    /// Byte offsets of the sections from the start of the file.
+    uint64_t buffersOffset;
+    uint64_t submeshesOffset;
+    uint64_t clustersOffset;
+    uint64_t stringsOffset;
+    uint64_t indicesOffset;
+} mesh_cache_header;
+
+/// What a loader fills a new cache with.
+typedef struct mesh_cache_desc {
+    uint64_t sourceHash;
+    uint64_t layoutHash;
+    uint32_t vertexCount;
+    uint32_t bufferCount;
+    /// Stride and length of every vertex buffer, offsets are ignored.
+    const mesh_cache_buffer *buffers;
+    uint32_t submeshCount;
+    const mesh_cache_submesh *submeshes;
+    uint32_t clusterCount;
+    const meshlet *clusters;
+    /// Levels of detail besides the full mesh, the highest lod of a submesh.
+    uint32_t lodCount;
+    uint64_t indicesLength;
+    /// NUL terminated strings back to back, the submeshes point into them.
+    const char *strings;
+    uint32_t stringsLength;
+    float boundsMin[3];
+    float boundsMax[3];
+} mesh_cache_desc;
+
+typedef struct mesh_cache {
+    uint64_t sourceHash;
+    uint64_t layoutHash;
+    uint32_t vertexCount;
+    uint32_t bufferCount;
+    uint32_t submeshCount;
+    uint32_t clusterCount;
+    uint32_t lodCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    const mesh_cache_buffer *buffers;
+    const mesh_cache_submesh *submeshes;
+    const meshlet *clusters;
+    const char *strings;
+    /// Vertices of buffer b, buffers[b].length bytes.
+    void *vertices[MESH_CACHE_MAX_BUFFERS];
+    void *indices;
+    uint64_t indicesLength;
+    /// Header and sections, either allocated or a private file mapping.
+    void *storage;
+    size_t storageSize;
+    bool mapped;
+} mesh_cache;
+
+/// 64-bit xxHash of `length` bytes, the content hash the cache is keyed by.
+uint64_t mesh_cache_hash(const void *bytes, size_t length, uint64_t seed);
+
+/// Returns a cache with the tables, clusters and strings of `desc` and zeroed
+/// vertices and indices to be filled by a loader. Returns NULL if out of
+/// memory or if a submesh points outside the indices, the clusters or the
+/// strings, a cluster outside its submesh, or a submesh has a level of
+/// detail above lodCount.
+mesh_cache *mesh_cache_create(const mesh_cache_desc *desc);
+
+/// Maps the cache file at `path`. Returns NULL if the file can't be mapped, is
+/// not a valid cache or was made from another source or vertex layout. The
+/// mapping is copy-on-write, edits never reach the file.
+mesh_cache *mesh_cache_load(const char *path, uint64_t sourceHash, uint64_t layoutHash);
+
+/// Writes the cache next to `path` and renames it into place, so a concurrent
+/// load sees the old file or the whole new one. Returns false on an I/O error.
+bool mesh_cache_write(const mesh_cache *cache, const char *path);
+
+void mesh_cache_destroy(mesh_cache *cache);
+
+/// Returns the string at `offset`, NULL for MESH_CACHE_NO_STRING.
+const char *mesh_cache_string(const mesh_cache *cache, uint32_t offset);
+
+#endif /* MeshCache_h */
@@ -0,0 +1,270 @@
+//
+//  MeshCache.swift
+//  common
+//
+
+import Foundation
+import Metal
+import MetalKit
+
+/// Binary cache of the meshes the text loaders parse, see MeshCache.h.
+///
+/// A loader hashes its source, asks for the mesh with `load`, and on a miss
+/// parses as before and hands the result to `store`. Files live in the caches
+/// directory and are named by their key. Only the source file is hashed, edits
+/// to files it refers to, such as an OBJ's material library, need the cache
+/// cleared with `removeAll`.
+public enum MeshCache {
+
+    /// Set to false to always parse the sources, for instance to time the loaders.
+    public static var isEnabled = true
+
+    struct Key {
+        let sourceHash: UInt64
+        let layoutHash: UInt64
+    }
+
+    struct Entry {
+        let mesh: MDLMesh
+        let baseColorTextures: [String : URL]
+        let specularTextures: [String : URL]
+        /// Clusters of every submesh, empty for submeshes without.
+        let clusters: [[meshlet]]
+        /// Levels of detail, finest first, indexing the vertices of `mesh`.
+        let lods: [MeshLOD]
+    }
+
+    static var directory: URL? {
+        guard let caches = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first else {
+            return nil
+        }
+        let directory = caches.appendingPathComponent("LearnMetal/Meshes", isDirectory: true)
+        try? FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true, attributes: nil)
+        return directory
+    }
+
+    public static func removeAll() {
+        if let directory = directory {
+            try? FileManager.default.removeItem(at: directory)
+        }
+    }
+
+    /// Keys a source by its content and the vertex layout it is loaded with:
+    /// names, formats, offsets and buffers of the attributes, and the strides.
+    /// `loader` tells apart loaders that turn the same source into different meshes.
+    static func key(source: Data, vertexDescriptor: MDLVertexDescriptor, loader: String) -> Key {
+        let sourceHash = source.withUnsafeBytes { bytes in
+            mesh_cache_hash(bytes.baseAddress, bytes.count, 0)
+        }
+
+        var layout = loader
+        for case let attribute as MDLVertexAttribute in vertexDescriptor.attributes where attribute.format != .invalid {
+            layout += "|\(attribute.name):\(attribute.format.rawValue):\(attribute.offset):\(attribute.bufferIndex)"
+        }
+        for case let bufferLayout as MDLVertexBufferLayout in vertexDescriptor.layouts {
+            layout += "|\(bufferLayout.stride)"
+        }
+        let layoutHash = layout.utf8CString.withUnsafeBytes { bytes in
+            mesh_cache_hash(bytes.baseAddress, bytes.count, 0)
+        }
+        return Key(sourceHash: sourceHash, layoutHash: layoutHash)
+    }
+
+    static func fileURL(for key: Key) -> URL? {
+        return directory?.appendingPathComponent(String(format: "%016llx-%016llx.lmmesh", key.sourceHash, key.layoutHash))
+    }
+
+    /// Maps the cached mesh for `key` and copies it into buffers of `allocator`,
+    /// nil on a miss. Relative texture paths are resolved against `directory`.
+    static func load(_ key: Key,
+                     vertexDescriptor: MDLVertexDescriptor,
+                     allocator: MTKMeshBufferAllocator,
+                     relativeTo directory: URL) -> Entry? {
+        guard isEnabled,
+              let url = fileURL(for: key),
+              let cache = mesh_cache_load(url.path, key.sourceHash, key.layoutHash) else {
+            return nil
+        }
+        defer { mesh_cache_destroy(cache) }
+        let contents = cache.pointee
+
+        // MTKMesh only wraps buffers of its own allocator, so the mapping is
+        // copied once into them; there is nothing to parse or convert
+        let vertexBuffers = (0..<Int(contents.bufferCount)).map { b -> MDLMeshBuffer in
+            let buffer = contents.buffers[b]
+            let bytes = Data(bytesNoCopy: contents.storage.advanced(by: Int(buffer.offset)),
+                             count: Int(buffer.length),
+                             deallocator: .none)
+            return allocator.newBuffer(with: bytes, type: .vertex)
+        }
+
+        func string(_ offset: UInt32) -> String? {
+            return mesh_cache_string(cache, offset).map { String(cString: $0) }
+        }
+        func textureURL(_ offset: UInt32) -> URL? {
+            return string(offset).map { path in
+                path.hasPrefix("/") ? URL(fileURLWithPath: path) : directory.appendingPathComponent(path)
+            }
+        }
+
+        var baseColorTextures: [String : URL] = [:]
+        var specularTextures: [String : URL] = [:]
+        var submeshes: [MDLSubmesh] = []
+        var clusters: [[meshlet]] = []
+        var lodSubmeshes = [[MDLSubmesh]](repeating: [], count: Int(contents.lodCount))
+        var lodErrors = [Float](repeating: 0, count: Int(contents.lodCount))
+        for s in 0..<Int(contents.submeshCount) {
+            let info = contents.submeshes[s]
+            let bytes = Data(bytesNoCopy: contents.indices.advanced(by: Int(info.indexOffset)),
+                             count: Int(info.indexCount) * Int(info.indexSize),
+                             deallocator: .none)
+            let submesh = MDLSubmesh(indexBuffer: allocator.newBuffer(with: bytes, type: .index),
+                                     indexCount: Int(info.indexCount),
+                                     indexType: info.indexSize == 2 ? .uInt16 : .uInt32,
+                                     geometryType: MDLGeometryType(rawValue: Int(info.geometryType)) ?? .triangles,
+                                     material: nil)
+            submesh.name = string(info.name) ?? ""
+            if info.lod > 0 {
+                lodSubmeshes[Int(info.lod) - 1].append(submesh)
+                lodErrors[Int(info.lod) - 1] = info.lodError
+                continue
+            }
+            clusters.append(Array(UnsafeBufferPointer(start: contents.clusters.advanced(by: Int(info.clusterOffset)),
+                                                      count: Int(info.clusterCount))))
+            baseColorTextures[submesh.name] = textureURL(info.baseColorTexture)
+            specularTextures[submesh.name] = textureURL(info.specularTexture)
+            submeshes.append(submesh)
+        }
+
+        let mesh = MDLMesh(vertexBuffers: vertexBuffers,
+                           vertexCount: Int(contents.vertexCount),
+                           descriptor: vertexDescriptor,
+                           submeshes: submeshes)
+        return Entry(mesh: mesh,
+                     baseColorTextures: baseColorTextures,
+                     specularTextures: specularTextures,
+                     clusters: clusters,
+                     lods: zip(lodErrors, lodSubmeshes).map { MeshLOD(error: $0, submeshes: $1) })
+    }
+
+    /// Writes `mesh` to the cache under `key`, with the clusters of each
+    /// submesh if it has any and its levels of detail. Texture paths inside `directory` are stored
+    /// relative to it, so the cache survives the app moving. Failures are
+    /// ignored, the next launch parses the source again.
+    static func store(_ mesh: MDLMesh,
+                      key: Key,
+                      baseColorTextures: [String : URL] = [:],
+                      specularTextures: [String : URL] = [:],
+                      clusters: [[meshlet]] = [],
+                      lods: [MeshLOD] = [],
+                      relativeTo directory: URL) {
+        guard isEnabled,
+              let url = fileURL(for: key),
+              let submeshes = mesh.submeshes as? [MDLSubmesh],
+              mesh.vertexCount <= Int(UInt32.max) else {
+            return
+        }
+
+        // MESH_CACHE_NO_STRING
+        let noString = UInt32.max
+        var strings: [CChar] = []
+        func addString(_ string: String?) -> UInt32 {
+            guard let string = string else {
+                return noString
+            }
+            let offset = UInt32(strings.count)
+            strings.append(contentsOf: string.utf8CString)
+            return offset
+        }
+        let base = directory.standardizedFileURL.path + "/"
+        func addTexture(_ textureURL: URL?) -> UInt32 {
+            guard let path = textureURL?.standardizedFileURL.path else {
+                return noString
+            }
+            return addString(path.hasPrefix(base) ? String(path.dropFirst(base.count)) : path)
+        }
+
+        var buffers: [mesh_cache_buffer] = []
+        for (i, vertexBuffer) in mesh.vertexBuffers.enumerated() {
+            guard let layout = mesh.vertexDescriptor.layouts[i] as? MDLVertexBufferLayout else {
+                return
+            }
+            buffers.append(mesh_cache_buffer(stride: UInt32(layout.stride), reserved: 0,
+                                             length: UInt64(vertexBuffer.length), offset: 0))
+        }
+
+        // levels follow the full mesh, their submeshes only need a name
+        var allSubmeshes: [(submesh: MDLSubmesh, lod: UInt32, error: Float)] = submeshes.map { ($0, 0, 0) }
+        for (l, lod) in lods.enumerated() {
+            allSubmeshes += lod.submeshes.map { ($0, UInt32(l + 1), lod.error) }
+        }
+
+        var cacheSubmeshes: [mesh_cache_submesh] = []
+        var cacheClusters: [meshlet] = []
+        var indicesLength: UInt64 = 0
+        for (s, (submesh, lod, lodError)) in allSubmeshes.enumerated() {
+            let indexSize = UInt32(submesh.indexType.rawValue / 8)
+            if indexSize != 2 && indexSize != 4 {
+                return
+            }
+            let clusterOffset = UInt32(cacheClusters.count)
+            if lod == 0 && s < clusters.count {
+                cacheClusters.append(contentsOf: clusters[s])
+            }
+            cacheSubmeshes.append(mesh_cache_submesh(geometryType: UInt32(submesh.geometryType.rawValue),
+                                                     indexSize: indexSize,
+                                                     indexCount: UInt32(submesh.indexCount),
+                                                     name: addString(submesh.name),
+                                                     baseColorTexture: lod == 0 ? addTexture(baseColorTextures[submesh.name]) : noString,
+                                                     specularTexture: lod == 0 ? addTexture(specularTextures[submesh.name]) : noString,
+                                                     clusterOffset: clusterOffset,
+                                                     clusterCount: UInt32(cacheClusters.count) - clusterOffset,
+                                                     lod: lod,
+                                                     lodError: lodError,
+                                                     indexOffset: indicesLength))
+            indicesLength = (indicesLength + UInt64(submesh.indexCount) * UInt64(indexSize) + 15) & ~15
+        }
+
+        let bounds = mesh.boundingBox
+        let created = buffers.withUnsafeBufferPointer { buffersPointer in
+            cacheSubmeshes.withUnsafeBufferPointer { submeshesPointer in
+                cacheClusters.withUnsafeBufferPointer { clustersPointer in
+                    strings.withUnsafeBufferPointer { stringsPointer -> UnsafeMutablePointer<mesh_cache>? in
+                        var desc = mesh_cache_desc(sourceHash: key.sourceHash,
+                                                   layoutHash: key.layoutHash,
+                                                   vertexCount: UInt32(mesh.vertexCount),
+                                                   bufferCount: UInt32(buffersPointer.count),
+                                                   buffers: buffersPointer.baseAddress,
+                                                   submeshCount: UInt32(submeshesPointer.count),
+                                                   submeshes: submeshesPointer.baseAddress,
+                                                   clusterCount: UInt32(clustersPointer.count),
+                                                   clusters: clustersPointer.baseAddress,
+                                                   lodCount: UInt32(lods.count),
+                                                   indicesLength: indicesLength,
+                                                   strings: stringsPointer.baseAddress,
+                                                   stringsLength: UInt32(stringsPointer.count),
+                                                   boundsMin: (bounds.minBounds.x, bounds.minBounds.y, bounds.minBounds.z),
+                                                   boundsMax: (bounds.maxBounds.x, bounds.maxBounds.y, bounds.maxBounds.z))
+                        return mesh_cache_create(&desc)
+                    }
+                }
+            }
+        }
+        guard let cache = created else {
+            return
+        }
+        defer { mesh_cache_destroy(cache) }
+
+        let contents = cache.pointee
+        for (b, vertexBuffer) in mesh.vertexBuffers.enumerated() {
+            contents.storage.advanced(by: Int(contents.buffers[b].offset))
+                .copyMemory(from: vertexBuffer.map().bytes, byteCount: vertexBuffer.length)
+        }
+        for (s, (submesh, _, _)) in allSubmeshes.enumerated() {
+            let info = cacheSubmeshes[s]
+            contents.indices.advanced(by: Int(info.indexOffset))
+                .copyMemory(from: submesh.indexBuffer.map().bytes, byteCount: Int(info.indexCount) * Int(info.indexSize))
+        }
+        _ = mesh_cache_write(cache, url.path)
+    }
+}
@@ -0,0 +1,413 @@
+//
+//  MeshOptimizer.c
+//  common
+//
+
+#include "MeshOptimizer.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Forsyth's scoring model: an LRU cache of 32 entries, the last triangle's
+// vertices scored flat, and a valence boost so lone triangles go early
+// instead of being stranded.
+enum { ScoreCacheSize = 32, MaxScoredValence = 32 };
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+static const uint32_t NoTriangle = UINT32_MAX;
+
+typedef struct score_tables {
+    float cache[ScoreCacheSize];
+    float valence[MaxScoredValence + 1];
+} score_tables;
+
+static void make_score_tables(score_tables *tables) {
+    for (int i = 0; i < ScoreCacheSize; i++) {
+        tables->cache[i] = i < 3 ? LastTriangleScore
+                                 : powf(1.0f - (float)(i - 3) / (ScoreCacheSize - 3), CacheDecayPower);
+    }
+    tables->valence[0] = 0.0f;
+    for (int v = 1; v <= MaxScoredValence; v++) {
+        tables->valence[v] = ValenceBoostScale * powf((float)v, -ValenceBoostPower);
+    }
+}
+
+static inline float vertex_score(const score_tables *tables, int32_t cachePosition, uint32_t valence) {
+    // a vertex without triangles left doesn't affect any score
+    if (valence == 0) return 0.0f;
+    float score = cachePosition >= 0 ? tables->cache[cachePosition] : 0.0f;
+    return score + tables->valence[valence < MaxScoredValence ? valence : MaxScoredValence];
+}
+
+// Returns `indices`, or a copy of it when the output overwrites it.
+static const uint32_t *input_indices(const uint32_t *indices, uint32_t *destination, size_t indexCount, uint32_t **copy) {
+    *copy = NULL;
+    if (destination != indices) return indices;
+    *copy = malloc(sizeof(uint32_t) * indexCount);
+    if (*copy) memcpy(*copy, indices, sizeof(uint32_t) * indexCount);
+    return *copy;
+}
+
+mesh_vertex_cache_stats mesh_analyze_vertex_cache(const uint32_t *indices,
+                                                  size_t indexCount,
+                                                  size_t vertexCount,
+                                                  uint32_t cacheSize) {
+    mesh_vertex_cache_stats stats = { 0 };
+    uint32_t *timestamps = calloc(vertexCount ? vertexCount : 1, sizeof(uint32_t));
+    if (!timestamps) return stats;
+
+    // FIFO by timestamps: a vertex is cached while fewer than cacheSize
+    // misses happened since its own, a zero timestamp was never used
+    uint32_t timestamp = cacheSize + 1;
+    uint32_t unique = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t v = indices[i];
+        if (timestamp - timestamps[v] > cacheSize) {
+            unique += timestamps[v] == 0;
+            timestamps[v] = timestamp++;
+            stats.transformedVertices++;
+        }
+    }
+    free(timestamps);
+
+    size_t triangleCount = indexCount / 3;
+    stats.acmr = triangleCount ? (float)stats.transformedVertices / triangleCount : 0.0f;
+    stats.atvr = unique ? (float)stats.transformedVertices / unique : 0.0f;
+    return stats;
+}
+
+bool mesh_optimize_vertex_cache(uint32_t *destination,
+                                const uint32_t *indices,
+                                size_t indexCount,
+                                size_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return true;
+
+    uint32_t *copy;
+    const uint32_t *input = input_indices(indices, destination, indexCount, &copy);
+    uint32_t *valences = calloc(vertexCount, sizeof(uint32_t));
+    uint32_t *adjacencyStarts = malloc(sizeof(uint32_t) * vertexCount);
+    uint32_t *adjacency = malloc(sizeof(uint32_t) * triangleCount * 3);
+    int32_t *cachePositions = malloc(sizeof(int32_t) * vertexCount);
+    float *vertexScores = malloc(sizeof(float) * vertexCount);
+    float *triangleScores = malloc(sizeof(float) * triangleCount);
+    uint8_t *emitted = calloc(triangleCount, 1);
+    bool ok = input && valences && adjacencyStarts && adjacency && cachePositions && vertexScores && triangleScores && emitted;
+
+    if (ok) {
+        score_tables tables;
+        make_score_tables(&tables);
+
+        // triangles of every vertex, valences count the ones not yet emitted
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            valences[input[i]]++;
+        }
+        uint32_t start = 0;
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStarts[v] = start;
+            start += valences[v];
+            valences[v] = 0;
+        }
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = input[t * 3 + k];
+                adjacency[adjacencyStarts[v] + valences[v]++] = (uint32_t)t;
+            }
+        }
+
+        for (size_t v = 0; v < vertexCount; v++) {
+            cachePositions[v] = -1;
+            vertexScores[v] = vertex_score(&tables, -1, valences[v]);
+        }
+        uint32_t best = NoTriangle;
+        float bestScore = -1.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const uint32_t *tri = input + t * 3;
+            triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+            if (triangleScores[t] > bestScore) {
+                bestScore = triangleScores[t];
+                best = (uint32_t)t;
+            }
+        }
+
+        uint32_t cache[ScoreCacheSize + 3];
+        uint32_t newCache[ScoreCacheSize + 3];
+        int cacheCount = 0;
+        size_t deadEndCursor = 0;
+
+        for (size_t out = 0; out < triangleCount; out++) {
+            if (best == NoTriangle) {
+                // nothing in the cache has triangles left, restart at the
+                // next triangle in input order
+                while (emitted[deadEndCursor]) deadEndCursor++;
+                best = (uint32_t)deadEndCursor;
+            }
+
+            const uint32_t *tri = input + (size_t)best * 3;
+            memcpy(destination + out * 3, tri, sizeof(uint32_t) * 3);
+            emitted[best] = 1;
+
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = tri[k];
+                uint32_t *triangles = adjacency + adjacencyStarts[v];
+                uint32_t count = valences[v];
+                for (uint32_t j = 0; j < count; j++) {
+                    if (triangles[j] == best) {
+                        triangles[j] = triangles[count - 1];
+                        break;
+                    }
+                }
+                valences[v] = count - 1;
+            }
+
+            // the triangle's vertices move to the front, the rest shift back
+            int newCount = 0;
+            newCache[newCount++] = tri[0];
+            newCache[newCount++] = tri[1];
+            newCache[newCount++] = tri[2];
+            for (int i = 0; i < cacheCount; i++) {
+                uint32_t v = cache[i];
+                if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                    newCache[newCount++] = v;
+                }
+            }
+
+            // rescore the vertices that moved, fell out or lost a triangle,
+            // and carry the change to their remaining triangles
+            for (int i = 0; i < newCount; i++) {
+                uint32_t v = newCache[i];
+                cachePositions[v] = i < ScoreCacheSize ? i : -1;
+                float score = vertex_score(&tables, cachePositions[v], valences[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                const uint32_t *triangles = adjacency + adjacencyStarts[v];
+                for (uint32_t j = 0; j < valences[v]; j++) {
+                    triangleScores[triangles[j]] += delta;
+                }
+            }
+
+            // the next triangle is the best one touching the cache
+            best = NoTriangle;
+            bestScore = -1.0f;
+            cacheCount = newCount < ScoreCacheSize ? newCount : ScoreCacheSize;
+            for (int i = 0; i < cacheCount; i++) {
+                uint32_t v = newCache[i];
+                cache[i] = v;
+                const uint32_t *triangles = adjacency + adjacencyStarts[v];
+                for (uint32_t j = 0; j < valences[v]; j++) {
+                    uint32_t t = triangles[j];
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        best = t;
+                    }
+                }
+            }
+        }
+    }
+
+    free(emitted);
+    free(triangleScores);
+    free(vertexScores);
+    free(cachePositions);
+    free(adjacency);
+    free(adjacencyStarts);
+    free(valences);
+    free(copy);
+    return ok;
+}
+
+typedef struct cluster_key {
+    float key;
+    uint32_t cluster;
+} cluster_key;
+
+static int compare_cluster_keys(const void *a, const void *b) {
+    const cluster_key *x = a;
+    const cluster_key *y = b;
+    // descending keys, input order among equals so the result is deterministic
+    if (x->key != y->key) return x->key > y->key ? -1 : 1;
+    return x->cluster < y->cluster ? -1 : (x->cluster > y->cluster);
+}
+
+static inline void load_position(float p[3], const void *positions, size_t stride, uint32_t v) {
+    memcpy(p, (const char *)positions + (size_t)v * stride, sizeof(float) * 3);
+}
+
+// Misses of one triangle against the FIFO of mesh_analyze_vertex_cache.
+static inline uint32_t simulate_triangle(const uint32_t *tri, uint32_t *timestamps, uint32_t *timestamp) {
+    uint32_t misses = 0;
+    for (int k = 0; k < 3; k++) {
+        uint32_t v = tri[k];
+        if (*timestamp - timestamps[v] > MESH_OPTIMIZER_FIFO_SIZE) {
+            timestamps[v] = (*timestamp)++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+bool mesh_optimize_overdraw(uint32_t *destination,
+                            const uint32_t *indices,
+                            size_t indexCount,
+                            const void *positions,
+                            size_t positionStride,
+                            size_t vertexCount,
+                            float threshold) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return true;
+
+    uint32_t *copy;
+    const uint32_t *input = input_indices(indices, destination, indexCount, &copy);
+    uint32_t *timestamps = calloc(vertexCount, sizeof(uint32_t));
+    uint32_t *hardStarts = malloc(sizeof(uint32_t) * (triangleCount + 1));
+    uint32_t *clusterStarts = malloc(sizeof(uint32_t) * (triangleCount + 1));
+    cluster_key *keys = malloc(sizeof(cluster_key) * triangleCount);
+    bool ok = input && timestamps && hardStarts && clusterStarts && keys;
+
+    if (ok) {
+        const uint32_t flush = MESH_OPTIMIZER_FIFO_SIZE + 1;
+
+        // hard boundaries where a triangle misses on all three vertices, the
+        // cache was flushed there anyway
+        uint32_t timestamp = flush;
+        size_t hardCount = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (simulate_triangle(input + t * 3, timestamps, &timestamp) == 3 || t == 0) {
+                hardStarts[hardCount++] = (uint32_t)t;
+            }
+        }
+        hardStarts[hardCount] = (uint32_t)triangleCount;
+
+        // soft boundaries inside a hard cluster, wherever the run so far is
+        // within threshold of the whole cluster's ACMR; every run starts cold
+        // since it won't follow its neighbour once sorted
+        size_t clusterCount = 0;
+        for (size_t h = 0; h < hardCount; h++) {
+            uint32_t begin = hardStarts[h];
+            uint32_t end = hardStarts[h + 1];
+
+            timestamp += flush;
+            uint32_t misses = 0;
+            for (uint32_t t = begin; t < end; t++) {
+                misses += simulate_triangle(input + (size_t)t * 3, timestamps, &timestamp);
+            }
+            float clusterThreshold = threshold * (float)misses / (float)(end - begin);
+
+            timestamp += flush;
+            uint32_t runStart = begin;
+            uint32_t runMisses = 0;
+            clusterStarts[clusterCount++] = begin;
+            for (uint32_t t = begin; t < end; t++) {
+                runMisses += simulate_triangle(input + (size_t)t * 3, timestamps, &timestamp);
+                if (t + 1 < end && (float)runMisses <= clusterThreshold * (float)(t + 1 - runStart)) {
+                    clusterStarts[clusterCount++] = t + 1;
+                    runStart = t + 1;
+                    runMisses = 0;
+                    timestamp += flush;
+                }
+            }
+        }
+        clusterStarts[clusterCount] = (uint32_t)triangleCount;
+
+        float meshCentroid[3] = { 0, 0, 0 };
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            float p[3];
+            load_position(p, positions, positionStride, input[i]);
+            meshCentroid[0] += p[0];
+            meshCentroid[1] += p[1];
+            meshCentroid[2] += p[2];
+        }
+        for (int k = 0; k < 3; k++) {
+            meshCentroid[k] /= (float)(triangleCount * 3);
+        }
+
+        // runs that face away from the centre and sit far out are drawn first
+        for (size_t c = 0; c < clusterCount; c++) {
+            float centroid[3] = { 0, 0, 0 };
+            float normal[3] = { 0, 0, 0 };
+            float area = 0.0f;
+            for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+                float a[3], b[3], p[3];
+                load_position(a, positions, positionStride, input[(size_t)t * 3]);
+                load_position(b, positions, positionStride, input[(size_t)t * 3 + 1]);
+                load_position(p, positions, positionStride, input[(size_t)t * 3 + 2]);
+                float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                float e1[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+                float n[3] = {
+                    e0[1] * e1[2] - e0[2] * e1[1],
+                    e0[2] * e1[0] - e0[0] * e1[2],
+                    e0[0] * e1[1] - e0[1] * e1[0],
+                };
+                float triangleArea = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int k = 0; k < 3; k++) {
+                    centroid[k] += (a[k] + b[k] + p[k]) * (1.0f / 3.0f) * triangleArea;
+                    normal[k] += n[k];
+                }
+                area += triangleArea;
+            }
+            float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            float key = 0.0f;
+            if (area > 0.0f && normalLength > 0.0f) {
+                for (int k = 0; k < 3; k++) {
+                    key += (centroid[k] / area - meshCentroid[k]) * normal[k] / normalLength;
+                }
+            }
+            keys[c].key = key;
+            keys[c].cluster = (uint32_t)c;
+        }
+        qsort(keys, clusterCount, sizeof(cluster_key), compare_cluster_keys);
+
+        uint32_t *out = destination;
+        for (size_t c = 0; c < clusterCount; c++) {
+            uint32_t cluster = keys[c].cluster;
+            size_t count = (size_t)(clusterStarts[cluster + 1] - clusterStarts[cluster]) * 3;
+            memcpy(out, input + (size_t)clusterStarts[cluster] * 3, sizeof(uint32_t) * count);
+            out += count;
+        }
+    }
+
+    free(keys);
+    free(clusterStarts);
+    free(hardStarts);
+    free(timestamps);
+    free(copy);
+    return ok;
+}
+
+size_t mesh_optimize_vertex_fetch_remap(uint32_t *remap,
+                                        const uint32_t *indices,
+                                        size_t indexCount,
+                                        size_t vertexCount) {
+    memset(remap, 0xFF, sizeof(uint32_t) * vertexCount);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = next++;
+        }
+    }
+    return next;
+}
+
+void mesh_remap_vertices(void *destination,
+                         const void *vertices,
+                         size_t vertexCount,
+                         size_t stride,
+                         const uint32_t *remap) {
+    char *out = destination;
+    const char *in = vertices;
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] != UINT32_MAX) {
+            memcpy(out + (size_t)remap[v] * stride, in + v * stride, stride);
+        }
+    }
+}
+
+void mesh_remap_indices(uint32_t *destination, const uint32_t *indices, size_t indexCount, const uint32_t *remap) {
+    for (size_t i = 0; i < indexCount; i++) {
+        destination[i] = remap[indices[i]];
+    }
+}
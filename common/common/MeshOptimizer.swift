@@ -0,0 +1,182 @@
+//
+//  MeshOptimizer.swift
+//  common
+//
+
+import Foundation
+import ModelIO
+
+/// Runs the stages of MeshOptimizer.h over an imported MDLMesh: every
+/// triangle submesh is reordered for the vertex cache and for overdraw, then
+/// the vertices of all submeshes are renumbered by first use.
+@objc
+public class MeshOptimizer: NSObject {
+
+    /// ACMR a triangle run may reach relative to its cluster before the
+    /// overdraw stage cuts it, 1 keeps the vertex cache order as it is.
+    @objc
+    public static var overdrawThreshold: Float = 1.05
+
+    /// Returns the optimized copy of `mesh` with buffers from `allocator`.
+    /// Submeshes keep their names, materials and index types, non-triangle
+    /// submeshes keep their order. Returns `mesh` if there is nothing to do or
+    /// out of memory.
+    @objc
+    public class func optimize(_ mesh: MDLMesh, allocator: MDLMeshBufferAllocator) -> MDLMesh {
+        guard let submeshes = mesh.submeshes as? [MDLSubmesh], !submeshes.isEmpty, mesh.vertexCount > 0 else {
+            return mesh
+        }
+        let vertexCount = mesh.vertexCount
+
+        // overdraw sorting needs float positions, without them only the cache order runs
+        var positionMap: MDLMeshBufferMap? = nil
+        var positionOffset = 0
+        var positionStride = 0
+        if let position = mesh.vertexDescriptor.attributeNamed(MDLVertexAttributePosition),
+           position.format == .float3 || position.format == .float4,
+           position.bufferIndex < mesh.vertexBuffers.count,
+           let layout = mesh.vertexDescriptor.layouts[position.bufferIndex] as? MDLVertexBufferLayout {
+            positionMap = mesh.vertexBuffers[position.bufferIndex].map()
+            positionOffset = position.offset
+            positionStride = layout.stride
+        }
+
+        var submeshIndices: [[UInt32]] = []
+        for submesh in submeshes {
+            let indexMap = submesh.indexBuffer(asIndexType: .uInt32).map()
+            var indices = Array(UnsafeBufferPointer(start: indexMap.bytes.assumingMemoryBound(to: UInt32.self),
+                                                    count: submesh.indexCount))
+
+            if submesh.geometryType == .triangles {
+                let optimized = indices.withUnsafeMutableBufferPointer { buffer -> Bool in
+                    guard mesh_optimize_vertex_cache(buffer.baseAddress, buffer.baseAddress, buffer.count, vertexCount) else {
+                        return false
+                    }
+                    guard let positionMap = positionMap else {
+                        return true
+                    }
+                    return mesh_optimize_overdraw(buffer.baseAddress, buffer.baseAddress, buffer.count,
+                                                  positionMap.bytes.advanced(by: positionOffset), positionStride,
+                                                  vertexCount, overdrawThreshold)
+                }
+                if !optimized {
+                    return mesh
+                }
+            }
+            submeshIndices.append(indices)
+        }
+
+        let allIndices = submeshIndices.flatMap { $0 }
+        var remap = [UInt32](repeating: 0, count: vertexCount)
+        let usedCount = mesh_optimize_vertex_fetch_remap(&remap, allIndices, allIndices.count, vertexCount)
+
+        var vertexBuffers: [MDLMeshBuffer] = []
+        for (b, vertexBuffer) in mesh.vertexBuffers.enumerated() {
+            guard let layout = mesh.vertexDescriptor.layouts[b] as? MDLVertexBufferLayout, layout.stride > 0 else {
+                return mesh
+            }
+            let optimized = allocator.newBuffer(usedCount * layout.stride, type: .vertex)
+            let source = vertexBuffer.map()
+            let destination = optimized.map()
+            mesh_remap_vertices(destination.bytes, source.bytes, vertexCount, layout.stride, remap)
+            vertexBuffers.append(optimized)
+        }
+
+        var optimizedSubmeshes: [MDLSubmesh] = []
+        for (submesh, var indices) in zip(submeshes, submeshIndices) {
+            indices.withUnsafeMutableBufferPointer { buffer in
+                mesh_remap_indices(buffer.baseAddress, buffer.baseAddress, buffer.count, remap)
+            }
+            let indexData: Data
+            let indexType: MDLIndexBitDepth
+            if submesh.indexType == .uInt32 {
+                indexData = Data(bytes: indices, count: MemoryLayout<UInt32>.stride * indices.count)
+                indexType = .uInt32
+            } else {
+                // fewer vertices than before, so the narrow type still addresses all
+                let narrow = indices.map { UInt16(truncatingIfNeeded: $0) }
+                indexData = Data(bytes: narrow, count: MemoryLayout<UInt16>.stride * narrow.count)
+                indexType = .uInt16
+            }
+            optimizedSubmeshes.append(MDLSubmesh(name: submesh.name,
+                                                 indexBuffer: allocator.newBuffer(with: indexData, type: .index),
+                                                 indexCount: indices.count,
+                                                 indexType: indexType,
+                                                 geometryType: submesh.geometryType,
+                                                 material: submesh.material))
+        }
+
+        return MDLMesh(vertexBuffers: vertexBuffers,
+                       vertexCount: usedCount,
+                       descriptor: mesh.vertexDescriptor,
+                       submeshes: optimizedSubmeshes)
+    }
+
+    /// Returns `mesh` with the indices of every triangle submesh regrouped into
+    /// clusters, see Meshlet.h, and the clusters of each submesh, empty for
+    /// the others. Returns `mesh` without clusters if out of memory.
+    public class func buildClusters(_ mesh: MDLMesh, allocator: MDLMeshBufferAllocator) -> (mesh: MDLMesh, clusters: [[meshlet]]) {
+        guard let submeshes = mesh.submeshes as? [MDLSubmesh],
+              let position = mesh.vertexDescriptor.attributeNamed(MDLVertexAttributePosition),
+              position.format == .float3 || position.format == .float4,
+              position.bufferIndex < mesh.vertexBuffers.count,
+              let layout = mesh.vertexDescriptor.layouts[position.bufferIndex] as? MDLVertexBufferLayout else {
+            return (mesh, [])
+        }
+        let positionMap = mesh.vertexBuffers[position.bufferIndex].map()
+        let positions = positionMap.bytes.advanced(by: position.offset)
+
+        var clusteredSubmeshes: [MDLSubmesh] = []
+        var clusters: [[meshlet]] = []
+        for submesh in submeshes {
+            guard submesh.geometryType == .triangles else {
+                clusteredSubmeshes.append(submesh)
+                clusters.append([])
+                continue
+            }
+            let indexMap = submesh.indexBuffer(asIndexType: .uInt32).map()
+            let indices = indexMap.bytes.assumingMemoryBound(to: UInt32.self)
+            var regrouped = [UInt32](repeating: 0, count: submesh.indexCount)
+            var submeshClusters = [meshlet](repeating: meshlet(), count: meshlet_bound(submesh.indexCount))
+            let clusterCount = meshlet_build(&submeshClusters, &regrouped, indices, submesh.indexCount,
+                                             positions, layout.stride, mesh.vertexCount)
+            if clusterCount == 0 && submesh.indexCount >= 3 {
+                return (mesh, [])
+            }
+            submeshClusters.removeSubrange(clusterCount...)
+
+            let indexData: Data
+            if submesh.indexType == .uInt32 {
+                indexData = Data(bytes: regrouped, count: MemoryLayout<UInt32>.stride * regrouped.count)
+            } else {
+                let narrow = regrouped.map { UInt16(truncatingIfNeeded: $0) }
+                indexData = Data(bytes: narrow, count: MemoryLayout<UInt16>.stride * narrow.count)
+            }
+            clusteredSubmeshes.append(MDLSubmesh(name: submesh.name,
+                                                 indexBuffer: allocator.newBuffer(with: indexData, type: .index),
+                                                 indexCount: regrouped.count,
+                                                 indexType: submesh.indexType == .uInt32 ? .uInt32 : .uInt16,
+                                                 geometryType: .triangles,
+                                                 material: submesh.material))
+            clusters.append(submeshClusters)
+        }
+
+        let clustered = MDLMesh(vertexBuffers: mesh.vertexBuffers,
+                                vertexCount: mesh.vertexCount,
+                                descriptor: mesh.vertexDescriptor,
+                                submeshes: clusteredSubmeshes)
+        return (clustered, clusters)
+    }
+
+    /// Statistics of a FIFO cache of `cacheSize` entries drawing every submesh
+    /// of `mesh` one after the other, MESH_OPTIMIZER_FIFO_SIZE is the usual size.
+    @objc
+    public class func vertexCacheStatistics(of mesh: MDLMesh, cacheSize: UInt32) -> mesh_vertex_cache_stats {
+        let indices = (mesh.submeshes as? [MDLSubmesh] ?? []).flatMap { submesh -> [UInt32] in
+            let indexMap = submesh.indexBuffer(asIndexType: .uInt32).map()
+            return Array(UnsafeBufferPointer(start: indexMap.bytes.assumingMemoryBound(to: UInt32.self),
+                                             count: submesh.indexCount))
+        }
+        return mesh_analyze_vertex_cache(indices, indices.count, mesh.vertexCount, cacheSize)
+    }
+}
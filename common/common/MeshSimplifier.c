@@ -0,0 +1,563 @@
+//
+//  MeshSimplifier.c
+//  common
+//
+
+#include "MeshSimplifier.h"
+#include "VertexWeld.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A collapse may turn a surviving triangle by up to about 75 degrees, more
+// and it folds over its neighbours or turns into a sliver.
+static const float MinNormalCosine = 0.25f;
+
+// Vertices of one position a collapse moves at once, more and the position
+// is too complex to collapse.
+enum { MaxSplitVertices = 16 };
+
+// Symmetric plane matrix sum, aa bb cc ab ac bc ad bd cd dd, and the area it
+// was weighted by. Doubles: errors are tiny differences of large sums.
+typedef struct quadric {
+    double m[10];
+    double weight;
+} quadric;
+
+// Squared deviation of one attribute from the linear field of the triangles
+// it was summed from, a quadric over (x, y, z, attribute), after "New
+// Quadric Metric for Simplifying Meshes with Appearance Attributes", Hoppe 1999.
+typedef struct attribute_quadric {
+    double a[10];
+    double b[4];
+    double c;
+} attribute_quadric;
+
+typedef struct collapse {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+} collapse;
+
+static void quadric_add_plane(quadric *q, double a, double b, double c, double d, double weight) {
+    q->m[0] += weight * a * a;
+    q->m[1] += weight * b * b;
+    q->m[2] += weight * c * c;
+    q->m[3] += weight * a * b;
+    q->m[4] += weight * a * c;
+    q->m[5] += weight * b * c;
+    q->m[6] += weight * a * d;
+    q->m[7] += weight * b * d;
+    q->m[8] += weight * c * d;
+    q->m[9] += weight * d * d;
+    q->weight += weight;
+}
+
+// Area weighted mean squared distance of p to the planes of q plus r.
+static double quadric_error(const quadric *q, const quadric *r, const float p[3]) {
+    double m[10];
+    for (int i = 0; i < 10; i++) {
+        m[i] = q->m[i] + r->m[i];
+    }
+    double weight = q->weight + r->weight;
+    double x = p[0], y = p[1], z = p[2];
+    double error = m[0] * x * x + m[1] * y * y + m[2] * z * z
+                 + 2.0 * (m[3] * x * y + m[4] * x * z + m[5] * y * z)
+                 + 2.0 * (m[6] * x + m[7] * y + m[8] * z)
+                 + m[9];
+    return weight > 0.0 ? fabs(error) / weight : 0.0;
+}
+
+static void attribute_quadric_add(attribute_quadric *q, const double v[4], double d, double weight) {
+    int i = 0;
+    for (int r = 0; r < 4; r++) {
+        for (int c = r; c < 4; c++) {
+            q->a[i++] += weight * v[r] * v[c];
+        }
+        q->b[r] += weight * d * v[r];
+    }
+    q->c += weight * d * d;
+}
+
+static double attribute_quadric_error(const attribute_quadric *q, const attribute_quadric *r, const double x[4]) {
+    double error = q->c + r->c;
+    int i = 0;
+    for (int row = 0; row < 4; row++) {
+        for (int col = row; col < 4; col++, i++) {
+            error += (row == col ? 1.0 : 2.0) * (q->a[i] + r->a[i]) * x[row] * x[col];
+        }
+        error += 2.0 * (q->b[row] + r->b[row]) * x[row];
+    }
+    return fabs(error);
+}
+
+static void triangle_normal(float n[3], const float *a, const float *b, const float *c) {
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static int compare_collapses(const void *a, const void *b) {
+    float x = ((const collapse *)a)->cost, y = ((const collapse *)b)->cost;
+    return (x > y) - (x < y);
+}
+
+static inline uint64_t edge_key(uint32_t a, uint32_t b) {
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+// Working state of one simplification. Positions are welded into groups,
+// one per distinct position, and collapses move whole groups.
+typedef struct simplifier {
+    uint32_t *indices;
+    size_t triangleCount;
+    /// Positions scaled to a unit extent, per group.
+    float *positions;
+    uint32_t *group;
+    size_t groupCount;
+    /// Attribute floats of every vertex, scaled by the square root of their
+    /// weight, and their quadrics, attributeFloats per vertex.
+    float *attributes;
+    size_t attributeFloats;
+    attribute_quadric *attributeQuadrics;
+    /// Area the attribute quadrics of every vertex were weighted by.
+    double *attributeWeights;
+    quadric *quadrics;
+    uint8_t *locked;
+    /// Triangles around every group, compressed rows rebuilt every pass.
+    uint32_t *offsets;
+    uint32_t *adjacency;
+    uint8_t *removed;
+    /// Pass in which a group was last part of a collapse.
+    uint32_t *stamps;
+} simplifier;
+
+static float attribute_distance(const simplifier *s, uint32_t a, uint32_t b) {
+    const float *x = s->attributes + (size_t)a * s->attributeFloats;
+    const float *y = s->attributes + (size_t)b * s->attributeFloats;
+    float distance = 0.0f;
+    for (size_t k = 0; k < s->attributeFloats; k++) {
+        distance += (x[k] - y[k]) * (x[k] - y[k]);
+    }
+    return distance;
+}
+
+// Finds the vertices of group `from` and for each the vertex of group `to`
+// it shares a triangle with, the closest in attributes when there are
+// several. Returns the count, 0 when a vertex has no partner.
+static size_t find_partners(const simplifier *s, uint32_t from, uint32_t to,
+                            uint32_t vertices[MaxSplitVertices], uint32_t partners[MaxSplitVertices]) {
+    size_t count = 0;
+    float distances[MaxSplitVertices];
+    for (uint32_t a = s->offsets[from]; a < s->offsets[from + 1]; a++) {
+        const uint32_t *triangle = s->indices + (size_t)s->adjacency[a] * 3;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            if (s->group[v] != from) continue;
+            size_t slot = 0;
+            while (slot < count && vertices[slot] != v) slot++;
+            if (slot == count) {
+                if (count == MaxSplitVertices) return 0;
+                vertices[count] = v;
+                partners[count] = UINT32_MAX;
+                distances[count] = INFINITY;
+                count++;
+            }
+            for (int j = 1; j < 3; j++) {
+                uint32_t w = triangle[(k + j) % 3];
+                if (s->group[w] != to) continue;
+                float distance = s->attributeFloats ? attribute_distance(s, v, w) : 0.0f;
+                if (distance < distances[slot]) {
+                    distances[slot] = distance;
+                    partners[slot] = w;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (partners[i] == UINT32_MAX) return 0;
+    }
+    return count;
+}
+
+// Mean squared attribute error of vertex `from` taking the place and the
+// attributes of `to`.
+static double attribute_error(const simplifier *s, uint32_t from, uint32_t to) {
+    double weight = s->attributeWeights[from] + s->attributeWeights[to];
+    if (weight <= 0.0) return 0.0;
+    const float *p = s->positions + (size_t)s->group[to] * 3;
+    double x[4] = { p[0], p[1], p[2], 0.0 };
+    double error = 0.0;
+    for (size_t k = 0; k < s->attributeFloats; k++) {
+        x[3] = s->attributes[(size_t)to * s->attributeFloats + k];
+        error += attribute_quadric_error(&s->attributeQuadrics[(size_t)from * s->attributeFloats + k],
+                                         &s->attributeQuadrics[(size_t)to * s->attributeFloats + k], x);
+    }
+    return error / weight;
+}
+
+// Squared error of collapsing `from` into `to`, negative if it can't: the
+// position error plus the worst attribute error of the vertices that move.
+static float collapse_cost(const simplifier *s, uint32_t from, uint32_t to) {
+    uint32_t vertices[MaxSplitVertices], partners[MaxSplitVertices];
+    size_t count = find_partners(s, from, to, vertices, partners);
+    if (count == 0) return -1.0f;
+    double error = quadric_error(&s->quadrics[from], &s->quadrics[to], s->positions + (size_t)to * 3);
+    double attributes = 0.0;
+    for (size_t i = 0; i < count && s->attributeFloats; i++) {
+        attributes = fmax(attributes, attribute_error(s, vertices[i], partners[i]));
+    }
+    return (float)(error + attributes);
+}
+
+// Rejects collapses that flip or crush a triangle that survives them.
+static bool collapse_keeps_orientation(const simplifier *s, uint32_t from, uint32_t to) {
+    const float *target = s->positions + (size_t)to * 3;
+    for (uint32_t a = s->offsets[from]; a < s->offsets[from + 1]; a++) {
+        const uint32_t *triangle = s->indices + (size_t)s->adjacency[a] * 3;
+        const float *before[3], *after[3];
+        bool collapses = false;
+        for (int k = 0; k < 3; k++) {
+            uint32_t g = s->group[triangle[k]];
+            collapses |= g == to;
+            before[k] = s->positions + (size_t)g * 3;
+            after[k] = g == from ? target : before[k];
+        }
+        if (collapses) continue;
+        float n0[3], n1[3];
+        triangle_normal(n0, before[0], before[1], before[2]);
+        triangle_normal(n1, after[0], after[1], after[2]);
+        float dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+        float lengths = sqrtf((n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]) *
+                              (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]));
+        if (dot <= MinNormalCosine * lengths) return false;
+    }
+    return true;
+}
+
+// Drops removed triangles and the ones collapsed to a line, then lists the
+// triangles around every group.
+static void rebuild_adjacency(simplifier *s) {
+    size_t kept = 0;
+    for (size_t t = 0; t < s->triangleCount; t++) {
+        const uint32_t *triangle = s->indices + t * 3;
+        uint32_t g0 = s->group[triangle[0]], g1 = s->group[triangle[1]], g2 = s->group[triangle[2]];
+        if (s->removed[t] || g0 == g1 || g1 == g2 || g0 == g2) continue;
+        memmove(s->indices + kept * 3, triangle, sizeof(uint32_t) * 3);
+        kept++;
+    }
+    s->triangleCount = kept;
+    memset(s->removed, 0, kept);
+
+    memset(s->offsets, 0, sizeof(uint32_t) * (s->groupCount + 1));
+    for (size_t i = 0; i < kept * 3; i++) {
+        s->offsets[s->group[s->indices[i]] + 1]++;
+    }
+    for (size_t g = 0; g < s->groupCount; g++) {
+        s->offsets[g + 1] += s->offsets[g];
+    }
+    for (size_t i = 0; i < kept * 3; i++) {
+        s->adjacency[s->offsets[s->group[s->indices[i]]]++] = (uint32_t)(i / 3);
+    }
+    for (size_t g = s->groupCount; g > 0; g--) {
+        s->offsets[g] = s->offsets[g - 1];
+    }
+    s->offsets[0] = 0;
+}
+
+// Locks the groups on open or non-manifold edges.
+static bool lock_borders(simplifier *s) {
+    size_t capacity = 1;
+    while (capacity < s->triangleCount * 6) capacity <<= 1;
+    uint64_t *keys = malloc(sizeof(uint64_t) * capacity);
+    uint32_t *counts = calloc(capacity, sizeof(uint32_t));
+    if (!keys || !counts) {
+        free(keys);
+        free(counts);
+        return false;
+    }
+    memset(keys, 0xFF, sizeof(uint64_t) * capacity);
+    for (size_t i = 0; i < s->triangleCount * 3; i++) {
+        uint32_t a = s->group[s->indices[i]];
+        uint32_t b = s->group[s->indices[i % 3 == 2 ? i - 2 : i + 1]];
+        uint64_t key = edge_key(a, b);
+        size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+        while (keys[slot] != UINT64_MAX && keys[slot] != key) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        keys[slot] = key;
+        counts[slot]++;
+    }
+    for (size_t slot = 0; slot < capacity; slot++) {
+        if (keys[slot] == UINT64_MAX || counts[slot] == 2) continue;
+        s->locked[keys[slot] >> 32] = 1;
+        s->locked[keys[slot] & 0xFFFFFFFFu] = 1;
+    }
+    free(keys);
+    free(counts);
+    return true;
+}
+
+float mesh_simplify_extent(const mesh_simplify_source *source) {
+    const uint8_t *bytes = (const uint8_t *)source->vertices + source->positionOffset;
+    float lower[3] = { INFINITY, INFINITY, INFINITY };
+    float upper[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (size_t v = 0; v < source->vertexCount; v++) {
+        float p[3];
+        memcpy(p, bytes + v * source->stride, sizeof(p));
+        for (int k = 0; k < 3; k++) {
+            lower[k] = fminf(lower[k], p[k]);
+            upper[k] = fmaxf(upper[k], p[k]);
+        }
+    }
+    float extent = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        extent = fmaxf(extent, upper[k] - lower[k]);
+    }
+    return extent;
+}
+
+static void simplifier_free(simplifier *s) {
+    free(s->positions);
+    free(s->group);
+    free(s->attributes);
+    free(s->attributeQuadrics);
+    free(s->attributeWeights);
+    free(s->quadrics);
+    free(s->locked);
+    free(s->offsets);
+    free(s->adjacency);
+    free(s->removed);
+    free(s->stamps);
+}
+
+// Welds the positions, scales them to a unit extent, and sums the planes of
+// the triangles around every group.
+static bool simplifier_init(simplifier *s, uint32_t *indices, size_t indexCount, const mesh_simplify_source *source) {
+    size_t vertexCount = source->vertexCount;
+    s->indices = indices;
+    s->triangleCount = indexCount / 3;
+    for (size_t a = 0; a < source->attributeCount; a++) {
+        s->attributeFloats += source->attributes[a].count;
+    }
+    if (s->attributeFloats > MESH_SIMPLIFY_MAX_ATTRIBUTE_FLOATS) {
+        s->attributeFloats = MESH_SIMPLIFY_MAX_ATTRIBUTE_FLOATS;
+    }
+
+    float *vertexPositions = malloc(sizeof(float) * 3 * vertexCount);
+    s->positions = malloc(sizeof(float) * 3 * vertexCount);
+    s->group = malloc(sizeof(uint32_t) * vertexCount);
+    s->attributes = s->attributeFloats ? malloc(sizeof(float) * s->attributeFloats * vertexCount) : NULL;
+    if (!vertexPositions || !s->positions || !s->group || (s->attributeFloats && !s->attributes)) {
+        free(vertexPositions);
+        return false;
+    }
+
+    float extent = mesh_simplify_extent(source);
+    float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+    const uint8_t *bytes = source->vertices;
+    for (size_t v = 0; v < vertexCount; v++) {
+        const uint8_t *vertex = bytes + v * source->stride;
+        float p[3];
+        memcpy(p, vertex + source->positionOffset, sizeof(p));
+        for (int k = 0; k < 3; k++) {
+            vertexPositions[v * 3 + k] = p[k] * scale;
+        }
+        if (s->attributeFloats == 0) continue;
+        float *attributes = s->attributes + v * s->attributeFloats;
+        size_t written = 0;
+        for (size_t a = 0; a < source->attributeCount; a++) {
+            const mesh_simplify_attribute *attribute = &source->attributes[a];
+            float weight = sqrtf(attribute->weight);
+            for (uint32_t k = 0; k < attribute->count && written < s->attributeFloats; k++) {
+                float value;
+                memcpy(&value, vertex + attribute->offset + k * sizeof(float), sizeof(float));
+                attributes[written++] = value * weight;
+            }
+        }
+    }
+    s->groupCount = vertex_weld_remap(s->group, vertexPositions, vertexCount, sizeof(float) * 3, 0.0f);
+    for (size_t v = 0; v < vertexCount; v++) {
+        memcpy(s->positions + (size_t)s->group[v] * 3, vertexPositions + v * 3, sizeof(float) * 3);
+    }
+    free(vertexPositions);
+
+    size_t groupCount = s->groupCount;
+    s->quadrics = calloc(groupCount, sizeof(quadric));
+    s->attributeQuadrics = calloc(vertexCount * s->attributeFloats + 1, sizeof(attribute_quadric));
+    s->attributeWeights = calloc(vertexCount, sizeof(double));
+    s->locked = calloc(groupCount, 1);
+    s->offsets = malloc(sizeof(uint32_t) * (groupCount + 1));
+    s->adjacency = malloc(sizeof(uint32_t) * (s->triangleCount * 3 + 1));
+    s->removed = calloc(s->triangleCount + 1, 1);
+    s->stamps = calloc(groupCount, sizeof(uint32_t));
+    if (groupCount == 0 || !s->quadrics || !s->attributeQuadrics || !s->attributeWeights || !s->locked ||
+        !s->offsets || !s->adjacency || !s->removed || !s->stamps) {
+        return false;
+    }
+
+    rebuild_adjacency(s);
+    if (!lock_borders(s)) return false;
+    for (size_t t = 0; t < s->triangleCount; t++) {
+        const uint32_t *triangle = s->indices + t * 3;
+        const float *p0 = s->positions + (size_t)s->group[triangle[0]] * 3;
+        const float *p1 = s->positions + (size_t)s->group[triangle[1]] * 3;
+        const float *p2 = s->positions + (size_t)s->group[triangle[2]] * 3;
+        float n[3];
+        triangle_normal(n, p0, p1, p2);
+        double length = sqrt((double)n[0] * n[0] + (double)n[1] * n[1] + (double)n[2] * n[2]);
+        if (length == 0.0) continue;
+        double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+        double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+        for (int k = 0; k < 3; k++) {
+            quadric_add_plane(&s->quadrics[s->group[triangle[k]]], a, b, c, d, length * 0.5);
+            s->attributeWeights[triangle[k]] += length * 0.5;
+        }
+
+        // the gradient of every attribute in the triangle's plane, its
+        // residual is what a vertex moving across the triangle changes
+        double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        double n2 = length * length;
+        double u[3] = { (e2[1] * n[2] - e2[2] * n[1]) / n2, (e2[2] * n[0] - e2[0] * n[2]) / n2, (e2[0] * n[1] - e2[1] * n[0]) / n2 };
+        double w[3] = { (n[1] * e1[2] - n[2] * e1[1]) / n2, (n[2] * e1[0] - n[0] * e1[2]) / n2, (n[0] * e1[1] - n[1] * e1[0]) / n2 };
+        for (size_t k = 0; k < s->attributeFloats; k++) {
+            double s0 = s->attributes[(size_t)triangle[0] * s->attributeFloats + k];
+            double s1 = s->attributes[(size_t)triangle[1] * s->attributeFloats + k];
+            double s2 = s->attributes[(size_t)triangle[2] * s->attributeFloats + k];
+            double g[4] = {
+                (s1 - s0) * u[0] + (s2 - s0) * w[0],
+                (s1 - s0) * u[1] + (s2 - s0) * w[1],
+                (s1 - s0) * u[2] + (s2 - s0) * w[2],
+                -1.0
+            };
+            double offset = s0 - (g[0] * p0[0] + g[1] * p0[1] + g[2] * p0[2]);
+            for (int j = 0; j < 3; j++) {
+                attribute_quadric_add(&s->attributeQuadrics[(size_t)triangle[j] * s->attributeFloats + k], g, offset, length * 0.5);
+            }
+        }
+    }
+    return true;
+}
+
+size_t mesh_simplify(uint32_t *destination,
+                     const uint32_t *indices,
+                     size_t indexCount,
+                     const mesh_simplify_source *source,
+                     size_t targetIndexCount,
+                     float targetError,
+                     float *resultError) {
+    indexCount -= indexCount % 3;
+    if (destination != indices) {
+        memmove(destination, indices, sizeof(uint32_t) * indexCount);
+    }
+    if (resultError) *resultError = 0.0f;
+    if (indexCount == 0 || source->vertexCount == 0) return indexCount;
+
+    simplifier s = { 0 };
+    collapse *collapses = malloc(sizeof(collapse) * indexCount);
+    if (!collapses || !simplifier_init(&s, destination, indexCount, source)) {
+        free(collapses);
+        simplifier_free(&s);
+        return 0;
+    }
+
+    float errorLimit = targetError * targetError;
+    float worst = 0.0f;
+    // removed triangles stay in place until the next rebuild compacts them
+    size_t live = s.triangleCount;
+    for (uint32_t pass = 1; live * 3 > targetIndexCount; pass++) {
+        if (pass > 1) rebuild_adjacency(&s);
+
+        // every directed edge of a triangle is one collapse, its twin in the
+        // neighbouring triangle is the other direction
+        size_t collapseCount = 0;
+        for (size_t i = 0; i < s.triangleCount * 3; i++) {
+            uint32_t from = s.group[s.indices[i]];
+            uint32_t to = s.group[s.indices[i % 3 == 2 ? i - 2 : i + 1]];
+            if (s.locked[from]) continue;
+            float cost = collapse_cost(&s, from, to);
+            if (cost < 0.0f || cost > errorLimit) continue;
+            collapses[collapseCount++] = (collapse){ cost, from, to };
+        }
+        qsort(collapses, collapseCount, sizeof(collapse), compare_collapses);
+
+        // cheapest first; groups around a collapse wait for the next pass,
+        // so the costs and orientation checks here stay exact
+        size_t performed = 0;
+        for (size_t c = 0; c < collapseCount && live * 3 > targetIndexCount; c++) {
+            uint32_t from = collapses[c].from, to = collapses[c].to;
+            if (s.stamps[from] == pass || s.stamps[to] == pass) continue;
+            if (!collapse_keeps_orientation(&s, from, to)) continue;
+
+            uint32_t vertices[MaxSplitVertices], partners[MaxSplitVertices];
+            size_t splitCount = find_partners(&s, from, to, vertices, partners);
+            for (size_t v = 0; v < splitCount && s.attributeFloats; v++) {
+                for (size_t k = 0; k < s.attributeFloats; k++) {
+                    attribute_quadric *target = &s.attributeQuadrics[(size_t)partners[v] * s.attributeFloats + k];
+                    const attribute_quadric *collapsed = &s.attributeQuadrics[(size_t)vertices[v] * s.attributeFloats + k];
+                    for (int i = 0; i < 10; i++) target->a[i] += collapsed->a[i];
+                    for (int i = 0; i < 4; i++) target->b[i] += collapsed->b[i];
+                    target->c += collapsed->c;
+                }
+                s.attributeWeights[partners[v]] += s.attributeWeights[vertices[v]];
+            }
+            for (uint32_t a = s.offsets[from]; a < s.offsets[from + 1]; a++) {
+                uint32_t t = s.adjacency[a];
+                uint32_t *triangle = s.indices + (size_t)t * 3;
+                bool degenerate = false;
+                for (int k = 0; k < 3; k++) {
+                    s.stamps[s.group[triangle[k]]] = pass;
+                    degenerate |= s.group[triangle[k]] == to;
+                }
+                if (degenerate) {
+                    s.removed[t] = 1;
+                    live--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    for (size_t v = 0; v < splitCount; v++) {
+                        if (triangle[k] == vertices[v]) triangle[k] = partners[v];
+                    }
+                }
+            }
+            for (int i = 0; i < 10; i++) {
+                s.quadrics[to].m[i] += s.quadrics[from].m[i];
+            }
+            s.quadrics[to].weight += s.quadrics[from].weight;
+            worst = fmaxf(worst, collapses[c].cost);
+            performed++;
+        }
+        if (performed == 0) break;
+    }
+    rebuild_adjacency(&s);
+    size_t result = s.triangleCount * 3;
+    if (resultError) *resultError = sqrtf(worst);
+
+    free(collapses);
+    simplifier_free(&s);
+    return result;
+}
+
+void mesh_lod_select_n(uint8_t *levels,
+                       const matrix_float4x4 *models,
+                       size_t count,
+                       const float *levelErrors,
+                       uint32_t levelCount,
+                       vector_float3 cameraPosition,
+                       float projectionScale,
+                       float thresholdPixels) {
+    for (size_t i = 0; i < count; i++) {
+        const vector_float4 *c = models[i].columns;
+        float scale = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            scale = fmaxf(scale, c[k].x * c[k].x + c[k].y * c[k].y + c[k].z * c[k].z);
+        }
+        float dx = c[3].x - cameraPosition.x, dy = c[3].y - cameraPosition.y, dz = c[3].z - cameraPosition.z;
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        levels[i] = (uint8_t)mesh_lod_select(levelErrors, levelCount, sqrtf(scale), distance,
+                                             projectionScale, thresholdPixels);
+    }
+}
@@ -0,0 +1,108 @@
+//
+//  MeshSimplifier.h
+//  common
+//
+//  Quadric error simplification for levels of detail.
+//
+//  Edges collapse one endpoint into the other, Garland and Heckbert's quadrics
+//  measure how far the surface moves, and the cheapest collapses go first
+//  until the triangle target or the error target is reached. Collapses never
+//  create vertices, so every level indexes the vertex buffer of the full mesh
+//  and a level of detail is only another index buffer.
+//
+//  Vertices split at texture or normal seams move together: a collapse maps
+//  each of them to the vertex on its own side of the seam, and the difference
+//  of their attributes adds to the error, so seams keep their shape and
+//  textures don't smear across them. Open borders, such as the edges where
+//  submeshes meet, are locked so levels of neighbouring submeshes stay
+//  closed.
+//
+//  Errors are relative to the mesh's extent, the largest side of its bounding
+//  box: 0.01 is a surface moving by a hundredth of the mesh's size. They are
+//  area weighted averages around every collapse, single vertices can move up
+//  to about twice as far.
+//
+
+#ifndef MeshSimplifier_h
+#define MeshSimplifier_h
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <common/MathTypes.h>
+
+/// Most attribute floats the error accounts for, besides the position.
+#define MESH_SIMPLIFY_MAX_ATTRIBUTE_FLOATS 8
+
+/// Floats of a vertex compared across a collapse.
+typedef struct mesh_simplify_attribute {
+    /// Byte offset of the floats in the vertex.
+    size_t offset;
+    uint32_t count;
+    /// Squared error of a unit difference, relative to the extent like
+    /// positions. 0.05 for unit normals and 0.5 for texture coordinates keep
+    /// shading and seams without holding the simplification back much.
+    float weight;
+} mesh_simplify_attribute;
+
+typedef struct mesh_simplify_source {
+    const void *vertices;
+    size_t vertexCount;
+    size_t stride;
+    /// Byte offset of three float position components.
+    size_t positionOffset;
+    const mesh_simplify_attribute *attributes;
+    size_t attributeCount;
+} mesh_simplify_source;
+
+/// Largest side of the bounding box of the vertices, what errors are relative to.
+float mesh_simplify_extent(const mesh_simplify_source *source);
+
+/// Simplifies the triangle list `indices` into `destination`, which may be
+/// `indices`, until at most `targetIndexCount` indices remain or every
+/// collapse left would move the surface by more than `targetError`. The
+/// largest error reached goes to `resultError` when not NULL. Returns the
+/// index count, 0 if out of memory.
+size_t mesh_simplify(uint32_t *destination,
+                     const uint32_t *indices,
+                     size_t indexCount,
+                     const mesh_simplify_source *source,
+                     size_t targetIndexCount,
+                     float targetError,
+                     float *resultError);
+
+/// Pixels covered by a unit length one unit in front of the camera, for a
+/// vertical field of view and a viewport height in pixels.
+static inline float mesh_lod_projection_scale(float fovyRadians, float viewportHeight) {
+    return viewportHeight / (2.0f * tanf(fovyRadians * 0.5f));
+}
+
+/// Coarsest of `levelCount` levels whose error, in model units times
+/// `scale`, covers at most `thresholdPixels` at `distance`. `levelErrors` are
+/// ascending, level 0 is the full mesh.
+static inline uint32_t mesh_lod_select(const float *levelErrors,
+                                       uint32_t levelCount,
+                                       float scale,
+                                       float distance,
+                                       float projectionScale,
+                                       float thresholdPixels) {
+    float budget = thresholdPixels * distance / (projectionScale * scale);
+    uint32_t level = 0;
+    while (level + 1 < levelCount && levelErrors[level + 1] <= budget) {
+        level++;
+    }
+    return level;
+}
+
+/// mesh_lod_select for instances: the distance is from `cameraPosition` to
+/// the translation of every model matrix, the scale its largest axis scale.
+void mesh_lod_select_n(uint8_t *levels,
+                       const matrix_float4x4 *models,
+                       size_t count,
+                       const float *levelErrors,
+                       uint32_t levelCount,
+                       vector_float3 cameraPosition,
+                       float projectionScale,
+                       float thresholdPixels);
+
+#endif /* MeshSimplifier_h */
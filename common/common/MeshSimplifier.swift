@@ -0,0 +1,145 @@
+//
+//  MeshSimplifier.swift
+//  common
+//
+
+import Foundation
+import ModelIO
+
+/// A level of detail of a mesh: its submeshes simplified, indexing the
+/// vertex buffers of the full mesh.
+@objc
+public class MeshLOD: NSObject {
+
+    /// How far the level's surface is from the full mesh, in model units,
+    /// see MeshSimplifier.h.
+    @objc
+    public let error: Float
+
+    @objc
+    public let submeshes: [MDLSubmesh]
+
+    @objc
+    public init(error: Float, submeshes: [MDLSubmesh]) {
+        self.error = error
+        self.submeshes = submeshes
+        super.init()
+    }
+}
+
+/// Builds levels of detail of Model IO meshes with MeshSimplifier.h.
+@objc
+public class MeshSimplifier: NSObject {
+
+    /// Relative errors for meshes drawn at many distances, a hundredth to a
+    /// fifth of the mesh's size. Loaders only build levels when given targets.
+    @objc
+    public static let defaultErrorTargets: [Float] = [0.01, 0.02, 0.05, 0.1, 0.2]
+
+    /// Attribute weights of the error, see mesh_simplify_attribute.
+    static let normalWeight: Float = 0.05
+    static let texcoordWeight: Float = 0.5
+
+    /// A level must have at most this share of the triangles of the level
+    /// before it, closer levels aren't worth their memory.
+    static let minimumReduction = 0.75
+
+    /// Simplifies every triangle submesh of `mesh` at each of `errorTargets`,
+    /// relative to the mesh's extent and ascending, and returns the levels
+    /// that reduce the mesh enough, finest first. Each level is simplified
+    /// from the full mesh and its indices are reordered for the vertex cache.
+    /// Normals and texture coordinates in the position's vertex buffer count
+    /// towards the error.
+    @objc
+    public class func buildLODs(_ mesh: MDLMesh, errorTargets: [Float], allocator: MDLMeshBufferAllocator) -> [MeshLOD] {
+        let descriptor = mesh.vertexDescriptor
+        guard let submeshes = mesh.submeshes as? [MDLSubmesh],
+              let position = descriptor.attributeNamed(MDLVertexAttributePosition),
+              position.format == .float3 || position.format == .float4,
+              position.bufferIndex < mesh.vertexBuffers.count,
+              let layout = descriptor.layouts[position.bufferIndex] as? MDLVertexBufferLayout else {
+            return []
+        }
+        var attributes: [mesh_simplify_attribute] = []
+        let weighted: [(String, UInt32, [MDLVertexFormat], Float)] = [
+            (MDLVertexAttributeNormal, 3, [.float3, .float4], normalWeight),
+            (MDLVertexAttributeTextureCoordinate, 2, [.float2, .float3, .float4], texcoordWeight)
+        ]
+        for (name, count, formats, weight) in weighted {
+            if let attribute = descriptor.attributeNamed(name),
+               attribute.bufferIndex == position.bufferIndex,
+               formats.contains(attribute.format) {
+                attributes.append(mesh_simplify_attribute(offset: attribute.offset, count: count, weight: weight))
+            }
+        }
+
+        let vertexMap = mesh.vertexBuffers[position.bufferIndex].map()
+        let sourceIndices = submeshes.map { submesh -> [UInt32] in
+            guard submesh.geometryType == .triangles else {
+                return []
+            }
+            let indexMap = submesh.indexBuffer(asIndexType: .uInt32).map()
+            return Array(UnsafeBufferPointer(start: indexMap.bytes.assumingMemoryBound(to: UInt32.self),
+                                             count: submesh.indexCount))
+        }
+
+        return attributes.withUnsafeBufferPointer { attributesPointer -> [MeshLOD] in
+            var source = mesh_simplify_source(vertices: UnsafeRawPointer(vertexMap.bytes),
+                                              vertexCount: mesh.vertexCount,
+                                              stride: layout.stride,
+                                              positionOffset: position.offset,
+                                              attributes: attributesPointer.baseAddress,
+                                              attributeCount: attributesPointer.count)
+            let extent = mesh_simplify_extent(&source)
+
+            var lods: [MeshLOD] = []
+            var previousIndexCount = submeshes.reduce(0) { $0 + $1.indexCount }
+            for target in errorTargets {
+                var levelSubmeshes: [MDLSubmesh] = []
+                var levelError: Float = 0
+                var levelIndexCount = 0
+                for (s, submesh) in submeshes.enumerated() {
+                    guard submesh.geometryType == .triangles, !sourceIndices[s].isEmpty else {
+                        levelSubmeshes.append(submesh)
+                        levelIndexCount += submesh.indexCount
+                        continue
+                    }
+                    var simplified = [UInt32](repeating: 0, count: sourceIndices[s].count)
+                    var error: Float = 0
+                    let indexCount = mesh_simplify(&simplified, sourceIndices[s], sourceIndices[s].count,
+                                                   &source, 0, target, &error)
+                    if indexCount == 0 {
+                        return lods
+                    }
+                    simplified.removeSubrange(indexCount...)
+                    simplified.withUnsafeMutableBufferPointer { indices in
+                        _ = mesh_optimize_vertex_cache(indices.baseAddress, indices.baseAddress, indexCount, mesh.vertexCount)
+                    }
+
+                    let indexData: Data
+                    if submesh.indexType == .uInt32 {
+                        indexData = Data(bytes: simplified, count: MemoryLayout<UInt32>.stride * indexCount)
+                    } else {
+                        let narrow = simplified.map { UInt16(truncatingIfNeeded: $0) }
+                        indexData = Data(bytes: narrow, count: MemoryLayout<UInt16>.stride * indexCount)
+                    }
+                    levelSubmeshes.append(MDLSubmesh(name: submesh.name,
+                                                     indexBuffer: allocator.newBuffer(with: indexData, type: .index),
+                                                     indexCount: indexCount,
+                                                     indexType: submesh.indexType == .uInt32 ? .uInt32 : .uInt16,
+                                                     geometryType: .triangles,
+                                                     material: submesh.material))
+                    levelError = max(levelError, error * extent)
+                    levelIndexCount += indexCount
+                }
+                // selectors expect errors to grow with the level
+                levelError = max(levelError, lods.last?.error ?? 0)
+                if Double(levelIndexCount) <= Double(previousIndexCount) * minimumReduction {
+                    lods.append(MeshLOD(error: levelError, submeshes: levelSubmeshes))
+                    previousIndexCount = levelIndexCount
+                }
+            }
+            return lods
+        }
+    }
+}
@@ -0,0 +1,79 @@
+//
+//  Meshlet.h
+//  common
+//
+//  Triangle clusters for culling below the draw call.
+//
+//  A mesh is cut into clusters of at most MESHLET_MAX_VERTICES vertices and
+//  MESHLET_MAX_TRIANGLES triangles, small enough for a mesh shader threadgroup.
+//  The clusters grow across shared edges, so they stay compact, and the index
+//  buffer is regrouped so each cluster is one run of it: a renderer without
+//  mesh shaders draws the clusters that survive culling as index ranges.
+//
+//  Every cluster carries a bounding sphere for frustum culling and a normal
+//  cone for backface culling: when the camera looks at the back of all its
+//  triangles, the whole cluster is skipped. Front faces are counter-clockwise
+//  seen from outside, the OBJ convention.
+//
+
+#ifndef Meshlet_h
+#define Meshlet_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <common/MathTypes.h>
+#include <common/Frustum.h>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct meshlet {
+    /// Sphere around the cluster's vertices.
+    float center[3];
+    float radius;
+    /// The triangles all face away from a camera at v when
+    /// dot(normalize(coneApex - v), coneAxis) >= coneCutoff. The cutoff is
+    /// above 1 when they face too many ways for that.
+    float coneApex[3];
+    float coneCutoff;
+    float coneAxis[3];
+    /// First index of the cluster in the regrouped index buffer.
+    uint32_t indexOffset;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+} meshlet;
+
+/// A run of consecutive visible clusters, in indices.
+typedef struct meshlet_draw {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+} meshlet_draw;
+
+/// Most clusters meshlet_build can make out of `indexCount` indices.
+size_t meshlet_bound(size_t indexCount);
+
+/// Clusters the triangle list `indices` into `meshlets`, which holds
+/// meshlet_bound(indexCount), and writes the regrouped indices to
+/// `destination`, which must not alias `indices`. Clusters follow the order
+/// of the input, so a cache optimized order mostly survives. Positions are
+/// three floats at the start of each `positionStride` bytes. Returns the
+/// cluster count, 0 if out of memory.
+size_t meshlet_build(meshlet *meshlets,
+                     uint32_t *destination,
+                     const uint32_t *indices,
+                     size_t indexCount,
+                     const void *positions,
+                     size_t positionStride,
+                     size_t vertexCount);
+
+/// Writes the index runs of the clusters inside the frustum `planes` and not
+/// facing away from `cameraPosition`, both in the model space of the mesh,
+/// into `draws`, which holds `meshletCount`. Adjacent visible clusters merge
+/// into one run. Returns the run count.
+size_t meshlet_cull(meshlet_draw *draws,
+                    const meshlet *meshlets,
+                    size_t meshletCount,
+                    const vector_float4 planes[FRUSTUM_PLANE_COUNT],
+                    vector_float3 cameraPosition);
+
+#endif /* Meshlet_h */
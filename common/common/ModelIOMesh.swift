@@ -8,6 +8,7 @@
 import Foundation
 import Metal
 import MetalKit
+import simd
 
 /// Model IO supported 3D format file loader
 /// ref https://developer.apple.com/documentation/modelio/mdlasset/1391813-canimportfileextension
@@ -20,13 +21,72 @@ public class ModelIOMesh: NSObject {
     
     public private(set) var specularTextures: [String : MTLTexture]! = [:]
     
+    /// Dequantizes the positions of a packed mesh, identity otherwise.
+    @objc
+    public private(set) var packingConstants = vertex_packing_constants(positionScale: vector_float4(1, 1, 1, 1),
+                                                                        positionOffset: vector_float4(0, 0, 0, 0))
+    
+    /// Center and radius of a sphere around the vertices, in model space.
+    @objc
+    public private(set) var boundingSphere = vector_float4(0, 0, 0, 0)
+    
+    /// Clusters of each submesh of `mtkMesh`, see Meshlet.h, empty for
+    /// submeshes drawn whole.
+    public private(set) var clusters: [[meshlet]] = []
+    
+    /// Levels of detail, `mtkMesh` first and then coarser meshes sharing its
+    /// vertex buffers, see MeshSimplifier.h.
+    public private(set) var lodMeshes: [MTKMesh] = []
+    
+    /// Error of each of `lodMeshes` in model units, 0 for the full mesh, the
+    /// input of mesh_lod_select.
+    @objc
+    public private(set) var lodErrors: [Float] = []
+    
+    @objc
+    public var lodCount: Int {
+        return lodMeshes.count
+    }
+    
     fileprivate var texturesCache : [URL: MTLTexture] = [:]
     
+    fileprivate var clusterDraws: [meshlet_draw] = []
+    
     @objc
-    public init(withUrl url: URL,
-                device: MTLDevice,
-                mtlVertexDescriptor: MTLVertexDescriptor,
-                attributeMap: [Int : String]) throws {
+    public convenience init(withUrl url: URL,
+                            device: MTLDevice,
+                            mtlVertexDescriptor: MTLVertexDescriptor,
+                            attributeMap: [Int : String]) throws {
+        try self.init(withUrl: url,
+                      device: device,
+                      mtlVertexDescriptor: mtlVertexDescriptor,
+                      attributeMap: attributeMap,
+                      packing: nil,
+                      lodErrorTargets: [])
+    }
+    
+    /// Loads the model in the float layout of `packing` and packs it, the mesh
+    /// then matches `packing.vertexDescriptor`. Levels of detail are only built
+    /// at `lodErrorTargets`, see MeshSimplifier.buildLODs, none by default.
+    @objc
+    public convenience init(withUrl url: URL,
+                            device: MTLDevice,
+                            packing: VertexPacking,
+                            lodErrorTargets: [Float] = []) throws {
+        try self.init(withUrl: url,
+                      device: device,
+                      mtlVertexDescriptor: packing.loadingVertexDescriptor,
+                      attributeMap: packing.attributeMap,
+                      packing: packing,
+                      lodErrorTargets: lodErrorTargets)
+    }
+    
+    init(withUrl url: URL,
+         device: MTLDevice,
+         mtlVertexDescriptor: MTLVertexDescriptor,
+         attributeMap: [Int : String],
+         packing: VertexPacking?,
+         lodErrorTargets: [Float]) throws {
         
         // model io vertex descriptor
         let mdlVertexDescriptor = MTKModelIOVertexDescriptorFromMetal(mtlVertexDescriptor)
@@ -36,65 +96,211 @@ public class ModelIOMesh: NSObject {
         
         // mesh allocator
         let metalAllocator = MTKMeshBufferAllocator(device: device)
+        let textureLoader = MTKTextureLoader(device: device)
+        let directory = url.deletingLastPathComponent()
         
-        let mdlAsset = MDLAsset(url: url,
-                                  vertexDescriptor: mdlVertexDescriptor,
-                                  bufferAllocator: metalAllocator)
+        let cacheKey = (try? Data(contentsOf: url, options: .mappedIfSafe)).map {
+            MeshCache.key(source: $0,
+                          vertexDescriptor: mdlVertexDescriptor,
+                          loader: "ModelIOMesh optimized clustered lods \(lodErrorTargets)")
+        }
         
         var mdlMesh : MDLMesh? = nil
+        var baseColorUrls: [String : URL] = [:]
+        var specularUrls: [String : URL] = [:]
+        var meshClusters: [[meshlet]] = []
+        var meshLODs: [MeshLOD] = []
         
-        for i in 0..<mdlAsset.count {
-            guard let mdlObject = mdlAsset.object(at: i) as? MDLMesh else {
-                continue
-            }
+        if let cacheKey = cacheKey,
+           let cached = MeshCache.load(cacheKey,
+                                       vertexDescriptor: mdlVertexDescriptor,
+                                       allocator: metalAllocator,
+                                       relativeTo: directory) {
+            mdlMesh = cached.mesh
+            meshClusters = cached.clusters
+            meshLODs = cached.lods
+            baseColorUrls = cached.baseColorTextures
+            specularUrls = cached.specularTextures
+        } else {
+            let mdlAsset = MDLAsset(url: url,
+                                      vertexDescriptor: mdlVertexDescriptor,
+                                      bufferAllocator: metalAllocator)
             
-            mdlMesh = mdlObject
-            let textureLoader = MTKTextureLoader(device: device)
-            
-            for subMesh in mdlObject.submeshes! {
-                guard let subMesh = subMesh as? MDLSubmesh else {
-                    break
+            for i in 0..<mdlAsset.count {
+                guard let mdlObject = mdlAsset.object(at: i) as? MDLMesh else {
+                    continue
                 }
                 
-                guard let material = subMesh.material else {
-                    break
-                }
+                mdlMesh = mdlObject
                 
-                if let baseColorProperty = material.property(with: .baseColor),
-                   let baseColorUrl = baseColorProperty.urlValue {
-                    if !texturesCache.keys.contains(baseColorUrl),
-                       let baseColorTexture = try? textureLoader.newTexture(URL: baseColorUrl, options: nil) {
-                        texturesCache[baseColorUrl] = baseColorTexture
-                        
+                for subMesh in mdlObject.submeshes! {
+                    guard let subMesh = subMesh as? MDLSubmesh else {
+                        break
                     }
                     
-                    baseColorTextures[subMesh.name] = texturesCache[baseColorUrl]!
-                }
-                
-                if let specularProperty = material.property(with: .specular),
-                   let specularUrl = specularProperty.urlValue {
-                    if !texturesCache.keys.contains(specularUrl),
-                       let specularTexture = try? textureLoader.newTexture(URL: specularUrl, options: nil) {
-                        texturesCache[specularUrl] = specularTexture
+                    guard let material = subMesh.material else {
+                        break
                     }
                     
-                    specularTextures[subMesh.name] = texturesCache[specularUrl]!
+                    if let baseColorProperty = material.property(with: .baseColor),
+                       let baseColorUrl = baseColorProperty.urlValue {
+                        baseColorUrls[subMesh.name] = baseColorUrl
+                    }
+                    
+                    if let specularProperty = material.property(with: .specular),
+                       let specularUrl = specularProperty.urlValue {
+                        specularUrls[subMesh.name] = specularUrl
+                    }
                 }
                 
+                // only read first mdl mesh
+                break
             }
             
-            // only read first mdl mesh
-            break
+            // reorder once at import, the cache keeps the optimized mesh
+            mdlMesh = mdlMesh.map { MeshOptimizer.optimize($0, allocator: metalAllocator) }
+            if let optimized = mdlMesh {
+                (mdlMesh, meshClusters) = MeshOptimizer.buildClusters(optimized, allocator: metalAllocator)
+                if !lodErrorTargets.isEmpty {
+                    meshLODs = MeshSimplifier.buildLODs(mdlMesh!, errorTargets: lodErrorTargets, allocator: metalAllocator)
+                }
+            }
+            
+            if let mdlMesh = mdlMesh, let cacheKey = cacheKey {
+                MeshCache.store(mdlMesh,
+                                key: cacheKey,
+                                baseColorTextures: baseColorUrls,
+                                specularTextures: specularUrls,
+                                clusters: meshClusters,
+                                lods: meshLODs,
+                                relativeTo: directory)
+            }
         }
         
         if mdlMesh == nil {
             throw Errors.runtimeError("can not read mdl mesh from \(url)")
         }
         
+        // bounds of the float positions, packed ones are normalized
+        let bounds = mdlMesh!.boundingBox
+        let center = (bounds.minBounds + bounds.maxBounds) * 0.5
+        let meshBoundingSphere = vector_float4(center, simd_length(bounds.maxBounds - bounds.minBounds) * 0.5)
+        
+        // the cache keeps the float layout, packing is a single pass over the vertices
+        if let packing = packing {
+            var constants = vertex_packing_constants()
+            guard let packed = packing.pack(mdlMesh!, allocator: metalAllocator, constants: &constants) else {
+                throw Errors.runtimeError("can not pack the vertices of \(url)")
+            }
+            mdlMesh = packed
+            packingConstants = constants
+        }
+        
+        // submeshes sharing a texture share the MTLTexture
+        var textures: [URL : MTLTexture] = [:]
+        func loadTextures(_ urls: [String : URL]) -> [String : MTLTexture] {
+            var loaded: [String : MTLTexture] = [:]
+            for (name, url) in urls {
+                if textures[url] == nil {
+                    textures[url] = try? textureLoader.newTexture(URL: url, options: nil)
+                }
+                loaded[name] = textures[url]
+            }
+            return loaded
+        }
+        baseColorTextures = loadTextures(baseColorUrls)
+        specularTextures = loadTextures(specularUrls)
+        texturesCache = textures
+        clusters = meshClusters
+        boundingSphere = meshBoundingSphere
+        
         mtkMesh = try! MTKMesh(mesh: mdlMesh!, device: device)
+        
+        // levels only differ in their index buffers, packing left them valid
+        lodMeshes = [mtkMesh]
+        lodErrors = [0]
+        for lod in meshLODs {
+            let lodMesh = MDLMesh(vertexBuffers: mdlMesh!.vertexBuffers,
+                                  vertexCount: mdlMesh!.vertexCount,
+                                  descriptor: mdlMesh!.vertexDescriptor,
+                                  submeshes: lod.submeshes)
+            lodMeshes.append(try MTKMesh(mesh: lodMesh, device: device))
+            lodErrors.append(lod.error)
+        }
     }
     
+    /// Draws the clusters inside the frustum of `modelViewProjection` that do
+    /// not face away from `cameraPosition`, given in the model space of the
+    /// mesh. Submeshes without clusters are drawn whole.
+    @objc
+    public func drawVisibleClusters(renderEncoder: MTLRenderCommandEncoder,
+                                    modelViewProjection: matrix_float4x4,
+                                    cameraPosition: vector_float3,
+                                    textureHandler: ((MDLMaterialSemantic, MTLTexture, String) -> Void)?) {
+        var planes = [vector_float4](repeating: vector_float4(), count: Int(FRUSTUM_PLANE_COUNT))
+        frustum_planes_from_matrix(&planes, modelViewProjection)
+        
+        for (s, subMesh) in mtkMesh.submeshes.enumerated() {
+            let submeshClusters = s < clusters.count ? clusters[s] : []
+            var runs = [(indexOffset: 0, indexCount: subMesh.indexCount)]
+            if !submeshClusters.isEmpty {
+                if clusterDraws.count < submeshClusters.count {
+                    clusterDraws = [meshlet_draw](repeating: meshlet_draw(), count: submeshClusters.count)
+                }
+                let runCount = meshlet_cull(&clusterDraws, submeshClusters, submeshClusters.count, planes, cameraPosition)
+                runs = clusterDraws[0..<runCount].map { (indexOffset: Int($0.indexOffset), indexCount: Int($0.indexCount)) }
+            }
+            if runs.isEmpty {
+                continue
+            }
+            
+            if let diffuseTexture = baseColorTextures[subMesh.name] {
+                textureHandler?(.baseColor, diffuseTexture, subMesh.name)
+            }
+            
+            if let specularTexture = specularTextures[subMesh.name] {
+                textureHandler?(.specular, specularTexture, subMesh.name)
+            }
+            
+            let indexSize = subMesh.indexType == .uint16 ? 2 : 4
+            for run in runs {
+                renderEncoder.drawIndexedPrimitives(type: subMesh.primitiveType,
+                                                    indexCount: run.indexCount,
+                                                    indexType: subMesh.indexType,
+                                                    indexBuffer: subMesh.indexBuffer.buffer,
+                                                    indexBufferOffset: subMesh.indexBuffer.offset + run.indexOffset * indexSize)
+            }
+        }
+    }
     
+    /// Draws `instanceCount` instances of level `level` of `lodMeshes`
+    /// starting at `baseInstance`, which the instance id in the vertex
+    /// function includes. The vertex buffers must already be bound.
+    @objc
+    public func drawLOD(_ level: Int,
+                        renderEncoder: MTLRenderCommandEncoder,
+                        instanceCount: Int,
+                        baseInstance: Int,
+                        textureHandler: ((MDLMaterialSemantic, MTLTexture, String) -> Void)?) {
+        for subMesh in lodMeshes[level].submeshes {
+            if let diffuseTexture = baseColorTextures[subMesh.name] {
+                textureHandler?(.baseColor, diffuseTexture, subMesh.name)
+            }
+            
+            if let specularTexture = specularTextures[subMesh.name] {
+                textureHandler?(.specular, specularTexture, subMesh.name)
+            }
+            
+            renderEncoder.drawIndexedPrimitives(type: subMesh.primitiveType,
+                                                indexCount: subMesh.indexCount,
+                                                indexType: subMesh.indexType,
+                                                indexBuffer: subMesh.indexBuffer.buffer,
+                                                indexBufferOffset: subMesh.indexBuffer.offset,
+                                                instanceCount: instanceCount,
+                                                baseVertex: 0,
+                                                baseInstance: baseInstance)
+        }
+    }
 }
 
 extension ModelIOMesh: MetalMesh {
@@ -0,0 +1,279 @@
+//
+//  PoseSampler.c
+//  common
+//
+
+#include "PoseSampler.h"
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define POSE_SAMPLER_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define POSE_SAMPLER_NEON 1
+#endif
+
+pose_sampler *pose_sampler_create(const animation_clip *clip) {
+    pose_sampler *sampler = calloc(1, sizeof(pose_sampler));
+    if (!sampler) return NULL;
+    sampler->clip = clip;
+    sampler->rotationBlend = PoseRotationNlerp;
+    sampler->loops = true;
+    return sampler;
+}
+
+pose_sampler *pose_sampler_create_compressed(const compressed_clip *clip) {
+    pose_sampler *sampler = calloc(1, sizeof(pose_sampler));
+    size_t trackCount = (size_t)clip->boneCount * CompressedTrackChannelCount;
+    if (sampler) {
+        sampler->cursors = calloc(trackCount > 0 ? trackCount : 1, sizeof(uint32_t));
+    }
+    if (!sampler || !sampler->cursors) {
+        free(sampler);
+        return NULL;
+    }
+    sampler->compressed = clip;
+    sampler->rotationBlend = PoseRotationNlerp;
+    sampler->loops = true;
+    return sampler;
+}
+
+void pose_sampler_destroy(pose_sampler *sampler) {
+    if (!sampler) return;
+    free(sampler->cursors);
+    free(sampler);
+}
+
+static uint32_t frame_count(const pose_sampler *sampler) {
+    return sampler->clip ? sampler->clip->frameCount : sampler->compressed->frameCount;
+}
+
+static float frames_per_second(const pose_sampler *sampler) {
+    return sampler->clip ? sampler->clip->framesPerSecond : sampler->compressed->framesPerSecond;
+}
+
+float pose_sampler_duration(const pose_sampler *sampler) {
+    uint32_t frames = frame_count(sampler);
+    float fps = frames_per_second(sampler);
+    return frames > 1 && fps > 0 ? (float)(frames - 1) / fps : 0;
+}
+
+//------------------------------------------------------------------------------
+// rotation blends of uncompressed clips, keys k0 and k0 + 1 of every bone
+
+static inline void nlerp_scalar(const float *a, const float *b, float t, quaternion_float *out) {
+    float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    float tb = dot < 0 ? -t : t;
+    float x = a[0] * (1 - t) + b[0] * tb;
+    float y = a[1] * (1 - t) + b[1] * tb;
+    float z = a[2] * (1 - t) + b[2] * tb;
+    float w = a[3] * (1 - t) + b[3] * tb;
+    float inverseLength = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+    out->x = x * inverseLength;
+    out->y = y * inverseLength;
+    out->z = z * inverseLength;
+    out->w = w * inverseLength;
+}
+
+static void nlerp_bones_scalar(const float *rotations, size_t stride, uint32_t firstBone, uint32_t boneCount,
+                               uint32_t k0, uint32_t k1, float t, quaternion_float *out) {
+    for (uint32_t b = firstBone; b < boneCount; b++) {
+        const float *track = rotations + b * stride;
+        nlerp_scalar(track + k0 * 4, track + k1 * 4, t, &out[b]);
+    }
+}
+
+#if POSE_SAMPLER_SSE
+
+// Four bones per step, transposed so every lane is one bone.
+static void nlerp_bones(const float *rotations, size_t stride, uint32_t boneCount,
+                        uint32_t k0, uint32_t k1, float t, quaternion_float *out) {
+    const __m128 tv = _mm_set1_ps(t);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    uint32_t b = 0;
+    for (; b + 4 <= boneCount; b += 4) {
+        const float *track = rotations + b * stride;
+        __m128 ax = _mm_loadu_ps(track + k0 * 4);
+        __m128 ay = _mm_loadu_ps(track + stride + k0 * 4);
+        __m128 az = _mm_loadu_ps(track + 2 * stride + k0 * 4);
+        __m128 aw = _mm_loadu_ps(track + 3 * stride + k0 * 4);
+        __m128 bx = _mm_loadu_ps(track + k1 * 4);
+        __m128 by = _mm_loadu_ps(track + stride + k1 * 4);
+        __m128 bz = _mm_loadu_ps(track + 2 * stride + k1 * 4);
+        __m128 bw = _mm_loadu_ps(track + 3 * stride + k1 * 4);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+                                _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        // flip t for the bones whose keys are on opposite hemispheres
+        __m128 tb = _mm_xor_ps(tv, _mm_and_ps(dot, signBit));
+        __m128 ta = _mm_sub_ps(_mm_set1_ps(1.0f), tv);
+
+        __m128 x = _mm_add_ps(_mm_mul_ps(ax, ta), _mm_mul_ps(bx, tb));
+        __m128 y = _mm_add_ps(_mm_mul_ps(ay, ta), _mm_mul_ps(by, tb));
+        __m128 z = _mm_add_ps(_mm_mul_ps(az, ta), _mm_mul_ps(bz, tb));
+        __m128 w = _mm_add_ps(_mm_mul_ps(aw, ta), _mm_mul_ps(bw, tb));
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                                               _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+        __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), length);
+        x = _mm_mul_ps(x, inverseLength);
+        y = _mm_mul_ps(y, inverseLength);
+        z = _mm_mul_ps(z, inverseLength);
+        w = _mm_mul_ps(w, inverseLength);
+
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps((float *)&out[b], x);
+        _mm_storeu_ps((float *)&out[b + 1], y);
+        _mm_storeu_ps((float *)&out[b + 2], z);
+        _mm_storeu_ps((float *)&out[b + 3], w);
+    }
+
+    nlerp_bones_scalar(rotations, stride, b, boneCount, k0, k1, t, out);
+}
+
+#elif POSE_SAMPLER_NEON
+
+// Rows to columns, lane i of every register becomes bone i.
+static inline void transpose4_neon(float32x4x4_t *m) {
+    float32x4x2_t t01 = vtrnq_f32(m->val[0], m->val[1]);
+    float32x4x2_t t23 = vtrnq_f32(m->val[2], m->val[3]);
+    m->val[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    m->val[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    m->val[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    m->val[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+static void nlerp_bones(const float *rotations, size_t stride, uint32_t boneCount,
+                        uint32_t k0, uint32_t k1, float t, quaternion_float *out) {
+    const float32x4_t tv = vdupq_n_f32(t);
+    const float32x4_t ta = vdupq_n_f32(1.0f - t);
+
+    uint32_t b = 0;
+    for (; b + 4 <= boneCount; b += 4) {
+        const float *track = rotations + b * stride;
+        float32x4x4_t a = { { vld1q_f32(track + k0 * 4), vld1q_f32(track + stride + k0 * 4),
+                              vld1q_f32(track + 2 * stride + k0 * 4), vld1q_f32(track + 3 * stride + k0 * 4) } };
+        float32x4x4_t k = { { vld1q_f32(track + k1 * 4), vld1q_f32(track + stride + k1 * 4),
+                              vld1q_f32(track + 2 * stride + k1 * 4), vld1q_f32(track + 3 * stride + k1 * 4) } };
+        transpose4_neon(&a);
+        transpose4_neon(&k);
+
+        float32x4_t dot = vmulq_f32(a.val[0], k.val[0]);
+        dot = vfmaq_f32(dot, a.val[1], k.val[1]);
+        dot = vfmaq_f32(dot, a.val[2], k.val[2]);
+        dot = vfmaq_f32(dot, a.val[3], k.val[3]);
+        float32x4_t tb = vbslq_f32(vcltzq_f32(dot), vnegq_f32(tv), tv);
+
+        float32x4x4_t q;
+        float32x4_t lengthSquared = vdupq_n_f32(0);
+        for (int c = 0; c < 4; c++) {
+            q.val[c] = vfmaq_f32(vmulq_f32(a.val[c], ta), k.val[c], tb);
+            lengthSquared = vfmaq_f32(lengthSquared, q.val[c], q.val[c]);
+        }
+        float32x4_t inverseLength = vdivq_f32(vdupq_n_f32(1.0f), vsqrtq_f32(lengthSquared));
+        for (int c = 0; c < 4; c++) {
+            q.val[c] = vmulq_f32(q.val[c], inverseLength);
+        }
+        // vst4q interleaves the lanes back into one quaternion per bone
+        vst4q_f32((float *)&out[b], q);
+    }
+
+    nlerp_bones_scalar(rotations, stride, b, boneCount, k0, k1, t, out);
+}
+
+#else
+
+static void nlerp_bones(const float *rotations, size_t stride, uint32_t boneCount,
+                        uint32_t k0, uint32_t k1, float t, quaternion_float *out) {
+    nlerp_bones_scalar(rotations, stride, 0, boneCount, k0, k1, t, out);
+}
+
+#endif
+
+static void slerp_bones(const float *rotations, size_t stride, uint32_t boneCount,
+                        uint32_t k0, uint32_t k1, float t, quaternion_float *out) {
+    for (uint32_t b = 0; b < boneCount; b++) {
+        const float *a = rotations + b * stride + k0 * 4;
+        const float *k = rotations + b * stride + k1 * 4;
+        float dot = a[0] * k[0] + a[1] * k[1] + a[2] * k[2] + a[3] * k[3];
+        float sign = dot < 0 ? -1.0f : 1.0f;
+        dot *= sign;
+
+        if (dot > 0.9995f) {
+            // nearly parallel, sin(angle) loses precision and nlerp is exact enough
+            nlerp_scalar(a, k, t, &out[b]);
+            continue;
+        }
+        float angle = acosf(dot);
+        float inverseSin = 1.0f / sinf(angle);
+        float wa = sinf((1 - t) * angle) * inverseSin;
+        float wb = sinf(t * angle) * inverseSin * sign;
+        out[b].x = a[0] * wa + k[0] * wb;
+        out[b].y = a[1] * wa + k[1] * wb;
+        out[b].z = a[2] * wa + k[2] * wb;
+        out[b].w = a[3] * wa + k[3] * wb;
+    }
+}
+
+static void lerp_bones(const float *values, size_t stride, uint32_t boneCount,
+                       uint32_t k0, uint32_t k1, float t, vector_float3 *out) {
+    for (uint32_t b = 0; b < boneCount; b++) {
+        const float *a = values + b * stride + k0 * 3;
+        const float *k = values + b * stride + k1 * 3;
+        out[b].x = a[0] + (k[0] - a[0]) * t;
+        out[b].y = a[1] + (k[1] - a[1]) * t;
+        out[b].z = a[2] + (k[2] - a[2]) * t;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void pose_sampler_sample(pose_sampler *sampler,
+                         float seconds,
+                         vector_float3 *translations,
+                         quaternion_float *rotations,
+                         vector_float3 *scales) {
+    uint32_t boneCount = sampler->clip ? sampler->clip->boneCount : sampler->compressed->boneCount;
+    pose_sampler_sample_bones(sampler, seconds, boneCount, translations, rotations, scales);
+}
+
+void pose_sampler_sample_bones(pose_sampler *sampler,
+                               float seconds,
+                               uint32_t boneCount,
+                               vector_float3 *translations,
+                               quaternion_float *rotations,
+                               vector_float3 *scales) {
+    float duration = pose_sampler_duration(sampler);
+    if (sampler->loops && duration > 0) {
+        seconds = fmodf(seconds, duration);
+        seconds = seconds < 0 ? seconds + duration : seconds;
+    }
+    float frame = seconds * frames_per_second(sampler);
+
+    if (sampler->compressed) {
+        compressed_clip_sample_bones(sampler->compressed, sampler->cursors, frame, boneCount,
+                                     translations, rotations, scales);
+        return;
+    }
+
+    const animation_clip *clip = sampler->clip;
+    if (clip->frameCount == 0) return;
+    boneCount = boneCount < clip->boneCount ? boneCount : clip->boneCount;
+    float last = (float)(clip->frameCount - 1);
+    frame = frame < 0 ? 0 : (frame > last ? last : frame);
+    uint32_t k0 = (uint32_t)frame;
+    uint32_t k1 = k0 + 1 < clip->frameCount ? k0 + 1 : k0;
+    float t = frame - (float)k0;
+
+    lerp_bones(clip->translations, (size_t)clip->frameCount * 3, boneCount, k0, k1, t, translations);
+    lerp_bones(clip->scales, (size_t)clip->frameCount * 3, boneCount, k0, k1, t, scales);
+    if (sampler->rotationBlend == PoseRotationSlerp) {
+        slerp_bones(clip->rotations, (size_t)clip->frameCount * 4, boneCount, k0, k1, t, rotations);
+    } else {
+        nlerp_bones(clip->rotations, (size_t)clip->frameCount * 4, boneCount, k0, k1, t, rotations);
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  PoseSampler.h
+//  common
+//
+//  Samples a whole skeleton pose from a clip at a time in seconds.
+//
+//  Rotations blend along the shortest path with a normalized lerp, or a slerp
+//  when exact angular velocity matters more than speed. Uncompressed clips have
+//  a key every frame and blend all bones in one SIMD batch; compressed clips keep
+//  a key cursor per track so sequential playback never searches.
+//
+
+#ifndef PoseSampler_h
+#define PoseSampler_h
+
+#include <common/AnimationClip.h>
+#include <common/CompressedClip.h>
+
+typedef enum {
+    PoseRotationNlerp,
+    PoseRotationSlerp,
+} pose_rotation_blend;
+
+typedef struct pose_sampler {
+    /// Exactly one of clip and compressed is set.
+    const animation_clip *clip;
+    const compressed_clip *compressed;
+    /// Only used for uncompressed clips, compressed clips were fitted with nlerp.
+    pose_rotation_blend rotationBlend;
+    /// Wraps time around the clip duration, otherwise it is clamped.
+    bool loops;
+    /// Key cursor per compressed track.
+    uint32_t *cursors;
+} pose_sampler;
+
+/// Returns a looping nlerp sampler of `clip`, which must outlive the sampler.
+pose_sampler *pose_sampler_create(const animation_clip *clip);
+
+/// Returns a looping sampler of `clip` with a cursor per track, which must outlive the sampler.
+pose_sampler *pose_sampler_create_compressed(const compressed_clip *clip);
+
+void pose_sampler_destroy(pose_sampler *sampler);
+
+/// Seconds from the first to the last key.
+float pose_sampler_duration(const pose_sampler *sampler);
+
+/// Writes the pose at `seconds` for every bone of the clip.
+void pose_sampler_sample(pose_sampler *sampler,
+                         float seconds,
+                         vector_float3 *translations,
+                         quaternion_float *rotations,
+                         vector_float3 *scales);
+
+/// pose_sampler_sample for the first `boneCount` bones only, the others are
+/// left untouched. Lets distant characters skip the bones at the end of the clip.
+void pose_sampler_sample_bones(pose_sampler *sampler,
+                               float seconds,
+                               uint32_t boneCount,
+                               vector_float3 *translations,
+                               quaternion_float *rotations,
+                               vector_float3 *scales);
+
+#endif /* PoseSampler_h */
@@ -0,0 +1,269 @@
+//
+//  RandomStream.c
+//  common
+//
+//  Philox4x32-10 from "Parallel Random Numbers: As Easy as 1, 2, 3" (Salmon et al.).
+//  The 128-bit counter is (block lo, block hi, stream id lo, stream id hi) and the
+//  key is the seed. The SIMD kernels run four counters side by side, one lane each.
+//
+
+#include "RandomStream.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RANDOM_STREAM_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RANDOM_STREAM_NEON 1
+#endif
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// 24 random bits mapped to [0, 1)
+#define UNIT_FLOAT_SCALE (1.0f / 16777216.0f)
+
+static void philox_block(const random_stream *stream, uint64_t block, uint32_t out[4]) {
+    uint32_t c0 = (uint32_t)block;
+    uint32_t c1 = (uint32_t)(block >> 32);
+    uint32_t c2 = stream->streamId[0];
+    uint32_t c3 = stream->streamId[1];
+    uint32_t k0 = stream->key[0];
+    uint32_t k1 = stream->key[1];
+
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0;
+        c1 = (uint32_t)p1;
+        c2 = n2;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+static inline float unit_float(uint32_t u) {
+    return (float)(u >> 8) * UNIT_FLOAT_SCALE;
+}
+
+void random_stream_init(random_stream *stream, uint64_t seed, uint64_t streamId) {
+    stream->key[0] = (uint32_t)seed;
+    stream->key[1] = (uint32_t)(seed >> 32);
+    stream->streamId[0] = (uint32_t)streamId;
+    stream->streamId[1] = (uint32_t)(streamId >> 32);
+    stream->position = 0;
+    stream->cachedBlock = UINT64_MAX;
+}
+
+void random_stream_skip(random_stream *stream, uint64_t count) {
+    stream->position += count;
+}
+
+uint32_t random_stream_next_u32(random_stream *stream) {
+    uint64_t block = stream->position >> 2;
+    if (block != stream->cachedBlock) {
+        philox_block(stream, block, stream->cache);
+        stream->cachedBlock = block;
+    }
+    return stream->cache[stream->position++ & 3];
+}
+
+float random_stream_next_float(random_stream *stream, float min, float max) {
+    return min + unit_float(random_stream_next_u32(stream)) * (max - min);
+}
+
+//------------------------------------------------------------------------------
+// bulk kernels, `blockCount` whole blocks starting at `firstBlock`
+
+static void fill_blocks_scalar(const random_stream *stream, uint64_t firstBlock, size_t blockCount,
+                               float *out, float min, float range) {
+    for (size_t b = 0; b < blockCount; b++) {
+        uint32_t words[4];
+        philox_block(stream, firstBlock + b, words);
+        for (int j = 0; j < 4; j++) {
+            out[b * 4 + j] = min + unit_float(words[j]) * range;
+        }
+    }
+}
+
+#if RANDOM_STREAM_SSE
+
+// 32x32 -> 64 bit products of all four lanes, split into low and high words.
+static inline void mulhilo_sse(__m128i a, __m128i m, __m128i *lo, __m128i *hi) {
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    __m128i evenLo = _mm_shuffle_epi32(even, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128i oddLo = _mm_shuffle_epi32(odd, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128i evenHi = _mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 3, 1));
+    __m128i oddHi = _mm_shuffle_epi32(odd, _MM_SHUFFLE(3, 1, 3, 1));
+    *lo = _mm_unpacklo_epi32(evenLo, oddLo);
+    *hi = _mm_unpacklo_epi32(evenHi, oddHi);
+}
+
+static inline __m128 unit_float_sse(__m128i u, __m128 min, __m128 range) {
+    __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(u, 8)), _mm_set1_ps(UNIT_FLOAT_SCALE));
+    return _mm_add_ps(min, _mm_mul_ps(f, range));
+}
+
+static void fill_blocks_simd(const random_stream *stream, uint64_t firstBlock, size_t blockCount,
+                             float *out, float min, float range) {
+    const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32((int)PHILOX_M1);
+    const __m128 minv = _mm_set1_ps(min);
+    const __m128 rangev = _mm_set1_ps(range);
+
+    size_t b = 0;
+    for (; b + 4 <= blockCount; b += 4) {
+        uint32_t lo[4], hi[4];
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t block = firstBlock + b + lane;
+            lo[lane] = (uint32_t)block;
+            hi[lane] = (uint32_t)(block >> 32);
+        }
+        __m128i c0 = _mm_loadu_si128((const __m128i *)lo);
+        __m128i c1 = _mm_loadu_si128((const __m128i *)hi);
+        __m128i c2 = _mm_set1_epi32((int)stream->streamId[0]);
+        __m128i c3 = _mm_set1_epi32((int)stream->streamId[1]);
+        uint32_t k0 = stream->key[0];
+        uint32_t k1 = stream->key[1];
+
+        for (int round = 0; round < PHILOX_ROUNDS; round++) {
+            __m128i lo0, hi0, lo1, hi1;
+            mulhilo_sse(c0, m0, &lo0, &hi0);
+            mulhilo_sse(c2, m1, &lo1, &hi1);
+            c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        // lanes hold blocks, transpose so the stores follow the stream order
+        __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+        __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+        __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+        __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+        float *dst = out + b * 4;
+        _mm_storeu_ps(dst,      unit_float_sse(_mm_unpacklo_epi64(t0, t1), minv, rangev));
+        _mm_storeu_ps(dst + 4,  unit_float_sse(_mm_unpackhi_epi64(t0, t1), minv, rangev));
+        _mm_storeu_ps(dst + 8,  unit_float_sse(_mm_unpacklo_epi64(t2, t3), minv, rangev));
+        _mm_storeu_ps(dst + 12, unit_float_sse(_mm_unpackhi_epi64(t2, t3), minv, rangev));
+    }
+
+    fill_blocks_scalar(stream, firstBlock + b, blockCount - b, out + b * 4, min, range);
+}
+
+#elif RANDOM_STREAM_NEON
+
+static inline float32x4_t unit_float_neon(uint32x4_t u, float32x4_t min, float32x4_t range) {
+    float32x4_t f = vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(u, 8)), UNIT_FLOAT_SCALE);
+    return vfmaq_f32(min, f, range);
+}
+
+static void fill_blocks_simd(const random_stream *stream, uint64_t firstBlock, size_t blockCount,
+                             float *out, float min, float range) {
+    const uint32x2_t m0 = vdup_n_u32(PHILOX_M0);
+    const uint32x2_t m1 = vdup_n_u32(PHILOX_M1);
+    const float32x4_t minv = vdupq_n_f32(min);
+    const float32x4_t rangev = vdupq_n_f32(range);
+
+    size_t b = 0;
+    for (; b + 4 <= blockCount; b += 4) {
+        uint32_t lo[4], hi[4];
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t block = firstBlock + b + lane;
+            lo[lane] = (uint32_t)block;
+            hi[lane] = (uint32_t)(block >> 32);
+        }
+        uint32x4_t c0 = vld1q_u32(lo);
+        uint32x4_t c1 = vld1q_u32(hi);
+        uint32x4_t c2 = vdupq_n_u32(stream->streamId[0]);
+        uint32x4_t c3 = vdupq_n_u32(stream->streamId[1]);
+        uint32_t k0 = stream->key[0];
+        uint32_t k1 = stream->key[1];
+
+        for (int round = 0; round < PHILOX_ROUNDS; round++) {
+            uint32x4_t p0a = vreinterpretq_u32_u64(vmull_u32(vget_low_u32(c0), m0));
+            uint32x4_t p0b = vreinterpretq_u32_u64(vmull_u32(vget_high_u32(c0), m0));
+            uint32x4_t p1a = vreinterpretq_u32_u64(vmull_u32(vget_low_u32(c2), m1));
+            uint32x4_t p1b = vreinterpretq_u32_u64(vmull_u32(vget_high_u32(c2), m1));
+            uint32x4_t lo0 = vuzp1q_u32(p0a, p0b);
+            uint32x4_t hi0 = vuzp2q_u32(p0a, p0b);
+            uint32x4_t lo1 = vuzp1q_u32(p1a, p1b);
+            uint32x4_t hi1 = vuzp2q_u32(p1a, p1b);
+            c0 = veorq_u32(veorq_u32(hi1, c1), vdupq_n_u32(k0));
+            c1 = lo1;
+            c2 = veorq_u32(veorq_u32(hi0, c3), vdupq_n_u32(k1));
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        // vst4q interleaves the word registers back into stream order
+        float32x4x4_t floats = { {
+            unit_float_neon(c0, minv, rangev),
+            unit_float_neon(c1, minv, rangev),
+            unit_float_neon(c2, minv, rangev),
+            unit_float_neon(c3, minv, rangev),
+        } };
+        vst4q_f32(out + b * 4, floats);
+    }
+
+    fill_blocks_scalar(stream, firstBlock + b, blockCount - b, out + b * 4, min, range);
+}
+
+#else
+
+#define fill_blocks_simd fill_blocks_scalar
+
+#endif
+
+//------------------------------------------------------------------------------
+
+void random_stream_fill_float(random_stream *stream, float *out, size_t count, float min, float max) {
+    // finish the current block one by one so the bulk part starts on a block boundary
+    while (count > 0 && (stream->position & 3) != 0) {
+        *out++ = random_stream_next_float(stream, min, max);
+        count--;
+    }
+
+    size_t blockCount = count / 4;
+    fill_blocks_simd(stream, stream->position >> 2, blockCount, out, min, max - min);
+    stream->position += (uint64_t)blockCount * 4;
+    out += blockCount * 4;
+    count -= blockCount * 4;
+
+    while (count > 0) {
+        *out++ = random_stream_next_float(stream, min, max);
+        count--;
+    }
+}
+
+void random_stream_fill_float3(random_stream *stream, vector_float3 *out, size_t count, float min, float max) {
+    enum { ChunkSize = 64 };
+    float values[ChunkSize * 3];
+
+    while (count > 0) {
+        size_t n = count < ChunkSize ? count : ChunkSize;
+        random_stream_fill_float(stream, values, n * 3, min, max);
+        for (size_t i = 0; i < n; i++) {
+            out[i].x = values[i * 3];
+            out[i].y = values[i * 3 + 1];
+            out[i].z = values[i * 3 + 2];
+        }
+        out += n;
+        count -= n;
+    }
+}
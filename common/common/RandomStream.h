@@ -0,0 +1,46 @@
+//
+//  RandomStream.h
+//  common
+//
+//  Counter-based random streams (Philox4x32-10).
+//
+//  Unlike seedRand/randi/randf there is no global state: every stream is a small
+//  value type seeded explicitly, so scene setup is reproducible across runs and
+//  different threads can fill their own streams in parallel. Streams created
+//  with the same seed and different stream ids never overlap.
+//
+
+#ifndef RandomStream_h
+#define RandomStream_h
+
+#include <common/MathTypes.h>
+
+typedef struct random_stream {
+    uint32_t key[2];
+    uint32_t streamId[2];
+    /// Index of the next output, every counter value yields four 32-bit outputs.
+    uint64_t position;
+    uint64_t cachedBlock;
+    uint32_t cache[4];
+} random_stream;
+
+/// Seeds a stream, `streamId` selects an independent sequence for the same seed.
+void random_stream_init(random_stream *stream, uint64_t seed, uint64_t streamId);
+
+/// Moves the stream `count` outputs ahead in O(1).
+void random_stream_skip(random_stream *stream, uint64_t count);
+
+/// Returns the next 32-bit random integer.
+uint32_t random_stream_next_u32(random_stream *stream);
+
+/// Returns the next float uniformly distributed between min and max.
+float random_stream_next_float(random_stream *stream, float min, float max);
+
+/// Fills `count` floats between min and max. Produces the same values as calling
+/// random_stream_next_float `count` times, four Philox blocks are generated per SIMD step.
+void random_stream_fill_float(random_stream *stream, float *out, size_t count, float min, float max);
+
+/// Fills `count` vectors between min and max, x, y and z take three consecutive outputs.
+void random_stream_fill_float3(random_stream *stream, vector_float3 *out, size_t count, float min, float max);
+
+#endif /* RandomStream_h */
@@ -0,0 +1,110 @@
+//
+//  SkinnedVertex.c
+//  common
+//
+
+#include "SkinnedVertex.h"
+#include <common/HalfFloat.h>
+#include <math.h>
+
+static inline int16_t snorm16_from_float(float f) {
+    f = f > 1.0f ? 1.0f : (f < -1.0f ? -1.0f : f);
+    return (int16_t)lrintf(f * 32767.0f);
+}
+
+static inline float float_from_snorm16(int16_t s) {
+    float f = s / 32767.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+// Scales the weights to integers summing to exactly 255, the rounding units
+// left over go to the largest remainders so the error stays below 1/255.
+static void quantize_weights(uint8_t out[4], const float weights[4]) {
+    float w[4];
+    float sum = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        w[i] = weights[i] > 0.0f ? weights[i] : 0.0f;
+        sum += w[i];
+    }
+    if (!(sum > 0.0f)) {
+        out[0] = 255;
+        out[1] = out[2] = out[3] = 0;
+        return;
+    }
+
+    float remainders[4];
+    int total = 0;
+    for (int i = 0; i < 4; i++) {
+        float scaled = w[i] / sum * 255.0f;
+        int floored = (int)scaled;
+        floored = floored > 255 ? 255 : floored;
+        out[i] = (uint8_t)floored;
+        remainders[i] = scaled - floored;
+        total += floored;
+    }
+    for (; total < 255; total++) {
+        int best = 0;
+        for (int i = 1; i < 4; i++) {
+            if (remainders[i] > remainders[best]) {
+                best = i;
+            }
+        }
+        out[best]++;
+        remainders[best] = -1.0f;
+    }
+}
+
+bool skinned_vertex_pack(skinned_vertex *out,
+                         const float position[3],
+                         const float normal[3],
+                         const float texCoord[2],
+                         const float joints[4],
+                         const float weights[4]) {
+    for (int i = 0; i < 3; i++) {
+        out->position[i] = position[i];
+        out->normal[i] = snorm16_from_float(normal[i]);
+    }
+    out->normal[3] = 0;
+    float16_from_float32_n(out->texCoord, texCoord, 2);
+
+    quantize_weights(out->weights, weights);
+    for (int i = 0; i < 4; i++) {
+        if (out->weights[i] == 0) {
+            out->joints[i] = 0;
+            continue;
+        }
+        float joint = joints[i];
+        if (!(joint >= 0.0f && joint <= SKINNED_VERTEX_MAX_JOINT)) {
+            return false;
+        }
+        out->joints[i] = (uint8_t)lrintf(joint);
+    }
+    return true;
+}
+
+void skinned_vertex_unpack(const skinned_vertex *vertex,
+                           float position[3],
+                           float normal[3],
+                           float texCoord[2],
+                           uint32_t joints[4],
+                           float weights[4]) {
+    for (int i = 0; i < 3; i++) {
+        if (position) {
+            position[i] = vertex->position[i];
+        }
+        if (normal) {
+            normal[i] = float_from_snorm16(vertex->normal[i]);
+        }
+    }
+    if (texCoord) {
+        float32_from_float16_n(texCoord, vertex->texCoord, 2);
+    }
+    for (int i = 0; i < 4; i++) {
+        if (joints) {
+            joints[i] = vertex->joints[i];
+        }
+        if (weights) {
+            weights[i] = vertex->weights[i] / 255.0f;
+        }
+    }
+}
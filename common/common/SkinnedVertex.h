@@ -0,0 +1,56 @@
+//
+//  SkinnedVertex.h
+//  common
+//
+//  Packed skinned vertex, 32 bytes instead of the 80 of the float layout.
+//
+//  Positions stay full floats. Normals are snorm16, texture coordinates are
+//  halfs, joints are 8-bit indices and weights are unorm8 that always sum to
+//  exactly 255, so a skin never gains or loses weight after quantization.
+//  Matching MTLVertexFormats: Float3, Short4Normalized, Half2, UChar4 and
+//  UChar4Normalized at the offsets of the struct members.
+//
+
+#ifndef SkinnedVertex_h
+#define SkinnedVertex_h
+
+#include <common/MathTypes.h>
+#include <stdbool.h>
+
+/// Largest joint index a packed vertex can reference.
+#define SKINNED_VERTEX_MAX_JOINT 255
+
+typedef struct skinned_vertex {
+    float position[3];
+    /// snorm16, w is 0
+    int16_t normal[4];
+    /// binary16
+    uint16_t texCoord[2];
+    uint8_t joints[4];
+    /// unorm8, sums to 255
+    uint8_t weights[4];
+} skinned_vertex;
+
+_Static_assert(sizeof(skinned_vertex) == 32, "skinned_vertex must stay 32 bytes");
+
+/// Packs one vertex. Negative weights count as zero and the weights are
+/// renormalized, a vertex without weight is bound fully to its first joint.
+/// Joints with zero weight are stored as 0. Returns false, leaving `out`
+/// undefined, if a weighted joint is above SKINNED_VERTEX_MAX_JOINT.
+bool skinned_vertex_pack(skinned_vertex *out,
+                         const float position[3],
+                         const float normal[3],
+                         const float texCoord[2],
+                         const float joints[4],
+                         const float weights[4]);
+
+/// Decodes a packed vertex with the same conversions the vertex fetch does.
+/// Any argument except `vertex` may be NULL.
+void skinned_vertex_unpack(const skinned_vertex *vertex,
+                           float position[3],
+                           float normal[3],
+                           float texCoord[2],
+                           uint32_t joints[4],
+                           float weights[4]);
+
+#endif /* SkinnedVertex_h */
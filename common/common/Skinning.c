@@ -0,0 +1,357 @@
+//
+//  Skinning.c
+//  common
+//
+//  Every kernel blends the four palette columns of a vertex first, then does a
+//  single matrix-vector product for the position and one for the normal.
+//  Joints with zero weight are skipped, most vertices only use one or two.
+//
+
+#include "Skinning.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SKINNING_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SKINNING_NEON 1
+#endif
+
+#define SNORM16_SCALE (1.0f / 32767.0f)
+#define UNORM8_SCALE (1.0f / 255.0f)
+
+//------------------------------------------------------------------------------
+// scalar
+
+#if !SKINNING_X86 && !SKINNING_NEON
+
+static void linear_blend_scalar(vector_float3 *positions,
+                                vector_float3 *normals,
+                                const skinned_vertex *vertices,
+                                const matrix_float4x4 *palette,
+                                size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const skinned_vertex *v = &vertices[i];
+        float m[4][3] = { { 0 } };
+        for (int k = 0; k < 4; k++) {
+            if (!v->weights[k]) {
+                continue;
+            }
+            float w = v->weights[k] * UNORM8_SCALE;
+            const float *bone = (const float *)&palette[v->joints[k]];
+            for (int c = 0; c < 4; c++) {
+                m[c][0] += w * bone[c * 4];
+                m[c][1] += w * bone[c * 4 + 1];
+                m[c][2] += w * bone[c * 4 + 2];
+            }
+        }
+
+        const float *p = v->position;
+        positions[i].x = m[0][0] * p[0] + m[1][0] * p[1] + m[2][0] * p[2] + m[3][0];
+        positions[i].y = m[0][1] * p[0] + m[1][1] * p[1] + m[2][1] * p[2] + m[3][1];
+        positions[i].z = m[0][2] * p[0] + m[1][2] * p[1] + m[2][2] * p[2] + m[3][2];
+
+        if (normals) {
+            float n[3];
+            for (int c = 0; c < 3; c++) {
+                n[c] = v->normal[c] * SNORM16_SCALE;
+                n[c] = n[c] < -1.0f ? -1.0f : n[c];
+            }
+            normals[i].x = m[0][0] * n[0] + m[1][0] * n[1] + m[2][0] * n[2];
+            normals[i].y = m[0][1] * n[0] + m[1][1] * n[1] + m[2][1] * n[2];
+            normals[i].z = m[0][2] * n[0] + m[1][2] * n[1] + m[2][2] * n[2];
+        }
+    }
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// SSE2 / AVX2
+
+#if SKINNING_X86
+
+static int has_avx2_fma(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        cached = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return cached;
+}
+
+static inline __m128 load_normal_sse(const skinned_vertex *v) {
+    // sign extend the four int16 into int32, then scale and clamp like the vertex fetch
+    __m128i n = _mm_loadl_epi64((const __m128i *)v->normal);
+    n = _mm_srai_epi32(_mm_unpacklo_epi16(n, n), 16);
+    __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(n), _mm_set1_ps(SNORM16_SCALE));
+    return _mm_max_ps(f, _mm_set1_ps(-1.0f));
+}
+
+static void linear_blend_sse(vector_float3 *positions,
+                             vector_float3 *normals,
+                             const skinned_vertex *vertices,
+                             const matrix_float4x4 *palette,
+                             size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const skinned_vertex *v = &vertices[i];
+        __m128 c0 = _mm_setzero_ps(), c1 = c0, c2 = c0, c3 = c0;
+        for (int k = 0; k < 4; k++) {
+            if (!v->weights[k]) {
+                continue;
+            }
+            __m128 w = _mm_set1_ps(v->weights[k] * UNORM8_SCALE);
+            const float *bone = (const float *)&palette[v->joints[k]];
+            c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(bone)));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(bone + 4)));
+            c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(bone + 8)));
+            c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(bone + 12)));
+        }
+
+        __m128 pos = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v->position[0])),
+                                           _mm_mul_ps(c1, _mm_set1_ps(v->position[1]))),
+                                _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v->position[2])), c3));
+        _mm_storeu_ps((float *)&positions[i], pos);
+
+        if (normals) {
+            __m128 n = load_normal_sse(v);
+            __m128 nrm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(n, n, 0x00)),
+                                               _mm_mul_ps(c1, _mm_shuffle_ps(n, n, 0x55))),
+                                    _mm_mul_ps(c2, _mm_shuffle_ps(n, n, 0xAA)));
+            _mm_storeu_ps((float *)&normals[i], nrm);
+        }
+    }
+}
+
+// Columns 0, 1 and columns 2, 3 of the blended matrix share a register, the
+// two halves of each product are added at the end.
+__attribute__((target("avx2,fma")))
+static void linear_blend_avx2(vector_float3 *positions,
+                              vector_float3 *normals,
+                              const skinned_vertex *vertices,
+                              const matrix_float4x4 *palette,
+                              size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const skinned_vertex *v = &vertices[i];
+        __m256 c01 = _mm256_setzero_ps(), c23 = c01;
+        for (int k = 0; k < 4; k++) {
+            if (!v->weights[k]) {
+                continue;
+            }
+            __m256 w = _mm256_set1_ps(v->weights[k] * UNORM8_SCALE);
+            const float *bone = (const float *)&palette[v->joints[k]];
+            c01 = _mm256_fmadd_ps(w, _mm256_loadu_ps(bone), c01);
+            c23 = _mm256_fmadd_ps(w, _mm256_loadu_ps(bone + 8), c23);
+        }
+
+        __m256 pxy = _mm256_insertf128_ps(_mm256_set1_ps(v->position[0]), _mm_set1_ps(v->position[1]), 1);
+        __m256 pz1 = _mm256_insertf128_ps(_mm256_set1_ps(v->position[2]), _mm_set1_ps(1.0f), 1);
+        __m256 pos = _mm256_fmadd_ps(c01, pxy, _mm256_mul_ps(c23, pz1));
+        _mm_storeu_ps((float *)&positions[i],
+                      _mm_add_ps(_mm256_castps256_ps128(pos), _mm256_extractf128_ps(pos, 1)));
+
+        if (normals) {
+            __m128 n = load_normal_sse(v);
+            __m256 nxy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_shuffle_ps(n, n, 0x00)),
+                                              _mm_shuffle_ps(n, n, 0x55), 1);
+            __m256 nz0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_shuffle_ps(n, n, 0xAA)),
+                                              _mm_setzero_ps(), 1);
+            __m256 nrm = _mm256_fmadd_ps(c01, nxy, _mm256_mul_ps(c23, nz0));
+            _mm_storeu_ps((float *)&normals[i],
+                          _mm_add_ps(_mm256_castps256_ps128(nrm), _mm256_extractf128_ps(nrm, 1)));
+        }
+    }
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// NEON
+
+#if SKINNING_NEON
+
+static void linear_blend_neon(vector_float3 *positions,
+                              vector_float3 *normals,
+                              const skinned_vertex *vertices,
+                              const matrix_float4x4 *palette,
+                              size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const skinned_vertex *v = &vertices[i];
+        float32x4_t c0 = vdupq_n_f32(0.0f), c1 = c0, c2 = c0, c3 = c0;
+        for (int k = 0; k < 4; k++) {
+            if (!v->weights[k]) {
+                continue;
+            }
+            float w = v->weights[k] * UNORM8_SCALE;
+            const float *bone = (const float *)&palette[v->joints[k]];
+            c0 = vfmaq_n_f32(c0, vld1q_f32(bone), w);
+            c1 = vfmaq_n_f32(c1, vld1q_f32(bone + 4), w);
+            c2 = vfmaq_n_f32(c2, vld1q_f32(bone + 8), w);
+            c3 = vfmaq_n_f32(c3, vld1q_f32(bone + 12), w);
+        }
+
+        float32x4_t pos = vfmaq_n_f32(c3, c0, v->position[0]);
+        pos = vfmaq_n_f32(pos, c1, v->position[1]);
+        pos = vfmaq_n_f32(pos, c2, v->position[2]);
+        vst1q_f32((float *)&positions[i], pos);
+
+        if (normals) {
+            float32x4_t n = vcvtq_f32_s32(vmovl_s16(vld1_s16(v->normal)));
+            n = vmaxq_f32(vmulq_n_f32(n, SNORM16_SCALE), vdupq_n_f32(-1.0f));
+            float32x4_t nrm = vmulq_laneq_f32(c0, n, 0);
+            nrm = vfmaq_laneq_f32(nrm, c1, n, 1);
+            nrm = vfmaq_laneq_f32(nrm, c2, n, 2);
+            vst1q_f32((float *)&normals[i], nrm);
+        }
+    }
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// dual quaternion
+
+static inline void cross3(float out[3], const float a[3], const float b[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void skinning_dual_quaternion(vector_float3 *positions,
+                              vector_float3 *normals,
+                              const skinned_vertex *vertices,
+                              const dual_quaternion *palette,
+                              size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const skinned_vertex *v = &vertices[i];
+        float real[4] = { 0 };
+        float dual[4] = { 0 };
+        // the first joint picks the hemisphere even without weight, as in the shader
+        const float *pivot = (const float *)&palette[v->joints[0]];
+        for (int k = 0; k < 4; k++) {
+            if (!v->weights[k]) {
+                continue;
+            }
+            const float *bone = (const float *)&palette[v->joints[k]];
+            // q and -q are the same rotation, take the one closest to the first joint
+            float dot = bone[0] * pivot[0] + bone[1] * pivot[1] + bone[2] * pivot[2] + bone[3] * pivot[3];
+            float w = v->weights[k] * UNORM8_SCALE;
+            w = dot < 0.0f ? -w : w;
+            for (int c = 0; c < 4; c++) {
+                real[c] += w * bone[c];
+                dual[c] += w * bone[4 + c];
+            }
+        }
+
+        float length = 1.0f / sqrtf(real[0] * real[0] + real[1] * real[1] + real[2] * real[2] + real[3] * real[3]);
+        for (int c = 0; c < 4; c++) {
+            real[c] *= length;
+            dual[c] *= length;
+        }
+
+        // t = 2 * (w * dual.xyz - dual.w * real.xyz + real.xyz x dual.xyz)
+        float t[3], rxd[3];
+        cross3(rxd, real, dual);
+        for (int c = 0; c < 3; c++) {
+            t[c] = 2.0f * (real[3] * dual[c] - dual[3] * real[c] + rxd[c]);
+        }
+
+        // p' = p + 2 * real.xyz x (real.xyz x p + w * p) + t
+        float a[3], b[3];
+        cross3(a, real, v->position);
+        for (int c = 0; c < 3; c++) {
+            a[c] += real[3] * v->position[c];
+        }
+        cross3(b, real, a);
+        positions[i].x = v->position[0] + 2.0f * b[0] + t[0];
+        positions[i].y = v->position[1] + 2.0f * b[1] + t[1];
+        positions[i].z = v->position[2] + 2.0f * b[2] + t[2];
+
+        if (normals) {
+            float n[3];
+            for (int c = 0; c < 3; c++) {
+                n[c] = v->normal[c] * SNORM16_SCALE;
+                n[c] = n[c] < -1.0f ? -1.0f : n[c];
+            }
+            cross3(a, real, n);
+            for (int c = 0; c < 3; c++) {
+                a[c] += real[3] * n[c];
+            }
+            cross3(b, real, a);
+            normals[i].x = n[0] + 2.0f * b[0];
+            normals[i].y = n[1] + 2.0f * b[1];
+            normals[i].z = n[2] + 2.0f * b[2];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void skinning_linear_blend(vector_float3 *positions,
+                           vector_float3 *normals,
+                           const skinned_vertex *vertices,
+                           const matrix_float4x4 *palette,
+                           size_t count) {
+#if SKINNING_X86
+    if (has_avx2_fma()) {
+        linear_blend_avx2(positions, normals, vertices, palette, count);
+    } else {
+        linear_blend_sse(positions, normals, vertices, palette, count);
+    }
+#elif SKINNING_NEON
+    linear_blend_neon(positions, normals, vertices, palette, count);
+#else
+    linear_blend_scalar(positions, normals, vertices, palette, count);
+#endif
+}
+
+enum {
+    // a few thousand vertices per job, big enough to hide the scheduling cost
+    SkinningGrain = 2048,
+};
+
+typedef struct skinning_job {
+    vector_float3 *positions;
+    vector_float3 *normals;
+    const skinned_vertex *vertices;
+    const matrix_float4x4 *palette;
+    const dual_quaternion *dualQuaternions;
+} skinning_job;
+
+static void skinning_job_run(void *context, size_t begin, size_t end) {
+    const skinning_job *job = context;
+    skinning_linear_blend(job->positions + begin,
+                          job->normals ? job->normals + begin : NULL,
+                          job->vertices + begin,
+                          job->palette,
+                          end - begin);
+}
+
+void skinning_linear_blend_parallel(vector_float3 *positions,
+                                    vector_float3 *normals,
+                                    const skinned_vertex *vertices,
+                                    const matrix_float4x4 *palette,
+                                    size_t count,
+                                    job_pool *pool) {
+    skinning_job job = { positions, normals, vertices, palette, NULL };
+    job_pool_parallel_for(pool, count, SkinningGrain, skinning_job_run, &job);
+}
+
+static void dual_quaternion_job_run(void *context, size_t begin, size_t end) {
+    const skinning_job *job = context;
+    skinning_dual_quaternion(job->positions + begin,
+                             job->normals ? job->normals + begin : NULL,
+                             job->vertices + begin,
+                             job->dualQuaternions,
+                             end - begin);
+}
+
+void skinning_dual_quaternion_parallel(vector_float3 *positions,
+                                       vector_float3 *normals,
+                                       const skinned_vertex *vertices,
+                                       const dual_quaternion *palette,
+                                       size_t count,
+                                       job_pool *pool) {
+    skinning_job job = { positions, normals, vertices, NULL, palette };
+    job_pool_parallel_for(pool, count, SkinningGrain, dual_quaternion_job_run, &job);
+}
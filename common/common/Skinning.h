@@ -0,0 +1,62 @@
+//
+//  Skinning.h
+//  common
+//
+//  CPU linear blend skinning, the reference for SkinAnimation's vertex shader.
+//
+//  Takes the same packed vertices and bone palette the GPU gets: every vertex
+//  is transformed by the weighted sum of its joints' palette matrices. Uses
+//  AVX2 + FMA when the CPU has it, SSE2 or NEON otherwise, and a scalar
+//  fallback everywhere else. The kernels differ by rounding only.
+//
+//  Dual quaternion skinning blends the rigid bone transforms instead of the
+//  matrices, which keeps twisting joints from collapsing. It is the reference
+//  for the dual quaternion vertex shader and runs the same scalar code on
+//  every platform.
+//
+
+#ifndef Skinning_h
+#define Skinning_h
+
+#include <common/MathTypes.h>
+#include <common/SkinnedVertex.h>
+#include <common/BonePalette.h>
+#include <common/JobPool.h>
+
+/// Skins `count` vertices against `palette`, palette entries as written by
+/// bone_palette_pack. Normals are skinned with the same matrix and are not
+/// renormalized, as in the shader. `normals` may be NULL.
+void skinning_linear_blend(vector_float3 *positions,
+                           vector_float3 *normals,
+                           const skinned_vertex *vertices,
+                           const matrix_float4x4 *palette,
+                           size_t count);
+
+/// skinning_linear_blend split across `pool`, bit-identical to it. A NULL pool
+/// runs inline.
+void skinning_linear_blend_parallel(vector_float3 *positions,
+                                    vector_float3 *normals,
+                                    const skinned_vertex *vertices,
+                                    const matrix_float4x4 *palette,
+                                    size_t count,
+                                    job_pool *pool);
+
+/// Dual quaternion skinning of `count` vertices against a palette from
+/// bone_palette_pack_dual_quaternion. Joints are blended on the hemisphere of
+/// the first joint and the result is normalized. `normals` may be NULL.
+void skinning_dual_quaternion(vector_float3 *positions,
+                              vector_float3 *normals,
+                              const skinned_vertex *vertices,
+                              const dual_quaternion *palette,
+                              size_t count);
+
+/// skinning_dual_quaternion split across `pool`, bit-identical to it. A NULL
+/// pool runs inline.
+void skinning_dual_quaternion_parallel(vector_float3 *positions,
+                                       vector_float3 *normals,
+                                       const skinned_vertex *vertices,
+                                       const dual_quaternion *palette,
+                                       size_t count,
+                                       job_pool *pool);
+
+#endif /* Skinning_h */
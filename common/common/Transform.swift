@@ -22,38 +22,93 @@ open class Transform: NSObject {
     @objc
     public private(set) weak var parent: Transform? = nil
     
+    /// World matrix evaluations done by every transform, lets tests and profiling
+    /// check how much work an update does.
     @objc
-    public private(set) var modelMatrix: matrix_float4x4 = matrix_identity_float4x4
+    public private(set) static var modelMatrixEvaluationCount: Int = 0
     
     @objc
-    public var position: vector_float3 = vector_float3(repeating: 0.0) {
-        didSet {
-            forceCalculateModelMatrix()
+    public static func resetModelMatrixEvaluationCount() {
+        modelMatrixEvaluationCount = 0
+    }
+    
+    /// World matrix, evaluated lazily. Reading it only resolves this node and
+    /// its stale ancestors; updateModelMatrixIfNeeded() refreshes a whole tree.
+    @objc
+    public var modelMatrix: matrix_float4x4 {
+        if let hierarchy = hierarchy {
+            return hierarchy.modelMatrix(at: hierarchyIndex)
+        }
+        if isModelMatrixDirty {
+            evaluateModelMatrix()
+            // the children are still stale, keep them reachable for the top-down pass
+            hasDirtyDescendant = hasDirtyDescendant || !children.isEmpty
+        }
+        return cachedModelMatrix
+    }
+    
+    @objc
+    public var position: vector_float3 {
+        get { return localPosition }
+        set {
+            localPosition = newValue
+            setNeedsUpdateLocalMatrix()
         }
     }
     
     @objc
-    public var quaternionVect: vector_float4 = vector_float4(0.0, 0.0, 0.0, 1.0) {
-        didSet {
-            forceCalculateModelMatrix()
+    public var quaternionVect: vector_float4 {
+        get { return localQuaternion }
+        set {
+            localQuaternion = newValue
+            setNeedsUpdateLocalMatrix()
         }
     }
     
     @objc
-    public var scale: vector_float3 = vector_float3(repeating: 1.0) {
-        didSet {
-            forceCalculateModelMatrix()
+    public var scale: vector_float3 {
+        get { return localScale }
+        set {
+            localScale = newValue
+            setNeedsUpdateLocalMatrix()
         }
     }
     
+    private var localPosition: vector_float3 = vector_float3(repeating: 0.0)
+    private var localQuaternion: vector_float4 = vector_float4(0.0, 0.0, 0.0, 1.0)
+    private var localScale: vector_float3 = vector_float3(repeating: 1.0)
+    
+    private var localMatrix: matrix_float4x4 = matrix_identity_float4x4
+    private var cachedModelMatrix: matrix_float4x4 = matrix_identity_float4x4
+    
+    private var isLocalMatrixDirty = false
+    // A dirty node always has dirty descendants, so a clean node has clean ancestors.
+    private var isModelMatrixDirty = false
+    // Set on the ancestors of dirty nodes, lets the top-down pass skip clean subtrees.
+    private var hasDirtyDescendant = false
+    
+    // Set while this transform is a handle into a TransformHierarchy store.
+    private(set) weak var hierarchy: TransformHierarchy? = nil
+    private(set) var hierarchyIndex: Int32 = -1
+    
+    /// Sets position, rotation and scale together, invalidating the subtree once.
+    @objc
+    public func setTRS(position: vector_float3, quaternion: vector_float4, scale: vector_float3) {
+        localPosition = position
+        localQuaternion = quaternion
+        localScale = scale
+        setNeedsUpdateLocalMatrix()
+    }
+    
     @objc
     public func add(child: Transform, notifyChild: Bool = true) {
         if (!children.contains(child)) {
+            hierarchy?.unbind()
+
             children.append(child)
             
             if notifyChild {
                 child.setParent(self, notifyParent: false)
-                child.forceCalculateModelMatrix()
             }
         }
         
@@ -62,44 +117,128 @@ open class Transform: NSObject {
     @objc
     public func remove(child: Transform, notifyChild: Bool = true) {
         if children.contains(child) {
+            hierarchy?.unbind()
+
             children.removeAll(where: { $0 == child })
             
             if notifyChild {
                 child.setParent(nil, notifyParent: false)
-                child.forceCalculateModelMatrix()
             }
         }
     }
     
     @objc
     public func setParent(_ parent: Transform?, notifyParent: Bool = false) {
+        hierarchy?.unbind()
+        parent?.hierarchy?.unbind()
+        
         if notifyParent {
             parent?.remove(child: self, notifyChild: false)
         }
         
         self.parent = parent
-        forceCalculateModelMatrix()
+        setNeedsUpdateModelMatrix()
         
         if (notifyParent) {
             parent?.add(child: self, notifyChild: false)
         }
     }
     
+    /// Single top-down pass that evaluates every stale world matrix in this
+    /// subtree once, clean subtrees are not visited.
     @objc
-    public func forceCalculateModelMatrix() {
-        // let translation to be the left-hand metal normlized space.
-        let mat = matrix_multiply(matrix4x4_translation(vector_float3(-position.x, position.y, -position.z)),
-                                  matrix_multiply(matrix4x4_from_quaternion(quaternionVect), matrix4x4_scale(scale)))
+    public func updateModelMatrixIfNeeded() {
+        if let hierarchy = hierarchy {
+            hierarchy.update()
+            return
+        }
         
-        if parent != nil {
-            modelMatrix = matrix_multiply(parent!.modelMatrix, mat)
-        } else {
-            modelMatrix = mat
+        let visitChildren = isModelMatrixDirty || hasDirtyDescendant
+        if isModelMatrixDirty {
+            evaluateModelMatrix()
         }
+        hasDirtyDescendant = false
+        
+        if visitChildren {
+            for child in children where child.isModelMatrixDirty || child.hasDirtyDescendant {
+                child.updateModelMatrixIfNeeded()
+            }
+        }
+    }
+    
+    /// Re-evaluates every world matrix in this subtree, dirty or not.
+    @objc
+    public func forceCalculateModelMatrix() {
+        if let hierarchy = hierarchy {
+            hierarchy.forceUpdate()
+            return
+        }
+        
+        evaluateModelMatrix()
+        hasDirtyDescendant = false
         
         children.forEach {
             $0.forceCalculateModelMatrix()
         }
     }
     
+    func bind(to hierarchy: TransformHierarchy, index: Int32) {
+        self.hierarchy = hierarchy
+        hierarchyIndex = index
+        hierarchy.setTRS(at: index, position: localPosition, quaternion: localQuaternion, scale: localScale)
+    }
+    
+    func unbindHierarchy() {
+        hierarchy = nil
+        hierarchyIndex = -1
+        setNeedsUpdateLocalMatrix()
+    }
+    
+    private func setNeedsUpdateLocalMatrix() {
+        if let hierarchy = hierarchy {
+            hierarchy.setTRS(at: hierarchyIndex, position: localPosition, quaternion: localQuaternion, scale: localScale)
+            return
+        }
+        
+        isLocalMatrixDirty = true
+        setNeedsUpdateModelMatrix()
+    }
+    
+    private func setNeedsUpdateModelMatrix() {
+        markModelMatrixDirty()
+        
+        var ancestor = parent
+        while let node = ancestor, !node.hasDirtyDescendant {
+            node.hasDirtyDescendant = true
+            ancestor = node.parent
+        }
+    }
+    
+    private func markModelMatrixDirty() {
+        // already dirty means the whole subtree is, stop here
+        guard !isModelMatrixDirty else { return }
+        isModelMatrixDirty = true
+        
+        children.forEach {
+            $0.markModelMatrixDirty()
+        }
+    }
+    
+    private func evaluateModelMatrix() {
+        if isLocalMatrixDirty {
+            // let translation to be the left-hand metal normlized space.
+            localMatrix = matrix_multiply(matrix4x4_translation(vector_float3(-localPosition.x, localPosition.y, -localPosition.z)),
+                                          matrix_multiply(matrix4x4_from_quaternion(localQuaternion), matrix4x4_scale(localScale)))
+            isLocalMatrixDirty = false
+        }
+        
+        if let parent = parent {
+            cachedModelMatrix = matrix_multiply(parent.modelMatrix, localMatrix)
+        } else {
+            cachedModelMatrix = localMatrix
+        }
+        isModelMatrixDirty = false
+        Transform.modelMatrixEvaluationCount += 1
+    }
+    
 }
@@ -0,0 +1,188 @@
+//
+//  TransformHierarchy.c
+//  common
+//
+
+#include "TransformHierarchy.h"
+#include <common/MatrixBatch.h>
+#include <stdlib.h>
+
+static const matrix_float4x4 kIdentity = { {
+    { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 },
+} };
+
+static inline vector_float3 make_float3(float x, float y, float z) {
+    vector_float3 v;
+    v.x = x; v.y = y; v.z = z;
+    return v;
+}
+
+static bool reserve(transform_hierarchy *h, size_t capacity) {
+    if (capacity <= h->capacity) {
+        return true;
+    }
+
+    // a failed realloc keeps the old block, so h stays usable at its old capacity
+    void *parents = realloc(h->parents, sizeof(int32_t) * capacity);
+    if (parents) h->parents = parents;
+    void *translations = realloc(h->translations, sizeof(vector_float3) * capacity);
+    if (translations) h->translations = translations;
+    void *rotations = realloc(h->rotations, sizeof(quaternion_float) * capacity);
+    if (rotations) h->rotations = rotations;
+    void *scales = realloc(h->scales, sizeof(vector_float3) * capacity);
+    if (scales) h->scales = scales;
+    void *locals = realloc(h->localMatrices, sizeof(matrix_float4x4) * capacity);
+    if (locals) h->localMatrices = locals;
+    void *worlds = realloc(h->worldMatrices, sizeof(matrix_float4x4) * capacity);
+    if (worlds) h->worldMatrices = worlds;
+    void *scratch = realloc(h->scratch, sizeof(matrix_float4x4) * capacity);
+    if (scratch) h->scratch = scratch;
+
+    if (!parents || !translations || !rotations || !scales || !locals || !worlds || !scratch) {
+        return false;
+    }
+    h->capacity = capacity;
+    return true;
+}
+
+transform_hierarchy *transform_hierarchy_create(size_t capacity) {
+    transform_hierarchy *h = calloc(1, sizeof(transform_hierarchy));
+    if (h && !reserve(h, capacity > 0 ? capacity : 16)) {
+        transform_hierarchy_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+void transform_hierarchy_destroy(transform_hierarchy *h) {
+    if (!h) return;
+    free(h->parents);
+    free(h->translations);
+    free(h->rotations);
+    free(h->scales);
+    free(h->localMatrices);
+    free(h->worldMatrices);
+    free(h->scratch);
+    free(h);
+}
+
+int32_t transform_hierarchy_add(transform_hierarchy *h, int32_t parent) {
+    if (parent < -1 || parent >= (int32_t)h->count || h->count >= INT32_MAX) {
+        return -1;
+    }
+    if (h->count == h->capacity && !reserve(h, h->capacity * 2)) {
+        return -1;
+    }
+
+    int32_t index = (int32_t)h->count++;
+    h->parents[index] = parent;
+    h->translations[index] = make_float3(0, 0, 0);
+    h->rotations[index] = (quaternion_float){ 0, 0, 0, 1 };
+    h->scales[index] = make_float3(1, 1, 1);
+    h->localMatrices[index] = kIdentity;
+    h->worldMatrices[index] = kIdentity;
+    h->needsUpdate = true;
+    return index;
+}
+
+void transform_hierarchy_set_trs(transform_hierarchy *h,
+                                 int32_t index,
+                                 vector_float3 translation,
+                                 quaternion_float rotation,
+                                 vector_float3 scale) {
+    h->translations[index] = translation;
+    h->rotations[index] = rotation;
+    h->scales[index] = scale;
+    h->needsUpdate = true;
+}
+
+// Gathers the parent world matrices of run items [begin, end) and multiplies them
+// in one batch. A run starts at `start` and all of its parents precede it.
+static void sweep_run(transform_hierarchy *h, size_t start, size_t begin, size_t end) {
+    for (size_t k = begin; k < end; k++) {
+        int32_t parent = h->parents[start + k];
+        h->scratch[k] = parent < 0 ? kIdentity : h->worldMatrices[parent];
+    }
+    matrix4x4_multiply_n(h->worldMatrices + start + begin, h->scratch + begin,
+                         h->localMatrices + start + begin, end - begin);
+}
+
+// Returns the end of the run starting at `start`, runs stop at `count`.
+static size_t run_end(const transform_hierarchy *h, size_t start, size_t count) {
+    size_t i = start;
+    while (i < count && h->parents[i] < (int32_t)start) {
+        i++;
+    }
+    return i;
+}
+
+static void update_nodes(transform_hierarchy *h, size_t count) {
+    matrix4x4_compose_trs_n(h->localMatrices, h->translations, h->rotations, h->scales, count);
+
+    // Split the sweep into runs whose parents all precede the run, every run is
+    // then a single batched multiply against the gathered parent matrices.
+    for (size_t start = 0; start < count;) {
+        size_t end = run_end(h, start, count);
+        sweep_run(h, start, 0, end - start);
+        start = end;
+    }
+}
+
+void transform_hierarchy_update(transform_hierarchy *h) {
+    update_nodes(h, h->count);
+    h->needsUpdate = false;
+}
+
+void transform_hierarchy_update_first(transform_hierarchy *h, size_t count) {
+    if (count >= h->count) {
+        transform_hierarchy_update(h);
+        return;
+    }
+    update_nodes(h, count);
+}
+
+//------------------------------------------------------------------------------
+// parallel update
+
+// The batch kernels handle up to eight matrices per step with a different
+// instruction mix for the tail, so chunks start on multiples of eight from the
+// beginning of the batch the serial update passes. Every matrix then goes
+// through the same code path and the result is bit-identical.
+enum {
+    ComposeGrain = 256,
+    SweepGrain = 128,
+    // shorter runs cost less than waking the workers
+    MinParallelRun = 4 * SweepGrain,
+};
+
+typedef struct {
+    transform_hierarchy *h;
+    size_t start;
+} sweep_job;
+
+static void compose_job(void *context, size_t begin, size_t end) {
+    transform_hierarchy *h = context;
+    matrix4x4_compose_trs_n(h->localMatrices + begin, h->translations + begin,
+                            h->rotations + begin, h->scales + begin, end - begin);
+}
+
+static void sweep_job_run(void *context, size_t begin, size_t end) {
+    sweep_job *job = context;
+    sweep_run(job->h, job->start, begin, end);
+}
+
+void transform_hierarchy_update_parallel(transform_hierarchy *h, job_pool *pool) {
+    job_pool_parallel_for(pool, h->count, ComposeGrain, compose_job, h);
+
+    // Runs depend on each other, the nodes inside a run don't. Breadth first
+    // order makes every depth level a run.
+    for (size_t start = 0; start < h->count;) {
+        size_t end = run_end(h, start, h->count);
+        sweep_job job = { h, start };
+        job_pool_parallel_for(end - start >= MinParallelRun ? pool : NULL,
+                              end - start, SweepGrain, sweep_job_run, &job);
+        start = end;
+    }
+
+    h->needsUpdate = false;
+}
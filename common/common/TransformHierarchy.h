@@ -0,0 +1,65 @@
+//
+//  TransformHierarchy.h
+//  common
+//
+//  Flat structure-of-arrays transform hierarchy.
+//
+//  Nodes are stored by index with the parent index of each node, parents always
+//  come before their children. Local TRS values and world matrices live in
+//  contiguous arrays, so an update is one batched compose followed by a single
+//  linear sweep over the world matrices.
+//
+
+#ifndef TransformHierarchy_h
+#define TransformHierarchy_h
+
+#include <stdbool.h>
+#include <common/MathTypes.h>
+#include <common/JobPool.h>
+
+typedef struct transform_hierarchy {
+    size_t count;
+    size_t capacity;
+    /// Parent index of every node, -1 for roots. parents[i] < i.
+    int32_t *parents;
+    vector_float3 *translations;
+    quaternion_float *rotations;
+    vector_float3 *scales;
+    matrix_float4x4 *localMatrices;
+    matrix_float4x4 *worldMatrices;
+    /// Set by the setters and transform_hierarchy_add, cleared by transform_hierarchy_update.
+    bool needsUpdate;
+    /// Parent world matrices gathered for the batched multiply.
+    matrix_float4x4 *scratch;
+} transform_hierarchy;
+
+/// Returns an empty hierarchy with room for `capacity` nodes, NULL if out of memory.
+transform_hierarchy *transform_hierarchy_create(size_t capacity);
+
+void transform_hierarchy_destroy(transform_hierarchy *hierarchy);
+
+/// Appends an identity node under `parent` (-1 for a root) and returns its index.
+/// Returns -1 if `parent` is not an existing node or the arrays can't grow.
+int32_t transform_hierarchy_add(transform_hierarchy *hierarchy, int32_t parent);
+
+/// Sets the local translation, unit rotation and scale of a node.
+void transform_hierarchy_set_trs(transform_hierarchy *hierarchy,
+                                 int32_t index,
+                                 vector_float3 translation,
+                                 quaternion_float rotation,
+                                 vector_float3 scale);
+
+/// Recomposes the local matrices and sweeps the world matrices, in that order,
+/// world = world[parent] * local.
+void transform_hierarchy_update(transform_hierarchy *hierarchy);
+
+/// transform_hierarchy_update for nodes [0, count) only, the other nodes keep
+/// their matrices and the hierarchy stays marked for update.
+void transform_hierarchy_update_first(transform_hierarchy *hierarchy, size_t count);
+
+/// Same as transform_hierarchy_update with the compose and every depth level
+/// split across `pool`. The world matrices are bit-identical to the serial update
+/// for any thread count. `pool` may be NULL.
+void transform_hierarchy_update_parallel(transform_hierarchy *hierarchy, job_pool *pool);
+
+#endif /* TransformHierarchy_h */
@@ -0,0 +1,116 @@
+//
+//  TransformHierarchy.swift
+//  common
+//
+
+import Foundation
+
+/// Flattens a Transform tree into a transform_hierarchy store.
+///
+/// While bound, every transform of the tree is a handle into the store: the TRS
+/// setters write the flat arrays and modelMatrix reads the swept world matrix,
+/// so a frame update is one linear pass instead of a walk over the object graph.
+/// Changing the parent of a bound transform unbinds the whole tree.
+@objc
+open class TransformHierarchy: NSObject {
+    
+    @objc
+    public let store: UnsafeMutablePointer<transform_hierarchy>
+    
+    /// Bound transforms in store order, parents before children.
+    @objc
+    public private(set) var transforms: [Transform] = []
+    
+    /// Binds `root` and its descendants. The store is rooted at `root`: a parent
+    /// of `root` is ignored, so every world matrix, and modelMatrix of the bound
+    /// transforms, is relative to that parent. Bind the topmost transform, or
+    /// multiply by the parent's modelMatrix where the tree is drawn. Throws, with
+    /// every transform left standalone, if the store can't grow.
+    @objc
+    public init(root: Transform) throws {
+        guard let store = transform_hierarchy_create(64) else {
+            throw Errors.runtimeError("out of memory for a transform hierarchy.")
+        }
+        self.store = store
+        super.init()
+        
+        // breadth first, so parents get lower indices and each depth level is contiguous
+        var nodes = [root]
+        var parents: [Int32] = [-1]
+        var head = 0
+        while head < nodes.count {
+            let node = nodes[head]
+            let index = transform_hierarchy_add(store, parents[head])
+            guard index >= 0 else {
+                // deinit unbinds the transforms bound so far
+                throw Errors.runtimeError("out of memory for \(nodes.count) transforms.")
+            }
+            node.bind(to: self, index: index)
+            transforms.append(node)
+            
+            for child in node.children {
+                nodes.append(child)
+                parents.append(index)
+            }
+            head += 1
+        }
+    }
+    
+    deinit {
+        unbind()
+        transform_hierarchy_destroy(store)
+    }
+    
+    @objc
+    public var count: Int {
+        return store.pointee.count
+    }
+    
+    /// Spreads update() across these threads, nil keeps it on the calling thread.
+    /// The world matrices are bit-identical either way.
+    @objc
+    public var jobPool: JobPool? = nil
+    
+    /// Recomposes and sweeps the store if any bound transform changed.
+    @objc
+    public func update() {
+        guard store.pointee.needsUpdate else {
+            return
+        }
+        if let jobPool = jobPool {
+            transform_hierarchy_update_parallel(store, jobPool.pool)
+        } else {
+            transform_hierarchy_update(store)
+        }
+    }
+    
+    /// Store index of a bound transform, -1 if it belongs to another tree.
+    @objc
+    public func index(of transform: Transform) -> Int {
+        return transform.hierarchy === self ? Int(transform.hierarchyIndex) : -1
+    }
+    
+    /// Turns the transforms back into standalone objects that keep their TRS values.
+    @objc
+    public func unbind() {
+        let nodes = transforms
+        transforms = []
+        nodes.forEach {
+            $0.unbindHierarchy()
+        }
+    }
+    
+    func forceUpdate() {
+        transform_hierarchy_update(store)
+    }
+    
+    func modelMatrix(at index: Int32) -> matrix_float4x4 {
+        update()
+        return store.pointee.worldMatrices[Int(index)]
+    }
+    
+    func setTRS(at index: Int32, position: vector_float3, quaternion: vector_float4, scale: vector_float3) {
+        // same left-hand flip of the translation as Transform
+        transform_hierarchy_set_trs(store, index, vector_float3(-position.x, position.y, -position.z), quaternion, scale)
+    }
+}
@@ -0,0 +1,245 @@
+//
+//  VertexAnimation.c
+//  common
+//
+
+#include "VertexAnimation.h"
+#include <common/BonePalette.h>
+#include <common/HalfFloat.h>
+#include <common/Skinning.h>
+#include <common/TransformHierarchy.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Vertices converted from halfs at a time by the sampler.
+enum { SampleChunk = 64 };
+
+static inline uint64_t align16(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+// Frame offset and total size of an animation, shared by create and the loader checks.
+static uint64_t layout(vertex_animation_header *header) {
+    header->framesOffset = align16(sizeof(vertex_animation_header));
+    return align16(header->framesOffset +
+                   (uint64_t)header->vertexCount * header->frameCount * sizeof(vertex_animation_vertex));
+}
+
+static void bind_storage(vertex_animation *animation) {
+    const vertex_animation_header *header = animation->storage;
+    animation->vertexCount = header->vertexCount;
+    animation->frameCount = header->frameCount;
+    animation->framesPerSecond = header->framesPerSecond;
+    animation->frames = (vertex_animation_vertex *)((char *)animation->storage + header->framesOffset);
+}
+
+vertex_animation *vertex_animation_create(uint32_t vertexCount, uint32_t frameCount, float framesPerSecond) {
+    vertex_animation_header header = {
+        .magic = VERTEX_ANIMATION_MAGIC,
+        .version = VERTEX_ANIMATION_VERSION,
+        .vertexCount = vertexCount,
+        .frameCount = frameCount,
+        .framesPerSecond = framesPerSecond,
+    };
+    uint64_t size = layout(&header);
+
+    vertex_animation *animation = calloc(1, sizeof(vertex_animation));
+    if (!animation) return NULL;
+    if (size > SIZE_MAX - 15 || !(animation->storage = aligned_alloc(16, ((size_t)size + 15) & ~(size_t)15))) {
+        free(animation);
+        return NULL;
+    }
+    memset(animation->storage, 0, (size_t)size);
+    memcpy(animation->storage, &header, sizeof(header));
+    animation->storageSize = (size_t)size;
+    bind_storage(animation);
+    return animation;
+}
+
+vertex_animation *vertex_animation_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(vertex_animation_header)) {
+        mapping = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    // as for clips, the offset is recomputed instead of trusted
+    const vertex_animation_header *stored = mapping;
+    vertex_animation_header expected = *stored;
+    uint64_t size = layout(&expected);
+    if (stored->magic != VERTEX_ANIMATION_MAGIC ||
+        stored->version != VERTEX_ANIMATION_VERSION ||
+        memcmp(stored, &expected, sizeof(expected)) != 0 ||
+        size > (uint64_t)st.st_size) {
+        munmap(mapping, (size_t)st.st_size);
+        return NULL;
+    }
+
+    vertex_animation *animation = calloc(1, sizeof(vertex_animation));
+    if (!animation) {
+        munmap(mapping, (size_t)st.st_size);
+        return NULL;
+    }
+    animation->storage = mapping;
+    animation->storageSize = (size_t)st.st_size;
+    animation->mapped = true;
+    bind_storage(animation);
+    return animation;
+}
+
+bool vertex_animation_write(const vertex_animation *animation, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(animation->storage, 1, animation->storageSize, file) == animation->storageSize;
+    return fclose(file) == 0 && ok;
+}
+
+void vertex_animation_destroy(vertex_animation *animation) {
+    if (!animation) return;
+    if (animation->mapped) {
+        munmap(animation->storage, animation->storageSize);
+    } else {
+        free(animation->storage);
+    }
+    free(animation);
+}
+
+void vertex_animation_store_frame(vertex_animation *animation,
+                                  uint32_t frame,
+                                  const vector_float3 *positions,
+                                  const vector_float3 *normals) {
+    vertex_animation_vertex *out = animation->frames + (size_t)frame * animation->vertexCount;
+    for (uint32_t i = 0; i < animation->vertexCount; i++) {
+        vector_float3 n = normals[i];
+        float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        float values[8] = {
+            positions[i].x, positions[i].y, positions[i].z, 1.0f,
+            n.x * scale, n.y * scale, n.z * scale, 0.0f,
+        };
+        float16_from_float32_n((uint16_t *)&out[i], values, 8);
+    }
+}
+
+vertex_animation *vertex_animation_bake_palettes(const skinned_vertex *vertices,
+                                                 size_t vertexCount,
+                                                 size_t boneCount,
+                                                 uint32_t frameCount,
+                                                 float framesPerSecond,
+                                                 vertex_animation_palette_function paletteFunction,
+                                                 void *context,
+                                                 job_pool *pool) {
+    if (vertexCount > UINT32_MAX) {
+        return NULL;
+    }
+
+    vertex_animation *animation = vertex_animation_create((uint32_t)vertexCount, frameCount, framesPerSecond);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * vertexCount);
+    bool ok = animation && palette && positions && normals;
+
+    for (uint32_t frame = 0; ok && frame < frameCount; frame++) {
+        paletteFunction(context, frame, palette);
+        skinning_linear_blend_parallel(positions, normals, vertices, palette, vertexCount, pool);
+        vertex_animation_store_frame(animation, frame, positions, normals);
+    }
+
+    free(normals);
+    free(positions);
+    free(palette);
+    if (!ok) {
+        vertex_animation_destroy(animation);
+        return NULL;
+    }
+    return animation;
+}
+
+typedef struct {
+    const crowd_skeleton *skeleton;
+    const animation_clip *clip;
+    transform_hierarchy *pose;
+} clip_palette_context;
+
+static void clip_palette(void *context, uint32_t frame, matrix_float4x4 *palette) {
+    clip_palette_context *c = context;
+    transform_hierarchy *pose = c->pose;
+    animation_clip_sample(c->clip, (float)frame, pose->translations, pose->rotations, pose->scales);
+    transform_hierarchy_update(pose);
+    bone_palette_pack(palette, pose->worldMatrices, NULL, c->skeleton->inverseBind, c->skeleton->boneCount);
+}
+
+vertex_animation *vertex_animation_bake(const skinned_vertex *vertices,
+                                        size_t vertexCount,
+                                        const crowd_skeleton *skeleton,
+                                        const animation_clip *clip,
+                                        job_pool *pool) {
+    size_t boneCount = skeleton->boneCount;
+    if (clip->boneCount != boneCount) {
+        return NULL;
+    }
+
+    transform_hierarchy *pose = transform_hierarchy_create(boneCount);
+    bool ok = pose != NULL;
+    for (size_t i = 0; ok && i < boneCount; i++) {
+        ok = transform_hierarchy_add(pose, skeleton->parents[i]) >= 0;
+    }
+
+    clip_palette_context context = { skeleton, clip, pose };
+    vertex_animation *animation = ok ? vertex_animation_bake_palettes(vertices, vertexCount, boneCount,
+                                                                      clip->frameCount, clip->framesPerSecond,
+                                                                      clip_palette, &context, pool)
+                                     : NULL;
+    transform_hierarchy_destroy(pose);
+    return animation;
+}
+
+void vertex_animation_sample(const vertex_animation *animation,
+                             float frame,
+                             vector_float3 *positions,
+                             vector_float3 *normals) {
+    const uint32_t frameCount = animation->frameCount;
+    if (frameCount == 0) return;
+
+    float last = (float)(frameCount - 1);
+    frame = frame < 0 ? 0 : (frame > last ? last : frame);
+    uint32_t k0 = (uint32_t)floorf(frame);
+    uint32_t k1 = k0 + 1 < frameCount ? k0 + 1 : k0;
+    float blend = frame - (float)k0;
+
+    const vertex_animation_vertex *a = animation->frames + (size_t)k0 * animation->vertexCount;
+    const vertex_animation_vertex *b = animation->frames + (size_t)k1 * animation->vertexCount;
+    float fa[SampleChunk * 8];
+    float fb[SampleChunk * 8];
+    for (uint32_t begin = 0; begin < animation->vertexCount; begin += SampleChunk) {
+        uint32_t count = animation->vertexCount - begin;
+        count = count < SampleChunk ? count : SampleChunk;
+        float32_from_float16_n(fa, (const uint16_t *)(a + begin), count * 8);
+        float32_from_float16_n(fb, (const uint16_t *)(b + begin), count * 8);
+
+        // lerp the halves as one flat array, which vectorizes, then pick the lanes
+        for (uint32_t k = 0; k < count * 8; k++) {
+            fa[k] += (fb[k] - fa[k]) * blend;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const float *v = fa + i * 8;
+            vector_float3 *p = &positions[begin + i];
+            p->x = v[0]; p->y = v[1]; p->z = v[2];
+            if (normals) {
+                vector_float3 *n = &normals[begin + i];
+                n->x = v[4]; n->y = v[5]; n->z = v[6];
+            }
+        }
+    }
+}
@@ -0,0 +1,116 @@
+//
+//  VertexAnimation.h
+//  common
+//
+//  Vertex animations baked from skinned meshes.
+//
+//  Every key of a clip is skinned once on the CPU and the resulting positions
+//  and normals are stored as halfs, frame after frame. Playing the animation
+//  back is a fetch of the two surrounding frames and a lerp per vertex, no
+//  skeleton, palette or skinning, which suits characters too far away for the
+//  pose to matter. A baked vertex is two RGBA16Float texels, so a frame can be
+//  bound as a buffer or as a texture row.
+//
+//  The file layout is the in-memory layout, a header followed by the frames,
+//  16-byte aligned, as for compiled animation clips. Loading maps the file.
+//
+
+#ifndef VertexAnimation_h
+#define VertexAnimation_h
+
+#include <stdbool.h>
+#include <common/MathTypes.h>
+#include <common/AnimationClip.h>
+#include <common/Crowd.h>
+#include <common/JobPool.h>
+#include <common/SkinnedVertex.h>
+
+#define VERTEX_ANIMATION_MAGIC 0x41564D4Cu // "LMVA"
+#define VERTEX_ANIMATION_VERSION 1
+
+/// Baked vertex of one frame, halfs. The position has w = 1 and the unit
+/// normal w = 0. Halfs keep about 11 bits, so positions are exact to roughly
+/// 1/2048 of their magnitude.
+typedef struct vertex_animation_vertex {
+    uint16_t position[4];
+    uint16_t normal[4];
+} vertex_animation_vertex;
+
+typedef struct vertex_animation_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t frameCount;
+    float framesPerSecond;
+    uint32_t reserved;
+    /// Byte offset of the frames from the start of the file.
+    uint64_t framesOffset;
+} vertex_animation_header;
+
+typedef struct vertex_animation {
+    uint32_t vertexCount;
+    uint32_t frameCount;
+    float framesPerSecond;
+    /// Frame f starts at frames + f * vertexCount.
+    vertex_animation_vertex *frames;
+    /// Header and frames, either allocated or a private file mapping.
+    void *storage;
+    size_t storageSize;
+    bool mapped;
+} vertex_animation;
+
+/// Returns an animation with zeroed frames to be filled by a baker, NULL if out of memory.
+vertex_animation *vertex_animation_create(uint32_t vertexCount, uint32_t frameCount, float framesPerSecond);
+
+/// Maps a baked animation file. Returns NULL if the file can't be mapped or is
+/// not a valid animation. The mapping is copy-on-write, edits never reach the file.
+vertex_animation *vertex_animation_load(const char *path);
+
+/// Writes the animation to `path`, returns false on an I/O error.
+bool vertex_animation_write(const vertex_animation *animation, const char *path);
+
+void vertex_animation_destroy(vertex_animation *animation);
+
+/// Stores skinned positions and normals, such as skinning_linear_blend writes
+/// them, as `frame`. Normals are normalized first.
+void vertex_animation_store_frame(vertex_animation *animation,
+                                  uint32_t frame,
+                                  const vector_float3 *positions,
+                                  const vector_float3 *normals);
+
+/// Writes the skinning palette of `frame` to `palette`, one matrix per bone.
+typedef void (*vertex_animation_palette_function)(void *context, uint32_t frame, matrix_float4x4 *palette);
+
+/// Bakes `frameCount` frames: `paletteFunction` writes the palette of every
+/// frame and `vertices` are skinned against it with linear blend skinning on
+/// `pool`, which may be NULL. For poses that come from somewhere else than a
+/// clip and a crowd_skeleton, such as a renderer's own bone hierarchy.
+/// Returns NULL if out of memory.
+vertex_animation *vertex_animation_bake_palettes(const skinned_vertex *vertices,
+                                                 size_t vertexCount,
+                                                 size_t boneCount,
+                                                 uint32_t frameCount,
+                                                 float framesPerSecond,
+                                                 vertex_animation_palette_function paletteFunction,
+                                                 void *context,
+                                                 job_pool *pool);
+
+/// Bakes one frame per key of `clip`: the skeleton is posed by the key, its
+/// palette packed, and `vertices` skinned as by vertex_animation_bake_palettes.
+/// The clip must animate exactly the skeleton's bones. Returns NULL if it
+/// doesn't or if out of memory.
+vertex_animation *vertex_animation_bake(const skinned_vertex *vertices,
+                                        size_t vertexCount,
+                                        const crowd_skeleton *skeleton,
+                                        const animation_clip *clip,
+                                        job_pool *pool);
+
+/// Blends the two frames around `frame` linearly, the playback path of the
+/// vertex shader. `frame` is clamped to [0, frameCount - 1], normals are not
+/// renormalized. `normals` may be NULL.
+void vertex_animation_sample(const vertex_animation *animation,
+                             float frame,
+                             vector_float3 *positions,
+                             vector_float3 *normals);
+
+#endif /* VertexAnimation_h */
@@ -0,0 +1,198 @@
+//
+//  VertexPacking.c
+//  common
+//
+
+#include "VertexPacking.h"
+#include "HalfFloat.h"
+#include <math.h>
+#include <string.h>
+
+// vertices converted to half per HalfFloat call
+#define VERTEX_PACKING_BLOCK 64
+
+static inline void load_floats(float *out, const uint8_t *p, size_t count) {
+    memcpy(out, p, sizeof(float) * count);
+}
+
+static inline int16_t snorm16(float value) {
+    value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return (int16_t)lrintf(value * 32767.0f);
+}
+
+static inline float float_from_snorm16(int16_t value) {
+    float f = value / 32767.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+// Projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds
+// the lower half over the upper one.
+static inline void encode_octahedral(int16_t encoded[2], const float n[3]) {
+    float length = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    if (!(length > 0.0f)) {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+    float u = n[0] / length;
+    float v = n[1] / length;
+    if (n[2] < 0.0f) {
+        float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = foldedU;
+        v = foldedV;
+    }
+    encoded[0] = snorm16(u);
+    encoded[1] = snorm16(v);
+}
+
+static inline void decode_octahedral(float n[3], const int16_t encoded[2]) {
+    float x = float_from_snorm16(encoded[0]);
+    float y = float_from_snorm16(encoded[1]);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = z < 0.0f ? -z : 0.0f;
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    float inverseLength = 1.0f / sqrtf(x * x + y * y + z * z);
+    n[0] = x * inverseLength;
+    n[1] = y * inverseLength;
+    n[2] = z * inverseLength;
+}
+
+vertex_packing_constants vertex_packing_compute_constants(const vertex_packing_source *source) {
+    float lower[3] = { INFINITY, INFINITY, INFINITY };
+    float upper[3] = { -INFINITY, -INFINITY, -INFINITY };
+    const uint8_t *bytes = (const uint8_t *)source->vertices + source->positionOffset;
+    for (size_t i = 0; i < source->vertexCount; i++) {
+        float p[3];
+        load_floats(p, bytes + i * source->stride, 3);
+        for (int k = 0; k < 3; k++) {
+            lower[k] = fminf(lower[k], p[k]);
+            upper[k] = fmaxf(upper[k], p[k]);
+        }
+    }
+
+    vertex_packing_constants constants;
+    float scale[3], offset[3];
+    for (int k = 0; k < 3; k++) {
+        if (!(upper[k] >= lower[k])) {
+            // no vertices
+            scale[k] = 1.0f;
+            offset[k] = 0.0f;
+            continue;
+        }
+        offset[k] = lower[k] * 0.5f + upper[k] * 0.5f;
+        scale[k] = upper[k] * 0.5f - lower[k] * 0.5f;
+        if (!(scale[k] > 0.0f)) {
+            scale[k] = 1.0f;
+        }
+    }
+    memset(&constants, 0, sizeof(constants));
+    constants.positionScale.x = scale[0];
+    constants.positionScale.y = scale[1];
+    constants.positionScale.z = scale[2];
+    constants.positionScale.w = 1.0f;
+    constants.positionOffset.x = offset[0];
+    constants.positionOffset.y = offset[1];
+    constants.positionOffset.z = offset[2];
+    constants.positionOffset.w = 0.0f;
+    return constants;
+}
+
+void vertex_pack(void *destination,
+                 const vertex_packing_source *source,
+                 vertex_packing_position_format positionFormat,
+                 const vertex_packing_constants *constants) {
+    const uint8_t *bytes = source->vertices;
+    uint8_t *out = destination;
+    const float offset[3] = { constants->positionOffset.x, constants->positionOffset.y, constants->positionOffset.z };
+    const float inverseScale[3] = {
+        1.0f / constants->positionScale.x,
+        1.0f / constants->positionScale.y,
+        1.0f / constants->positionScale.z,
+    };
+
+    // the halfs of a block go through one bulk conversion: four position
+    // components when positions are halfs, then the two texture coordinates
+    float floats[VERTEX_PACKING_BLOCK * 6];
+    uint16_t halfs[VERTEX_PACKING_BLOCK * 6];
+    for (size_t first = 0; first < source->vertexCount; first += VERTEX_PACKING_BLOCK) {
+        size_t count = source->vertexCount - first;
+        if (count > VERTEX_PACKING_BLOCK) count = VERTEX_PACKING_BLOCK;
+
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t *vertex = bytes + (first + i) * source->stride;
+            uint8_t *packed = out + (first + i) * VERTEX_PACKING_STRIDE;
+            float *f = floats + i * 6;
+
+            float p[3];
+            load_floats(p, vertex + source->positionOffset, 3);
+            for (int k = 0; k < 3; k++) {
+                f[k] = (p[k] - offset[k]) * inverseScale[k];
+            }
+            f[3] = 1.0f;
+            if (positionFormat == VertexPackingPositionSnorm16) {
+                int16_t position[4] = { snorm16(f[0]), snorm16(f[1]), snorm16(f[2]), 32767 };
+                memcpy(packed + VERTEX_PACKING_POSITION_OFFSET, position, sizeof(position));
+            }
+
+            int16_t normal[2] = { 0, 0 };
+            if (source->normalOffset != VERTEX_PACKING_ABSENT) {
+                float n[3];
+                load_floats(n, vertex + source->normalOffset, 3);
+                encode_octahedral(normal, n);
+            }
+            memcpy(packed + VERTEX_PACKING_NORMAL_OFFSET, normal, sizeof(normal));
+
+            if (source->texcoordOffset != VERTEX_PACKING_ABSENT) {
+                load_floats(f + 4, vertex + source->texcoordOffset, 2);
+            } else {
+                f[4] = 0.0f;
+                f[5] = 0.0f;
+            }
+        }
+
+        float16_from_float32_n(halfs, floats, count * 6);
+        for (size_t i = 0; i < count; i++) {
+            uint8_t *packed = out + (first + i) * VERTEX_PACKING_STRIDE;
+            if (positionFormat == VertexPackingPositionHalf) {
+                memcpy(packed + VERTEX_PACKING_POSITION_OFFSET, halfs + i * 6, sizeof(uint16_t) * 4);
+            }
+            memcpy(packed + VERTEX_PACKING_TEXCOORD_OFFSET, halfs + i * 6 + 4, sizeof(uint16_t) * 2);
+        }
+    }
+}
+
+void vertex_unpack(float position[3],
+                   float normal[3],
+                   float texcoord[2],
+                   const void *packed,
+                   vertex_packing_position_format positionFormat,
+                   const vertex_packing_constants *constants) {
+    const uint8_t *bytes = packed;
+    float p[3];
+    if (positionFormat == VertexPackingPositionSnorm16) {
+        int16_t encoded[4];
+        memcpy(encoded, bytes + VERTEX_PACKING_POSITION_OFFSET, sizeof(encoded));
+        for (int k = 0; k < 3; k++) {
+            p[k] = float_from_snorm16(encoded[k]);
+        }
+    } else {
+        uint16_t encoded[4];
+        float decoded[4];
+        memcpy(encoded, bytes + VERTEX_PACKING_POSITION_OFFSET, sizeof(encoded));
+        float32_from_float16_n(decoded, encoded, 4);
+        memcpy(p, decoded, sizeof(p));
+    }
+    position[0] = p[0] * constants->positionScale.x + constants->positionOffset.x;
+    position[1] = p[1] * constants->positionScale.y + constants->positionOffset.y;
+    position[2] = p[2] * constants->positionScale.z + constants->positionOffset.z;
+
+    int16_t encodedNormal[2];
+    memcpy(encodedNormal, bytes + VERTEX_PACKING_NORMAL_OFFSET, sizeof(encodedNormal));
+    decode_octahedral(normal, encodedNormal);
+
+    uint16_t encodedTexcoord[2];
+    memcpy(encodedTexcoord, bytes + VERTEX_PACKING_TEXCOORD_OFFSET, sizeof(encodedTexcoord));
+    float32_from_float16_n(texcoord, encodedTexcoord, 2);
+}
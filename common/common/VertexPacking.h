@@ -0,0 +1,93 @@
+//
+//  VertexPacking.h
+//  common
+//
+//  Quantized vertex layout for static meshes.
+//
+//  The samples load models as float3 position, float2 texture coordinate and
+//  float3 normal in a 48 byte stride, most of it padding. Packing rewrites
+//  such vertices into 16 bytes:
+//
+//    offset  0  position  short4 normalized or half4, relative to the bounds
+//    offset  8  normal    short2 normalized, octahedral
+//    offset 12  texcoord  half2
+//
+//  The vertex fetch turns every attribute back into floats, the shader then
+//  only scales the position into the bounds and unfolds the normal:
+//
+//    float4 position = in.position * constants.positionScale + constants.positionOffset;
+//    float3 normal = float3(in.normal, 1.0 - abs(in.normal.x) - abs(in.normal.y));
+//    float t = saturate(-normal.z);
+//    normal.xy += select(float2(t), float2(-t), normal.xy >= 0.0);
+//    normal = normalize(normal);
+//
+//  snorm16 positions land within about 1/65000 of half the bounds size, half
+//  positions within about 1/4096 of it, normals within 0.04 degrees. Texture
+//  coordinates in [0, 1] land within 1/4096, a quarter texel of a 1024 texture.
+//
+
+#ifndef VertexPacking_h
+#define VertexPacking_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <common/MathTypes.h>
+
+#define VERTEX_PACKING_STRIDE 16
+#define VERTEX_PACKING_POSITION_OFFSET 0
+#define VERTEX_PACKING_NORMAL_OFFSET 8
+#define VERTEX_PACKING_TEXCOORD_OFFSET 12
+
+/// Marks an attribute the source vertices do not have.
+#define VERTEX_PACKING_ABSENT SIZE_MAX
+
+typedef enum vertex_packing_position_format {
+    /// short4 normalized, exact to 16 bits across the bounds.
+    VertexPackingPositionSnorm16 = 0,
+    /// half4, finer near the bounds center than at its faces.
+    VertexPackingPositionHalf    = 1,
+} vertex_packing_position_format;
+
+/// Float vertices to pack, attributes at byte offsets into every `stride`.
+typedef struct vertex_packing_source {
+    const void *vertices;
+    size_t vertexCount;
+    size_t stride;
+    /// float3 position, required.
+    size_t positionOffset;
+    /// float3 unit normal, or VERTEX_PACKING_ABSENT to store +z.
+    size_t normalOffset;
+    /// float2 texture coordinate, or VERTEX_PACKING_ABSENT to store 0.
+    size_t texcoordOffset;
+} vertex_packing_source;
+
+/// What the vertex shader needs to dequantize positions, laid out for a
+/// constant buffer.
+typedef struct vertex_packing_constants {
+    /// Half the bounds size, 1 on flat axes, w 1.
+    vector_float4 positionScale;
+    /// Bounds center, w 0.
+    vector_float4 positionOffset;
+} vertex_packing_constants;
+
+/// Returns the constants that map the bounds of the source positions onto
+/// [-1, 1].
+vertex_packing_constants vertex_packing_compute_constants(const vertex_packing_source *source);
+
+/// Packs every source vertex into VERTEX_PACKING_STRIDE bytes of
+/// `destination`.
+void vertex_pack(void *destination,
+                 const vertex_packing_source *source,
+                 vertex_packing_position_format positionFormat,
+                 const vertex_packing_constants *constants);
+
+/// Decodes one packed vertex the way the vertex fetch and shader do, for
+/// tools and tests.
+void vertex_unpack(float position[3],
+                   float normal[3],
+                   float texcoord[2],
+                   const void *packed,
+                   vertex_packing_position_format positionFormat,
+                   const vertex_packing_constants *constants);
+
+#endif /* VertexPacking_h */
@@ -0,0 +1,125 @@
+//
+//  VertexPacking.swift
+//  common
+//
+
+import Foundation
+import Metal
+import MetalKit
+import ModelIO
+
+/// The packed vertex layout of VertexPacking.h for one sample's attribute
+/// and buffer indices. Models are loaded in `loadingVertexDescriptor`, the
+/// 48 byte float layout, then packed into `vertexDescriptor`.
+@objc
+public class VertexPacking: NSObject {
+
+    @objc
+    public let positionFormat: vertex_packing_position_format
+
+    /// The packed layout, what render pipelines are built with.
+    @objc
+    public let vertexDescriptor: MTLVertexDescriptor
+
+    /// float3 position at 0, float2 texture coordinate at 16 and float3 normal
+    /// at 32 in a 48 byte stride.
+    @objc
+    public let loadingVertexDescriptor: MTLVertexDescriptor
+
+    /// Model IO attribute names of the three attribute indices.
+    @objc
+    public let attributeMap: [Int : String]
+
+    @objc
+    public init(positionFormat: vertex_packing_position_format,
+                positionAttribute: Int,
+                texcoordAttribute: Int,
+                normalAttribute: Int,
+                bufferIndex: Int) {
+        self.positionFormat = positionFormat
+
+        vertexDescriptor = MTLVertexDescriptor()
+        vertexDescriptor.attributes[positionAttribute].format = positionFormat == VertexPackingPositionHalf ? .half4 : .short4Normalized
+        vertexDescriptor.attributes[positionAttribute].offset = Int(VERTEX_PACKING_POSITION_OFFSET)
+        vertexDescriptor.attributes[positionAttribute].bufferIndex = bufferIndex
+        vertexDescriptor.attributes[normalAttribute].format = .short2Normalized
+        vertexDescriptor.attributes[normalAttribute].offset = Int(VERTEX_PACKING_NORMAL_OFFSET)
+        vertexDescriptor.attributes[normalAttribute].bufferIndex = bufferIndex
+        vertexDescriptor.attributes[texcoordAttribute].format = .half2
+        vertexDescriptor.attributes[texcoordAttribute].offset = Int(VERTEX_PACKING_TEXCOORD_OFFSET)
+        vertexDescriptor.attributes[texcoordAttribute].bufferIndex = bufferIndex
+        vertexDescriptor.layouts[bufferIndex].stride = Int(VERTEX_PACKING_STRIDE)
+        vertexDescriptor.layouts[bufferIndex].stepRate = 1
+        vertexDescriptor.layouts[bufferIndex].stepFunction = .perVertex
+
+        loadingVertexDescriptor = MTLVertexDescriptor()
+        loadingVertexDescriptor.attributes[positionAttribute].format = .float3
+        loadingVertexDescriptor.attributes[positionAttribute].offset = 0
+        loadingVertexDescriptor.attributes[positionAttribute].bufferIndex = bufferIndex
+        loadingVertexDescriptor.attributes[texcoordAttribute].format = .float2
+        loadingVertexDescriptor.attributes[texcoordAttribute].offset = 16
+        loadingVertexDescriptor.attributes[texcoordAttribute].bufferIndex = bufferIndex
+        loadingVertexDescriptor.attributes[normalAttribute].format = .float3
+        loadingVertexDescriptor.attributes[normalAttribute].offset = 32
+        loadingVertexDescriptor.attributes[normalAttribute].bufferIndex = bufferIndex
+        loadingVertexDescriptor.layouts[bufferIndex].stride = 48
+        loadingVertexDescriptor.layouts[bufferIndex].stepRate = 1
+        loadingVertexDescriptor.layouts[bufferIndex].stepFunction = .perVertex
+
+        attributeMap = [
+            positionAttribute : MDLVertexAttributePosition,
+            texcoordAttribute : MDLVertexAttributeTextureCoordinate,
+            normalAttribute   : MDLVertexAttributeNormal
+        ]
+        super.init()
+    }
+
+    /// Packs a mesh with float3 position, float3 normal and float2 texture
+    /// coordinate attributes in one vertex buffer into the packed layout, the
+    /// submeshes are kept. Returns nil for any other layout.
+    @objc
+    public func pack(_ mesh: MDLMesh,
+                     allocator: MDLMeshBufferAllocator,
+                     constants: UnsafeMutablePointer<vertex_packing_constants>) -> MDLMesh? {
+        let descriptor = mesh.vertexDescriptor
+        guard let position = descriptor.attributeNamed(MDLVertexAttributePosition),
+              position.format == .float3 || position.format == .float4,
+              position.bufferIndex < mesh.vertexBuffers.count,
+              let layout = descriptor.layouts[position.bufferIndex] as? MDLVertexBufferLayout else {
+            return nil
+        }
+        func offset(of name: String, formats: [MDLVertexFormat]) -> Int? {
+            guard let attribute = descriptor.attributeNamed(name),
+                  attribute.bufferIndex == position.bufferIndex,
+                  formats.contains(attribute.format) else {
+                return nil
+            }
+            return attribute.offset
+        }
+        let normalOffset = offset(of: MDLVertexAttributeNormal, formats: [.float3, .float4])
+        let texcoordOffset = offset(of: MDLVertexAttributeTextureCoordinate, formats: [.float2, .float3, .float4])
+
+        // VERTEX_PACKING_ABSENT
+        let absent = Int(bitPattern: UInt.max)
+        let source = mesh.vertexBuffers[position.bufferIndex].map()
+        var packingSource = vertex_packing_source(vertices: UnsafeRawPointer(source.bytes),
+                                                  vertexCount: mesh.vertexCount,
+                                                  stride: layout.stride,
+                                                  positionOffset: position.offset,
+                                                  normalOffset: normalOffset ?? absent,
+                                                  texcoordOffset: texcoordOffset ?? absent)
+        constants.pointee = vertex_packing_compute_constants(&packingSource)
+        let packed = allocator.newBuffer(mesh.vertexCount * Int(VERTEX_PACKING_STRIDE), type: .vertex)
+        vertex_pack(packed.map().bytes, &packingSource, positionFormat, constants)
+
+        let packedDescriptor = MTKModelIOVertexDescriptorFromMetal(vertexDescriptor)
+        for (index, name) in attributeMap {
+            (packedDescriptor.attributes[index] as! MDLVertexAttribute).name = name
+        }
+        let packedMesh = MDLMesh(vertexBuffers: [packed],
+                                 vertexCount: mesh.vertexCount,
+                                 descriptor: packedDescriptor,
+                                 submeshes: mesh.submeshes as? [MDLSubmesh] ?? [])
+        return packedMesh
+    }
+}
@@ -0,0 +1,119 @@
+//
+//  VertexWeld.c
+//  common
+//
+
+#include "VertexWeld.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t EmptySlot = UINT32_MAX;
+
+static inline uint32_t load_word(const uint8_t *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Grid cell of a float, the key an epsilon weld compares.
+static inline int32_t snap(const uint8_t *p, float inverseEpsilon) {
+    float value;
+    memcpy(&value, p, sizeof(value));
+    float cell = floorf(value * inverseEpsilon + 0.5f);
+    // out of range and NaN all share one cell instead of overflowing the conversion
+    return cell > -2147483648.0f && cell < 2147483648.0f ? (int32_t)cell : INT32_MIN;
+}
+
+static inline uint32_t mix(uint32_t hash, uint32_t word) {
+    hash ^= word * 0xCC9E2D51u;
+    hash = (hash << 13) | (hash >> 19);
+    return hash * 5 + 0xE6546B64u;
+}
+
+static uint32_t hash_vertex(const uint8_t *vertex, size_t stride, float inverseEpsilon, bool exact) {
+    uint32_t hash = (uint32_t)stride;
+    size_t b = 0;
+    if (exact) {
+        for (; b + 4 <= stride; b += 4) {
+            hash = mix(hash, load_word(vertex + b));
+        }
+        for (; b < stride; b++) {
+            hash = mix(hash, vertex[b]);
+        }
+    } else {
+        for (; b < stride; b += 4) {
+            hash = mix(hash, (uint32_t)snap(vertex + b, inverseEpsilon));
+        }
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static bool equal_vertices(const uint8_t *a, const uint8_t *b, size_t stride, float inverseEpsilon, bool exact) {
+    if (exact) {
+        return memcmp(a, b, stride) == 0;
+    }
+    for (size_t k = 0; k < stride; k += 4) {
+        if (snap(a + k, inverseEpsilon) != snap(b + k, inverseEpsilon)) return false;
+    }
+    return true;
+}
+
+size_t vertex_weld_remap(uint32_t *remap, const void *vertices, size_t vertexCount, size_t stride, float epsilon) {
+    if (vertexCount == 0) return 0;
+    if (vertexCount > UINT32_MAX - 1) return 0;
+
+    // open addressing at a load of at most one half, slots hold the first
+    // occurrence of a welded vertex
+    size_t capacity = 16;
+    while (capacity < vertexCount * 2) {
+        capacity *= 2;
+    }
+    uint32_t *slots = malloc(sizeof(uint32_t) * capacity);
+    if (!slots) return 0;
+    memset(slots, 0xFF, sizeof(uint32_t) * capacity);
+
+    const uint8_t *bytes = vertices;
+    const bool exact = epsilon <= 0.0f;
+    const float inverseEpsilon = exact ? 0.0f : 1.0f / epsilon;
+    const size_t mask = capacity - 1;
+    uint32_t welded = 0;
+    for (size_t i = 0; i < vertexCount; i++) {
+        const uint8_t *vertex = bytes + i * stride;
+        size_t slot = hash_vertex(vertex, stride, inverseEpsilon, exact) & mask;
+        while (true) {
+            uint32_t first = slots[slot];
+            if (first == EmptySlot) {
+                slots[slot] = (uint32_t)i;
+                remap[i] = welded++;
+                break;
+            }
+            if (equal_vertices(bytes + (size_t)first * stride, vertex, stride, inverseEpsilon, exact)) {
+                remap[i] = remap[first];
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    free(slots);
+    return welded;
+}
+
+void vertex_weld_apply(void *destination, const void *vertices, size_t vertexCount, size_t stride, const uint32_t *remap) {
+    uint8_t *out = destination;
+    const uint8_t *bytes = vertices;
+    // welded indices were handed out in order, so a vertex is a first
+    // occurrence exactly when it gets the next one
+    uint32_t next = 0;
+    for (size_t i = 0; i < vertexCount; i++) {
+        if (remap[i] == next) {
+            memcpy(out + (size_t)next * stride, bytes + i * stride, stride);
+            next++;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+//
+//  VertexWeld.h
+//  common
+//
+//  Vertex welding for meshes stored as triangle soup.
+//
+//  Exporters such as the one behind fox.json write one vertex per triangle
+//  corner, so every vertex shared by several triangles is stored, transformed
+//  and shaded several times. Welding hashes the interleaved attributes of
+//  every vertex, maps equal vertices to one, and yields the compact vertex
+//  array plus the index of every original corner into it.
+//
+//  Matching is either exact, byte for byte, or by epsilon: every attribute is
+//  snapped to a grid of that spacing and vertices in the same grid cell weld.
+//  Two vertices closer than epsilon can still land in neighbouring cells and
+//  stay apart, which costs a duplicate and never a wrong weld.
+//
+
+#ifndef VertexWeld_h
+#define VertexWeld_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Computes the welded index of each of `vertexCount` vertices, `stride` bytes
+/// apart, into `remap`. Welded vertices are numbered in the order of their
+/// first occurrence. With `epsilon` 0 vertices weld when all their bytes are
+/// equal; otherwise the vertex is read as floats, `stride` must be a multiple
+/// of 4, and floats are compared on a grid of `epsilon`. Returns the number of
+/// welded vertices, 0 if out of memory.
+size_t vertex_weld_remap(uint32_t *remap, const void *vertices, size_t vertexCount, size_t stride, float epsilon);
+
+/// Copies the first occurrence of every welded vertex to its slot in
+/// `destination`, which holds the count vertex_weld_remap returned.
+void vertex_weld_apply(void *destination, const void *vertices, size_t vertexCount, size_t stride, const uint32_t *remap);
+
+#endif /* VertexWeld_h */
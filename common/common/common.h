@@ -21,3 +21,26 @@ FOUNDATION_EXPORT const unsigned char commonVersionString[];
 #import <common/ForwardCameraController.h>
 #import <common/LinearMoveCameraController.h>
 #import <common/SimpleCamera.h>
+#import <common/MathTypes.h>
+#import <common/MatrixBatch.h>
+#import <common/HalfFloat.h>
+#import <common/RandomStream.h>
+#import <common/AnimationClip.h>
+#import <common/CompressedClip.h>
+#import <common/PoseSampler.h>
+#import <common/BonePalette.h>
+#import <common/SkinnedVertex.h>
+#import <common/Skinning.h>
+#import <common/JobPool.h>
+#import <common/TransformHierarchy.h>
+#import <common/Crowd.h>
+#import <common/VertexAnimation.h>
+#import <common/JsonFloatParser.h>
+#import <common/MeshCache.h>
+#import <common/VertexWeld.h>
+#import <common/MeshOptimizer.h>
+#import <common/VertexPacking.h>
+#import <common/Frustum.h>
+#import <common/Meshlet.h>
+#import <common/MeshSimplifier.h>
+#import <common/InstanceCull.h>
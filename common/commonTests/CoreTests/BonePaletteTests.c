@@ -0,0 +1,208 @@
+//
+//  BonePaletteTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/BonePalette.h>
+#include <common/MatrixBatch.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The palette is gathered in chunks of 64 bones, these counts end inside,
+// at and just past a chunk.
+static const size_t boneCounts[] = { 1, 63, 64, 65, 70, 130, 150 };
+enum { BoneCountCount = sizeof(boneCounts) / sizeof(boneCounts[0]), MaxBones = 150 };
+
+// Rotations and translations only, scaled by `scale` if it's not 1.
+static void random_rigid_matrices(matrix_float4x4 *matrices, size_t count, float scale) {
+    vector_float3 *translations = malloc(sizeof(vector_float3) * count);
+    quaternion_float *rotations = malloc(sizeof(quaternion_float) * count);
+    vector_float3 *scales = malloc(sizeof(vector_float3) * count);
+    for (size_t i = 0; i < count; i++) {
+        translations[i].x = core_random(5.0f);
+        translations[i].y = core_random(5.0f);
+        translations[i].z = core_random(5.0f);
+        float x = core_random(1.0f), y = core_random(1.0f), z = core_random(1.0f), w = core_random(1.0f);
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        rotations[i].x = x / length;
+        rotations[i].y = y / length;
+        rotations[i].z = z / length;
+        rotations[i].w = w / length;
+        scales[i].x = scales[i].y = scales[i].z = scale;
+    }
+    matrix4x4_compose_trs_n(matrices, translations, rotations, scales, count);
+    free(translations);
+    free(rotations);
+    free(scales);
+}
+
+// Largest relative difference of palette[i] from world[nodes[i]] * inverseBind[i]
+// multiplied out one element at a time in double precision.
+static double pack_error(const matrix_float4x4 *palette, const matrix_float4x4 *world, const int32_t *nodes,
+                         const matrix_float4x4 *inverseBind, size_t count) {
+    double worst = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const float *a = (const float *)&world[nodes ? (size_t)nodes[i] : i];
+        const float *b = (const float *)&inverseBind[i];
+        const float *p = (const float *)&palette[i];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                double expected = 0.0;
+                for (int k = 0; k < 4; k++) {
+                    expected += (double)a[k * 4 + r] * b[c * 4 + k];
+                }
+                worst = fmax(worst, fabs(p[c * 4 + r] - expected) / fmax(1.0, fabs(expected)));
+            }
+        }
+    }
+    return worst;
+}
+
+// Largest difference between the rigid part of `m`, its columns normalized,
+// and the transform of the dual quaternion, applied to the axes and origin.
+static double dual_quaternion_error(const dual_quaternion *dq, const matrix_float4x4 *m) {
+    const float *c = (const float *)m;
+    double x = dq->real.x, y = dq->real.y, z = dq->real.z, w = dq->real.w;
+    double rotation[9] = {
+        1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+        2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+        2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y),
+    };
+    // t = 2 * dual * conjugate(real)
+    double dx = dq->dual.x, dy = dq->dual.y, dz = dq->dual.z, dw = dq->dual.w;
+    double translation[3] = {
+        2 * (-dw * x + dx * w - dy * z + dz * y),
+        2 * (-dw * y + dy * w - dz * x + dx * z),
+        2 * (-dw * z + dz * w - dx * y + dy * x),
+    };
+    double worst = fabs(sqrt(x * x + y * y + z * z + w * w) - 1.0);
+    for (int column = 0; column < 3; column++) {
+        double length = sqrt((double)c[column * 4] * c[column * 4] + (double)c[column * 4 + 1] * c[column * 4 + 1] +
+                             (double)c[column * 4 + 2] * c[column * 4 + 2]);
+        for (int row = 0; row < 3; row++) {
+            worst = fmax(worst, fabs(rotation[column * 3 + row] - c[column * 4 + row] / length));
+        }
+        worst = fmax(worst, fabs(translation[column] - c[12 + column]) / fmax(1.0, fabs(c[12 + column])));
+    }
+    return worst;
+}
+
+void bone_palette_checks(void) {
+    // world holds more nodes than there are bones, as the hierarchy store does
+    const size_t nodeCount = MaxBones * 3;
+    matrix_float4x4 *world = malloc(sizeof(matrix_float4x4) * nodeCount);
+    matrix_float4x4 *inverseBind = malloc(sizeof(matrix_float4x4) * MaxBones);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * MaxBones);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * MaxBones);
+    dual_quaternion *dualQuaternions = malloc(sizeof(dual_quaternion) * MaxBones);
+    dual_quaternion *fromPalette = malloc(sizeof(dual_quaternion) * MaxBones);
+    int32_t nodes[MaxBones];
+
+    core_random_trs_matrices(world, nodeCount);
+    core_random_trs_matrices(inverseBind, MaxBones);
+    matrix4x4_trs_inverse_n(inverseBind, inverseBind, MaxBones);
+    for (size_t c = 0; c < BoneCountCount; c++) {
+        size_t count = boneCounts[c];
+        for (size_t i = 0; i < count; i++) {
+            nodes[i] = (int32_t)core_random_index((uint32_t)nodeCount);
+        }
+        memset(palette, 0xA5, sizeof(matrix_float4x4) * MaxBones);
+        bone_palette_pack(palette, world, nodes, inverseBind, count);
+        CHECK(pack_error(palette, world, nodes, inverseBind, count) < 1e-5);
+        // nothing past the last bone is written
+        CHECK(count == MaxBones || ((const uint8_t *)&palette[count])[0] == 0xA5);
+
+        bone_palette_pack(palette, world, NULL, inverseBind, count);
+        CHECK(pack_error(palette, world, NULL, inverseBind, count) < 1e-5);
+    }
+
+    // rigid bones, then bones with a uniform scale that is divided out
+    const float scales[2] = { 1.0f, 1.7f };
+    for (int s = 0; s < 2; s++) {
+        random_rigid_matrices(world, nodeCount, scales[s]);
+        random_rigid_matrices(inverseBind, MaxBones, 1.0f);
+        for (size_t c = 0; c < BoneCountCount; c++) {
+            size_t count = boneCounts[c];
+            for (size_t i = 0; i < count; i++) {
+                nodes[i] = (int32_t)core_random_index((uint32_t)nodeCount);
+            }
+            bone_palette_pack_dual_quaternion(dualQuaternions, world, nodes, inverseBind, count);
+            bone_palette_pack(expected, world, nodes, inverseBind, count);
+            dual_quaternion_from_matrix_n(fromPalette, expected, count);
+            CHECK(memcmp(dualQuaternions, fromPalette, sizeof(dual_quaternion) * count) == 0);
+            double worst = 0.0;
+            for (size_t i = 0; i < count; i++) {
+                worst = fmax(worst, dual_quaternion_error(&dualQuaternions[i], &expected[i]));
+            }
+            CHECK(worst < 1e-5);
+
+            bone_palette_pack_dual_quaternion(dualQuaternions, world, NULL, inverseBind, count);
+            bone_palette_pack(expected, world, NULL, inverseBind, count);
+            worst = 0.0;
+            for (size_t i = 0; i < count; i++) {
+                worst = fmax(worst, dual_quaternion_error(&dualQuaternions[i], &expected[i]));
+            }
+            CHECK(worst < 1e-5);
+        }
+    }
+
+    // every branch of Shepperd's method: half turns around x, y and z, and none
+    matrix_float4x4 turns[4];
+    memset(turns, 0, sizeof(turns));
+    for (int t = 0; t < 4; t++) {
+        float *m = (float *)&turns[t];
+        for (int k = 0; k < 3; k++) {
+            m[k * 4 + k] = t == 3 || t == k ? 1.0f : -1.0f;
+        }
+        m[12] = 1.0f + t;
+        m[15] = 1.0f;
+    }
+    dual_quaternion_from_matrix_n(dualQuaternions, turns, 4);
+    double worst = 0.0;
+    for (int t = 0; t < 4; t++) {
+        worst = fmax(worst, dual_quaternion_error(&dualQuaternions[t], &turns[t]));
+    }
+    CHECK(worst < 1e-6);
+
+    free(world);
+    free(inverseBind);
+    free(palette);
+    free(expected);
+    free(dualQuaternions);
+    free(fromPalette);
+}
+
+void bone_palette_benchmarks(void) {
+    const size_t nodeCount = 1000, boneCount = 150;
+    const int runs = 100000;
+    matrix_float4x4 *world = malloc(sizeof(matrix_float4x4) * nodeCount);
+    matrix_float4x4 *inverseBind = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    dual_quaternion *dualQuaternions = malloc(sizeof(dual_quaternion) * boneCount);
+    int32_t nodes[150];
+    random_rigid_matrices(world, nodeCount, 1.0f);
+    random_rigid_matrices(inverseBind, boneCount, 1.0f);
+    for (size_t i = 0; i < boneCount; i++) {
+        nodes[i] = (int32_t)core_random_index((uint32_t)nodeCount);
+    }
+
+    double start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        bone_palette_pack(palette, world, nodes, inverseBind, boneCount);
+    }
+    double gathered = (core_seconds() - start) / runs;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        bone_palette_pack_dual_quaternion(dualQuaternions, world, nodes, inverseBind, boneCount);
+    }
+    double dual = (core_seconds() - start) / runs;
+    core_report("bone_palette", "%zu bones from %zu nodes: matrices %.2f us, dual quaternions %.2f us",
+                boneCount, nodeCount, gathered * 1e6, dual * 1e6);
+
+    free(world);
+    free(inverseBind);
+    free(palette);
+    free(dualQuaternions);
+}
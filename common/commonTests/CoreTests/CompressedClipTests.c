@@ -0,0 +1,257 @@
+//
+//  CompressedClipTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/CompressedClip.h>
+#include <common/MatrixBatch.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNOUT_ANIMATION CORE_TESTS_RESOURCES "/snout/snout-anim.json"
+
+// 15-bit smallest three components step 1.4142 / 32767
+static const float rotationQuantization = 1e-4f;
+
+// Smooth curves on every channel, scales included, which the snout rig keeps
+// at one.
+static animation_clip *smooth_clip(uint32_t boneCount, uint32_t frameCount) {
+    animation_clip *clip = animation_clip_create(boneCount, frameCount, 30.0f);
+    for (uint32_t b = 0; b < boneCount; b++) {
+        float phase = core_random(3.0f), speed = 0.05f + fabsf(core_random(0.2f));
+        for (uint32_t f = 0; f < frameCount; f++) {
+            size_t key = (size_t)b * frameCount + f;
+            float angle = phase + speed * f;
+            for (int k = 0; k < 3; k++) {
+                clip->translations[key * 3 + k] = 10.0f * sinf(angle + k);
+                clip->scales[key * 3 + k] = 1.0f + 0.25f * cosf(angle * (k + 1));
+            }
+            // around the axis (1, 0.5, 0.3)
+            float sine = sinf(0.5f * angle) / sqrtf(1.34f);
+            clip->rotations[key * 4 + 0] = sine;
+            clip->rotations[key * 4 + 1] = 0.5f * sine;
+            clip->rotations[key * 4 + 2] = 0.3f * sine;
+            clip->rotations[key * 4 + 3] = cosf(0.5f * angle);
+        }
+    }
+    return clip;
+}
+
+typedef struct key_errors {
+    // largest error over its bound, <= 1 when within
+    double translation;
+    double rotation;
+    double scale;
+    // largest raw errors, for the report
+    double translationError;
+    double rotationError;
+    double scaleError;
+} key_errors;
+
+// Samples the compressed clip at every source key of every bone and measures
+// the error of each channel, on every axis.
+static key_errors errors_at_keys(const animation_clip *clip, const compressed_clip *compressed,
+                                 const animation_compression_settings *settings) {
+    key_errors errors = { 0, 0, 0, 0, 0, 0 };
+    uint32_t boneCount = clip->boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+    for (uint32_t f = 0; f < clip->frameCount; f++) {
+        compressed_clip_sample(compressed, (float)f, t, q, s);
+        for (uint32_t b = 0; b < boneCount; b++) {
+            const compressed_track *tracks = compressed->tracks + b * CompressedTrackChannelCount;
+            size_t key = (size_t)b * clip->frameCount + f;
+
+            const float *expected = clip->translations + key * 3;
+            const float *extent = tracks[CompressedTrackTranslation].extent;
+            float sampled[3] = { t[b].x, t[b].y, t[b].z };
+            double distance = 0.0, range = 0.0;
+            for (int k = 0; k < 3; k++) {
+                double d = sampled[k] - expected[k];
+                distance += d * d;
+                range += (double)extent[k] * extent[k];
+                errors.translationError = fmax(errors.translationError, fabs(d));
+            }
+            double bound = fmax(settings->translationTolerance, sqrt(range) / 65535);
+            errors.translation = fmax(errors.translation, sqrt(distance) / bound);
+
+            // chord between the unit quaternions, acos of the dot product is too
+            // coarse in float below about 1e-3
+            const float *r = clip->rotations + key * 4;
+            double length = sqrt((double)r[0] * r[0] + (double)r[1] * r[1] + (double)r[2] * r[2] + (double)r[3] * r[3]);
+            double source[4] = { r[0] / length, r[1] / length, r[2] / length, r[3] / length };
+            double decoded[4] = { q[b].x, q[b].y, q[b].z, q[b].w };
+            double dot = 0.0, chord = 0.0;
+            for (int k = 0; k < 4; k++) dot += source[k] * decoded[k];
+            for (int k = 0; k < 4; k++) {
+                double d = source[k] - (dot < 0 ? -decoded[k] : decoded[k]);
+                chord += d * d;
+            }
+            double angle = 4.0 * asin(fmin(1.0, 0.5 * sqrt(chord)));
+            errors.rotationError = fmax(errors.rotationError, angle);
+            errors.rotation = fmax(errors.rotation, angle / (settings->rotationTolerance + rotationQuantization));
+
+            expected = clip->scales + key * 3;
+            extent = tracks[CompressedTrackScale].extent;
+            sampled[0] = s[b].x;
+            sampled[1] = s[b].y;
+            sampled[2] = s[b].z;
+            for (int k = 0; k < 3; k++) {
+                double d = fabs(sampled[k] - expected[k]);
+                errors.scaleError = fmax(errors.scaleError, d);
+                errors.scale = fmax(errors.scale, d / (settings->scaleTolerance + extent[k] / 65535.0));
+            }
+        }
+    }
+    free(t);
+    free(q);
+    free(s);
+    return errors;
+}
+
+static void check_clip(const animation_clip *clip) {
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(clip, &settings);
+    CHECK(compressed != NULL);
+    if (!compressed) return;
+    CHECK(compressed->boneCount == clip->boneCount && compressed->frameCount == clip->frameCount);
+    CHECK(compressed->keyCount <= (size_t)clip->boneCount * clip->frameCount * 3);
+    key_errors errors = errors_at_keys(clip, compressed, &settings);
+    CHECK(errors.translation <= 1.0);
+    CHECK(errors.rotation <= 1.0);
+    CHECK(errors.scale <= 1.0);
+
+    // the cursors give the search's pose during playback and after seeking back
+    uint32_t boneCount = clip->boneCount;
+    size_t trackCount = (size_t)boneCount * CompressedTrackChannelCount;
+    uint32_t *cursors = calloc(trackCount, sizeof(uint32_t));
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount * 2);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount * 2);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount * 2);
+    bool same = true;
+    for (int i = 0; i < 400; i++) {
+        float frame = i < 300 ? i * 0.037f * clip->frameCount : core_random(1.0f) * clip->frameCount;
+        compressed_clip_sample(compressed, frame, t, q, s);
+        compressed_clip_sample_cursors(compressed, cursors, frame, t + boneCount, q + boneCount, s + boneCount);
+        // component by component, the padding of vector_float3 is not written
+        for (uint32_t b = 0; b < boneCount; b++) {
+            const vector_float3 *t2 = &t[boneCount + b], *s2 = &s[boneCount + b];
+            same &= t[b].x == t2->x && t[b].y == t2->y && t[b].z == t2->z &&
+                    s[b].x == s2->x && s[b].y == s2->y && s[b].z == s2->z &&
+                    memcmp(&q[b], &q[boneCount + b], sizeof(quaternion_float)) == 0;
+        }
+    }
+    CHECK(same);
+    free(cursors);
+    free(t);
+    free(q);
+    free(s);
+    compressed_clip_destroy(compressed);
+}
+
+void compressed_clip_checks(void) {
+    animation_clip *snout = core_load_clip_json(SNOUT_ANIMATION, 6.0f);
+    CHECK(snout != NULL);
+    if (snout) {
+        CHECK(snout->boneCount == 70 && snout->frameCount == 11);
+        check_clip(snout);
+        animation_clip_destroy(snout);
+    }
+
+    animation_clip *smooth = smooth_clip(45, 301);
+    check_clip(smooth);
+    animation_clip_destroy(smooth);
+
+    animation_clip *noisy = core_random_clip(33, 17, 30.0f);
+    check_clip(noisy);
+    animation_clip_destroy(noisy);
+}
+
+// Chains the bones so the error of every bone adds up at the leaf, the worst
+// case for a rig of this size.
+static void leaf_error(const animation_clip *clip, const compressed_clip *compressed, float *error, float *distance) {
+    uint32_t boneCount = clip->boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *sampled = malloc(sizeof(matrix_float4x4) * boneCount);
+    *error = *distance = 0.0f;
+    for (uint32_t f = 0; f < clip->frameCount; f++) {
+        animation_clip_sample(clip, (float)f, t, q, s);
+        for (uint32_t b = 0; b < boneCount; b++) {
+            float length = sqrtf(q[b].x * q[b].x + q[b].y * q[b].y + q[b].z * q[b].z + q[b].w * q[b].w);
+            q[b].x /= length;
+            q[b].y /= length;
+            q[b].z /= length;
+            q[b].w /= length;
+        }
+        matrix4x4_compose_trs_n(expected, t, q, s, boneCount);
+        compressed_clip_sample(compressed, (float)f, t, q, s);
+        matrix4x4_compose_trs_n(sampled, t, q, s, boneCount);
+        for (uint32_t b = 1; b < boneCount; b++) {
+            matrix4x4_multiply_n(&expected[b], &expected[b - 1], &expected[b], 1);
+            matrix4x4_multiply_n(&sampled[b], &sampled[b - 1], &sampled[b], 1);
+        }
+        vector_float4 leaf = expected[boneCount - 1].columns[3], other = sampled[boneCount - 1].columns[3];
+        float dx = leaf.x - other.x, dy = leaf.y - other.y, dz = leaf.z - other.z;
+        *error = fmaxf(*error, sqrtf(dx * dx + dy * dy + dz * dz));
+        *distance = fmaxf(*distance, sqrtf(leaf.x * leaf.x + leaf.y * leaf.y + leaf.z * leaf.z));
+    }
+    free(t);
+    free(q);
+    free(s);
+    free(expected);
+    free(sampled);
+}
+
+void compressed_clip_benchmarks(void) {
+    animation_clip *snout = core_load_clip_json(SNOUT_ANIMATION, 6.0f);
+    if (!snout) return;
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(snout, &settings);
+    uint32_t boneCount = snout->boneCount;
+    size_t rawSize = (size_t)boneCount * snout->frameCount * 10 * sizeof(float);
+    key_errors errors = errors_at_keys(snout, compressed, &settings);
+    float leaf, distance;
+    leaf_error(snout, compressed, &leaf, &distance);
+    core_report("compressed_clip", "snout, %u bones x %u frames: %.1f kB -> %.1f kB, %zu of %zu keys kept",
+                boneCount, snout->frameCount, rawSize / 1000.0, compressed_clip_size(compressed) / 1000.0,
+                compressed->keyCount, (size_t)boneCount * snout->frameCount * 3);
+    core_report("compressed_clip", "snout, errors at keys: translation %.4f, rotation %.2e rad, scale %.2e, "
+                "chained leaf %.2f at distance %.0f",
+                errors.translationError, errors.rotationError, errors.scaleError, leaf, distance);
+
+    const int poses = 100000;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+    uint32_t *cursors = calloc((size_t)boneCount * CompressedTrackChannelCount, sizeof(uint32_t));
+    float last = (float)(snout->frameCount - 1);
+    double start = core_seconds();
+    for (int i = 0; i < poses; i++) {
+        animation_clip_sample(snout, fmodf(i * 0.1f, last), t, q, s);
+    }
+    double raw = (core_seconds() - start) / poses;
+    start = core_seconds();
+    for (int i = 0; i < poses; i++) {
+        compressed_clip_sample(compressed, fmodf(i * 0.1f, last), t, q, s);
+    }
+    double decoded = (core_seconds() - start) / poses;
+    start = core_seconds();
+    for (int i = 0; i < poses; i++) {
+        compressed_clip_sample_cursors(compressed, cursors, fmodf(i * 0.1f, last), t, q, s);
+    }
+    double cursored = (core_seconds() - start) / poses;
+    core_report("compressed_clip", "snout pose: compressed %.2f us, with cursors %.2f us, raw float tracks %.2f us",
+                decoded * 1e6, cursored * 1e6, raw * 1e6);
+    free(t);
+    free(q);
+    free(s);
+    free(cursors);
+    compressed_clip_destroy(compressed);
+    animation_clip_destroy(snout);
+}
@@ -0,0 +1,356 @@
+//
+//  CoreTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/JsonFloatParser.h>
+#include <common/MatrixBatch.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Failures past this many are counted but not printed, a broken kernel fails
+// the same check for every vertex.
+enum { PrintedFailures = 20 };
+
+static unsigned failures = 0;
+static uint64_t randomState = 1;
+
+bool core_check(bool passed, const char *condition, const char *file, int line) {
+    if (!passed) {
+        if (failures < PrintedFailures) {
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+        }
+        failures++;
+    }
+    return passed;
+}
+
+bool core_close(double a, double b, double tolerance) {
+    return fabs(a - b) <= tolerance;
+}
+
+unsigned core_failures(void) {
+    return failures;
+}
+
+double core_seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+double core_cpu_seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+void core_random_seed(uint64_t seed) {
+    randomState = seed;
+}
+
+// PCG style LCG step, the top 24 bits are uniform enough for test data
+static uint32_t next_random(void) {
+    randomState = randomState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(randomState >> 40);
+}
+
+float core_random(float range) {
+    return ((float)next_random() / 16777215.0f * 2.0f - 1.0f) * range;
+}
+
+uint32_t core_random_index(uint32_t count) {
+    return (uint32_t)(((uint64_t)next_random() * count) >> 24);
+}
+
+void core_random_trs_matrices(matrix_float4x4 *matrices, size_t count) {
+    vector_float3 *translations = malloc(sizeof(vector_float3) * count);
+    quaternion_float *rotations = malloc(sizeof(quaternion_float) * count);
+    vector_float3 *scales = malloc(sizeof(vector_float3) * count);
+    for (size_t i = 0; i < count; i++) {
+        translations[i].x = core_random(1.0f);
+        translations[i].y = core_random(1.0f);
+        translations[i].z = core_random(1.0f);
+        float x = core_random(1.0f), y = core_random(1.0f), z = core_random(1.0f), w = core_random(1.0f);
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        rotations[i].x = x / length;
+        rotations[i].y = y / length;
+        rotations[i].z = z / length;
+        rotations[i].w = w / length;
+        float scale = 1.0f + core_random(0.1f);
+        scales[i].x = scales[i].y = scales[i].z = scale;
+    }
+    matrix4x4_compose_trs_n(matrices, translations, rotations, scales, count);
+    free(translations);
+    free(rotations);
+    free(scales);
+}
+
+skinned_vertex *core_random_skinned_vertices(size_t vertexCount, size_t boneCount) {
+    skinned_vertex *vertices = malloc(sizeof(skinned_vertex) * vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        float position[3] = { core_random(1.0f), core_random(1.0f), core_random(1.0f) };
+        float normal[3] = { core_random(1.0f), core_random(1.0f), core_random(1.0f) };
+        float texCoord[2] = { 0.0f, 0.0f };
+        float joints[4];
+        for (int k = 0; k < 4; k++) {
+            joints[k] = (float)core_random_index((uint32_t)boneCount);
+        }
+        float weights[4] = {
+            fabsf(core_random(1.0f)) + 0.01f,
+            i % 2 ? fabsf(core_random(1.0f)) : 0.0f,
+            i % 3 ? 0.0f : fabsf(core_random(1.0f)),
+            0.0f,
+        };
+        skinned_vertex_pack(&vertices[i], position, normal, texCoord, joints, weights);
+    }
+    return vertices;
+}
+
+animation_clip *core_random_clip(uint32_t boneCount, uint32_t frameCount, float framesPerSecond) {
+    animation_clip *clip = animation_clip_create(boneCount, frameCount, framesPerSecond);
+    for (size_t key = 0; key < (size_t)boneCount * frameCount; key++) {
+        float *translation = clip->translations + key * 3;
+        float *rotation = clip->rotations + key * 4;
+        float *scale = clip->scales + key * 3;
+        for (int k = 0; k < 3; k++) {
+            translation[k] = core_random(1.0f);
+            scale[k] = 1.0f;
+        }
+        // w stays away from 0, so neighboring keys are close rotations
+        float x = core_random(1.0f), y = core_random(1.0f), z = core_random(1.0f), w = core_random(1.0f) + 2.0f;
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        rotation[0] = x / length;
+        rotation[1] = y / length;
+        rotation[2] = z / length;
+        rotation[3] = w / length;
+    }
+    return clip;
+}
+
+// Decodes the array called `key` in [from, end) into `values`, up to `capacity`
+// of them. Returns the count of numbers, -1 if there is no such array.
+static ptrdiff_t decode_channel(const char *from, const char *end, const char *key, float *values, size_t capacity) {
+    size_t keyLength = strlen(key);
+    const char *p = from;
+    while ((p = memchr(p, '"', (size_t)(end - p))) != NULL) {
+        p++;
+        if ((size_t)(end - p) > keyLength && memcmp(p, key, keyLength) == 0 && p[keyLength] == '"') break;
+    }
+    if (!p || !(p = memchr(p, '[', (size_t)(end - p)))) return -1;
+    p++;
+    size_t count = 0;
+    for (;;) {
+        p += strspn(p, ", \t\r\n");
+        if (p >= end || *p == ']') break;
+        float value;
+        const char *next = json_parse_float(p, end, &value);
+        if (!next) return -1;
+        if (count < capacity) values[count] = value;
+        count++;
+        p = next;
+    }
+    return (ptrdiff_t)count;
+}
+
+char *core_read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    *length = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *bytes = malloc(*length + 1);
+    if (fread(bytes, 1, *length, file) != *length) {
+        free(bytes);
+        bytes = NULL;
+    } else {
+        bytes[*length] = '\0';
+    }
+    fclose(file);
+    return bytes;
+}
+
+float *core_load_json_corners(const char *path, size_t *cornerCount) {
+    size_t length;
+    char *json = core_read_file(path, &length);
+    if (!json) return NULL;
+    json_member members[8];
+    ptrdiff_t count = json_index_members(json, length, members, 8);
+    const char *keys[3] = { "position", "normal", "uv" };
+    const size_t widths[3] = { 3, 3, 2 };
+    const json_member *position = count > 0 ? json_find_member(members, (size_t)count, "position") : NULL;
+    float *corners = NULL;
+    if (position) {
+        *cornerCount = position->floatCount / 3;
+        corners = calloc(*cornerCount > 0 ? *cornerCount : 1, CORE_JSON_CORNER_STRIDE);
+    }
+    for (int a = 0; a < 3 && corners; a++) {
+        const json_member *member = json_find_member(members, (size_t)count, keys[a]);
+        if (!member || member->floatCount != *cornerCount * widths[a] ||
+            json_decode_floats(member, corners + a * 4, widths[a], CORE_JSON_CORNER_STRIDE) != member->floatCount) {
+            free(corners);
+            corners = NULL;
+        }
+    }
+    free(json);
+    return corners;
+}
+
+animation_clip *core_load_clip_json(const char *path, float framesPerSecond) {
+    size_t length;
+    char *json = core_read_file(path, &length);
+    if (!json) return NULL;
+
+    // frames are flat objects of arrays, so each ends at its first '}'
+    enum { MaxFrames = 1024 };
+    const char *frameBegins[MaxFrames], *frameEnds[MaxFrames];
+    uint32_t frameCount = 0;
+    const char *p = strstr(json, "\"frames\"");
+    while (p && frameCount < MaxFrames && (p = strchr(p, '{')) != NULL) {
+        frameBegins[frameCount] = p;
+        if (!(p = strchr(p, '}'))) break;
+        frameEnds[frameCount++] = p;
+    }
+    ptrdiff_t positionCount = frameCount > 0 ? decode_channel(frameBegins[0], frameEnds[0], "position", NULL, 0) : -1;
+    animation_clip *clip = positionCount > 0 && positionCount % 3 == 0
+                         ? animation_clip_create((uint32_t)(positionCount / 3), frameCount, framesPerSecond)
+                         : NULL;
+    uint32_t boneCount = clip ? clip->boneCount : 0;
+    const char *keys[3] = { "position", "quaternion", "scale" };
+    const size_t widths[3] = { 3, 4, 3 };
+    float *values = malloc(sizeof(float) * boneCount * 4 + 1);
+    for (uint32_t f = 0; f < frameCount && clip; f++) {
+        float *tracks[3] = { clip->translations, clip->rotations, clip->scales };
+        for (int c = 0; c < 3; c++) {
+            ptrdiff_t count = decode_channel(frameBegins[f], frameEnds[f], keys[c], values, boneCount * 4);
+            if (count != (ptrdiff_t)(boneCount * widths[c])) {
+                animation_clip_destroy(clip);
+                clip = NULL;
+                break;
+            }
+            for (uint32_t b = 0; b < boneCount; b++) {
+                memcpy(tracks[c] + ((size_t)b * frameCount + f) * widths[c], values + b * widths[c],
+                       sizeof(float) * widths[c]);
+            }
+        }
+    }
+    free(values);
+    free(json);
+    return clip;
+}
+
+crowd_skeleton *core_binary_skeleton(size_t boneCount) {
+    int32_t *parents = malloc(sizeof(int32_t) * boneCount);
+    matrix_float4x4 *inverseBind = calloc(boneCount, sizeof(matrix_float4x4));
+    for (size_t i = 0; i < boneCount; i++) {
+        parents[i] = i == 0 ? -1 : (int32_t)(i - 1) / 2;
+        inverseBind[i].columns[0].x = 1.0f;
+        inverseBind[i].columns[1].y = 1.0f;
+        inverseBind[i].columns[2].z = 1.0f;
+        inverseBind[i].columns[3].w = 1.0f;
+    }
+    crowd_skeleton *skeleton = crowd_skeleton_create(parents, inverseBind, boneCount);
+    free(parents);
+    free(inverseBind);
+    return skeleton;
+}
+
+core_mesh core_load_obj(const char *path) {
+    core_mesh mesh = { NULL, 0, NULL, 0 };
+    FILE *file = fopen(path, "r");
+    if (!file) return mesh;
+    size_t positionCapacity = 0, indexCapacity = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            if (mesh.vertexCount == positionCapacity) {
+                positionCapacity = positionCapacity ? positionCapacity * 2 : 1024;
+                mesh.positions = realloc(mesh.positions, sizeof(float) * 3 * positionCapacity);
+            }
+            float *position = mesh.positions + mesh.vertexCount++ * 3;
+            if (sscanf(line + 2, "%f %f %f", &position[0], &position[1], &position[2]) != 3) {
+                position[0] = position[1] = position[2] = 0.0f;
+            }
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            uint32_t face[64];
+            size_t corners = 0;
+            char *p = line + 2;
+            while (corners < 64) {
+                char *next;
+                long index = strtol(p, &next, 10);
+                if (next == p) break;
+                // negative indices count back from the last position
+                face[corners++] = (uint32_t)(index < 0 ? (long)mesh.vertexCount + index : index - 1);
+                p = next + strcspn(next, " \t\r\n");
+            }
+            for (size_t k = 1; k + 1 < corners; k++) {
+                if (mesh.indexCount + 3 > indexCapacity) {
+                    indexCapacity = indexCapacity ? indexCapacity * 2 : 3072;
+                    mesh.indices = realloc(mesh.indices, sizeof(uint32_t) * indexCapacity);
+                }
+                mesh.indices[mesh.indexCount++] = face[0];
+                mesh.indices[mesh.indexCount++] = face[k];
+                mesh.indices[mesh.indexCount++] = face[k + 1];
+            }
+        }
+    }
+    fclose(file);
+    return mesh;
+}
+
+core_mesh core_torus(uint32_t rings, uint32_t sides) {
+    core_mesh mesh;
+    mesh.vertexCount = (size_t)rings * sides;
+    mesh.indexCount = mesh.vertexCount * 6;
+    mesh.positions = malloc(sizeof(float) * 3 * mesh.vertexCount);
+    mesh.indices = malloc(sizeof(uint32_t) * mesh.indexCount);
+    const float turn = 6.28318531f;
+    for (uint32_t r = 0; r < rings; r++) {
+        for (uint32_t s = 0; s < sides; s++) {
+            float u = turn * r / rings, v = turn * s / sides;
+            float *position = mesh.positions + ((size_t)r * sides + s) * 3;
+            position[0] = (0.6f + 0.2f * cosf(v)) * cosf(u);
+            position[1] = (0.6f + 0.2f * cosf(v)) * sinf(u);
+            position[2] = 0.2f * sinf(v);
+        }
+    }
+    uint32_t *index = mesh.indices;
+    for (uint32_t r = 0; r < rings; r++) {
+        for (uint32_t s = 0; s < sides; s++) {
+            uint32_t a = r * sides + s;
+            uint32_t b = ((r + 1) % rings) * sides + s;
+            uint32_t c = ((r + 1) % rings) * sides + (s + 1) % sides;
+            uint32_t d = r * sides + (s + 1) % sides;
+            *index++ = a; *index++ = b; *index++ = c;
+            *index++ = a; *index++ = c; *index++ = d;
+        }
+    }
+    return mesh;
+}
+
+void core_mesh_destroy(core_mesh *mesh) {
+    free(mesh->positions);
+    free(mesh->indices);
+    *mesh = (core_mesh){ NULL, 0, NULL, 0 };
+}
+
+const char *core_threads(const job_pool *pool) {
+    static char label[32];
+    if (!pool) return "calling thread";
+    unsigned count = job_pool_thread_count(pool);
+    snprintf(label, sizeof(label), "%u thread%s", count, count == 1 ? "" : "s");
+    return label;
+}
+
+void core_report(const char *suite, const char *format, ...) {
+    printf("%-16s ", suite);
+    va_list arguments;
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+    printf("\n");
+    fflush(stdout);
+}
@@ -0,0 +1,172 @@
+//
+//  CoreTests.h
+//  commonTests
+//
+//  Checks and benchmarks of the plain C cores of common that build with any
+//  C11 compiler, so they run on machines without Xcode, such as a Linux build
+//  farm. commonTests.m stays the suite for the Swift and Metal side.
+//
+//  Every suite has a checks function, and optionally a benchmarks function
+//  that logs throughput. See main.c for the suite list and the Makefile for
+//  how to run them. CORE_TESTS_RESOURCES is the path of common/resources and
+//  CORE_TESTS_OUTPUT a directory for the files suites write.
+//
+
+#ifndef CoreTests_h
+#define CoreTests_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <common/MathTypes.h>
+#include <common/AnimationClip.h>
+#include <common/Crowd.h>
+#include <common/JobPool.h>
+#include <common/SkinnedVertex.h>
+
+/// Records a failed check, the condition is reported as written.
+#define CHECK(condition) core_check((condition) != 0, #condition, __FILE__, __LINE__)
+
+/// Records a failed check if `a` and `b` are further apart than `tolerance`.
+#define CHECK_CLOSE(a, b, tolerance) \
+    core_check(core_close((a), (b), (tolerance)), #a " ~ " #b, __FILE__, __LINE__)
+
+bool core_check(bool passed, const char *condition, const char *file, int line);
+
+bool core_close(double a, double b, double tolerance);
+
+/// Failed checks so far.
+unsigned core_failures(void);
+
+/// Wall clock seconds.
+double core_seconds(void);
+
+/// CPU seconds of the process, summed over its threads.
+double core_cpu_seconds(void);
+
+/// Restarts the random stream, so every suite sees the same numbers whatever
+/// ran before it.
+void core_random_seed(uint64_t seed);
+
+/// Uniform in [-range, range].
+float core_random(float range);
+
+/// Uniform in [0, count).
+uint32_t core_random_index(uint32_t count);
+
+/// Random translation, unit rotation and scale matrices, as a pose produces.
+void core_random_trs_matrices(matrix_float4x4 *matrices, size_t count);
+
+/// Random vertices in the unit cube weighted to one to three of `boneCount`
+/// bones. Free with free().
+skinned_vertex *core_random_skinned_vertices(size_t vertexCount, size_t boneCount);
+
+/// A clip of random keys with unit rotations and unit scales.
+animation_clip *core_random_clip(uint32_t boneCount, uint32_t frameCount, float framesPerSecond);
+
+/// Reads a whole file and NUL terminates it, `length` excludes the terminator.
+/// Returns NULL if the file does not open or read. Free with free().
+char *core_read_file(const char *path, size_t *length);
+
+/// Bytes from one corner of core_load_json_corners to the next.
+#define CORE_JSON_CORNER_STRIDE 48
+
+/// Loads the "position", "normal" and "uv" arrays of a mesh JSON like fox.json
+/// in the JsonMesh vertex layout: position, normal and uv 16 bytes apart,
+/// CORE_JSON_CORNER_STRIDE bytes per corner, unused floats zero. Returns NULL
+/// if the file does not open or an array is missing or malformed.
+float *core_load_json_corners(const char *path, size_t *cornerCount);
+
+/// Converts a keyframe JSON of { "frames": [ { "position": [], "quaternion": [],
+/// "scale": [] } ] } like AnimationClip.swift does. Returns NULL if the file does
+/// not open or a frame has a bad array.
+animation_clip *core_load_clip_json(const char *path, float framesPerSecond);
+
+/// A binary tree of `boneCount` bones in breadth first order, bound at the
+/// identity.
+crowd_skeleton *core_binary_skeleton(size_t boneCount);
+
+/// Indexed triangles with positions only, three floats per vertex.
+typedef struct core_mesh {
+    float *positions;
+    size_t vertexCount;
+    uint32_t *indices;
+    size_t indexCount;
+} core_mesh;
+
+/// Loads the positions and faces of an OBJ file, polygons fanned into
+/// triangles. Texture coordinates and normals are dropped, so vertices are
+/// the file's positions. Returns an empty mesh if the file does not open.
+core_mesh core_load_obj(const char *path);
+
+/// A closed torus around z of `rings` by `sides` quads, counter-clockwise
+/// seen from outside.
+core_mesh core_torus(uint32_t rings, uint32_t sides);
+
+void core_mesh_destroy(core_mesh *mesh);
+
+/// "calling thread" for a NULL pool, its thread count otherwise, for reports. The
+/// string is overwritten by the next call.
+const char *core_threads(const job_pool *pool);
+
+/// Prints one benchmark result, prefixed with its suite.
+void core_report(const char *suite, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void skinning_checks(void);
+void skinning_benchmarks(void);
+
+void crowd_checks(void);
+void crowd_benchmarks(void);
+
+void vertex_animation_checks(void);
+void vertex_animation_benchmarks(void);
+
+void json_checks(void);
+void json_benchmarks(void);
+
+void meshlet_checks(void);
+void meshlet_benchmarks(void);
+
+void simplifier_checks(void);
+void simplifier_benchmarks(void);
+
+void instance_cull_checks(void);
+void instance_cull_benchmarks(void);
+
+void matrix_batch_checks(void);
+void matrix_batch_benchmarks(void);
+
+void half_float_checks(void);
+void half_float_benchmarks(void);
+
+void random_stream_checks(void);
+void random_stream_benchmarks(void);
+
+void hierarchy_checks(void);
+void hierarchy_benchmarks(void);
+
+void compressed_clip_checks(void);
+void compressed_clip_benchmarks(void);
+
+void pose_sampler_checks(void);
+void pose_sampler_benchmarks(void);
+
+void bone_palette_checks(void);
+void bone_palette_benchmarks(void);
+
+void skinned_vertex_checks(void);
+void skinned_vertex_benchmarks(void);
+
+void mesh_cache_checks(void);
+void mesh_cache_benchmarks(void);
+
+void vertex_weld_checks(void);
+void vertex_weld_benchmarks(void);
+
+void mesh_optimizer_checks(void);
+void mesh_optimizer_benchmarks(void);
+
+void vertex_packing_checks(void);
+void vertex_packing_benchmarks(void);
+
+#endif /* CoreTests_h */
@@ -0,0 +1,298 @@
+//
+//  CrowdTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/BonePalette.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { BoneCount = 70, KeyCount = 11, CharacterCount = 500 };
+
+static crowd *make_crowd(const crowd_skeleton *skeleton, const animation_clip *clip, size_t count) {
+    crowd *characters = crowd_create(skeleton, count);
+    for (size_t i = 0; i < count; i++) {
+        crowd_add_instance(characters, pose_sampler_create(clip), (float)i * 0.013f, 0.5f + (float)(i % 7) * 0.1f);
+    }
+    return characters;
+}
+
+// Palette of one character at `time`, sampled and swept on its own.
+static void reference_palette(const crowd_skeleton *skeleton, const animation_clip *clip, float time,
+                              matrix_float4x4 *palette) {
+    transform_hierarchy *pose = transform_hierarchy_create(skeleton->boneCount);
+    for (size_t b = 0; b < skeleton->boneCount; b++) {
+        transform_hierarchy_add(pose, skeleton->parents[b]);
+    }
+    pose_sampler *sampler = pose_sampler_create(clip);
+    pose_sampler_sample(sampler, time, pose->translations, pose->rotations, pose->scales);
+    pose->needsUpdate = true;
+    transform_hierarchy_update(pose);
+    bone_palette_pack(palette, pose->worldMatrices, NULL, skeleton->inverseBind, skeleton->boneCount);
+    pose_sampler_destroy(sampler);
+    transform_hierarchy_destroy(pose);
+}
+
+// Plays a band that evaluates every `Interval` frames and checks every palette
+// against the two evaluations of its span, and that from the second frame on
+// the spans of the crowd start evenly spread over the frames.
+static void check_throttled(const crowd_skeleton *skeleton, const animation_clip *clip) {
+    enum { Count = 64, Interval = 4, Frames = 40 };
+    const float deltaTime = 1.0f / 60.0f;
+    crowd *characters = make_crowd(skeleton, clip, Count);
+    const crowd_lod_band band = { 0.0f, Interval, UINT32_MAX };
+    CHECK(crowd_set_lod_bands(characters, &band, 1));
+    size_t size = sizeof(matrix_float4x4) * BoneCount;
+    matrix_float4x4 *palette = malloc(size * Count);
+    matrix_float4x4 *lastKeys = malloc(size * Count);
+    matrix_float4x4 *nextKeys = malloc(size * Count);
+
+    bool keysMatch = true, staggered = true, firstSpansShortened = true;
+    double lerpError = 0.0;
+    for (int frame = 0; frame < Frames; frame++) {
+        crowd_update(characters, deltaTime, palette, NULL);
+        size_t starts = 0;
+        for (size_t i = 0; i < Count; i++) {
+            const crowd_instance *instance = &characters->instances[i];
+            matrix_float4x4 *lastKey = lastKeys + i * BoneCount, *nextKey = nextKeys + i * BoneCount;
+            const float *played = (const float *)(palette + i * BoneCount);
+            if (instance->phase == 1) {
+                // a span starts on the pose the last one ended on
+                if (frame == 0) {
+                    reference_palette(skeleton, clip, instance->time, nextKey);
+                    firstSpansShortened &= instance->interval == Interval - i % Interval;
+                }
+                keysMatch &= memcmp(played, nextKey, size) == 0;
+                memcpy(lastKey, nextKey, size);
+                reference_palette(skeleton, clip, instance->time + instance->interval * deltaTime * instance->speed,
+                                  nextKey);
+                starts++;
+                continue;
+            }
+            const float *a = (const float *)lastKey, *b = (const float *)nextKey;
+            double t = (double)(instance->phase - 1) / instance->interval;
+            for (size_t k = 0; k < BoneCount * 16; k++) {
+                double lerped = a[k] + (b[k] - (double)a[k]) * t;
+                lerpError = fmax(lerpError, fabs(played[k] - lerped) / fmax(1.0, fabs(lerped)));
+            }
+        }
+        staggered &= starts == (frame == 0 ? Count : Count / Interval);
+    }
+    CHECK(keysMatch);
+    CHECK(firstSpansShortened);
+    CHECK(staggered);
+    CHECK(lerpError < 1e-6);
+
+    free(palette);
+    free(lastKeys);
+    free(nextKeys);
+    crowd_destroy(characters);
+}
+
+// Bones deeper than the band's depth copy their closest evaluated ancestor.
+static void check_collapsed(const crowd_skeleton *skeleton, const animation_clip *clip) {
+    enum { Count = 8, MaxDepth = 2 };
+    crowd *characters = make_crowd(skeleton, clip, Count);
+    const crowd_lod_band band = { 0.0f, 1, MaxDepth };
+    CHECK(crowd_set_lod_bands(characters, &band, 1));
+    CHECK(characters->bandBoneCounts[0] == (1 << (MaxDepth + 1)) - 1);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * Count * BoneCount);
+    matrix_float4x4 expected[BoneCount];
+    crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+    // the batch kernels take a different tail for the shorter runs, so the
+    // evaluated bones are only close to the full evaluation
+    double evaluatedError = 0.0;
+    bool collapsed = true;
+    for (size_t i = 0; i < Count; i++) {
+        const matrix_float4x4 *played = palette + i * BoneCount;
+        reference_palette(skeleton, clip, characters->instances[i].time, expected);
+        for (size_t b = 0; b < BoneCount; b++) {
+            size_t ancestor = b;
+            while (skeleton->depths[ancestor] > MaxDepth) {
+                ancestor = (size_t)skeleton->parents[ancestor];
+            }
+            if (ancestor == b) {
+                const float *p = (const float *)&played[b], *e = (const float *)&expected[b];
+                for (int k = 0; k < 16; k++) {
+                    evaluatedError = fmax(evaluatedError, fabs(p[k] - e[k]) / fmax(1.0, fabs(e[k])));
+                }
+            } else {
+                collapsed &= memcmp(&played[b], &played[ancestor], sizeof(matrix_float4x4)) == 0;
+            }
+        }
+    }
+    CHECK(evaluatedError < 1e-5);
+    CHECK(collapsed);
+    free(palette);
+    crowd_destroy(characters);
+
+    // evaluation stops at the first deeper bone, the second root and its
+    // child are left without an evaluated ancestor
+    const int32_t parents[4] = { -1, 0, -1, 2 };
+    matrix_float4x4 inverseBind[4];
+    core_random_trs_matrices(inverseBind, 4);
+    crowd_skeleton *twoRoots = crowd_skeleton_create(parents, inverseBind, 4);
+    animation_clip *twoRootClip = core_random_clip(4, KeyCount, 6.0f);
+    crowd *rootsOnly = crowd_create(twoRoots, 1);
+    crowd_add_instance(rootsOnly, pose_sampler_create(twoRootClip), 0.3f, 1.0f);
+    const crowd_lod_band rootBand = { 0.0f, 1, 0 };
+    CHECK(crowd_set_lod_bands(rootsOnly, &rootBand, 1));
+    CHECK(rootsOnly->bandBoneCounts[0] == 1);
+    matrix_float4x4 rootPalette[4];
+    crowd_update(rootsOnly, 0.0f, rootPalette, NULL);
+    CHECK(memcmp(&rootPalette[1], &rootPalette[0], sizeof(matrix_float4x4)) == 0);
+    bool identity = true;
+    for (int b = 2; b < 4; b++) {
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                identity &= ((const float *)&rootPalette[b])[c * 4 + r] == (c == r ? 1.0f : 0.0f);
+            }
+        }
+    }
+    CHECK(identity);
+    crowd_destroy(rootsOnly);
+    crowd_skeleton_destroy(twoRoots);
+    animation_clip_destroy(twoRootClip);
+}
+
+// The distance picks the band, the last one also applies beyond its distance,
+// and new bands drop the key palettes of the old ones.
+static void check_bands(const crowd_skeleton *skeleton, const animation_clip *clip) {
+    enum { Count = 12 };
+    crowd *characters = make_crowd(skeleton, clip, Count);
+    const crowd_lod_band bands[2] = { { 10.0f, 1, UINT32_MAX }, { 40.0f, 3, 1 } };
+    CHECK(crowd_set_lod_bands(characters, bands, 2));
+    for (size_t i = 0; i < Count; i++) {
+        characters->instances[i].lodDistance = (float)(i % 3) * 30.0f;
+    }
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * Count * BoneCount);
+    crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+    bool picked = true;
+    for (size_t i = 0; i < Count; i++) {
+        const crowd_instance *instance = &characters->instances[i];
+        picked &= i % 3 == 0 ? instance->interval == 0 : instance->interval > 0 && instance->band == 1;
+    }
+    CHECK(picked);
+
+    CHECK(crowd_set_lod_bands(characters, NULL, 0));
+    bool reset = true;
+    for (size_t i = 0; i < Count; i++) {
+        reset &= characters->instances[i].interval == 0;
+    }
+    CHECK(reset);
+    crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+    matrix_float4x4 expected[BoneCount];
+    reference_palette(skeleton, clip, characters->instances[Count - 1].time, expected);
+    CHECK(memcmp(expected, palette + (Count - 1) * BoneCount, sizeof(expected)) == 0);
+    free(palette);
+    crowd_destroy(characters);
+}
+
+void crowd_checks(void) {
+    const size_t count = 64;
+    int32_t childFirst[3] = { -1, 2, 0 };
+    matrix_float4x4 identity[3];
+    memset(identity, 0, sizeof(identity));
+    CHECK(crowd_skeleton_create(childFirst, identity, 3) == NULL);
+
+    animation_clip *clip = core_random_clip(BoneCount, KeyCount, 6.0f);
+    crowd_skeleton *skeleton = core_binary_skeleton(BoneCount);
+    crowd *serial = make_crowd(skeleton, clip, count);
+    crowd *parallel = make_crowd(skeleton, clip, count);
+    matrix_float4x4 *serialPalette = malloc(sizeof(matrix_float4x4) * count * BoneCount);
+    matrix_float4x4 *parallelPalette = malloc(sizeof(matrix_float4x4) * count * BoneCount);
+    job_pool *pool = job_pool_create(4);
+
+    // long enough for the looping clocks to wrap
+    for (int frame = 0; frame < 200; frame++) {
+        crowd_update(serial, 1.0f / 60.0f, serialPalette, NULL);
+        crowd_update(parallel, 1.0f / 60.0f, parallelPalette, pool);
+    }
+    CHECK(memcmp(serialPalette, parallelPalette, sizeof(matrix_float4x4) * count * BoneCount) == 0);
+
+    // an instance's palette is its own pose, sampled and swept on its own
+    const size_t instance = 5;
+    matrix_float4x4 expected[BoneCount];
+    reference_palette(skeleton, clip, serial->instances[instance].time, expected);
+    CHECK(memcmp(expected, serialPalette + instance * BoneCount, sizeof(expected)) == 0);
+    CHECK(serial->instances[instance].time >= 0.0f);
+    CHECK(serial->instances[instance].time < pose_sampler_duration(serial->instances[instance].sampler));
+
+    check_throttled(skeleton, clip);
+    check_collapsed(skeleton, clip);
+    check_bands(skeleton, clip);
+
+    job_pool_destroy(pool);
+    free(serialPalette);
+    free(parallelPalette);
+    crowd_destroy(serial);
+    crowd_destroy(parallel);
+    crowd_skeleton_destroy(skeleton);
+    animation_clip_destroy(clip);
+}
+
+void crowd_benchmarks(void) {
+    const int frames = 100;
+    animation_clip *clip = core_random_clip(BoneCount, KeyCount, 6.0f);
+    crowd_skeleton *skeleton = core_binary_skeleton(BoneCount);
+    crowd *characters = make_crowd(skeleton, clip, CharacterCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * CharacterCount * BoneCount);
+
+    job_pool *pool = job_pool_create(0);
+    job_pool *pools[2] = { NULL, pool };
+    for (int p = 0; p < 2; p++) {
+        crowd_update(characters, 1.0f / 60.0f, palette, pools[p]);
+        double start = core_seconds();
+        double cpuStart = core_cpu_seconds();
+        for (int frame = 0; frame < frames; frame++) {
+            crowd_update(characters, 1.0f / 60.0f, palette, pools[p]);
+        }
+        double elapsed = core_seconds() - start;
+        double cpu = core_cpu_seconds() - cpuStart;
+        core_report("crowd", "%d characters of %d bones, %s: %.0f characters per ms of CPU time, "
+                    "%.2f ms per update",
+                    CharacterCount, BoneCount, core_threads(pools[p]),
+                    CharacterCount * frames / (cpu * 1e3), elapsed * 1e3 / frames);
+    }
+    job_pool_destroy(pool);
+    free(palette);
+    crowd_destroy(characters);
+
+    // characters at a constant density around the camera, so most of a larger
+    // crowd is far away
+    const crowd_lod_band bands[4] = {
+        { 20.0f, 1, UINT32_MAX },
+        { 60.0f, 2, UINT32_MAX },
+        { 120.0f, 4, 3 },
+        { 0.0f, 8, 1 },
+    };
+    const size_t sizes[3] = { 250, 1000, 4000 };
+    for (int s = 0; s < 3; s++) {
+        size_t count = sizes[s];
+        characters = make_crowd(skeleton, clip, count);
+        palette = malloc(sizeof(matrix_float4x4) * count * BoneCount);
+        for (size_t i = 0; i < count; i++) {
+            characters->instances[i].lodDistance = 2.0f * sqrtf((float)i);
+        }
+        double perUpdate[2];
+        for (int lod = 0; lod < 2; lod++) {
+            crowd_set_lod_bands(characters, lod ? bands : NULL, lod ? 4 : 0);
+            crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+            double start = core_seconds();
+            for (int frame = 0; frame < frames; frame++) {
+                crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+            }
+            perUpdate[lod] = (core_seconds() - start) / frames;
+        }
+        core_report("crowd", "%zu characters of %d bones on one thread: %.2f ms per update, "
+                    "%.2f ms with distance bands, %.2f us per character",
+                    count, BoneCount, perUpdate[0] * 1e3, perUpdate[1] * 1e3, perUpdate[1] * 1e6 / count);
+        free(palette);
+        crowd_destroy(characters);
+    }
+
+    crowd_skeleton_destroy(skeleton);
+    animation_clip_destroy(clip);
+}
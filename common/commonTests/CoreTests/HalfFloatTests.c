@@ -0,0 +1,207 @@
+//
+//  HalfFloatTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/HalfFloat.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An RGBA HDR radiance map of 4096 x 2048.
+enum { ImageFloatCount = 4096 * 2048 * 4, RandomCount = 1 << 22 };
+
+static uint32_t bits_of(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static float float_of(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static bool half_is_nan(uint16_t h) {
+    return (h & 0x7C00) == 0x7C00 && (h & 0x3FF) != 0;
+}
+
+// The half `h` stands for, by its definition.
+static double reference_float(uint16_t h) {
+    int exponent = (h >> 10) & 0x1F, mantissa = h & 0x3FF;
+    double magnitude = exponent == 0x1F ? INFINITY
+                     : exponent == 0 ? ldexp(mantissa, -24)
+                     : ldexp(1024 + mantissa, exponent - 25);
+    return h & 0x8000 ? -magnitude : magnitude;
+}
+
+// Rounds a finite or infinite `value` to the nearest half, ties to even, in
+// double precision, which holds every float and every step exactly.
+static uint16_t reference_half(float value) {
+    uint16_t sign = signbit(value) ? 0x8000 : 0;
+    double magnitude = fabs((double)value);
+    int exponent = magnitude == 0.0 ? -14 : ilogb(magnitude);
+    if (exponent < -14) exponent = -14;
+    // nearbyint rounds ties to even in the default rounding mode
+    double rounded = ldexp(nearbyint(ldexp(magnitude, 10 - exponent)), exponent - 10);
+    if (rounded >= 65536.0) return sign | 0x7C00;
+    if (rounded < ldexp(1.0, -14)) return sign | (uint16_t)ldexp(rounded, 24);
+    exponent = ilogb(rounded);
+    return sign | (uint16_t)((exponent + 15) << 10) | (uint16_t)(ldexp(rounded, 10 - exponent) - 1024.0);
+}
+
+// The one-value-at-a-time conversion a loop without the bulk call uses.
+static uint16_t scalar_half(float value) {
+    uint32_t f = bits_of(value);
+    uint16_t sign = (f >> 16) & 0x8000;
+    f &= 0x7FFFFFFF;
+    if (f >= 0x7F800000) return sign | (f == 0x7F800000 ? 0x7C00 : (0x7E00 | ((f >> 13) & 0x3FF)));
+    if (f >= 0x477FF000) return sign | 0x7C00;
+    if (f < 0x38800000) {
+        uint32_t shift = 113 - (f >> 23) + 13;
+        if (shift > 24) return sign;
+        uint32_t mantissa = (f & 0x7FFFFF) | 0x800000;
+        uint32_t half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1), tie = 1u << (shift - 1);
+        return sign | (uint16_t)(half + (rest > tie || (rest == tie && (half & 1))));
+    }
+    f += 0xC8000FFF + ((f >> 13) & 1);
+    return sign | (uint16_t)(f >> 13);
+}
+
+static uint32_t random_bits(void) {
+    return core_random_index(1u << 16) << 16 | core_random_index(1u << 16);
+}
+
+void half_float_checks(void) {
+    // every half to float and back
+    const size_t halfCount = 1 << 16;
+    uint16_t *halfs = malloc(sizeof(uint16_t) * halfCount);
+    uint16_t *back = malloc(sizeof(uint16_t) * halfCount);
+    float *floats = malloc(sizeof(float) * halfCount);
+    for (size_t i = 0; i < halfCount; i++) {
+        halfs[i] = (uint16_t)i;
+    }
+    float32_from_float16_n(floats, halfs, halfCount);
+    float16_from_float32_n(back, floats, halfCount);
+    bool exact = true, roundTrips = true, quieted = true;
+    for (size_t i = 0; i < halfCount; i++) {
+        if (half_is_nan(halfs[i])) {
+            quieted &= isnan(floats[i]) && back[i] == (halfs[i] | 0x200);
+        } else {
+            exact &= (double)floats[i] == reference_float(halfs[i]) &&
+                     (signbit(floats[i]) != 0) == ((halfs[i] & 0x8000) != 0);
+            roundTrips &= back[i] == halfs[i];
+        }
+    }
+    CHECK(exact);
+    CHECK(roundTrips);
+    CHECK(quieted);
+    free(halfs);
+    free(back);
+    free(floats);
+
+    // the edges of rounding
+    const float values[] = {
+        65504.0f, 65519.0f, 65520.0f, 1e10f, -INFINITY, INFINITY,
+        1.0f + 1.0f / 2048.0f,              // tie, rounds down to even
+        1.0f + 3.0f / 2048.0f,              // tie, rounds up to even
+        5.9604644775390625e-8f,             // smallest subnormal
+        2.98023223876953125e-8f,            // half of it, ties to zero
+        8.94069671630859375e-8f,            // one and a half of it, ties to two
+        6.0975551605224609375e-5f,          // largest subnormal
+        6.1035156e-5f, -0.0f, 0.0f, 0.1f, -3.14159f, 1e-30f,
+    };
+    const size_t valueCount = sizeof(values) / sizeof(values[0]);
+    uint16_t edges[sizeof(values) / sizeof(values[0])];
+    float16_from_float32_n(edges, values, valueCount);
+    bool edgesRounded = true;
+    for (size_t i = 0; i < valueCount; i++) {
+        edgesRounded &= edges[i] == reference_half(values[i]);
+    }
+    CHECK(edgesRounded);
+    CHECK(edges[2] == 0x7C00 && edges[1] == 0x7BFF && edges[9] == 0x0000 && edges[10] == 0x0002);
+
+    // random bit patterns, and random values around the range of halfs; the
+    // count is not a multiple of any vector width
+    const size_t count = RandomCount + 5;
+    float *random = malloc(sizeof(float) * count);
+    uint16_t *converted = malloc(sizeof(uint16_t) * count);
+    uint16_t *clamped = malloc(sizeof(uint16_t) * count);
+    for (size_t i = 0; i < count; i++) {
+        random[i] = i % 2 ? float_of(random_bits())
+                          : ldexpf(core_random(1.0f), (int)core_random_index(48) - 30);
+    }
+    float16_from_float32_n(converted, random, count);
+    float16_from_float32_clamped_n(clamped, random, count);
+    bool rounded = true, nans = true, saturated = true, scalar = true;
+    for (size_t i = 0; i < count; i++) {
+        float value = random[i];
+        if (isnan(value)) {
+            nans &= half_is_nan(converted[i]) && half_is_nan(clamped[i]) &&
+                    (converted[i] & 0x8000) == ((bits_of(value) >> 16) & 0x8000);
+            continue;
+        }
+        uint16_t expected = reference_half(value);
+        rounded &= converted[i] == expected;
+        scalar &= scalar_half(value) == expected;
+        uint16_t largest = (uint16_t)((expected & 0x8000) | 0x7BFF);
+        saturated &= clamped[i] == ((expected & 0x7FFF) == 0x7C00 ? largest : expected);
+    }
+    CHECK(rounded);
+    CHECK(nans);
+    CHECK(saturated);
+    CHECK(scalar);
+    free(random);
+    free(converted);
+    free(clamped);
+
+    const float hdr[] = { 65504.0f, 65520.0f, 1e10f, INFINITY, -1e10f, -INFINITY, 1.5f, NAN };
+    uint16_t hdrHalfs[8];
+    float16_from_float32_clamped_n(hdrHalfs, hdr, 8);
+    CHECK(hdrHalfs[0] == 0x7BFF && hdrHalfs[1] == 0x7BFF && hdrHalfs[2] == 0x7BFF && hdrHalfs[3] == 0x7BFF);
+    CHECK(hdrHalfs[4] == 0xFBFF && hdrHalfs[5] == 0xFBFF);
+    CHECK(hdrHalfs[6] == 0x3E00);
+    CHECK(half_is_nan(hdrHalfs[7]));
+}
+
+void half_float_benchmarks(void) {
+    const int runs = 5;
+    float *src = malloc(sizeof(float) * ImageFloatCount);
+    uint16_t *halfs = malloc(sizeof(uint16_t) * ImageFloatCount);
+    float *floats = malloc(sizeof(float) * ImageFloatCount);
+    for (size_t i = 0; i < ImageFloatCount; i++) {
+        src[i] = (i % 1000) * 0.37f;
+    }
+
+    double start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        for (size_t i = 0; i < ImageFloatCount; i++) {
+            halfs[i] = scalar_half(src[i]);
+        }
+    }
+    double scalar = (core_seconds() - start) / runs;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        float16_from_float32_n(halfs, src, ImageFloatCount);
+    }
+    double bulk = (core_seconds() - start) / runs;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        float16_from_float32_clamped_n(halfs, src, ImageFloatCount);
+    }
+    double clamped = (core_seconds() - start) / runs;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        float32_from_float16_n(floats, halfs, ImageFloatCount);
+    }
+    double widened = (core_seconds() - start) / runs;
+    core_report("half_float", "4096x2048 RGBA to half: bulk %.1f ms, clamped %.1f ms, scalar loop %.1f ms",
+                bulk * 1e3, clamped * 1e3, scalar * 1e3);
+    core_report("half_float", "4096x2048 RGBA to float: bulk %.1f ms", widened * 1e3);
+
+    free(src);
+    free(halfs);
+    free(floats);
+}
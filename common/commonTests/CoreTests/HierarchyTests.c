@@ -0,0 +1,146 @@
+//
+//  HierarchyTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/TransformHierarchy.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { NodeCount = 100000, Frames = 100 };
+
+typedef enum hierarchy_shape {
+    // parent (i - 1) / 4, like a store of crowd skeletons
+    HierarchyQuadTree,
+    // every node under the one before it, one node per depth level
+    HierarchyChain,
+    // a thousand roots, then their children, then their grandchildren
+    HierarchyForest,
+} hierarchy_shape;
+
+static int32_t parent_of(hierarchy_shape shape, size_t i) {
+    switch (shape) {
+        case HierarchyQuadTree: return i == 0 ? -1 : (int32_t)((i - 1) / 4);
+        case HierarchyChain: return (int32_t)i - 1;
+        case HierarchyForest: return i < 1000 ? -1 : (int32_t)(i - 1000);
+    }
+    return -1;
+}
+
+static transform_hierarchy *make_hierarchy(hierarchy_shape shape, size_t count) {
+    transform_hierarchy *hierarchy = transform_hierarchy_create(count);
+    for (size_t i = 0; i < count; i++) {
+        int32_t index = transform_hierarchy_add(hierarchy, parent_of(shape, i));
+        vector_float3 translation, scale;
+        translation.x = core_random(0.1f);
+        translation.y = core_random(0.1f);
+        translation.z = core_random(0.1f);
+        scale.x = scale.y = scale.z = 1.0f + core_random(0.01f);
+        float x = core_random(1.0f), y = core_random(1.0f), z = core_random(1.0f), w = core_random(1.0f);
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        quaternion_float rotation;
+        rotation.x = x / length;
+        rotation.y = y / length;
+        rotation.z = z / length;
+        rotation.w = w / length;
+        transform_hierarchy_set_trs(hierarchy, index, translation, rotation, scale);
+    }
+    return hierarchy;
+}
+
+// Updates with pools of 1 to 8 threads and without one, from scrambled world
+// matrices, and compares them bit for bit with the serial update.
+static bool parallel_matches_serial(transform_hierarchy *hierarchy) {
+    size_t size = sizeof(matrix_float4x4) * hierarchy->count;
+    matrix_float4x4 *serial = malloc(size);
+    transform_hierarchy_update(hierarchy);
+    memcpy(serial, hierarchy->worldMatrices, size);
+    bool identical = true;
+    for (unsigned threads = 0; threads <= 8; threads++) {
+        job_pool *pool = threads == 0 ? NULL : job_pool_create(threads);
+        memset(hierarchy->worldMatrices, 0xA5, size);
+        memset(hierarchy->localMatrices, 0xA5, size);
+        transform_hierarchy_update_parallel(hierarchy, pool);
+        identical &= memcmp(hierarchy->worldMatrices, serial, size) == 0 && !hierarchy->needsUpdate;
+        job_pool_destroy(pool);
+    }
+    free(serial);
+    return identical;
+}
+
+// Largest difference of the world matrices from world[parent] * local in
+// double precision.
+static double sweep_error(const transform_hierarchy *hierarchy) {
+    double worst = 0.0;
+    for (size_t i = 0; i < hierarchy->count; i++) {
+        const float *local = (const float *)&hierarchy->localMatrices[i];
+        const float *world = (const float *)&hierarchy->worldMatrices[i];
+        int32_t parent = hierarchy->parents[i];
+        const float *parentWorld = parent < 0 ? NULL : (const float *)&hierarchy->worldMatrices[parent];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                double expected = local[c * 4 + r];
+                if (parentWorld) {
+                    expected = 0.0;
+                    for (int k = 0; k < 4; k++) {
+                        expected += (double)parentWorld[k * 4 + r] * local[c * 4 + k];
+                    }
+                }
+                worst = fmax(worst, fabs(world[c * 4 + r] - expected) / fmax(1.0, fabs(expected)));
+            }
+        }
+    }
+    return worst;
+}
+
+void hierarchy_checks(void) {
+    const hierarchy_shape shapes[3] = { HierarchyQuadTree, HierarchyChain, HierarchyForest };
+    // short runs stay on the calling thread, long ones are split, and the
+    // counts are not multiples of the compose width
+    const size_t counts[3] = { NodeCount + 3, 1003, 5005 };
+    for (int s = 0; s < 3; s++) {
+        transform_hierarchy *hierarchy = make_hierarchy(shapes[s], counts[s]);
+        CHECK(hierarchy->count == counts[s]);
+        CHECK(parallel_matches_serial(hierarchy));
+        CHECK(sweep_error(hierarchy) < 1e-5);
+        transform_hierarchy_destroy(hierarchy);
+    }
+
+    // a node under a missing parent is refused
+    transform_hierarchy *hierarchy = transform_hierarchy_create(4);
+    CHECK(transform_hierarchy_add(hierarchy, -1) == 0);
+    CHECK(transform_hierarchy_add(hierarchy, 1) == -1);
+    CHECK(transform_hierarchy_add(hierarchy, 0) == 1);
+    transform_hierarchy_destroy(hierarchy);
+}
+
+void hierarchy_benchmarks(void) {
+    transform_hierarchy *hierarchy = make_hierarchy(HierarchyQuadTree, NodeCount);
+    double start = core_seconds();
+    for (int frame = 0; frame < Frames; frame++) {
+        transform_hierarchy_update(hierarchy);
+    }
+    double serial = (core_seconds() - start) / Frames;
+    core_report("hierarchy", "%d nodes, serial update: %.3f ms per update", NodeCount, serial * 1e3);
+
+    job_pool *all = job_pool_create(0);
+    unsigned maxThreads = job_pool_thread_count(all) < 4 ? 4 : job_pool_thread_count(all);
+    job_pool_destroy(all);
+    for (unsigned threads = 1; threads <= maxThreads; threads++) {
+        job_pool *pool = job_pool_create(threads);
+        transform_hierarchy_update_parallel(hierarchy, pool);
+        double cpu = core_cpu_seconds();
+        start = core_seconds();
+        for (int frame = 0; frame < Frames; frame++) {
+            transform_hierarchy_update_parallel(hierarchy, pool);
+        }
+        double elapsed = (core_seconds() - start) / Frames;
+        cpu = (core_cpu_seconds() - cpu) / Frames;
+        core_report("hierarchy", "%d nodes, %s: %.3f ms per update, %.3f ms of CPU, %.2fx serial",
+                    NodeCount, core_threads(pool), elapsed * 1e3, cpu * 1e3, serial / elapsed);
+        job_pool_destroy(pool);
+    }
+    transform_hierarchy_destroy(hierarchy);
+}
@@ -0,0 +1,226 @@
+//
+//  InstanceCullTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/InstanceCull.h>
+#include <common/MatrixBatch.h>
+#include <common/MeshSimplifier.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const float levelErrors[4] = { 0.0f, 0.3f, 1.0f, 3.0f };
+
+static vector_float3 vector3(float x, float y, float z) {
+    vector_float3 v;
+    v.x = x;
+    v.y = y;
+    v.z = z;
+    return v;
+}
+
+static vector_float3 normalize3(vector_float3 v) {
+    float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    return vector3(v.x / length, v.y / length, v.z / length);
+}
+
+static vector_float3 cross3(vector_float3 a, vector_float3 b) {
+    return vector3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static float dot3(vector_float3 a, vector_float3 b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Left-handed view projection of a camera at `eye` looking at the origin,
+// Metal clip space, as the samples' cameras build it.
+static matrix_float4x4 view_projection(vector_float3 eye, float fovy, float aspect) {
+    const float near = 0.1f, far = 1000.0f;
+    matrix_float4x4 projection;
+    memset(&projection, 0, sizeof(projection));
+    float ys = 1.0f / tanf(fovy * 0.5f), zs = far / (far - near);
+    projection.columns[0].x = ys / aspect;
+    projection.columns[1].y = ys;
+    projection.columns[2].z = zs;
+    projection.columns[2].w = 1.0f;
+    projection.columns[3].z = -near * zs;
+
+    vector_float3 z = normalize3(vector3(-eye.x, -eye.y, -eye.z));
+    vector_float3 x = normalize3(cross3(vector3(0.0f, 1.0f, 0.0f), z));
+    vector_float3 y = cross3(z, x);
+    matrix_float4x4 view;
+    vector_float3 axes[3] = { x, y, z };
+    for (int row = 0; row < 3; row++) {
+        float *column = (float *)&view.columns[0];
+        column[row] = axes[row].x;
+        column[4 + row] = axes[row].y;
+        column[8 + row] = axes[row].z;
+        column[12 + row] = -dot3(axes[row], eye);
+        column[3 + row * 4] = 0.0f;
+    }
+    view.columns[3].w = 1.0f;
+
+    matrix_float4x4 result;
+    matrix4x4_multiply_n(&result, &projection, &view, 1);
+    return result;
+}
+
+// `count` rocks in a belt of radius 150 around y, as the asteroid sample
+// places them.
+static matrix_float4x4 *belt(size_t count) {
+    vector_float3 *translations = malloc(sizeof(vector_float3) * count);
+    quaternion_float *rotations = malloc(sizeof(quaternion_float) * count);
+    vector_float3 *scales = malloc(sizeof(vector_float3) * count);
+    vector_float3 axis = normalize3(vector3(0.4f, 0.6f, 0.8f));
+    for (size_t i = 0; i < count; i++) {
+        float angle = core_random(3.14159265f), radius = 150.0f + core_random(25.0f);
+        translations[i] = vector3(sinf(angle) * radius, core_random(10.0f), cosf(angle) * radius);
+        float scale = 0.25f + core_random(0.2f);
+        scales[i] = vector3(scale, scale, scale);
+        float spin = core_random(3.14159265f);
+        rotations[i].x = axis.x * sinf(spin * 0.5f);
+        rotations[i].y = axis.y * sinf(spin * 0.5f);
+        rotations[i].z = axis.z * sinf(spin * 0.5f);
+        rotations[i].w = cosf(spin * 0.5f);
+    }
+    matrix_float4x4 *models = malloc(sizeof(matrix_float4x4) * count);
+    matrix4x4_compose_trs_n(models, translations, rotations, scales, count);
+    free(translations);
+    free(rotations);
+    free(scales);
+    return models;
+}
+
+static instance_cull_view make_view(vector_float3 eye, float fovy) {
+    instance_cull_view view;
+    frustum_planes_from_matrix(view.planes, view_projection(eye, fovy, 1.5f));
+    view.cameraPosition = eye;
+    view.levelErrors = levelErrors;
+    view.levelCount = 4;
+    view.projectionScale = mesh_lod_projection_scale(fovy, 1000.0f);
+    view.thresholdPixels = 1.0f;
+    return view;
+}
+
+// Every instance tested one at a time and appended to its level.
+static size_t reference_run(matrix_float4x4 *instances, uint32_t *levelCounts, const instance_cull *cull,
+                            const matrix_float4x4 *models, const instance_cull_view *view) {
+    size_t visible = 0;
+    for (uint32_t level = 0; level < view->levelCount; level++) {
+        levelCounts[level] = 0;
+        for (size_t i = 0; i < cull->count; i++) {
+            if (!frustum_contains_sphere(view->planes, cull->centerX[i], cull->centerY[i], cull->centerZ[i],
+                                         cull->radius[i])) {
+                continue;
+            }
+            float dx = cull->centerX[i] - view->cameraPosition.x;
+            float dy = cull->centerY[i] - view->cameraPosition.y;
+            float dz = cull->centerZ[i] - view->cameraPosition.z;
+            if (mesh_lod_select(view->levelErrors, view->levelCount, cull->radius[i] / cull->sphereRadius,
+                                sqrtf(dx * dx + dy * dy + dz * dz), view->projectionScale,
+                                view->thresholdPixels) == level) {
+                instances[visible++] = models[i];
+                levelCounts[level]++;
+            }
+        }
+    }
+    return visible;
+}
+
+void instance_cull_checks(void) {
+    const size_t count = 20000;
+    matrix_float4x4 *models = belt(count);
+    instance_cull *cull = instance_cull_create(count);
+    vector_float4 sphere;
+    sphere.x = 0.0f;
+    sphere.y = 0.1f;
+    sphere.z = 0.0f;
+    sphere.w = 1.2f;
+    CHECK(!instance_cull_set_bounds(cull, models, count + 1, sphere));
+    CHECK(instance_cull_set_bounds(cull, models, count, sphere));
+
+    // spheres are the model's sphere placed and scaled by every model
+    bool placed = true;
+    for (size_t i = 0; i < count; i++) {
+        const matrix_float4x4 *m = &models[i];
+        float x = m->columns[1].x * sphere.y + m->columns[3].x;
+        float y = m->columns[1].y * sphere.y + m->columns[3].y;
+        float z = m->columns[1].z * sphere.y + m->columns[3].z;
+        float scale = sqrtf(m->columns[0].x * m->columns[0].x + m->columns[0].y * m->columns[0].y +
+                            m->columns[0].z * m->columns[0].z);
+        placed &= core_close(cull->centerX[i], x, 1e-4) && core_close(cull->centerY[i], y, 1e-4) &&
+                  core_close(cull->centerZ[i], z, 1e-4) && core_close(cull->radius[i], sphere.w * scale, 1e-4);
+    }
+    CHECK(placed);
+
+    matrix_float4x4 *instances = malloc(sizeof(matrix_float4x4) * count);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * count);
+    job_pool *pool = job_pool_create(4);
+    for (int v = 0; v < 6; v++) {
+        float fovy = 0.05f + v * 0.25f;
+        instance_cull_view view = make_view(vector3(0.0f, 40.0f, 300.0f), fovy);
+        uint32_t levelCounts[4], pooledCounts[4], expectedCounts[4];
+        size_t visible = instance_cull_run(cull, instances, levelCounts, models, &view, NULL);
+        size_t expectedVisible = reference_run(expected, expectedCounts, cull, models, &view);
+        CHECK(visible == expectedVisible);
+        CHECK(memcmp(levelCounts, expectedCounts, sizeof(levelCounts)) == 0);
+        CHECK(memcmp(instances, expected, sizeof(matrix_float4x4) * visible) == 0);
+
+        size_t pooled = instance_cull_run(cull, instances, pooledCounts, models, &view, pool);
+        CHECK(pooled == visible);
+        CHECK(memcmp(pooledCounts, levelCounts, sizeof(levelCounts)) == 0);
+        CHECK(memcmp(instances, expected, sizeof(matrix_float4x4) * visible) == 0);
+    }
+    // a narrow view sees part of the belt, a wide one most of it
+    uint32_t levelCounts[4];
+    instance_cull_view narrow = make_view(vector3(0.0f, 40.0f, 300.0f), 0.05f);
+    CHECK(instance_cull_run(cull, instances, levelCounts, models, &narrow, NULL) < count / 10);
+    instance_cull_view wide = make_view(vector3(0.0f, 40.0f, 300.0f), 1.3f);
+    CHECK(instance_cull_run(cull, instances, levelCounts, models, &wide, NULL) > count / 2);
+
+    instance_cull_view noLevels = narrow;
+    noLevels.levelCount = 0;
+    CHECK(instance_cull_run(cull, instances, levelCounts, models, &noLevels, NULL) == 0);
+
+    job_pool_destroy(pool);
+    free(instances);
+    free(expected);
+    instance_cull_destroy(cull);
+    free(models);
+}
+
+void instance_cull_benchmarks(void) {
+    const size_t counts[3] = { 10000, 100000, 1000000 };
+    const float fields[3] = { 0.3f, 0.8f, 1.3f };
+    const int runs = 20;
+    job_pool *pool = job_pool_create(0);
+    vector_float4 sphere;
+    sphere.x = 0.0f;
+    sphere.y = 0.1f;
+    sphere.z = 0.0f;
+    sphere.w = 1.2f;
+    for (int c = 0; c < 3; c++) {
+        matrix_float4x4 *models = belt(counts[c]);
+        instance_cull *cull = instance_cull_create(counts[c]);
+        instance_cull_set_bounds(cull, models, counts[c], sphere);
+        matrix_float4x4 *instances = malloc(sizeof(matrix_float4x4) * counts[c]);
+        for (int f = 0; f < 3; f++) {
+            instance_cull_view view = make_view(vector3(0.0f, 40.0f, 300.0f), fields[f]);
+            uint32_t levelCounts[4];
+            size_t visible = instance_cull_run(cull, instances, levelCounts, models, &view, pool);
+            double start = core_seconds();
+            for (int r = 0; r < runs; r++) {
+                instance_cull_run(cull, instances, levelCounts, models, &view, pool);
+            }
+            double elapsed = (core_seconds() - start) / runs;
+            core_report("instance_cull", "%zu instances, fov %.1f, %s: %.1f%% visible, %.3f ms per run",
+                        counts[c], fields[f], core_threads(pool), 100.0 * visible / counts[c], elapsed * 1e3);
+        }
+        free(instances);
+        instance_cull_destroy(cull);
+        free(models);
+    }
+    job_pool_destroy(pool);
+}
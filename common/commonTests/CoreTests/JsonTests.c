@@ -0,0 +1,191 @@
+//
+//  JsonTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/JsonFloatParser.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct text_buffer {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} text_buffer;
+
+static void append(text_buffer *buffer, const char *text, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        buffer->capacity = (buffer->length + length) * 2;
+        buffer->bytes = realloc(buffer->bytes, buffer->capacity);
+    }
+    memcpy(buffer->bytes + buffer->length, text, length);
+    buffer->length += length;
+}
+
+// Decodes a float array member with strtof, the reference for the decoder.
+// The value is copied out so that strtof stops at its closing bracket.
+static size_t strtof_floats(const json_member *member, float *values) {
+    char *text = malloc(member->valueLength + 1);
+    memcpy(text, member->value, member->valueLength);
+    text[member->valueLength] = '\0';
+    char *p = text + 1;
+    size_t count = 0;
+    while (count < member->floatCount) {
+        char *next;
+        values[count++] = strtof(p, &next);
+        p = next + strspn(next, ", \t\r\n");
+    }
+    free(text);
+    return count;
+}
+
+// A mesh of `vertexCount` vertices in the layout of fox.json.
+static text_buffer mesh_json(size_t vertexCount) {
+    static const char *keys[3] = { "position", "normal", "uv" };
+    static const size_t widths[3] = { 3, 3, 2 };
+    text_buffer json = { NULL, 0, 0 };
+    append(&json, "{", 1);
+    for (int a = 0; a < 3; a++) {
+        char text[64];
+        int length = snprintf(text, sizeof(text), "%s\"%s\": [", a ? ", " : "", keys[a]);
+        append(&json, text, (size_t)length);
+        for (size_t i = 0; i < vertexCount * widths[a]; i++) {
+            length = a == 0 ? snprintf(text, sizeof(text), "%s%.3f", i ? ", " : "", core_random(10.0f))
+                            : snprintf(text, sizeof(text), "%s%.6g", i ? ", " : "", core_random(1.0f));
+            append(&json, text, (size_t)length);
+        }
+        append(&json, "]", 1);
+    }
+    append(&json, "}", 1);
+    return json;
+}
+
+void json_checks(void) {
+    char text[64];
+    for (int i = 0; i < 200000; i++) {
+        int exponent = (int)core_random_index(60) - 30;
+        switch (i % 5) {
+            case 0: snprintf(text, sizeof(text), "%.3f", core_random(100.0f)); break;
+            case 1: snprintf(text, sizeof(text), "%.6g", core_random(1.0f)); break;
+            case 2: snprintf(text, sizeof(text), "%.9g", core_random(1.0f) * powf(10.0f, (float)exponent)); break;
+            case 3: snprintf(text, sizeof(text), "%.17g", (double)core_random(1.0f) * pow(10.0, exponent / 1.5)); break;
+            default: snprintf(text, sizeof(text), "%ue%d", core_random_index(100000), exponent); break;
+        }
+        size_t length = strlen(text);
+        float expected = strtof(text, NULL);
+        float value;
+        const char *end = json_parse_float(text, text + length, &value);
+        // the failing number is the condition, one failure is enough
+        if (!core_check(end == text + length && memcmp(&value, &expected, sizeof(float)) == 0,
+                        text, __FILE__, __LINE__)) {
+            break;
+        }
+    }
+
+    // the edges of the exact paths and of the float range
+    const char *edges[] = {
+        "0", "-0", "1e-46", "1e39", "3.4028235e38", "3.4028236e38", "1.17549435e-38", "1.4e-45",
+        "9007199254740993", "0.30000000000000004", "123456789012345678901234567890", "1e22", "1e23",
+        "16777217", "0.000000000000000000000000000000000000000000001",
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        float expected = strtof(edges[i], NULL);
+        float value;
+        size_t length = strlen(edges[i]);
+        CHECK(json_parse_float(edges[i], edges[i] + length, &value) == edges[i] + length);
+        CHECK(memcmp(&value, &expected, sizeof(float)) == 0);
+    }
+
+    const char *malformed[] = { "-", "01", "1.", "1e", ".5", "1.e3", "+1", "nan" };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        float value;
+        CHECK(json_parse_float(malformed[i], malformed[i] + strlen(malformed[i]), &value) == NULL);
+    }
+
+    const char *json = "{ \"position\": [1, 2.5, -3e2 ,4], \"rig\": {\"bones\": [{\"parent\": -1}], \"name\": \"]\"},"
+                       " \"empty\": [], \"mixed\": [1, \"x\"], \"flag\": true }";
+    json_member members[8];
+    ptrdiff_t count = json_index_members(json, strlen(json), members, 8);
+    CHECK(count == 5);
+    const json_member *position = json_find_member(members, (size_t)count, "position");
+    CHECK(position && position->isFloatArray && position->floatCount == 4);
+    const json_member *rig = json_find_member(members, (size_t)count, "rig");
+    const char *rigValue = "{\"bones\": [{\"parent\": -1}], \"name\": \"]\"}";
+    CHECK(rig && !rig->isFloatArray && rig->valueLength == strlen(rigValue) &&
+          memcmp(rig->value, rigValue, rig->valueLength) == 0);
+    const json_member *empty = json_find_member(members, (size_t)count, "empty");
+    CHECK(empty && empty->isFloatArray && empty->floatCount == 0);
+    CHECK(!json_find_member(members, (size_t)count, "mixed")->isFloatArray);
+    CHECK(!json_find_member(members, (size_t)count, "flag")->isFloatArray);
+    CHECK(json_find_member(members, (size_t)count, "normal") == NULL);
+
+    // two components in every 16 byte tuple
+    float tuples[8] = { 0 };
+    CHECK(json_decode_floats(position, tuples, 2, 16) == 4);
+    CHECK(tuples[0] == 1.0f && tuples[1] == 2.5f && tuples[4] == -300.0f && tuples[5] == 4.0f);
+
+    // more members than room for them
+    CHECK(json_index_members(json, strlen(json), members, 2) == 5);
+    const char *truncated = "{ \"position\": [1, 2";
+    CHECK(json_index_members(truncated, strlen(truncated), members, 8) == -1);
+    const char *unclosed = "{ \"rig\": {\"name\": \"]}";
+    CHECK(json_index_members(unclosed, strlen(unclosed), members, 8) == -1);
+
+    size_t length;
+    char *fox = core_read_file(CORE_TESTS_RESOURCES "/fox/fox.json", &length);
+    CHECK(fox != NULL);
+    if (!fox) return;
+    count = json_index_members(fox, length, members, 8);
+    CHECK(count == 3);
+    const char *keys[3] = { "position", "normal", "uv" };
+    for (int a = 0; a < 3 && count == 3; a++) {
+        const json_member *member = json_find_member(members, 3, keys[a]);
+        CHECK(member && member->isFloatArray && member->floatCount > 0);
+        if (!member) continue;
+        float *values = malloc(sizeof(float) * member->floatCount);
+        float *expected = malloc(sizeof(float) * member->floatCount);
+        CHECK(json_decode_floats(member, values, 1, sizeof(float)) == member->floatCount);
+        CHECK(strtof_floats(member, expected) == member->floatCount);
+        CHECK(memcmp(values, expected, sizeof(float) * member->floatCount) == 0);
+        free(values);
+        free(expected);
+    }
+    free(fox);
+}
+
+void json_benchmarks(void) {
+    const size_t vertexCount = 1000000;
+    const size_t widths[3] = { 3, 3, 2 };
+    text_buffer json = mesh_json(vertexCount);
+    double megabytes = json.length / 1e6;
+
+    // interleaved like JsonMesh, 16 bytes per attribute
+    float *vertices = calloc(vertexCount, 48);
+    double start = core_seconds();
+    json_member members[3];
+    ptrdiff_t count = json_index_members(json.bytes, json.length, members, 3);
+    double indexing = core_seconds() - start;
+    size_t decoded = 0;
+    for (int a = 0; a < 3 && count == 3; a++) {
+        decoded += json_decode_floats(&members[a], vertices + a * 4, widths[a], 48);
+    }
+    double streaming = core_seconds() - start;
+    CHECK(decoded == vertexCount * 8);
+
+    float *values = malloc(sizeof(float) * vertexCount * 3);
+    start = core_seconds();
+    for (int a = 0; a < 3 && count == 3; a++) {
+        strtof_floats(&members[a], values);
+    }
+    double scanning = core_seconds() - start;
+
+    core_report("json", "%.1f MB mesh JSON: indexing %.0f MB/s, indexing and decoding %.0f MB/s, "
+                "strtof scan %.0f MB/s",
+                megabytes, megabytes / indexing, megabytes / streaming, megabytes / scanning);
+    free(values);
+    free(vertices);
+    free(json.bytes);
+}
@@ -0,0 +1,256 @@
+//
+//  MatrixBatchTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/MatrixBatch.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Not a multiple of 4 or 8, so the kernels' tails run too.
+enum { Count = 1001 };
+
+typedef struct trs_arrays {
+    vector_float3 *translations;
+    quaternion_float *rotations;
+    vector_float3 *scales;
+} trs_arrays;
+
+static trs_arrays random_trs(size_t count) {
+    trs_arrays trs = {
+        malloc(sizeof(vector_float3) * count),
+        malloc(sizeof(quaternion_float) * count),
+        malloc(sizeof(vector_float3) * count),
+    };
+    for (size_t i = 0; i < count; i++) {
+        trs.translations[i].x = core_random(10.0f);
+        trs.translations[i].y = core_random(10.0f);
+        trs.translations[i].z = core_random(10.0f);
+        float x = core_random(1.0f), y = core_random(1.0f), z = core_random(1.0f), w = core_random(1.0f);
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        trs.rotations[i].x = x / length;
+        trs.rotations[i].y = y / length;
+        trs.rotations[i].z = z / length;
+        trs.rotations[i].w = w / length;
+        trs.scales[i].x = 0.5f + fabsf(core_random(2.0f));
+        trs.scales[i].y = 0.5f + fabsf(core_random(2.0f));
+        trs.scales[i].z = 0.5f + fabsf(core_random(2.0f));
+    }
+    return trs;
+}
+
+static void free_trs(trs_arrays *trs) {
+    free(trs->translations);
+    free(trs->rotations);
+    free(trs->scales);
+}
+
+// translation * rotation * scale in double precision, column-major.
+static void reference_trs(double m[16], vector_float3 t, quaternion_float q, vector_float3 s) {
+    double x = q.x, y = q.y, z = q.z, w = q.w;
+    double r[9] = {
+        1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+        2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+        2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y),
+    };
+    double scale[3] = { s.x, s.y, s.z };
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            m[c * 4 + k] = r[c * 3 + k] * scale[c];
+        }
+        m[c * 4 + 3] = 0.0;
+    }
+    m[12] = t.x;
+    m[13] = t.y;
+    m[14] = t.z;
+    m[15] = 1.0;
+}
+
+static void reference_multiply(double out[16], const float *a, const float *b) {
+    for (int c = 0; c < 4; c++) {
+        for (int k = 0; k < 4; k++) {
+            double sum = 0.0;
+            for (int j = 0; j < 4; j++) {
+                sum += (double)a[j * 4 + k] * b[c * 4 + j];
+            }
+            out[c * 4 + k] = sum;
+        }
+    }
+}
+
+// Largest difference of `m` times `inverse` from the identity.
+static double inverse_error(const matrix_float4x4 *m, const matrix_float4x4 *inverse) {
+    double product[16], worst = 0.0;
+    reference_multiply(product, (const float *)m, (const float *)inverse);
+    for (int j = 0; j < 16; j++) {
+        worst = fmax(worst, fabs(product[j] - (j % 5 == 0 ? 1.0 : 0.0)));
+    }
+    return worst;
+}
+
+// Largest difference of transpose(normal) times the upper 3x3 of `m` from the identity.
+static double normal_error(const matrix_float4x4 *m, const matrix_float3x3 *normal) {
+    const float *columns = (const float *)m;
+    const float *n = (const float *)normal;
+    double worst = 0.0;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            double sum = 0.0;
+            for (int k = 0; k < 3; k++) {
+                // normal columns are 4 floats apart like vector_float3
+                sum += (double)n[r * 4 + k] * columns[c * 4 + k];
+            }
+            worst = fmax(worst, fabs(sum - (r == c ? 1.0 : 0.0)));
+        }
+    }
+    return worst;
+}
+
+// The scalar loop the batch replaces, one matrix at a time in float.
+static void scalar_compose(matrix_float4x4 *out, const trs_arrays *trs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        quaternion_float q = trs->rotations[i];
+        float x = q.x, y = q.y, z = q.z, w = q.w;
+        float *o = (float *)&out[i];
+        float sx = trs->scales[i].x, sy = trs->scales[i].y, sz = trs->scales[i].z;
+        o[0] = (1 - 2 * (y * y + z * z)) * sx; o[1] = 2 * (x * y + z * w) * sx; o[2] = 2 * (x * z - y * w) * sx; o[3] = 0;
+        o[4] = 2 * (x * y - z * w) * sy; o[5] = (1 - 2 * (x * x + z * z)) * sy; o[6] = 2 * (y * z + x * w) * sy; o[7] = 0;
+        o[8] = 2 * (x * z + y * w) * sz; o[9] = 2 * (y * z - x * w) * sz; o[10] = (1 - 2 * (x * x + y * y)) * sz; o[11] = 0;
+        o[12] = trs->translations[i].x; o[13] = trs->translations[i].y; o[14] = trs->translations[i].z; o[15] = 1;
+    }
+}
+
+static void scalar_multiply(matrix_float4x4 *out, const matrix_float4x4 *a, const matrix_float4x4 *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const float *x = (const float *)&a[i], *y = (const float *)&b[i];
+        float *o = (float *)&out[i];
+        for (int c = 0; c < 4; c++) {
+            for (int k = 0; k < 4; k++) {
+                o[c * 4 + k] = x[k] * y[c * 4] + x[4 + k] * y[c * 4 + 1] + x[8 + k] * y[c * 4 + 2] +
+                               x[12 + k] * y[c * 4 + 3];
+            }
+        }
+    }
+}
+
+void matrix_batch_checks(void) {
+    trs_arrays trs = random_trs(Count);
+    matrix_float4x4 *composed = malloc(sizeof(matrix_float4x4) * Count);
+    matrix4x4_compose_trs_n(composed, trs.translations, trs.rotations, trs.scales, Count);
+    double worst = 0.0;
+    for (size_t i = 0; i < Count; i++) {
+        double expected[16];
+        reference_trs(expected, trs.translations[i], trs.rotations[i], trs.scales[i]);
+        const float *m = (const float *)&composed[i];
+        for (int j = 0; j < 16; j++) {
+            worst = fmax(worst, fabs(m[j] - expected[j]));
+        }
+    }
+    // a few ulps of the scales and translations, which reach 10
+    CHECK(worst < 5e-6);
+
+    matrix_float4x4 *products = malloc(sizeof(matrix_float4x4) * Count);
+    matrix_float4x4 *others = malloc(sizeof(matrix_float4x4) * Count);
+    core_random_trs_matrices(others, Count);
+    matrix4x4_multiply_n(products, composed, others, Count);
+    worst = 0.0;
+    for (size_t i = 0; i < Count; i++) {
+        double expected[16];
+        reference_multiply(expected, (const float *)&composed[i], (const float *)&others[i]);
+        const float *m = (const float *)&products[i];
+        for (int j = 0; j < 16; j++) {
+            worst = fmax(worst, fabs(m[j] - expected[j]) / fmax(1.0, fabs(expected[j])));
+        }
+    }
+    CHECK(worst < 1e-6);
+
+    // out may alias an input
+    memcpy(others, composed, sizeof(matrix_float4x4) * Count);
+    matrix4x4_multiply_n(others, others, others, Count);
+    matrix4x4_multiply_n(products, composed, composed, Count);
+    CHECK(memcmp(others, products, sizeof(matrix_float4x4) * Count) == 0);
+
+    matrix_float4x4 *inverses = malloc(sizeof(matrix_float4x4) * Count);
+    matrix_float3x3 *normals = malloc(sizeof(matrix_float3x3) * Count);
+    matrix4x4_trs_inverse_n(inverses, composed, Count);
+    matrix3x3_trs_normal_n(normals, composed, Count);
+    double worstInverse = 0.0, worstNormal = 0.0;
+    for (size_t i = 0; i < Count; i++) {
+        worstInverse = fmax(worstInverse, inverse_error(&composed[i], &inverses[i]));
+        worstNormal = fmax(worstNormal, normal_error(&composed[i], &normals[i]));
+    }
+    CHECK(worstInverse < 1e-5);
+    CHECK(worstNormal < 1e-5);
+
+    // a shear is affine but not TRS
+    for (size_t i = 0; i < Count; i++) {
+        composed[i].columns[1].x += 0.3f;
+        composed[i].columns[2].y -= 0.2f;
+    }
+    matrix4x4_affine_inverse_n(inverses, composed, Count);
+    matrix3x3_affine_normal_n(normals, composed, Count);
+    worstInverse = worstNormal = 0.0;
+    for (size_t i = 0; i < Count; i++) {
+        worstInverse = fmax(worstInverse, inverse_error(&composed[i], &inverses[i]));
+        worstNormal = fmax(worstNormal, normal_error(&composed[i], &normals[i]));
+    }
+    CHECK(worstInverse < 1e-4);
+    CHECK(worstNormal < 1e-4);
+
+    free(inverses);
+    free(normals);
+    free(products);
+    free(others);
+    free(composed);
+    free_trs(&trs);
+}
+
+void matrix_batch_benchmarks(void) {
+    const size_t count = 100000;
+    const int runs = 50;
+    trs_arrays trs = random_trs(count);
+    matrix_float4x4 *a = malloc(sizeof(matrix_float4x4) * count);
+    matrix_float4x4 *b = malloc(sizeof(matrix_float4x4) * count);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * count);
+
+    double start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        scalar_compose(a, &trs, count);
+    }
+    double scalar = core_seconds() - start;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        matrix4x4_compose_trs_n(a, trs.translations, trs.rotations, trs.scales, count);
+    }
+    double batch = core_seconds() - start;
+    core_report("matrix_batch", "compose: batch %.0f, scalar loop %.0f million matrices/s",
+                count * runs / batch / 1e6, count * runs / scalar / 1e6);
+
+    core_random_trs_matrices(b, count);
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        scalar_multiply(out, a, b, count);
+    }
+    scalar = core_seconds() - start;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        matrix4x4_multiply_n(out, a, b, count);
+    }
+    batch = core_seconds() - start;
+    core_report("matrix_batch", "multiply: batch %.0f, scalar loop %.0f million matrices/s",
+                count * runs / batch / 1e6, count * runs / scalar / 1e6);
+
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        matrix4x4_affine_inverse_n(out, a, count);
+    }
+    batch = core_seconds() - start;
+    core_report("matrix_batch", "affine inverse: batch %.0f million matrices/s", count * runs / batch / 1e6);
+
+    free(a);
+    free(b);
+    free(out);
+    free_trs(&trs);
+}
@@ -0,0 +1,263 @@
+//
+//  MeshCacheTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/JsonFloatParser.h>
+#include <common/MeshCache.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_PATH CORE_TESTS_OUTPUT "/mesh_cache.lmmesh"
+#define FOX_JSON CORE_TESTS_RESOURCES "/fox/fox.json"
+
+static const char strings[] = "body\0textures/body.png\0/absolute/specular.png\0";
+static const mesh_cache_buffer buffers[2] = {
+    { .stride = 48, .length = 48 * 100 },
+    { .stride = 8, .length = 8 * 100 },
+};
+static const mesh_cache_submesh submeshes[2] = {
+    { .geometryType = 2, .indexSize = 4, .indexCount = 90, .name = 0, .baseColorTexture = 5,
+      .specularTexture = 23, .indexOffset = 0 },
+    { .geometryType = 2, .indexSize = 2, .indexCount = 30, .name = MESH_CACHE_NO_STRING,
+      .baseColorTexture = MESH_CACHE_NO_STRING, .specularTexture = MESH_CACHE_NO_STRING, .indexOffset = 368 },
+};
+
+static mesh_cache_desc two_submeshes(void) {
+    mesh_cache_desc desc = {
+        .sourceHash = 1,
+        .layoutHash = 2,
+        .vertexCount = 100,
+        .bufferCount = 2,
+        .buffers = buffers,
+        .submeshCount = 2,
+        .submeshes = submeshes,
+        .indicesLength = 428,
+        .strings = strings,
+        .stringsLength = sizeof(strings),
+        .boundsMin = { -1, -2, -3 },
+        .boundsMax = { 1, 2, 3 },
+    };
+    return desc;
+}
+
+// Writes `cache`, overwrites `length` bytes at `offset` of the file, or cuts
+// it there if `bytes` is NULL, and loads it back.
+static bool corrupted_load_fails(const mesh_cache *cache, uint64_t offset, const void *bytes, size_t length) {
+    FILE *file = fopen(CACHE_PATH, "wb");
+    if (!file) return false;
+    fwrite(cache->storage, 1, bytes ? cache->storageSize : (size_t)offset, file);
+    if (bytes) {
+        fseek(file, (long)offset, SEEK_SET);
+        fwrite(bytes, 1, length, file);
+    }
+    fclose(file);
+    mesh_cache *loaded = mesh_cache_load(CACHE_PATH, 1, 2);
+    mesh_cache_destroy(loaded);
+    return loaded == NULL;
+}
+
+static void check_hash(void) {
+    CHECK(mesh_cache_hash("", 0, 0) == 0xEF46DB3751D8E999ull);
+    CHECK(mesh_cache_hash("abc", 3, 0) == 0x44BC2CF5AD770999ull);
+    CHECK(mesh_cache_hash("abcdefg", 7, 0) == 0x1860940E2902822Dull);
+
+    // the 32 byte lanes, then the 8, 4 and 1 byte tails
+    uint8_t bytes[111];
+    for (int i = 0; i < 111; i++) {
+        bytes[i] = (uint8_t)i;
+    }
+    CHECK(mesh_cache_hash(bytes, 100, 0) == 0x6AC1E58032166597ull);
+    CHECK(mesh_cache_hash(bytes, 111, 0) == 0x666CC5E38345DE58ull);
+    CHECK(mesh_cache_hash(bytes, 111, 0x9E3779B97F4A7C15ull) == 0x93037167BD3783E3ull);
+    CHECK(mesh_cache_hash(bytes, 99, 0) != mesh_cache_hash(bytes, 100, 0));
+}
+
+void mesh_cache_checks(void) {
+    check_hash();
+
+    mesh_cache_desc desc = two_submeshes();
+    mesh_cache *cache = mesh_cache_create(&desc);
+    CHECK(cache != NULL);
+    if (!cache) return;
+    for (uint32_t b = 0; b < 2; b++) {
+        for (uint64_t i = 0; i < cache->buffers[b].length; i++) {
+            ((uint8_t *)cache->vertices[b])[i] = (uint8_t)core_random_index(256);
+        }
+        CHECK((uintptr_t)cache->vertices[b] % 16 == 0);
+    }
+    for (uint64_t i = 0; i < cache->indicesLength; i++) {
+        ((uint8_t *)cache->indices)[i] = (uint8_t)core_random_index(256);
+    }
+
+    CHECK(mesh_cache_write(cache, CACHE_PATH));
+    mesh_cache *loaded = mesh_cache_load(CACHE_PATH, 1, 2);
+    CHECK(loaded != NULL);
+    if (loaded) {
+        CHECK(loaded->mapped);
+        CHECK(loaded->vertexCount == 100 && loaded->bufferCount == 2 && loaded->submeshCount == 2);
+        CHECK(loaded->boundsMin[0] == -1.0f && loaded->boundsMax[2] == 3.0f);
+        CHECK(loaded->storageSize == cache->storageSize);
+        CHECK(memcmp(loaded->storage, cache->storage, cache->storageSize) == 0);
+        CHECK(memcmp(loaded->vertices[1], cache->vertices[1], 8 * 100) == 0);
+        CHECK(strcmp(mesh_cache_string(loaded, loaded->submeshes[0].name), "body") == 0);
+        CHECK(strcmp(mesh_cache_string(loaded, loaded->submeshes[0].specularTexture), "/absolute/specular.png") == 0);
+        CHECK(mesh_cache_string(loaded, loaded->submeshes[1].name) == NULL);
+        // edits stay in the copy-on-write mapping
+        ((uint8_t *)loaded->indices)[0] ^= 0xFF;
+        mesh_cache_destroy(loaded);
+        loaded = mesh_cache_load(CACHE_PATH, 1, 2);
+        CHECK(loaded && memcmp(loaded->indices, cache->indices, 1) == 0);
+        mesh_cache_destroy(loaded);
+    }
+
+    // another source or vertex layout is a miss, so is a missing file
+    CHECK(mesh_cache_load(CACHE_PATH, 3, 2) == NULL);
+    CHECK(mesh_cache_load(CACHE_PATH, 1, 3) == NULL);
+    CHECK(mesh_cache_load(CORE_TESTS_OUTPUT "/missing.lmmesh", 1, 2) == NULL);
+
+    // a cluster past its submesh is refused
+    meshlet clusters[2] = { { .indexOffset = 0, .triangleCount = 20 }, { .indexOffset = 60, .triangleCount = 11 } };
+    mesh_cache_submesh clustered[2] = { submeshes[0], submeshes[1] };
+    clustered[0].clusterCount = 2;
+    desc.submeshes = clustered;
+    desc.clusterCount = 2;
+    desc.clusters = clusters;
+    CHECK(mesh_cache_create(&desc) == NULL);
+    clusters[1].triangleCount = 10;
+    mesh_cache *withClusters = mesh_cache_create(&desc);
+    CHECK(withClusters && withClusters->clusterCount == 2 && withClusters->clusters[1].indexOffset == 60);
+    mesh_cache_destroy(withClusters);
+
+    // so is a level of detail the header doesn't count
+    mesh_cache_submesh levels[2] = { submeshes[0], submeshes[1] };
+    levels[1].lod = 1;
+    levels[1].lodError = 0.25f;
+    desc = two_submeshes();
+    desc.submeshes = levels;
+    CHECK(mesh_cache_create(&desc) == NULL);
+    desc.lodCount = 1;
+    mesh_cache *withLevels = mesh_cache_create(&desc);
+    CHECK(withLevels && withLevels->submeshes[1].lod == 1 && withLevels->submeshes[1].lodError == 0.25f);
+    mesh_cache_destroy(withLevels);
+
+    // and a submesh past the indices, or a buffer short of the vertices
+    mesh_cache_submesh outside[2] = { submeshes[0], submeshes[1] };
+    outside[1].indexOffset = 400;
+    desc = two_submeshes();
+    desc.submeshes = outside;
+    CHECK(mesh_cache_create(&desc) == NULL);
+    mesh_cache_buffer shortBuffers[2] = { buffers[0], buffers[1] };
+    shortBuffers[1].length -= 1;
+    desc = two_submeshes();
+    desc.buffers = shortBuffers;
+    CHECK(mesh_cache_create(&desc) == NULL);
+
+    // the same corruptions in a file are rejected when loaded, as are a wrong
+    // magic or version, an unterminated string and a truncated file
+    const mesh_cache_header *header = cache->storage;
+    const uint32_t badMagic = MESH_CACHE_MAGIC ^ 1, badVersion = MESH_CACHE_VERSION + 1;
+    const uint32_t longVertexCount = 101;
+    const uint64_t bigIndices = 1u << 20;
+    CHECK(corrupted_load_fails(cache, offsetof(mesh_cache_header, magic), &badMagic, sizeof(badMagic)));
+    CHECK(corrupted_load_fails(cache, offsetof(mesh_cache_header, version), &badVersion, sizeof(badVersion)));
+    CHECK(corrupted_load_fails(cache, offsetof(mesh_cache_header, vertexCount), &longVertexCount, sizeof(longVertexCount)));
+    CHECK(corrupted_load_fails(cache, offsetof(mesh_cache_header, indicesLength), &bigIndices, sizeof(bigIndices)));
+    CHECK(corrupted_load_fails(cache, header->submeshesOffset + sizeof(mesh_cache_submesh), &outside[1],
+                               sizeof(mesh_cache_submesh)));
+    CHECK(corrupted_load_fails(cache, header->stringsOffset + header->stringsLength - 1, "x", 1));
+    CHECK(corrupted_load_fails(cache, cache->storageSize - 16, NULL, 0));
+    CHECK(corrupted_load_fails(cache, sizeof(mesh_cache_header) - 1, NULL, 0));
+    // the untouched file still loads
+    CHECK(!corrupted_load_fails(cache, 0, header, sizeof(uint32_t)));
+
+    remove(CACHE_PATH);
+    mesh_cache_destroy(cache);
+}
+
+void mesh_cache_benchmarks(void) {
+    size_t length;
+    char *json = core_read_file(FOX_JSON, &length);
+    if (!json) return;
+    json_member members[8];
+    ptrdiff_t count = json_index_members(json, length, members, 8);
+    uint32_t vertexCount = (uint32_t)(json_find_member(members, (size_t)count, "position")->floatCount / 3);
+
+    // the JsonMesh layout with identity indices
+    const mesh_cache_buffer buffer = { .stride = CORE_JSON_CORNER_STRIDE,
+                                       .length = (uint64_t)vertexCount * CORE_JSON_CORNER_STRIDE };
+    const mesh_cache_submesh submesh = {
+        .geometryType = 2, .indexSize = 4, .indexCount = vertexCount, .name = MESH_CACHE_NO_STRING,
+        .baseColorTexture = MESH_CACHE_NO_STRING, .specularTexture = MESH_CACHE_NO_STRING,
+    };
+    mesh_cache_desc desc = {
+        .sourceHash = mesh_cache_hash(json, length, 0),
+        .vertexCount = vertexCount,
+        .bufferCount = 1,
+        .buffers = &buffer,
+        .submeshCount = 1,
+        .submeshes = &submesh,
+        .indicesLength = (uint64_t)vertexCount * 4,
+    };
+    mesh_cache *cache = mesh_cache_create(&desc);
+    size_t cornerCount;
+    float *corners = core_load_json_corners(FOX_JSON, &cornerCount);
+    memcpy(cache->vertices[0], corners, (size_t)buffer.length);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        ((uint32_t *)cache->indices)[i] = i;
+    }
+    mesh_cache_write(cache, CACHE_PATH);
+
+    const int iterations = 1000;
+    const char *keys[3] = { "position", "normal", "uv" };
+    const size_t widths[3] = { 3, 3, 2 };
+    float *vertices = calloc(vertexCount, CORE_JSON_CORNER_STRIDE);
+    double start = core_seconds();
+    for (int k = 0; k < iterations; k++) {
+        ptrdiff_t indexed = json_index_members(json, length, members, 8);
+        for (int a = 0; a < 3; a++) {
+            json_decode_floats(json_find_member(members, (size_t)indexed, keys[a]), vertices + a * 4, widths[a],
+                               CORE_JSON_CORNER_STRIDE);
+        }
+    }
+    double parse = (core_seconds() - start) / iterations;
+
+    // a load hashes the source to find its key, then maps and reads the cache
+    uint64_t checksum = 0;
+    bool loads = true;
+    start = core_seconds();
+    for (int k = 0; k < iterations; k++) {
+        uint64_t key = mesh_cache_hash(json, length, 0);
+        mesh_cache *loaded = mesh_cache_load(CACHE_PATH, key, 0);
+        loads &= loaded != NULL;
+        if (!loaded) break;
+        checksum += mesh_cache_hash(loaded->vertices[0], (size_t)loaded->buffers[0].length, 0);
+        mesh_cache_destroy(loaded);
+    }
+    double load = (core_seconds() - start) / iterations;
+    CHECK(loads);
+    CHECK(checksum == mesh_cache_hash(cache->vertices[0], (size_t)buffer.length, 0) * iterations);
+    CHECK(memcmp(vertices, cache->vertices[0], (size_t)buffer.length) == 0);
+    core_report("mesh_cache", "fox.json, %u vertices, %.0f kB of text: parse %.3f ms, cached load %.3f ms (%.1fx)",
+                vertexCount, length / 1e3, parse * 1e3, load * 1e3, parse / load);
+
+    const size_t hashLength = 64u << 20;
+    uint8_t *bytes = malloc(hashLength);
+    for (size_t i = 0; i < hashLength; i++) {
+        bytes[i] = (uint8_t)(i * 31);
+    }
+    start = core_seconds();
+    uint64_t hash = mesh_cache_hash(bytes, hashLength, 0);
+    double hashing = core_seconds() - start;
+    core_report("mesh_cache", "hash of %zu MB: %.0f MB/s (%016llx)", hashLength >> 20,
+                hashLength / hashing / 1e6, (unsigned long long)hash);
+
+    remove(CACHE_PATH);
+    free(bytes);
+    free(vertices);
+    free(corners);
+    free(json);
+    mesh_cache_destroy(cache);
+}
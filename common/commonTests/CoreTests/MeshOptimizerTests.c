@@ -0,0 +1,200 @@
+//
+//  MeshOptimizerTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/MeshOptimizer.h>
+#include <common/VertexWeld.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { MeshCount = 5 };
+
+static const char *const meshNames[MeshCount] = { "nanosuit.obj", "planet.obj", "rock.obj", "torus 20x60", "fox.json" };
+
+// Positions are the first three floats of every `stride` bytes.
+typedef struct optimizer_mesh {
+    float *vertices;
+    size_t stride;
+    size_t vertexCount;
+    uint32_t *indices;
+    size_t indexCount;
+} optimizer_mesh;
+
+// The OBJs and the torus as positions, fox.json welded like JsonMesh does.
+static optimizer_mesh load_mesh(int m) {
+    optimizer_mesh mesh = { NULL, sizeof(float) * 3, 0, NULL, 0 };
+    if (m < 3) {
+        char path[512];
+        const char *directories[3] = { "nanosuit", "planet", "rock" };
+        snprintf(path, sizeof(path), "%s/%s/%s", CORE_TESTS_RESOURCES, directories[m], meshNames[m]);
+        core_mesh obj = core_load_obj(path);
+        mesh.vertices = obj.positions;
+        mesh.vertexCount = obj.vertexCount;
+        mesh.indices = obj.indices;
+        mesh.indexCount = obj.indexCount;
+    } else if (m == 3) {
+        core_mesh torus = core_torus(20, 60);
+        mesh.vertices = torus.positions;
+        mesh.vertexCount = torus.vertexCount;
+        mesh.indices = torus.indices;
+        mesh.indexCount = torus.indexCount;
+    } else {
+        size_t cornerCount;
+        float *corners = core_load_json_corners(CORE_TESTS_RESOURCES "/fox/fox.json", &cornerCount);
+        if (!corners) return mesh;
+        mesh.stride = CORE_JSON_CORNER_STRIDE;
+        mesh.indices = malloc(sizeof(uint32_t) * cornerCount);
+        mesh.indexCount = cornerCount;
+        mesh.vertexCount = vertex_weld_remap(mesh.indices, corners, cornerCount, mesh.stride, 0.0f);
+        mesh.vertices = malloc(mesh.stride * mesh.vertexCount);
+        vertex_weld_apply(mesh.vertices, corners, cornerCount, mesh.stride, mesh.indices);
+        free(corners);
+    }
+    return mesh;
+}
+
+static void mesh_destroy(optimizer_mesh *mesh) {
+    free(mesh->vertices);
+    free(mesh->indices);
+}
+
+static int compare_triangles(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(uint32_t) * 3);
+}
+
+// Rotates every triangle to start at its smallest index, keeping the winding,
+// and sorts them, so two orders of one triangle set compare equal.
+static void canonical_triangles(uint32_t *indices, size_t indexCount) {
+    for (size_t t = 0; t < indexCount; t += 3) {
+        uint32_t *triangle = indices + t;
+        while (triangle[0] > triangle[1] || triangle[0] > triangle[2]) {
+            uint32_t first = triangle[0];
+            triangle[0] = triangle[1];
+            triangle[1] = triangle[2];
+            triangle[2] = first;
+        }
+    }
+    qsort(indices, indexCount / 3, sizeof(uint32_t) * 3, compare_triangles);
+}
+
+static bool same_triangles(const uint32_t *a, const uint32_t *b, size_t indexCount) {
+    uint32_t *sortedA = malloc(sizeof(uint32_t) * indexCount);
+    uint32_t *sortedB = malloc(sizeof(uint32_t) * indexCount);
+    memcpy(sortedA, a, sizeof(uint32_t) * indexCount);
+    memcpy(sortedB, b, sizeof(uint32_t) * indexCount);
+    canonical_triangles(sortedA, indexCount);
+    canonical_triangles(sortedB, indexCount);
+    bool same = memcmp(sortedA, sortedB, sizeof(uint32_t) * indexCount) == 0;
+    free(sortedA);
+    free(sortedB);
+    return same;
+}
+
+typedef struct optimizer_run {
+    // before, after the vertex cache stage, after the overdraw stage
+    mesh_vertex_cache_stats stats[3];
+    bool trianglesKept;
+    bool fetchOrdered;
+    size_t referencedVertices;
+    double seconds;
+} optimizer_run;
+
+// Runs the three stages as the importers do and checks that every stage keeps
+// the triangle set, and that the fetch remap numbers vertices by first use and
+// moves them intact.
+static optimizer_run optimize(const optimizer_mesh *mesh) {
+    optimizer_run run;
+    size_t indexCount = mesh->indexCount, vertexCount = mesh->vertexCount;
+    uint32_t *optimized = malloc(sizeof(uint32_t) * indexCount);
+    uint32_t *remap = malloc(sizeof(uint32_t) * vertexCount);
+    uint8_t *remapped = malloc(mesh->stride * vertexCount);
+
+    run.stats[0] = mesh_analyze_vertex_cache(mesh->indices, indexCount, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+    double start = core_seconds();
+    run.trianglesKept = mesh_optimize_vertex_cache(optimized, mesh->indices, indexCount, vertexCount);
+    double cache = core_seconds() - start;
+    run.stats[1] = mesh_analyze_vertex_cache(optimized, indexCount, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+    run.trianglesKept &= same_triangles(mesh->indices, optimized, indexCount);
+    start = core_seconds();
+    run.trianglesKept &= mesh_optimize_overdraw(optimized, optimized, indexCount, mesh->vertices, mesh->stride,
+                                                vertexCount, 1.05f);
+    double overdraw = core_seconds() - start;
+    run.stats[2] = mesh_analyze_vertex_cache(optimized, indexCount, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+    run.trianglesKept &= same_triangles(mesh->indices, optimized, indexCount);
+
+    start = core_seconds();
+    run.referencedVertices = mesh_optimize_vertex_fetch_remap(remap, optimized, indexCount, vertexCount);
+    mesh_remap_vertices(remapped, mesh->vertices, vertexCount, mesh->stride, remap);
+    run.seconds = cache + overdraw + core_seconds() - start;
+
+    // every referenced vertex lands in its slot, and the remapped indices meet
+    // the vertices in increasing order
+    bool moved = true;
+    for (size_t v = 0; v < vertexCount; v++) {
+        moved &= remap[v] == UINT32_MAX ||
+                 memcmp(remapped + remap[v] * mesh->stride, (const uint8_t *)mesh->vertices + v * mesh->stride,
+                        mesh->stride) == 0;
+    }
+    uint32_t *original = malloc(sizeof(uint32_t) * indexCount);
+    mesh_remap_indices(optimized, optimized, indexCount, remap);
+    mesh_remap_indices(original, mesh->indices, indexCount, remap);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        moved &= optimized[i] <= next;
+        next += optimized[i] == next;
+    }
+    run.fetchOrdered = moved && next == run.referencedVertices;
+    run.trianglesKept &= same_triangles(original, optimized, indexCount);
+
+    free(original);
+    free(remapped);
+    free(remap);
+    free(optimized);
+    return run;
+}
+
+void mesh_optimizer_checks(void) {
+    // triangle soup misses on every vertex
+    const uint32_t soup[9] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    mesh_vertex_cache_stats stats = mesh_analyze_vertex_cache(soup, 9, 9, MESH_OPTIMIZER_FIFO_SIZE);
+    CHECK(stats.transformedVertices == 9);
+    CHECK_CLOSE(stats.acmr, 3.0, 1e-6);
+    CHECK_CLOSE(stats.atvr, 1.0, 1e-6);
+    // and a vertex evicted from a FIFO of 3 is transformed again
+    const uint32_t evicted[9] = { 0, 1, 2, 2, 1, 3, 0, 3, 2 };
+    CHECK(mesh_analyze_vertex_cache(evicted, 9, 4, 3).transformedVertices == 5);
+
+    for (int m = 0; m < MeshCount; m++) {
+        optimizer_mesh mesh = load_mesh(m);
+        CHECK(mesh.indexCount > 0);
+        if (mesh.indexCount == 0) continue;
+        optimizer_run run = optimize(&mesh);
+        CHECK(run.trianglesKept);
+        CHECK(run.fetchOrdered);
+        CHECK(run.referencedVertices <= mesh.vertexCount);
+        // fox.json is flat shaded, welding leaves nothing shared to reorder
+        if (m == 4) {
+            CHECK(run.stats[1].acmr <= run.stats[0].acmr && run.stats[2].acmr <= run.stats[0].acmr);
+        } else {
+            CHECK(run.stats[1].acmr < run.stats[0].acmr && run.stats[2].acmr < run.stats[0].acmr);
+            CHECK(run.stats[1].atvr < run.stats[0].atvr);
+        }
+        mesh_destroy(&mesh);
+    }
+}
+
+void mesh_optimizer_benchmarks(void) {
+    for (int m = 0; m < MeshCount; m++) {
+        optimizer_mesh mesh = load_mesh(m);
+        if (mesh.indexCount == 0) continue;
+        optimizer_run run = optimize(&mesh);
+        core_report("mesh_optimizer", "%-12s %6zu vertices: ACMR %.3f -> %.3f (%.3f after overdraw), "
+                    "ATVR %.3f -> %.3f (%.3f), %.1f ms", meshNames[m], mesh.vertexCount,
+                    run.stats[0].acmr, run.stats[1].acmr, run.stats[2].acmr,
+                    run.stats[0].atvr, run.stats[1].atvr, run.stats[2].atvr, run.seconds * 1e3);
+        mesh_destroy(&mesh);
+    }
+}
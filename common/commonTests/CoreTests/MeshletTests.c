@@ -0,0 +1,227 @@
+//
+//  MeshletTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/Meshlet.h>
+#include <common/MeshOptimizer.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct meshlet_mesh {
+    core_mesh mesh;
+    meshlet *meshlets;
+    size_t meshletCount;
+    uint32_t *indices;
+    double buildSeconds;
+} meshlet_mesh;
+
+static meshlet_mesh build(core_mesh mesh) {
+    meshlet_mesh result = { mesh, NULL, 0, NULL, 0.0 };
+    mesh_optimize_vertex_cache(mesh.indices, mesh.indices, mesh.indexCount, mesh.vertexCount);
+    result.meshlets = malloc(sizeof(meshlet) * meshlet_bound(mesh.indexCount));
+    result.indices = malloc(sizeof(uint32_t) * mesh.indexCount);
+    double start = core_seconds();
+    result.meshletCount = meshlet_build(result.meshlets, result.indices, mesh.indices, mesh.indexCount,
+                                        mesh.positions, sizeof(float) * 3, mesh.vertexCount);
+    result.buildSeconds = core_seconds() - start;
+    return result;
+}
+
+static void destroy(meshlet_mesh *clusters) {
+    free(clusters->meshlets);
+    free(clusters->indices);
+    core_mesh_destroy(&clusters->mesh);
+}
+
+static int compare_triangles(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(uint32_t) * 3);
+}
+
+// Rotates every triangle to start at its smallest index, which keeps the
+// winding, and sorts them.
+static void canonical_triangles(uint32_t *indices, size_t indexCount) {
+    for (size_t i = 0; i < indexCount; i += 3) {
+        uint32_t *t = indices + i;
+        while (t[0] > t[1] || t[0] > t[2]) {
+            uint32_t first = t[0];
+            t[0] = t[1];
+            t[1] = t[2];
+            t[2] = first;
+        }
+    }
+    qsort(indices, indexCount / 3, sizeof(uint32_t) * 3, compare_triangles);
+}
+
+static void check_clusters(const meshlet_mesh *clusters) {
+    const core_mesh *mesh = &clusters->mesh;
+    CHECK(clusters->meshletCount > 0);
+    size_t triangles = 0;
+    bool limited = true, contained = true, counted = true, contiguous = true;
+    for (size_t i = 0; i < clusters->meshletCount; i++) {
+        const meshlet *m = &clusters->meshlets[i];
+        triangles += m->triangleCount;
+        limited &= m->vertexCount <= MESHLET_MAX_VERTICES && m->triangleCount <= MESHLET_MAX_TRIANGLES;
+        contiguous &= m->indexOffset == (i == 0 ? 0 : clusters->meshlets[i - 1].indexOffset +
+                                                          clusters->meshlets[i - 1].triangleCount * 3);
+
+        uint32_t seen[MESHLET_MAX_VERTICES];
+        size_t seenCount = 0;
+        for (size_t k = 0; k < (size_t)m->triangleCount * 3; k++) {
+            uint32_t vertex = clusters->indices[m->indexOffset + k];
+            size_t j = 0;
+            while (j < seenCount && seen[j] != vertex) j++;
+            if (j == seenCount && seenCount < MESHLET_MAX_VERTICES) seen[seenCount++] = vertex;
+            const float *p = mesh->positions + (size_t)vertex * 3;
+            float dx = p[0] - m->center[0], dy = p[1] - m->center[1], dz = p[2] - m->center[2];
+            contained &= sqrtf(dx * dx + dy * dy + dz * dz) <= m->radius * 1.0001f + 1e-6f;
+        }
+        counted &= seenCount == m->vertexCount;
+    }
+    CHECK(limited);
+    CHECK(contained);
+    CHECK(counted);
+    CHECK(contiguous);
+    CHECK(triangles * 3 == mesh->indexCount);
+
+    // regrouped, not changed
+    uint32_t *before = malloc(sizeof(uint32_t) * mesh->indexCount);
+    uint32_t *after = malloc(sizeof(uint32_t) * mesh->indexCount);
+    memcpy(before, mesh->indices, sizeof(uint32_t) * mesh->indexCount);
+    memcpy(after, clusters->indices, sizeof(uint32_t) * mesh->indexCount);
+    canonical_triangles(before, mesh->indexCount);
+    canonical_triangles(after, mesh->indexCount);
+    CHECK(memcmp(before, after, sizeof(uint32_t) * mesh->indexCount) == 0);
+    free(before);
+    free(after);
+}
+
+static void bounds(const core_mesh *mesh, float center[3], float *extent) {
+    float low[3] = { INFINITY, INFINITY, INFINITY }, high[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (size_t v = 0; v < mesh->vertexCount; v++) {
+        for (int k = 0; k < 3; k++) {
+            low[k] = fminf(low[k], mesh->positions[v * 3 + k]);
+            high[k] = fmaxf(high[k], mesh->positions[v * 3 + k]);
+        }
+    }
+    *extent = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        center[k] = (low[k] + high[k]) * 0.5f;
+        *extent = fmaxf(*extent, high[k] - low[k]);
+    }
+}
+
+// Culls from `cameraCount` random cameras around the mesh, with the frustum
+// cut to one random half space. Returns the share of triangles culled and
+// counts the culled ones that face the camera with a vertex inside.
+static double cull_randomly(const meshlet_mesh *clusters, int cameraCount, size_t *wronglyCulled, double *seconds) {
+    const core_mesh *mesh = &clusters->mesh;
+    size_t triangleCount = mesh->indexCount / 3;
+    float center[3], extent;
+    bounds(mesh, center, &extent);
+    meshlet_draw *draws = malloc(sizeof(meshlet_draw) * clusters->meshletCount);
+    bool *drawn = malloc(triangleCount);
+    size_t culled = 0;
+    *wronglyCulled = 0;
+    *seconds = 0.0;
+
+    for (int c = 0; c < cameraCount; c++) {
+        vector_float3 camera;
+        camera.x = center[0] + core_random(extent * 2.0f);
+        camera.y = center[1] + core_random(extent * 2.0f);
+        camera.z = center[2] + core_random(extent * 2.0f);
+        // one plane through the center, the others too far to cut anything
+        vector_float4 planes[FRUSTUM_PLANE_COUNT];
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            planes[p].x = planes[p].y = planes[p].z = 0.0f;
+            planes[p].w = 1e9f;
+        }
+        float nx = core_random(1.0f), ny = core_random(1.0f), nz = core_random(1.0f);
+        float length = sqrtf(nx * nx + ny * ny + nz * nz) + 1e-6f;
+        planes[0].x = nx / length;
+        planes[0].y = ny / length;
+        planes[0].z = nz / length;
+        planes[0].w = -(planes[0].x * center[0] + planes[0].y * center[1] + planes[0].z * center[2]);
+
+        double start = core_seconds();
+        size_t drawCount = meshlet_cull(draws, clusters->meshlets, clusters->meshletCount, planes, camera);
+        *seconds += core_seconds() - start;
+
+        memset(drawn, 0, triangleCount);
+        for (size_t d = 0; d < drawCount; d++) {
+            memset(drawn + draws[d].indexOffset / 3, 1, draws[d].indexCount / 3);
+        }
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (drawn[t]) continue;
+            culled++;
+            const float *p[3];
+            bool inside = false;
+            for (int k = 0; k < 3; k++) {
+                p[k] = mesh->positions + (size_t)clusters->indices[t * 3 + k] * 3;
+                inside |= planes[0].x * p[k][0] + planes[0].y * p[k][1] + planes[0].z * p[k][2] + planes[0].w > 0.0f;
+            }
+            float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+            float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (area == 0.0f) continue;
+            float distance = ((camera.x - p[0][0]) * n[0] + (camera.y - p[0][1]) * n[1] +
+                              (camera.z - p[0][2]) * n[2]) / area;
+            if (inside && distance > 1e-4f * extent) (*wronglyCulled)++;
+        }
+    }
+    free(draws);
+    free(drawn);
+    return (double)culled / (triangleCount * cameraCount);
+}
+
+void meshlet_checks(void) {
+    CHECK(meshlet_bound(0) == 0);
+
+    meshlet_mesh torus = build(core_torus(100, 60));
+    check_clusters(&torus);
+    size_t wronglyCulled;
+    double seconds;
+    double culled = cull_randomly(&torus, 200, &wronglyCulled, &seconds);
+    CHECK(wronglyCulled == 0);
+    // a closed surface seen from outside shows about half of itself
+    CHECK(culled > 0.2);
+    destroy(&torus);
+
+    meshlet_mesh nanosuit = build(core_load_obj(CORE_TESTS_RESOURCES "/nanosuit/nanosuit.obj"));
+    CHECK(nanosuit.mesh.indexCount > 0);
+    if (nanosuit.mesh.indexCount > 0) {
+        check_clusters(&nanosuit);
+        cull_randomly(&nanosuit, 50, &wronglyCulled, &seconds);
+        CHECK(wronglyCulled == 0);
+    }
+    destroy(&nanosuit);
+}
+
+void meshlet_benchmarks(void) {
+    const char *names[4] = { "nanosuit", "planet", "rock", "torus" };
+    const char *paths[3] = {
+        CORE_TESTS_RESOURCES "/nanosuit/nanosuit.obj",
+        CORE_TESTS_RESOURCES "/planet/planet.obj",
+        CORE_TESTS_RESOURCES "/rock/rock.obj",
+    };
+    const int cameraCount = 200;
+    for (int i = 0; i < 4; i++) {
+        meshlet_mesh clusters = build(i < 3 ? core_load_obj(paths[i]) : core_torus(100, 60));
+        if (clusters.meshletCount == 0) {
+            destroy(&clusters);
+            continue;
+        }
+        size_t wronglyCulled;
+        double seconds;
+        double culled = cull_randomly(&clusters, cameraCount, &wronglyCulled, &seconds);
+        core_report("meshlet", "%s: %zu triangles in %zu clusters of %.1f, built in %.2f ms, "
+                    "%.0f%% culled from a random half space in %.1f us",
+                    names[i], clusters.mesh.indexCount / 3, clusters.meshletCount,
+                    clusters.mesh.indexCount / 3.0 / clusters.meshletCount, clusters.buildSeconds * 1e3,
+                    culled * 100.0, seconds / cameraCount * 1e6);
+        destroy(&clusters);
+    }
+}
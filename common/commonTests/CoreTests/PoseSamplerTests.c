@@ -0,0 +1,222 @@
+//
+//  PoseSamplerTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/PoseSampler.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNOUT_ANIMATION CORE_TESTS_RESOURCES "/snout/snout-anim.json"
+
+typedef struct pose {
+    vector_float3 *translations;
+    quaternion_float *rotations;
+    vector_float3 *scales;
+} pose;
+
+static pose pose_create(uint32_t boneCount) {
+    pose p = {
+        calloc(boneCount, sizeof(vector_float3)),
+        calloc(boneCount, sizeof(quaternion_float)),
+        calloc(boneCount, sizeof(vector_float3)),
+    };
+    return p;
+}
+
+static void pose_destroy(pose *p) {
+    free(p->translations);
+    free(p->rotations);
+    free(p->scales);
+}
+
+// Bit for bit, component by component since the padding of vector_float3 is
+// not written.
+static bool poses_equal(const pose *a, const pose *b, uint32_t boneCount) {
+    bool equal = true;
+    for (uint32_t i = 0; i < boneCount; i++) {
+        const vector_float3 *t = &a->translations[i], *u = &b->translations[i];
+        const vector_float3 *s = &a->scales[i], *v = &b->scales[i];
+        equal &= t->x == u->x && t->y == u->y && t->z == u->z && s->x == v->x && s->y == v->y && s->z == v->z &&
+                 memcmp(&a->rotations[i], &b->rotations[i], sizeof(quaternion_float)) == 0;
+    }
+    return equal;
+}
+
+// Shortest path blend of two keys in double precision, normalized for nlerp,
+// at constant angular velocity for slerp.
+static void reference_blend(const float *a, const float *b, double t, bool slerp, double out[4]) {
+    double dot = 0.0;
+    for (int k = 0; k < 4; k++) dot += (double)a[k] * b[k];
+    double sign = dot < 0 ? -1.0 : 1.0, wa = 1.0 - t, wb = t * sign;
+    dot = fmin(1.0, dot * sign);
+    if (slerp && dot < 1.0) {
+        double angle = acos(dot);
+        wa = sin((1.0 - t) * angle) / sin(angle);
+        wb = sin(t * angle) / sin(angle) * sign;
+    }
+    double length = 0.0;
+    for (int k = 0; k < 4; k++) {
+        out[k] = a[k] * wa + b[k] * wb;
+        length += out[k] * out[k];
+    }
+    for (int k = 0; k < 4; k++) out[k] /= sqrt(length);
+}
+
+typedef struct blend_errors {
+    double nlerp;
+    double slerp;
+    double lerp;
+} blend_errors;
+
+// Samples 60 fps over the whole clip with both blends and compares every bone
+// with the reference of its two keys.
+static blend_errors blend_errors_of(const animation_clip *clip) {
+    blend_errors errors = { 0.0, 0.0, 0.0 };
+    pose_sampler *sampler = pose_sampler_create(clip);
+    pose nlerped = pose_create(clip->boneCount), slerped = pose_create(clip->boneCount);
+    float duration = pose_sampler_duration(sampler);
+    for (int i = 0; i / 60.0f < duration; i++) {
+        float seconds = i / 60.0f;
+        sampler->rotationBlend = PoseRotationNlerp;
+        pose_sampler_sample(sampler, seconds, nlerped.translations, nlerped.rotations, nlerped.scales);
+        sampler->rotationBlend = PoseRotationSlerp;
+        pose_sampler_sample(sampler, seconds, slerped.translations, slerped.rotations, slerped.scales);
+        float frame = seconds * clip->framesPerSecond;
+        uint32_t k0 = (uint32_t)frame;
+        float t = frame - (float)k0;
+        for (uint32_t b = 0; b < clip->boneCount; b++) {
+            const float *key = clip->rotations + ((size_t)b * clip->frameCount + k0) * 4;
+            double expected[4];
+            reference_blend(key, key + 4, t, false, expected);
+            const float *q = (const float *)&nlerped.rotations[b];
+            for (int k = 0; k < 4; k++) errors.nlerp = fmax(errors.nlerp, fabs(q[k] - expected[k]));
+            reference_blend(key, key + 4, t, true, expected);
+            q = (const float *)&slerped.rotations[b];
+            for (int k = 0; k < 4; k++) errors.slerp = fmax(errors.slerp, fabs(q[k] - expected[k]));
+
+            const float *translation = clip->translations + ((size_t)b * clip->frameCount + k0) * 3;
+            const float sampled[3] = { nlerped.translations[b].x, nlerped.translations[b].y, nlerped.translations[b].z };
+            for (int k = 0; k < 3; k++) {
+                double lerped = translation[k] + ((double)translation[k + 3] - translation[k]) * t;
+                errors.lerp = fmax(errors.lerp, fabs(sampled[k] - lerped) / fmax(1.0, fabs(lerped)));
+            }
+        }
+    }
+    pose_destroy(&nlerped);
+    pose_destroy(&slerped);
+    pose_sampler_destroy(sampler);
+    return errors;
+}
+
+static void check_blends(const animation_clip *clip) {
+    blend_errors errors = blend_errors_of(clip);
+    CHECK(errors.nlerp < 1e-6);
+    // slerp falls back to nlerp for keys less than 0.06 rad apart
+    CHECK(errors.slerp < 1e-5);
+    CHECK(errors.lerp < 1e-6);
+}
+
+// Playback through compressed keys, 60 fps over three loops then a jump back,
+// against the searching sampler.
+static bool cursors_match_search(const animation_clip *clip) {
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(clip, &settings);
+    pose_sampler *sampler = pose_sampler_create_compressed(compressed);
+    float duration = pose_sampler_duration(sampler);
+    uint32_t boneCount = compressed->boneCount;
+    pose played = pose_create(boneCount), searched = pose_create(boneCount);
+    bool same = true;
+    int frames = (int)(duration * 60.0f) * 3;
+    for (int i = 0; i <= frames; i++) {
+        float seconds = i == frames ? 0.1f : i / 60.0f;
+        pose_sampler_sample(sampler, seconds, played.translations, played.rotations, played.scales);
+        compressed_clip_sample(compressed, fmodf(seconds, duration) * compressed->framesPerSecond,
+                               searched.translations, searched.rotations, searched.scales);
+        same &= poses_equal(&played, &searched, boneCount);
+    }
+    pose_destroy(&played);
+    pose_destroy(&searched);
+    pose_sampler_destroy(sampler);
+    compressed_clip_destroy(compressed);
+    return same;
+}
+
+void pose_sampler_checks(void) {
+    animation_clip *snout = core_load_clip_json(SNOUT_ANIMATION, 6.0f);
+    CHECK(snout != NULL);
+    if (!snout) return;
+    check_blends(snout);
+    CHECK(cursors_match_search(snout));
+
+    // bone counts that leave a tail after the four-wide steps
+    for (uint32_t boneCount = 1; boneCount <= 7; boneCount += 3) {
+        animation_clip *clip = core_random_clip(boneCount * 11, 9, 30.0f);
+        check_blends(clip);
+        CHECK(cursors_match_search(clip));
+        animation_clip_destroy(clip);
+    }
+
+    pose_sampler *sampler = pose_sampler_create(snout);
+    float duration = pose_sampler_duration(sampler);
+    CHECK_CLOSE(duration, (snout->frameCount - 1) / 6.0, 1e-6);
+    uint32_t boneCount = snout->boneCount;
+    pose first = pose_create(boneCount), second = pose_create(boneCount);
+
+    // looping wraps the time, clamping holds the last key
+    pose_sampler_sample(sampler, 0.25f, first.translations, first.rotations, first.scales);
+    pose_sampler_sample(sampler, 0.25f + 3 * duration, second.translations, second.rotations, second.scales);
+    bool wrapped = true;
+    for (uint32_t b = 0; b < boneCount; b++) {
+        wrapped &= core_close(first.translations[b].x, second.translations[b].x, 1e-3) &&
+                   core_close(first.rotations[b].w, second.rotations[b].w, 1e-5);
+    }
+    CHECK(wrapped);
+    sampler->loops = false;
+    pose_sampler_sample(sampler, duration * 2, first.translations, first.rotations, first.scales);
+    pose_sampler_sample(sampler, duration, second.translations, second.rotations, second.scales);
+    CHECK(poses_equal(&first, &second, boneCount));
+
+    // the first bones only, the others keep what they had
+    memset(first.translations, 0, sizeof(vector_float3) * boneCount);
+    pose_sampler_sample_bones(sampler, 0.3f, 10, first.translations, first.rotations, first.scales);
+    CHECK(first.translations[9].y != 0.0f);
+    CHECK(first.translations[10].x == 0.0f && first.translations[10].y == 0.0f && first.translations[10].z == 0.0f);
+
+    pose_destroy(&first);
+    pose_destroy(&second);
+    pose_sampler_destroy(sampler);
+    animation_clip_destroy(snout);
+}
+
+void pose_sampler_benchmarks(void) {
+    animation_clip *snout = core_load_clip_json(SNOUT_ANIMATION, 6.0f);
+    if (!snout) return;
+    blend_errors errors = blend_errors_of(snout);
+    core_report("pose_sampler", "snout, %u bones: nlerp within %.1e of the shortest path reference, slerp %.1e",
+                snout->boneCount, errors.nlerp, errors.slerp);
+
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(snout, &settings);
+    pose_sampler *samplers[3] = { pose_sampler_create(snout), pose_sampler_create(snout),
+                                  pose_sampler_create_compressed(compressed) };
+    samplers[1]->rotationBlend = PoseRotationSlerp;
+    double perPose[3];
+    const int poses = 100000;
+    pose p = pose_create(snout->boneCount);
+    for (int s = 0; s < 3; s++) {
+        double start = core_seconds();
+        for (int i = 0; i < poses; i++) {
+            pose_sampler_sample(samplers[s], i / 60.0f, p.translations, p.rotations, p.scales);
+        }
+        perPose[s] = (core_seconds() - start) / poses;
+        pose_sampler_destroy(samplers[s]);
+    }
+    core_report("pose_sampler", "snout pose at 60 fps: nlerp %.2f us, slerp %.2f us, compressed with cursors %.2f us",
+                perPose[0] * 1e6, perPose[1] * 1e6, perPose[2] * 1e6);
+    pose_destroy(&p);
+    compressed_clip_destroy(compressed);
+    animation_clip_destroy(snout);
+}
@@ -0,0 +1,178 @@
+//
+//  RandomStreamTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/RandomStream.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Philox4x32-10 written from the paper, on a full 128-bit counter.
+static void reference_philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c[4] = { counter[0], counter[1], counter[2], counter[3] };
+    uint32_t k[2] = { key[0], key[1] };
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c[2];
+        uint32_t next[4] = {
+            (uint32_t)(p1 >> 32) ^ c[1] ^ k[0], (uint32_t)p1,
+            (uint32_t)(p0 >> 32) ^ c[3] ^ k[1], (uint32_t)p0,
+        };
+        memcpy(c, next, sizeof(c));
+        k[0] += 0x9E3779B9u;
+        k[1] += 0xBB67AE85u;
+    }
+    memcpy(out, c, sizeof(c));
+}
+
+static uint64_t random_u64(void) {
+    uint64_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = value << 16 | core_random_index(1u << 16);
+    }
+    return value;
+}
+
+void random_stream_checks(void) {
+    // the known-answer vectors of the Random123 distribution, the stream only
+    // reaches counters below 2^62 blocks so the others go through the reference
+    random_stream stream;
+    random_stream_init(&stream, 0, 0);
+    const uint32_t zeros[4] = { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u };
+    bool known = true;
+    for (int i = 0; i < 4; i++) {
+        known &= random_stream_next_u32(&stream) == zeros[i];
+    }
+    CHECK(known);
+    const uint32_t piCounter[4] = { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u };
+    const uint32_t piKey[2] = { 0xa4093822u, 0x299f31d0u };
+    const uint32_t pi[4] = { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u };
+    const uint32_t onesCounter[4] = { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu };
+    const uint32_t ones[4] = { 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu };
+    uint32_t words[4];
+    reference_philox(piCounter, piKey, words);
+    CHECK(memcmp(words, pi, sizeof(words)) == 0);
+    reference_philox(onesCounter, onesCounter, words);
+    CHECK(memcmp(words, ones, sizeof(words)) == 0);
+
+    // any seed, stream and position is the counter (block, stream id) under
+    // the key seed
+    bool counted = true;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t seed = random_u64(), streamId = random_u64(), position = random_u64() >> 3;
+        random_stream_init(&stream, seed, streamId);
+        random_stream_skip(&stream, position);
+        uint64_t block = position >> 2;
+        uint32_t counter[4] = { (uint32_t)block, (uint32_t)(block >> 32), (uint32_t)streamId, (uint32_t)(streamId >> 32) };
+        uint32_t key[2] = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+        reference_philox(counter, key, words);
+        for (uint64_t p = position; p < (block + 2) * 4; p++) {
+            if (p > position && p % 4 == 0) {
+                counter[0]++;
+                counter[1] += counter[0] == 0;
+                reference_philox(counter, key, words);
+            }
+            counted &= random_stream_next_u32(&stream) == words[p % 4];
+        }
+    }
+    CHECK(counted);
+
+    // fills are next calls, from every offset in a block and over whole SIMD steps
+    enum { FillCount = 203 };
+    float filled[FillCount];
+    vector_float3 filled3[FillCount];
+    bool matched = true, inRange = true, matched3 = true;
+    for (uint64_t start = 0; start < 20; start++) {
+        random_stream a, b;
+        random_stream_init(&a, 1234, 7);
+        random_stream_skip(&a, start);
+        b = a;
+        random_stream_fill_float(&a, filled, FillCount, -3.0f, 5.0f);
+        for (size_t i = 0; i < FillCount; i++) {
+            float value = random_stream_next_float(&b, -3.0f, 5.0f);
+            matched &= filled[i] == value;
+            inRange &= value >= -3.0f && value < 5.0f;
+        }
+        matched &= random_stream_next_u32(&a) == random_stream_next_u32(&b);
+
+        random_stream_fill_float3(&a, filled3, FillCount, 0.0f, 1.0f);
+        for (size_t i = 0; i < FillCount; i++) {
+            float x = random_stream_next_float(&b, 0.0f, 1.0f);
+            float y = random_stream_next_float(&b, 0.0f, 1.0f);
+            float z = random_stream_next_float(&b, 0.0f, 1.0f);
+            matched3 &= filled3[i].x == x && filled3[i].y == y && filled3[i].z == z;
+        }
+    }
+    CHECK(matched);
+    CHECK(inRange);
+    CHECK(matched3);
+
+    // a skip lands where the same number of next calls does
+    random_stream skipped, stepped;
+    random_stream_init(&skipped, 99, 3);
+    random_stream_init(&stepped, 99, 3);
+    bool skips = true;
+    for (uint64_t count = 0; count < 40; count++) {
+        random_stream_skip(&skipped, count);
+        for (uint64_t i = 0; i < count; i++) {
+            random_stream_next_u32(&stepped);
+        }
+        skips &= random_stream_next_u32(&skipped) == random_stream_next_u32(&stepped);
+    }
+    CHECK(skips);
+
+    // other stream ids and seeds share no values in the same positions
+    random_stream a, b, c;
+    random_stream_init(&a, 42, 0);
+    random_stream_init(&b, 42, 1);
+    random_stream_init(&c, 43, 0);
+    size_t sameB = 0, sameC = 0;
+    for (size_t i = 0; i < 1 << 16; i++) {
+        uint32_t value = random_stream_next_u32(&a);
+        sameB += value == random_stream_next_u32(&b);
+        sameC += value == random_stream_next_u32(&c);
+    }
+    CHECK(sameB == 0);
+    CHECK(sameC == 0);
+}
+
+void random_stream_benchmarks(void) {
+    // as many floats as an RGBA 4096 x 2048 image
+    const size_t count = 4096 * 2048 * 4;
+    const int runs = 5;
+    float *values = malloc(sizeof(float) * count);
+    random_stream stream;
+
+    double start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        random_stream_init(&stream, 42, 0);
+        for (size_t i = 0; i < count; i++) {
+            values[i] = random_stream_next_float(&stream, 0.0f, 1.0f);
+        }
+    }
+    double next = (core_seconds() - start) / runs;
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        random_stream_init(&stream, 42, 0);
+        random_stream_fill_float(&stream, values, count, 0.0f, 1.0f);
+    }
+    double fill = (core_seconds() - start) / runs;
+    // the same blocks through the scalar rounds, without the per call overhead
+    start = core_seconds();
+    for (int r = 0; r < runs; r++) {
+        const uint32_t key[2] = { 42, 0 };
+        for (size_t b = 0; b < count / 4; b++) {
+            const uint32_t counter[4] = { (uint32_t)b, (uint32_t)((uint64_t)b >> 32), 0, 0 };
+            uint32_t words[4];
+            reference_philox(counter, key, words);
+            for (int j = 0; j < 4; j++) {
+                values[b * 4 + j] = (float)(words[j] >> 8) * (1.0f / 16777216.0f);
+            }
+        }
+    }
+    double rounds = (core_seconds() - start) / runs;
+    core_report("random_stream", "%zu floats: fill %.1f ms, scalar rounds %.1f ms, next loop %.1f ms",
+                count, fill * 1e3, rounds * 1e3, next * 1e3);
+    free(values);
+}
@@ -0,0 +1,195 @@
+//
+//  SimplifierTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/MeshOptimizer.h>
+#include <common/MeshSimplifier.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const float errorTargets[4] = { 0.005f, 0.01f, 0.02f, 0.05f };
+
+static mesh_simplify_source positions_only(const core_mesh *mesh) {
+    mesh_simplify_source source = { mesh->positions, mesh->vertexCount, sizeof(float) * 3, 0, NULL, 0 };
+    return source;
+}
+
+// A flat square of `size` by `size` quads in z = 0, counter-clockwise seen
+// from +z, its area is size squared.
+static core_mesh grid(uint32_t size) {
+    core_mesh mesh;
+    mesh.vertexCount = (size_t)(size + 1) * (size + 1);
+    mesh.indexCount = (size_t)size * size * 6;
+    mesh.positions = malloc(sizeof(float) * 3 * mesh.vertexCount);
+    mesh.indices = malloc(sizeof(uint32_t) * mesh.indexCount);
+    for (uint32_t y = 0; y <= size; y++) {
+        for (uint32_t x = 0; x <= size; x++) {
+            float *position = mesh.positions + ((size_t)y * (size + 1) + x) * 3;
+            position[0] = (float)x;
+            position[1] = (float)y;
+            position[2] = 0.0f;
+        }
+    }
+    uint32_t *index = mesh.indices;
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            uint32_t a = y * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+            *index++ = a; *index++ = b; *index++ = d;
+            *index++ = a; *index++ = d; *index++ = c;
+        }
+    }
+    return mesh;
+}
+
+// Distance from p to the triangle abc, after Ericson's closest point.
+static float distance_to_triangle(const float *p, const float *a, const float *b, const float *c) {
+    float ab[3], ac[3], ap[3], bp[3], cp[3], closest[3];
+    for (int k = 0; k < 3; k++) {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+        ap[k] = p[k] - a[k];
+        bp[k] = p[k] - b[k];
+        cp[k] = p[k] - c[k];
+    }
+#define DOT(u, v) ((u)[0] * (v)[0] + (u)[1] * (v)[1] + (u)[2] * (v)[2])
+    float d1 = DOT(ab, ap), d2 = DOT(ac, ap), d3 = DOT(ab, bp), d4 = DOT(ac, bp), d5 = DOT(ab, cp), d6 = DOT(ac, cp);
+#undef DOT
+    float va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+    for (int k = 0; k < 3; k++) {
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            closest[k] = a[k];
+        } else if (d3 >= 0.0f && d4 <= d3) {
+            closest[k] = b[k];
+        } else if (d6 >= 0.0f && d5 <= d6) {
+            closest[k] = c[k];
+        } else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            closest[k] = a[k] + d1 / (d1 - d3) * ab[k];
+        } else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            closest[k] = a[k] + d2 / (d2 - d6) * ac[k];
+        } else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+            closest[k] = b[k] + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c[k] - b[k]);
+        } else {
+            float denominator = 1.0f / (va + vb + vc);
+            closest[k] = a[k] + ab[k] * vb * denominator + ac[k] * vc * denominator;
+        }
+    }
+    float dx = p[0] - closest[0], dy = p[1] - closest[1], dz = p[2] - closest[2];
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+// Largest distance from the vertices of `mesh` to the simplified surface,
+// relative to the extent.
+static float measured_error(const core_mesh *mesh, const uint32_t *indices, size_t indexCount, float extent) {
+    float worst = 0.0f;
+    for (size_t v = 0; v < mesh->vertexCount; v++) {
+        float nearest = INFINITY;
+        for (size_t t = 0; t < indexCount; t += 3) {
+            nearest = fminf(nearest, distance_to_triangle(mesh->positions + v * 3,
+                                                          mesh->positions + (size_t)indices[t] * 3,
+                                                          mesh->positions + (size_t)indices[t + 1] * 3,
+                                                          mesh->positions + (size_t)indices[t + 2] * 3));
+        }
+        worst = fmaxf(worst, nearest);
+    }
+    return worst / extent;
+}
+
+void simplifier_checks(void) {
+    // a flat grid collapses to its border, which stays, with its area
+    const uint32_t size = 20;
+    core_mesh square = grid(size);
+    mesh_simplify_source source = positions_only(&square);
+    CHECK(mesh_simplify_extent(&source) == (float)size);
+    uint32_t *simplified = malloc(sizeof(uint32_t) * square.indexCount);
+    float error;
+    size_t count = mesh_simplify(simplified, square.indices, square.indexCount, &source, 0, 0.01f, &error);
+    CHECK(count > 0 && count < square.indexCount / 4);
+    CHECK(error <= 0.01f);
+    bool *used = calloc(square.vertexCount, sizeof(bool));
+    bool inRange = true;
+    double area = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        inRange &= simplified[i] < square.vertexCount;
+        if (inRange) used[simplified[i]] = true;
+    }
+    CHECK(inRange);
+    bool borderKept = true;
+    for (uint32_t y = 0; y <= size && inRange; y++) {
+        for (uint32_t x = 0; x <= size; x++) {
+            if (x == 0 || y == 0 || x == size || y == size) borderKept &= used[y * (size + 1) + x];
+        }
+    }
+    CHECK(borderKept);
+    for (size_t t = 0; t < count && inRange; t += 3) {
+        const float *a = square.positions + (size_t)simplified[t] * 3;
+        const float *b = square.positions + (size_t)simplified[t + 1] * 3;
+        const float *c = square.positions + (size_t)simplified[t + 2] * 3;
+        area += ((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0])) * 0.5;
+    }
+    CHECK_CLOSE(area, (double)size * size, 1e-3);
+    free(used);
+    free(simplified);
+    core_mesh_destroy(&square);
+
+    // a closed surface, by error and by triangle count
+    core_mesh torus = core_torus(48, 24);
+    source = positions_only(&torus);
+    float extent = mesh_simplify_extent(&source);
+    simplified = malloc(sizeof(uint32_t) * torus.indexCount);
+    size_t previous = torus.indexCount;
+    for (int l = 0; l < 4; l++) {
+        count = mesh_simplify(simplified, torus.indices, torus.indexCount, &source, 0, errorTargets[l], &error);
+        CHECK(count > 0 && count <= previous);
+        CHECK(error <= errorTargets[l]);
+        // single vertices move up to about twice the average
+        CHECK(measured_error(&torus, simplified, count, extent) <= errorTargets[l] * 2.5f);
+        previous = count;
+    }
+    count = mesh_simplify(simplified, torus.indices, torus.indexCount, &source, torus.indexCount / 4, 1.0f, &error);
+    CHECK(count > 0 && count <= torus.indexCount / 4);
+
+    // in place is the same as into another buffer
+    uint32_t *inPlace = malloc(sizeof(uint32_t) * torus.indexCount);
+    memcpy(inPlace, torus.indices, sizeof(uint32_t) * torus.indexCount);
+    size_t inPlaceCount = mesh_simplify(inPlace, inPlace, torus.indexCount, &source, torus.indexCount / 4, 1.0f, NULL);
+    CHECK(inPlaceCount == count && memcmp(inPlace, simplified, sizeof(uint32_t) * count) == 0);
+    free(inPlace);
+    free(simplified);
+    core_mesh_destroy(&torus);
+
+    // one pixel of a 0.01 error at distance 10 and a scale of 1
+    const float levelErrors[3] = { 0.0f, 0.01f, 0.1f };
+    CHECK(mesh_lod_select(levelErrors, 3, 1.0f, 10.0f, 1000.0f, 1.0f) == 1);
+    CHECK(mesh_lod_select(levelErrors, 3, 1.0f, 1.0f, 1000.0f, 1.0f) == 0);
+    CHECK(mesh_lod_select(levelErrors, 3, 1.0f, 1000.0f, 1000.0f, 1.0f) == 2);
+}
+
+void simplifier_benchmarks(void) {
+    const char *names[4] = { "rock", "planet", "nanosuit", "torus" };
+    const char *paths[3] = {
+        CORE_TESTS_RESOURCES "/rock/rock.obj",
+        CORE_TESTS_RESOURCES "/planet/planet.obj",
+        CORE_TESTS_RESOURCES "/nanosuit/nanosuit.obj",
+    };
+    for (int i = 0; i < 4; i++) {
+        core_mesh mesh = i < 3 ? core_load_obj(paths[i]) : core_torus(200, 100);
+        if (mesh.indexCount == 0) continue;
+        mesh_optimize_vertex_cache(mesh.indices, mesh.indices, mesh.indexCount, mesh.vertexCount);
+        mesh_simplify_source source = positions_only(&mesh);
+        uint32_t *simplified = malloc(sizeof(uint32_t) * mesh.indexCount);
+        for (int l = 0; l < 4; l++) {
+            float error;
+            double start = core_seconds();
+            size_t count = mesh_simplify(simplified, mesh.indices, mesh.indexCount, &source, 0, errorTargets[l], &error);
+            double elapsed = core_seconds() - start;
+            core_report("simplifier", "%s, error %.3f: %zu of %zu triangles (%.1f%%), error reached %.4f, %.1f ms",
+                        names[i], errorTargets[l], count / 3, mesh.indexCount / 3,
+                        100.0 * count / mesh.indexCount, error, elapsed * 1e3);
+        }
+        free(simplified);
+        core_mesh_destroy(&mesh);
+    }
+}
@@ -0,0 +1,144 @@
+//
+//  SkinnedVertexTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/SkinnedVertex.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { VertexCount = 1000000 };
+
+typedef struct vertex_input {
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+    float joints[4];
+    float weights[4];
+} vertex_input;
+
+// One to four weighted joints, some weights negative or zero, and now and
+// then a vertex with no weight at all.
+static void random_input(vertex_input *input, size_t i) {
+    for (int k = 0; k < 3; k++) {
+        input->position[k] = core_random(100.0f);
+        input->normal[k] = core_random(1.0f);
+    }
+    input->texCoord[0] = core_random(2.0f);
+    input->texCoord[1] = core_random(2.0f);
+    uint32_t weighted = 1 + core_random_index(4);
+    for (uint32_t k = 0; k < 4; k++) {
+        input->joints[k] = (float)core_random_index(SKINNED_VERTEX_MAX_JOINT + 1);
+        input->weights[k] = k < weighted ? fabsf(core_random(1.0f)) : (k % 2 ? 0.0f : -fabsf(core_random(1.0f)));
+    }
+    if (i % 1000 == 0) {
+        memset(input->weights, 0, sizeof(input->weights));
+    }
+}
+
+typedef struct pack_errors {
+    bool packed;
+    bool summed;
+    bool jointsKept;
+    bool positionsExact;
+    double weight;
+    double normal;
+    double texCoord;
+} pack_errors;
+
+static void check_vertex(pack_errors *errors, const vertex_input *input, const skinned_vertex *vertex) {
+    float position[3], normal[3], texCoord[2], weights[4];
+    uint32_t joints[4];
+    skinned_vertex_unpack(vertex, position, normal, texCoord, joints, weights);
+
+    errors->positionsExact &= memcmp(position, input->position, sizeof(position)) == 0;
+    for (int k = 0; k < 3; k++) {
+        errors->normal = fmax(errors->normal, fabs(normal[k] - input->normal[k]));
+    }
+    errors->positionsExact &= vertex->normal[3] == 0;
+    for (int k = 0; k < 2; k++) {
+        errors->texCoord = fmax(errors->texCoord, fabs(texCoord[k] - input->texCoord[k]) /
+                                                  fmax(fabs(input->texCoord[k]), 6.103515625e-05));
+    }
+
+    double sum = 0.0;
+    for (int k = 0; k < 4; k++) sum += input->weights[k] > 0 ? input->weights[k] : 0.0;
+    unsigned total = 0;
+    for (int k = 0; k < 4; k++) {
+        total += vertex->weights[k];
+        double normalized = sum > 0 ? fmax(input->weights[k], 0.0) / sum : (k == 0 ? 1.0 : 0.0);
+        errors->weight = fmax(errors->weight, fabs(vertex->weights[k] / 255.0 - normalized));
+        errors->jointsKept &= joints[k] == (vertex->weights[k] == 0 ? 0 : (uint32_t)input->joints[k]);
+    }
+    errors->summed &= total == 255;
+}
+
+void skinned_vertex_checks(void) {
+    pack_errors errors = { true, true, true, true, 0.0, 0.0, 0.0 };
+    vertex_input input;
+    skinned_vertex vertex;
+    for (size_t i = 0; i < VertexCount; i++) {
+        random_input(&input, i);
+        errors.packed &= skinned_vertex_pack(&vertex, input.position, input.normal, input.texCoord,
+                                             input.joints, input.weights);
+        check_vertex(&errors, &input, &vertex);
+    }
+    CHECK(errors.packed);
+    CHECK(errors.summed);
+    CHECK(errors.jointsKept);
+    CHECK(errors.positionsExact);
+    // largest remainder rounding
+    CHECK(errors.weight < 1.0 / 255.0);
+    // half a snorm16 step, and half a half ulp
+    CHECK(errors.normal <= 0.5 / 32767.0 + 1e-7);
+    CHECK(errors.texCoord <= 1.0 / 2048.0);
+
+    // a vertex without weight is bound to its first joint
+    memset(input.weights, 0, sizeof(input.weights));
+    input.joints[0] = 17.0f;
+    CHECK(skinned_vertex_pack(&vertex, input.position, input.normal, input.texCoord, input.joints, input.weights));
+    CHECK(vertex.weights[0] == 255 && vertex.joints[0] == 17 && vertex.joints[1] == 0);
+
+    // a weighted joint past the largest index fails, an unweighted one is dropped
+    const float weights[4] = { 0.5f, 0.5f, 0.0f, 0.0f };
+    const float tooLarge[4] = { 3.0f, SKINNED_VERTEX_MAX_JOINT + 1.0f, 0.0f, 0.0f };
+    const float negative[4] = { -1.0f, 3.0f, 0.0f, 0.0f };
+    const float unweighted[4] = { 3.0f, 255.0f, 4000.0f, -7.0f };
+    CHECK(!skinned_vertex_pack(&vertex, input.position, input.normal, input.texCoord, tooLarge, weights));
+    CHECK(!skinned_vertex_pack(&vertex, input.position, input.normal, input.texCoord, negative, weights));
+    CHECK(skinned_vertex_pack(&vertex, input.position, input.normal, input.texCoord, unweighted, weights));
+    CHECK(vertex.joints[0] == 3 && vertex.joints[1] == 255 && vertex.joints[2] == 0 && vertex.joints[3] == 0);
+    CHECK(vertex.weights[0] + vertex.weights[1] == 255);
+
+    // normals past the unit range clamp
+    const float outside[3] = { 2.0f, -3.0f, 0.0f };
+    CHECK(skinned_vertex_pack(&vertex, input.position, outside, input.texCoord, input.joints, weights));
+    CHECK(vertex.normal[0] == 32767 && vertex.normal[1] == -32767);
+}
+
+void skinned_vertex_benchmarks(void) {
+    vertex_input *inputs = malloc(sizeof(vertex_input) * VertexCount);
+    skinned_vertex *vertices = malloc(sizeof(skinned_vertex) * VertexCount);
+    for (size_t i = 0; i < VertexCount; i++) {
+        random_input(&inputs[i], i);
+    }
+    double start = core_seconds();
+    for (size_t i = 0; i < VertexCount; i++) {
+        const vertex_input *input = &inputs[i];
+        skinned_vertex_pack(&vertices[i], input->position, input->normal, input->texCoord, input->joints, input->weights);
+    }
+    double packed = core_seconds() - start;
+
+    pack_errors errors = { true, true, true, true, 0.0, 0.0, 0.0 };
+    for (size_t i = 0; i < VertexCount; i++) {
+        check_vertex(&errors, &inputs[i], &vertices[i]);
+    }
+    core_report("skinned_vertex", "%d vertices, %zu -> %zu bytes each, packed in %.1f ms: "
+                "weight error %.2f/255, normal %.1e, texture coordinates %.1e relative",
+                VertexCount, sizeof(vertex_input), sizeof(skinned_vertex), packed * 1e3,
+                errors.weight * 255.0, errors.normal, errors.texCoord);
+    free(inputs);
+    free(vertices);
+}
@@ -0,0 +1,130 @@
+//
+//  SkinningTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/Skinning.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { BoneCount = 70 };
+
+// Linear blend skinning of one vertex in double precision, the reference the
+// kernels are held to.
+static void reference_linear_blend(double position[3], double normal[3],
+                                   const skinned_vertex *vertex, const matrix_float4x4 *palette) {
+    float p[3], n[3], weights[4];
+    uint32_t joints[4];
+    skinned_vertex_unpack(vertex, p, n, NULL, joints, weights);
+    memset(position, 0, sizeof(double) * 3);
+    memset(normal, 0, sizeof(double) * 3);
+    for (int k = 0; k < 4; k++) {
+        const float *m = (const float *)&palette[joints[k]];
+        for (int row = 0; row < 3; row++) {
+            position[row] += weights[k] * ((double)m[row] * p[0] + (double)m[4 + row] * p[1] +
+                                           (double)m[8 + row] * p[2] + m[12 + row]);
+            normal[row] += weights[k] * ((double)m[row] * n[0] + (double)m[4 + row] * n[1] +
+                                         (double)m[8 + row] * n[2]);
+        }
+    }
+}
+
+void skinning_checks(void) {
+    const size_t count = 20000;
+    matrix_float4x4 palette[BoneCount];
+    core_random_trs_matrices(palette, BoneCount);
+    skinned_vertex *vertices = core_random_skinned_vertices(count, BoneCount);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * count);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * count);
+    vector_float3 *parallel = malloc(sizeof(vector_float3) * count);
+
+    skinning_linear_blend(positions, normals, vertices, palette, count);
+    double worst = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double position[3], normal[3];
+        reference_linear_blend(position, normal, &vertices[i], palette);
+        const float *p = (const float *)&positions[i];
+        const float *n = (const float *)&normals[i];
+        for (int k = 0; k < 3; k++) {
+            worst = fmax(worst, fmax(fabs(p[k] - position[k]), fabs(n[k] - normal[k])));
+        }
+    }
+    // a few ulps of the unit-sized inputs
+    CHECK(worst < 2e-6);
+
+    job_pool *pool = job_pool_create(4);
+    skinning_linear_blend_parallel(parallel, NULL, vertices, palette, count, pool);
+    bool identical = true;
+    for (size_t i = 0; i < count; i++) {
+        identical &= positions[i].x == parallel[i].x && positions[i].y == parallel[i].y &&
+                     positions[i].z == parallel[i].z;
+    }
+    CHECK(identical);
+    job_pool_destroy(pool);
+
+    // rigid palettes skin the same with either method
+    dual_quaternion dualPalette[BoneCount];
+    dual_quaternion_from_matrix_n(dualPalette, palette, BoneCount);
+    for (int b = 0; b < BoneCount; b++) {
+        // dual quaternions carry no scale, so compare against the unscaled matrices
+        float *m = (float *)&palette[b];
+        for (int c = 0; c < 3; c++) {
+            float length = sqrtf(m[c * 4] * m[c * 4] + m[c * 4 + 1] * m[c * 4 + 1] + m[c * 4 + 2] * m[c * 4 + 2]);
+            m[c * 4] /= length;
+            m[c * 4 + 1] /= length;
+            m[c * 4 + 2] /= length;
+        }
+    }
+    skinned_vertex single[BoneCount];
+    for (int b = 0; b < BoneCount; b++) {
+        float position[3] = { core_random(1.0f), core_random(1.0f), core_random(1.0f) };
+        float normal[3] = { 0.0f, 1.0f, 0.0f };
+        float texCoord[2] = { 0.0f, 0.0f };
+        float joints[4] = { (float)b, 0.0f, 0.0f, 0.0f };
+        float weights[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        skinned_vertex_pack(&single[b], position, normal, texCoord, joints, weights);
+    }
+    vector_float3 linear[BoneCount], dual[BoneCount];
+    skinning_linear_blend(linear, NULL, single, palette, BoneCount);
+    skinning_dual_quaternion(dual, NULL, single, dualPalette, BoneCount);
+    for (int b = 0; b < BoneCount; b++) {
+        CHECK_CLOSE(dual[b].x, linear[b].x, 1e-4);
+        CHECK_CLOSE(dual[b].y, linear[b].y, 1e-4);
+        CHECK_CLOSE(dual[b].z, linear[b].z, 1e-4);
+    }
+
+    free(vertices);
+    free(positions);
+    free(normals);
+    free(parallel);
+}
+
+void skinning_benchmarks(void) {
+    const size_t count = 200000;
+    const int frames = 20;
+    matrix_float4x4 palette[BoneCount];
+    core_random_trs_matrices(palette, BoneCount);
+    skinned_vertex *vertices = core_random_skinned_vertices(count, BoneCount);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * count);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * count);
+
+    job_pool *pool = job_pool_create(0);
+    job_pool *pools[2] = { NULL, pool };
+    for (int p = 0; p < 2; p++) {
+        skinning_linear_blend_parallel(positions, normals, vertices, palette, count, pools[p]);
+        double start = core_seconds();
+        for (int frame = 0; frame < frames; frame++) {
+            skinning_linear_blend_parallel(positions, normals, vertices, palette, count, pools[p]);
+        }
+        double elapsed = core_seconds() - start;
+        core_report("skinning", "linear blend, %s: %.1f million vertices/s",
+                    core_threads(pools[p]), count * frames / elapsed / 1e6);
+    }
+    job_pool_destroy(pool);
+
+    free(vertices);
+    free(positions);
+    free(normals);
+}
@@ -0,0 +1,126 @@
+//
+//  VertexAnimationTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/BonePalette.h>
+#include <common/Skinning.h>
+#include <common/VertexAnimation.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { BoneCount = 70, KeyCount = 11 };
+
+void vertex_animation_checks(void) {
+    const size_t vertexCount = 5000;
+    animation_clip *clip = core_random_clip(BoneCount, KeyCount, 6.0f);
+    crowd_skeleton *skeleton = core_binary_skeleton(BoneCount);
+    skinned_vertex *vertices = core_random_skinned_vertices(vertexCount, BoneCount);
+    job_pool *pool = job_pool_create(4);
+
+    vertex_animation *animation = vertex_animation_bake(vertices, vertexCount, skeleton, clip, pool);
+    CHECK(animation != NULL);
+    if (!animation) return;
+    CHECK(animation->frameCount == KeyCount);
+    CHECK(animation->vertexCount == vertexCount);
+
+    // every key skinned by hand, the bake only differs by the halfs
+    transform_hierarchy *pose = transform_hierarchy_create(BoneCount);
+    for (size_t b = 0; b < BoneCount; b++) {
+        transform_hierarchy_add(pose, skeleton->parents[b]);
+    }
+    matrix_float4x4 palette[BoneCount];
+    vector_float3 *positions = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *baked = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *bakedNormals = malloc(sizeof(vector_float3) * vertexCount);
+    double worstPosition = 0.0, worstNormal = 0.0;
+    for (uint32_t frame = 0; frame < KeyCount; frame++) {
+        animation_clip_sample(clip, (float)frame, pose->translations, pose->rotations, pose->scales);
+        pose->needsUpdate = true;
+        transform_hierarchy_update(pose);
+        bone_palette_pack(palette, pose->worldMatrices, NULL, skeleton->inverseBind, BoneCount);
+        skinning_linear_blend(positions, normals, vertices, palette, vertexCount);
+        vertex_animation_sample(animation, (float)frame, baked, bakedNormals);
+
+        for (size_t i = 0; i < vertexCount; i++) {
+            vector_float3 p = positions[i], n = normals[i];
+            double magnitude = fmax(1.0, fmax(fabs(p.x), fmax(fabs(p.y), fabs(p.z))));
+            double length = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+            worstPosition = fmax(worstPosition, fabs(baked[i].x - p.x) / magnitude);
+            worstPosition = fmax(worstPosition, fabs(baked[i].y - p.y) / magnitude);
+            worstPosition = fmax(worstPosition, fabs(baked[i].z - p.z) / magnitude);
+            worstNormal = fmax(worstNormal, fabs(bakedNormals[i].x - n.x / length));
+            worstNormal = fmax(worstNormal, fabs(bakedNormals[i].y - n.y / length));
+            worstNormal = fmax(worstNormal, fabs(bakedNormals[i].z - n.z / length));
+        }
+    }
+    // halfs keep 11 bits
+    CHECK(worstPosition < 1e-3);
+    CHECK(worstNormal < 2e-3);
+
+    // a clip of other bones is refused
+    animation_clip *otherClip = core_random_clip(BoneCount - 1, KeyCount, 6.0f);
+    CHECK(vertex_animation_bake(vertices, vertexCount, skeleton, otherClip, NULL) == NULL);
+    animation_clip_destroy(otherClip);
+
+    const char *path = CORE_TESTS_OUTPUT "/vertex_animation.lmvat";
+    CHECK(vertex_animation_write(animation, path));
+    vertex_animation *loaded = vertex_animation_load(path);
+    CHECK(loaded != NULL);
+    if (loaded) {
+        CHECK(loaded->frameCount == animation->frameCount);
+        CHECK(loaded->framesPerSecond == animation->framesPerSecond);
+        CHECK(memcmp(loaded->frames, animation->frames,
+                     sizeof(vertex_animation_vertex) * vertexCount * KeyCount) == 0);
+        vertex_animation_destroy(loaded);
+    }
+    remove(path);
+
+    free(positions);
+    free(normals);
+    free(baked);
+    free(bakedNormals);
+    transform_hierarchy_destroy(pose);
+    vertex_animation_destroy(animation);
+    job_pool_destroy(pool);
+    free(vertices);
+    crowd_skeleton_destroy(skeleton);
+    animation_clip_destroy(clip);
+}
+
+void vertex_animation_benchmarks(void) {
+    const size_t vertexCount = 100000;
+    const int samples = 100;
+    animation_clip *clip = core_random_clip(BoneCount, KeyCount, 6.0f);
+    crowd_skeleton *skeleton = core_binary_skeleton(BoneCount);
+    skinned_vertex *vertices = core_random_skinned_vertices(vertexCount, BoneCount);
+    job_pool *pool = job_pool_create(0);
+
+    double start = core_seconds();
+    vertex_animation *animation = vertex_animation_bake(vertices, vertexCount, skeleton, clip, pool);
+    double bake = core_seconds() - start;
+    core_report("vertex_animation", "bake of %zu vertices x %d keys, %s: %.1f ms",
+                vertexCount, KeyCount, core_threads(pool), bake * 1e3);
+
+    vector_float3 *positions = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * vertexCount);
+    start = core_seconds();
+    for (int s = 0; s < samples; s++) {
+        vertex_animation_sample(animation, (float)s * 0.1f, positions, normals);
+    }
+    double elapsed = core_seconds() - start;
+    core_report("vertex_animation", "playback on the calling thread: %.1f million vertices/s",
+                vertexCount * samples / elapsed / 1e6);
+
+    free(positions);
+    free(normals);
+    vertex_animation_destroy(animation);
+    job_pool_destroy(pool);
+    free(vertices);
+    crowd_skeleton_destroy(skeleton);
+    animation_clip_destroy(clip);
+}
@@ -0,0 +1,128 @@
+//
+//  VertexPackingTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/VertexPacking.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { VertexCount = 1000000, FloatStride = 48 };
+
+// The 48 byte layout the samples load: position, texture coordinate at 16,
+// normal at 32. Positions spread over a flat box off the origin, normals
+// start with the six axes where the octahedral fold has its edges.
+static float *random_vertices(size_t vertexCount) {
+    float *vertices = calloc(vertexCount, FloatStride);
+    for (size_t i = 0; i < vertexCount; i++) {
+        float *v = vertices + i * 12;
+        v[0] = 3.0f + core_random(20.0f);
+        v[1] = core_random(0.5f);
+        v[2] = -40.0f + core_random(2.0f);
+        v[4] = 0.5f + core_random(0.5f);
+        v[5] = 0.5f + core_random(0.5f);
+        float n[3] = { core_random(1.0f), core_random(1.0f), core_random(1.0f) };
+        if (i < 6) {
+            n[0] = n[1] = n[2] = 0.0f;
+            n[i / 2] = i % 2 ? -1.0f : 1.0f;
+        }
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length < 1e-3f) {
+            n[0] = n[1] = 0.0f;
+            n[2] = length = 1.0f;
+        }
+        for (int k = 0; k < 3; k++) v[8 + k] = n[k] / length;
+    }
+    return vertices;
+}
+
+typedef struct packing_errors {
+    // of half the bounds size
+    double position;
+    double normalDegrees;
+    double texcoord;
+} packing_errors;
+
+static packing_errors unpack_errors(const uint8_t *packed, const float *vertices, size_t vertexCount,
+                                    vertex_packing_position_format format, const vertex_packing_constants *constants) {
+    packing_errors errors = { 0.0, 0.0, 0.0 };
+    const float *scale = (const float *)&constants->positionScale;
+    for (size_t i = 0; i < vertexCount; i++) {
+        const float *v = vertices + i * 12;
+        float position[3], normal[3], texcoord[2];
+        vertex_unpack(position, normal, texcoord, packed + i * VERTEX_PACKING_STRIDE, format, constants);
+        for (int k = 0; k < 3; k++) {
+            errors.position = fmax(errors.position, fabs(position[k] - v[k]) / scale[k]);
+        }
+        double cosine = fmin((double)normal[0] * v[8] + (double)normal[1] * v[9] + (double)normal[2] * v[10], 1.0);
+        errors.normalDegrees = fmax(errors.normalDegrees, acos(cosine) * 57.29577951308232);
+        errors.texcoord = fmax(errors.texcoord, fmax(fabs(texcoord[0] - v[4]), fabs(texcoord[1] - v[5])));
+    }
+    return errors;
+}
+
+void vertex_packing_checks(void) {
+    float *vertices = random_vertices(VertexCount);
+    vertex_packing_source source = { vertices, VertexCount, FloatStride, 0, 32, 16 };
+    vertex_packing_constants constants = vertex_packing_compute_constants(&source);
+    const float *scale = (const float *)&constants.positionScale;
+    const float *offset = (const float *)&constants.positionOffset;
+    CHECK(scale[3] == 1.0f && offset[3] == 0.0f);
+    CHECK_CLOSE(offset[0], 3.0, 1e-3);
+    CHECK_CLOSE(scale[0], 20.0, 1e-3);
+
+    uint8_t *packed = malloc(VERTEX_PACKING_STRIDE * (size_t)VertexCount);
+    vertex_pack(packed, &source, VertexPackingPositionSnorm16, &constants);
+    packing_errors errors = unpack_errors(packed, vertices, VertexCount, VertexPackingPositionSnorm16, &constants);
+    // half a step of 1/32767
+    CHECK(errors.position < 1.0 / 65000.0);
+    CHECK(errors.normalDegrees < 0.04);
+    CHECK(errors.texcoord <= 1.0 / 4096.0);
+
+    vertex_pack(packed, &source, VertexPackingPositionHalf, &constants);
+    errors = unpack_errors(packed, vertices, VertexCount, VertexPackingPositionHalf, &constants);
+    // half an ulp of a half in [0.5, 1), plus the float rounding of positions
+    // up to 43 away from the origin in units of 20
+    CHECK(errors.position <= 1.0 / 4096.0 + 43.0 / 20.0 * 0x1p-23);
+    CHECK(errors.normalDegrees < 0.04);
+    CHECK(errors.texcoord <= 1.0 / 4096.0);
+
+    // a flat axis scales by 1, absent attributes decode as +z and 0
+    float flat[2][12] = { { 1.0f, 2.0f, 3.0f }, { 5.0f, 2.0f, 3.0f } };
+    vertex_packing_source bare = { flat, 2, FloatStride, 0, VERTEX_PACKING_ABSENT, VERTEX_PACKING_ABSENT };
+    vertex_packing_constants flatConstants = vertex_packing_compute_constants(&bare);
+    const float *flatScale = (const float *)&flatConstants.positionScale;
+    CHECK(flatScale[0] == 2.0f && flatScale[1] == 1.0f && flatScale[2] == 1.0f);
+    vertex_pack(packed, &bare, VertexPackingPositionSnorm16, &flatConstants);
+    float position[3], normal[3], texcoord[2];
+    vertex_unpack(position, normal, texcoord, packed + VERTEX_PACKING_STRIDE, VertexPackingPositionSnorm16,
+                  &flatConstants);
+    CHECK(position[0] == 5.0f && position[1] == 2.0f && position[2] == 3.0f);
+    CHECK(normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 1.0f);
+    CHECK(texcoord[0] == 0.0f && texcoord[1] == 0.0f);
+
+    free(packed);
+    free(vertices);
+}
+
+void vertex_packing_benchmarks(void) {
+    float *vertices = random_vertices(VertexCount);
+    vertex_packing_source source = { vertices, VertexCount, FloatStride, 0, 32, 16 };
+    vertex_packing_constants constants = vertex_packing_compute_constants(&source);
+    uint8_t *packed = malloc(VERTEX_PACKING_STRIDE * (size_t)VertexCount);
+    const vertex_packing_position_format formats[2] = { VertexPackingPositionSnorm16, VertexPackingPositionHalf };
+    for (int f = 0; f < 2; f++) {
+        double start = core_seconds();
+        vertex_pack(packed, &source, formats[f], &constants);
+        double elapsed = core_seconds() - start;
+        packing_errors errors = unpack_errors(packed, vertices, VertexCount, formats[f], &constants);
+        core_report("vertex_packing", "%s positions, %d vertices %d -> %d bytes in %.1f ms: position error "
+                    "1/%.0f of half the bounds, normals %.4f degrees, texture coordinates 1/%.0f",
+                    f == 0 ? "snorm16" : "half", VertexCount, FloatStride, VERTEX_PACKING_STRIDE, elapsed * 1e3,
+                    1.0 / errors.position, errors.normalDegrees, 1.0 / errors.texcoord);
+    }
+    free(packed);
+    free(vertices);
+}
@@ -0,0 +1,168 @@
+//
+//  VertexWeldTests.c
+//  commonTests
+//
+
+#include "CoreTests.h"
+#include <common/VertexWeld.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FOX_JSON CORE_TESTS_RESOURCES "/fox/fox.json"
+
+// The remap of an exact weld by brute force: every vertex takes the index of
+// the first vertex with the same bytes, first occurrences count up.
+static size_t reference_remap(uint32_t *remap, const uint8_t *vertices, size_t vertexCount, size_t stride) {
+    uint32_t welded = 0;
+    for (size_t i = 0; i < vertexCount; i++) {
+        size_t first = 0;
+        while (memcmp(vertices + first * stride, vertices + i * stride, stride) != 0) {
+            first++;
+        }
+        remap[i] = first == i ? welded++ : remap[first];
+    }
+    return welded;
+}
+
+// `baseCount` vertices of four floats on a grid of `epsilon`, each repeated
+// `copies` times in a shuffled order with noise of a quarter cell. bases[i] is
+// the base vertex i is a copy of.
+static float *noisy_copies(size_t baseCount, size_t copies, float epsilon, uint32_t *bases) {
+    size_t count = baseCount * copies;
+    float *vertices = calloc(count, sizeof(float) * 4);
+    for (size_t i = 0; i < count; i++) {
+        bases[i] = (uint32_t)(i % baseCount);
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = ((size_t)core_random_index(1u << 16) << 16 | core_random_index(1u << 16)) % (i + 1);
+        uint32_t swap = bases[i];
+        bases[i] = bases[j];
+        bases[j] = swap;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t base = bases[i];
+        vertices[i * 4 + 0] = (float)(base % 1000) * epsilon + core_random(epsilon * 0.25f);
+        vertices[i * 4 + 1] = (float)(base / 1000) * epsilon + core_random(epsilon * 0.25f);
+        vertices[i * 4 + 2] = -(float)(base % 13) * epsilon + core_random(epsilon * 0.25f);
+    }
+    return vertices;
+}
+
+static void check_fox(void) {
+    size_t cornerCount;
+    float *corners = core_load_json_corners(FOX_JSON, &cornerCount);
+    CHECK(corners != NULL);
+    if (!corners) return;
+    const size_t stride = CORE_JSON_CORNER_STRIDE;
+    uint32_t *remap = malloc(sizeof(uint32_t) * cornerCount);
+    uint32_t *expected = malloc(sizeof(uint32_t) * cornerCount);
+    size_t vertexCount = vertex_weld_remap(remap, corners, cornerCount, stride, 0.0f);
+    CHECK(cornerCount == 2940);
+    CHECK(vertexCount == 1960);
+    CHECK(reference_remap(expected, (const uint8_t *)corners, cornerCount, stride) == vertexCount);
+    CHECK(memcmp(remap, expected, sizeof(uint32_t) * cornerCount) == 0);
+
+    // every corner is its welded vertex, bit for bit
+    uint8_t *vertices = malloc(stride * vertexCount);
+    vertex_weld_apply(vertices, corners, cornerCount, stride, remap);
+    bool same = true;
+    for (size_t i = 0; i < cornerCount; i++) {
+        same &= remap[i] < vertexCount && memcmp(vertices + remap[i] * stride, (uint8_t *)corners + i * stride, stride) == 0;
+    }
+    CHECK(same);
+
+    free(vertices);
+    free(expected);
+    free(remap);
+    free(corners);
+}
+
+static void check_epsilon(void) {
+    enum { BaseCount = 3000, Copies = 3 };
+    const float epsilon = 1e-3f;
+    uint32_t *bases = malloc(sizeof(uint32_t) * BaseCount * Copies);
+    float *vertices = noisy_copies(BaseCount, Copies, epsilon, bases);
+    uint32_t *remap = malloc(sizeof(uint32_t) * BaseCount * Copies);
+    CHECK(vertex_weld_remap(remap, vertices, BaseCount * Copies, sizeof(float) * 4, 0.0f) == BaseCount * Copies);
+    CHECK(vertex_weld_remap(remap, vertices, BaseCount * Copies, sizeof(float) * 4, epsilon) == BaseCount);
+
+    // copies of a base share its welded vertex, which is its first copy
+    uint32_t *firstOf = malloc(sizeof(uint32_t) * BaseCount);
+    memset(firstOf, 0xFF, sizeof(uint32_t) * BaseCount);
+    float *welded = malloc(sizeof(float) * 4 * BaseCount);
+    vertex_weld_apply(welded, vertices, BaseCount * Copies, sizeof(float) * 4, remap);
+    bool shared = true, firstKept = true;
+    uint32_t next = 0;
+    for (size_t i = 0; i < BaseCount * Copies; i++) {
+        uint32_t base = bases[i];
+        if (firstOf[base] == UINT32_MAX) {
+            firstOf[base] = remap[i];
+            shared &= remap[i] == next++;
+            firstKept &= memcmp(&welded[remap[i] * 4], &vertices[i * 4], sizeof(float) * 4) == 0;
+        }
+        shared &= remap[i] == firstOf[base];
+    }
+    CHECK(shared);
+    CHECK(firstKept);
+
+    // out of range and NaN floats share one cell
+    const float odd[4][4] = { { NAN, 0, 0, 0 }, { 1e30f, 0, 0, 0 }, { -INFINITY, 0, 0, 0 }, { 0.1f, 0, 0, 0 } };
+    uint32_t oddRemap[4];
+    CHECK(vertex_weld_remap(oddRemap, odd, 4, sizeof(odd[0]), epsilon) == 2);
+    CHECK(oddRemap[0] == 0 && oddRemap[1] == 0 && oddRemap[2] == 0 && oddRemap[3] == 1);
+
+    free(welded);
+    free(firstOf);
+    free(remap);
+    free(vertices);
+    free(bases);
+}
+
+void vertex_weld_checks(void) {
+    check_fox();
+    check_epsilon();
+
+    // strides that are not a multiple of 4 weld exactly, byte tails included
+    const uint8_t bytes[4][6] = { { 1, 2, 3, 4, 5, 6 }, { 1, 2, 3, 4, 5, 7 }, { 1, 2, 3, 4, 5, 6 }, { 1, 2, 3, 4, 5, 7 } };
+    uint32_t remap[4], expected[4];
+    CHECK(vertex_weld_remap(remap, bytes, 4, 6, 0.0f) == 2);
+    reference_remap(expected, &bytes[0][0], 4, 6);
+    CHECK(memcmp(remap, expected, sizeof(remap)) == 0);
+    CHECK(vertex_weld_remap(remap, bytes, 0, 6, 0.0f) == 0);
+}
+
+void vertex_weld_benchmarks(void) {
+    size_t cornerCount;
+    float *corners = core_load_json_corners(FOX_JSON, &cornerCount);
+    if (!corners) return;
+    const size_t stride = CORE_JSON_CORNER_STRIDE;
+    uint32_t *remap = malloc(sizeof(uint32_t) * cornerCount);
+    size_t vertexCount = vertex_weld_remap(remap, corners, cornerCount, stride, 0.0f);
+    size_t indexSize = vertexCount <= UINT16_MAX ? 2 : 4;
+    size_t before = cornerCount * stride + cornerCount * 4;
+    size_t after = vertexCount * stride + cornerCount * indexSize;
+    core_report("vertex_weld", "fox.json: %zu corners into %zu vertices (%.1f%%), vertex and index memory "
+                "%zu -> %zu bytes (%.1f%%)", cornerCount, vertexCount, 100.0 * vertexCount / cornerCount,
+                before, after, 100.0 * after / before);
+    free(remap);
+    free(corners);
+
+    enum { BaseCount = 300000, Copies = 4 };
+    const float epsilon = 1e-3f;
+    const size_t count = (size_t)BaseCount * Copies;
+    uint32_t *bases = malloc(sizeof(uint32_t) * count);
+    float *vertices = noisy_copies(BaseCount, Copies, epsilon, bases);
+    remap = malloc(sizeof(uint32_t) * count);
+    const float epsilons[2] = { 0.0f, epsilon };
+    for (int e = 0; e < 2; e++) {
+        double start = core_seconds();
+        size_t welded = vertex_weld_remap(remap, vertices, count, sizeof(float) * 4, epsilons[e]);
+        double elapsed = core_seconds() - start;
+        core_report("vertex_weld", "%zu vertices of 16 bytes, %s: %zu welded, %.1f ns per vertex", count,
+                    e == 0 ? "exact" : "epsilon 1e-3", welded, elapsed * 1e9 / count);
+    }
+    free(remap);
+    free(vertices);
+    free(bases);
+}
@@ -0,0 +1,87 @@
+//
+//  main.c
+//  commonTests
+//
+//  core_tests [--bench] [suite ...]
+//
+//  Runs the checks of the named suites, every suite by default, and with
+//  --bench their benchmarks after the checks. Exits with 1 if a check failed.
+//
+
+#include "CoreTests.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct core_suite {
+    const char *name;
+    void (*checks)(void);
+    void (*benchmarks)(void);
+} core_suite;
+
+static const core_suite suites[] = {
+    { "skinning", skinning_checks, skinning_benchmarks },
+    { "crowd", crowd_checks, crowd_benchmarks },
+    { "vertex_animation", vertex_animation_checks, vertex_animation_benchmarks },
+    { "json", json_checks, json_benchmarks },
+    { "meshlet", meshlet_checks, meshlet_benchmarks },
+    { "simplifier", simplifier_checks, simplifier_benchmarks },
+    { "instance_cull", instance_cull_checks, instance_cull_benchmarks },
+    { "matrix_batch", matrix_batch_checks, matrix_batch_benchmarks },
+    { "half_float", half_float_checks, half_float_benchmarks },
+    { "random_stream", random_stream_checks, random_stream_benchmarks },
+    { "hierarchy", hierarchy_checks, hierarchy_benchmarks },
+    { "compressed_clip", compressed_clip_checks, compressed_clip_benchmarks },
+    { "pose_sampler", pose_sampler_checks, pose_sampler_benchmarks },
+    { "bone_palette", bone_palette_checks, bone_palette_benchmarks },
+    { "skinned_vertex", skinned_vertex_checks, skinned_vertex_benchmarks },
+    { "mesh_cache", mesh_cache_checks, mesh_cache_benchmarks },
+    { "vertex_weld", vertex_weld_checks, vertex_weld_benchmarks },
+    { "mesh_optimizer", mesh_optimizer_checks, mesh_optimizer_benchmarks },
+    { "vertex_packing", vertex_packing_checks, vertex_packing_benchmarks },
+};
+
+static const size_t suiteCount = sizeof(suites) / sizeof(suites[0]);
+
+static bool selected(const core_suite *suite, int argc, char **argv) {
+    bool named = false;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') continue;
+        named = true;
+        if (strcmp(argv[i], suite->name) == 0) return true;
+    }
+    return !named;
+}
+
+int main(int argc, char **argv) {
+    bool benchmarks = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            benchmarks = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--bench] [suite ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t s = 0; s < suiteCount; s++) {
+        if (!selected(&suites[s], argc, argv)) continue;
+        unsigned before = core_failures();
+        core_random_seed(s + 1);
+        suites[s].checks();
+        printf("%-16s %s\n", suites[s].name, core_failures() == before ? "ok" : "FAILED");
+    }
+
+    if (benchmarks) {
+        for (size_t s = 0; s < suiteCount; s++) {
+            if (!suites[s].benchmarks || !selected(&suites[s], argc, argv)) continue;
+            core_random_seed(s + 1);
+            suites[s].benchmarks();
+        }
+    }
+
+    if (core_failures() > 0) {
+        printf("%u checks failed\n", core_failures());
+        return 1;
+    }
+    return 0;
+}
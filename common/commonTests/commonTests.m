@@ -6,6 +6,119 @@
 //
 
 #import <XCTest/XCTest.h>
+#import <MetalKit/MetalKit.h>
+#import <ModelIO/ModelIO.h>
+#import <common/common.h>
+#import <common/common-Swift.h>
+
+// Same size as the Asteroids rock ring.
+static const size_t kBatchCount = 10000;
+
+// Bone count of a large skinned rig.
+static const NSUInteger kHierarchyNodeCount = 1000;
+
+// A crowd of a hundred such rigs.
+static const size_t kCrowdNodeCount = 100000;
+
+// A 4096 x 2048 RGBA equirectangular environment map.
+static const size_t kHDRImageFloatCount = 4096 * 2048 * 4;
+
+static void fillRandomTRS(vector_float3 *t, quaternion_float *q, vector_float3 *s, size_t count) {
+    seedRand(42);
+    for (size_t i = 0; i < count; i++) {
+        t[i] = (vector_float3){ randf(100), randf(100), randf(100) };
+        q[i] = quaternion_normalize((quaternion_float){ randf(1), randf(1), randf(1), randf(1) + 1.5f });
+        s[i] = (vector_float3){ 0.5f + fabsf(randf(2)), 0.5f + fabsf(randf(2)), 0.5f + fabsf(randf(2)) };
+    }
+}
+
+static matrix_float4x4 composeTRS(vector_float3 t, quaternion_float q, vector_float3 s) {
+    return matrix_multiply(matrix4x4_translation(t),
+                           matrix_multiply(matrix4x4_from_quaternion(q), matrix4x4_scale(s)));
+}
+
+static void fillRandomTRSMatrices(matrix_float4x4 *m, size_t count) {
+    vector_float3 *t = malloc(sizeof(vector_float3) * count);
+    vector_float3 *s = malloc(sizeof(vector_float3) * count);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * count);
+    fillRandomTRS(t, q, s, count);
+    matrix4x4_compose_trs_n(m, t, q, s, count);
+    free(t); free(s); free(q);
+}
+
+// 4-ary tree, nodes[0] is the root and parents come before their children.
+static NSArray<Transform *> *makeHierarchy(NSUInteger count) {
+    NSMutableArray<Transform *> *nodes = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        Transform *node = [Transform new];
+        if (i > 0) {
+            [node setParent:nodes[(i - 1) / 4] notifyParent:YES];
+        }
+        [nodes addObject:node];
+    }
+    return nodes;
+}
+
+static void animateHierarchy(NSArray<Transform *> *nodes, float time) {
+    for (NSUInteger i = 0; i < nodes.count; i++) {
+        [nodes[i] setTRSWithPosition:(vector_float3){ sinf(time + i), 0.1f * i, cosf(time) }
+                          quaternion:quaternion_from_axis_angle((vector_float3){ 0, 1, 0 }, time * 0.01f * i)
+                               scale:(vector_float3){ 1, 1, 1 }];
+    }
+}
+
+// Flat 4-ary tree of random TRS nodes.
+static transform_hierarchy *makeStoreHierarchy(size_t count) {
+    vector_float3 *t = malloc(sizeof(vector_float3) * count);
+    vector_float3 *s = malloc(sizeof(vector_float3) * count);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * count);
+    fillRandomTRS(t, q, s, count);
+
+    transform_hierarchy *hierarchy = transform_hierarchy_create(count);
+    for (size_t i = 0; i < count; i++) {
+        int32_t index = transform_hierarchy_add(hierarchy, i == 0 ? -1 : (int32_t)((i - 1) / 4));
+        // keep the world matrices in range
+        transform_hierarchy_set_trs(hierarchy, index, t[i] * 0.01f, q[i], (vector_float3){ 1, 1, 1 });
+    }
+    free(t); free(s); free(q);
+    return hierarchy;
+}
+
+static const size_t kSkinnedVertexCount = 100000;
+static const size_t kSkinBoneCount = 70;
+
+// Random rigid-ish bone palette and vertices with one to three weighted joints.
+static skinned_vertex *makeSkinnedMesh(matrix_float4x4 *palette, size_t boneCount, size_t vertexCount) {
+    fillRandomTRSMatrices(palette, boneCount);
+    skinned_vertex *vertices = malloc(sizeof(skinned_vertex) * vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        float position[3] = { randf(1.0), randf(1.0), randf(1.0) };
+        float normal[3] = { randf(1.0), randf(1.0), randf(1.0) };
+        float texCoord[2] = { 0.0, 0.0 };
+        float joints[4];
+        for (int k = 0; k < 4; k++) {
+            joints[k] = (uint32_t)randi() % boneCount;
+        }
+        float weights[4] = { fabsf(randf(1.0)), i % 2 ? fabsf(randf(1.0)) : 0.0, i % 3 ? 0.0 : fabsf(randf(1.0)), 0.0 };
+        skinned_vertex_pack(&vertices[i], position, normal, texCoord, joints, weights);
+    }
+    return vertices;
+}
+
+static NSURL *snoutAnimationURL(void) {
+    return [NSBundle.common URLForResource:@"snout-anim.json" withExtension:nil subdirectory:@"snout"];
+}
+
+static vector_float4 lerpJSONKey(NSDictionary *pre, NSDictionary *next, NSString *channel,
+                                 int bone, int width, float blend) {
+    vector_float4 v = 0;
+    for (int c = 0; c < width; c++) {
+        float a = [pre[channel][bone * width + c] floatValue];
+        float b = [next[channel][bone * width + c] floatValue];
+        v[c] = a + (b - a) * blend;
+    }
+    return v;
+}
 
 @interface commonTests : XCTestCase
 
@@ -33,4 +146,2715 @@
     }];
 }
 
+#pragma mark - MatrixBatch
+
+- (void)testComposeTRSMatchesScalarBuilders {
+    // odd count so the scalar tail after the SIMD groups is covered too
+    const size_t count = 37;
+    vector_float3 t[count], s[count];
+    quaternion_float q[count];
+    matrix_float4x4 batched[count], product[count];
+    fillRandomTRS(t, q, s, count);
+
+    matrix4x4_compose_trs_n(batched, t, q, s, count);
+    matrix4x4_multiply_n(product, batched, batched, count);
+
+    for (size_t i = 0; i < count; i++) {
+        matrix_float4x4 expected = composeTRS(t[i], q[i], s[i]);
+        XCTAssertTrue(simd_almost_equal_elements_relative(batched[i], expected, 1e-5), @"compose %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements_relative(product[i], matrix_multiply(expected, expected), 1e-5),
+                      @"multiply %zu", i);
+    }
+}
+
+- (void)testPerformanceComposeTRSScalarLoop {
+    vector_float3 *t = malloc(sizeof(vector_float3) * kBatchCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * kBatchCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * kBatchCount);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    fillRandomTRS(t, q, s, kBatchCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            for (size_t i = 0; i < kBatchCount; i++) {
+                out[i] = composeTRS(t[i], q[i], s[i]);
+            }
+        }
+    }];
+
+    free(t); free(s); free(q); free(out);
+}
+
+- (void)testPerformanceComposeTRSBatch {
+    vector_float3 *t = malloc(sizeof(vector_float3) * kBatchCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * kBatchCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * kBatchCount);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    fillRandomTRS(t, q, s, kBatchCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            matrix4x4_compose_trs_n(out, t, q, s, kBatchCount);
+        }
+    }];
+
+    free(t); free(s); free(q); free(out);
+}
+
+- (void)testPerformanceMultiplyScalarLoop {
+    matrix_float4x4 *a = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float4x4 *b = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    for (size_t i = 0; i < kBatchCount; i++) {
+        a[i] = matrix4x4_rotation(i * 0.01f, 0.4f, 0.6f, 0.8f);
+        b[i] = matrix4x4_translation(i, 1, 2);
+    }
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            for (size_t i = 0; i < kBatchCount; i++) {
+                out[i] = matrix_multiply(a[i], b[i]);
+            }
+        }
+    }];
+
+    free(a); free(b); free(out);
+}
+
+- (void)testPerformanceMultiplyBatch {
+    matrix_float4x4 *a = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float4x4 *b = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    for (size_t i = 0; i < kBatchCount; i++) {
+        a[i] = matrix4x4_rotation(i * 0.01f, 0.4f, 0.6f, 0.8f);
+        b[i] = matrix4x4_translation(i, 1, 2);
+    }
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            matrix4x4_multiply_n(out, a, b, kBatchCount);
+        }
+    }];
+
+    free(a); free(b); free(out);
+}
+
+#pragma mark - Affine inverse
+
+- (void)testTRSInverseMatchesGeneralInverse {
+    const size_t count = 37;
+    matrix_float4x4 m[count], inverse[count];
+    matrix_float3x3 normal[count];
+    fillRandomTRSMatrices(m, count);
+
+    matrix4x4_trs_inverse_n(inverse, m, count);
+    matrix3x3_trs_normal_n(normal, m, count);
+
+    for (size_t i = 0; i < count; i++) {
+        matrix_float4x4 expected = simd_inverse(m[i]);
+        matrix_float3x3 expectedNormal = simd_transpose(simd_inverse(matrix3x3_upper_left(m[i])));
+        XCTAssertTrue(simd_almost_equal_elements(inverse[i], expected, 1e-3), @"batch %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements(matrix4x4_trs_inverse(m[i]), expected, 1e-3), @"single %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements(normal[i], expectedNormal, 1e-4), @"normal %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements(matrix3x3_trs_normal(m[i]), expectedNormal, 1e-4), @"normal %zu", i);
+    }
+}
+
+- (void)testAffineInverseMatchesGeneralInverse {
+    const size_t count = 37;
+    matrix_float4x4 m[count], inverse[count];
+    matrix_float3x3 normal[count];
+    fillRandomTRSMatrices(m, count);
+    // shear breaks the orthogonal columns the TRS path relies on
+    for (size_t i = 0; i < count; i++) {
+        m[i].columns[1].x += 0.3f;
+        m[i].columns[2].y -= 0.5f;
+    }
+
+    // in place, the batched inverse may alias its input
+    memcpy(inverse, m, sizeof(m));
+    matrix4x4_affine_inverse_n(inverse, inverse, count);
+    matrix3x3_affine_normal_n(normal, m, count);
+
+    for (size_t i = 0; i < count; i++) {
+        matrix_float4x4 expected = simd_inverse(m[i]);
+        matrix_float3x3 expectedNormal = simd_transpose(simd_inverse(matrix3x3_upper_left(m[i])));
+        XCTAssertTrue(simd_almost_equal_elements(inverse[i], expected, 1e-3), @"batch %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements(matrix4x4_affine_inverse(m[i]), expected, 1e-3), @"single %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements(normal[i], expectedNormal, 1e-4), @"normal %zu", i);
+        XCTAssertTrue(simd_almost_equal_elements(matrix3x3_affine_normal(m[i]), expectedNormal, 1e-4), @"normal %zu", i);
+    }
+}
+
+- (void)testPerformanceGeneralInverseLoop {
+    matrix_float4x4 *m = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    fillRandomTRSMatrices(m, kBatchCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            for (size_t i = 0; i < kBatchCount; i++) {
+                out[i] = simd_inverse(m[i]);
+            }
+        }
+    }];
+
+    free(m); free(out);
+}
+
+- (void)testPerformanceTRSInverseBatch {
+    matrix_float4x4 *m = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float4x4 *out = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    fillRandomTRSMatrices(m, kBatchCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            matrix4x4_trs_inverse_n(out, m, kBatchCount);
+        }
+    }];
+
+    free(m); free(out);
+}
+
+- (void)testPerformanceNormalMatrixLoop {
+    matrix_float4x4 *m = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float3x3 *out = malloc(sizeof(matrix_float3x3) * kBatchCount);
+    fillRandomTRSMatrices(m, kBatchCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            for (size_t i = 0; i < kBatchCount; i++) {
+                out[i] = simd_transpose(simd_inverse(matrix3x3_upper_left(m[i])));
+            }
+        }
+    }];
+
+    free(m); free(out);
+}
+
+- (void)testPerformanceTRSNormalBatch {
+    matrix_float4x4 *m = malloc(sizeof(matrix_float4x4) * kBatchCount);
+    matrix_float3x3 *out = malloc(sizeof(matrix_float3x3) * kBatchCount);
+    fillRandomTRSMatrices(m, kBatchCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            matrix3x3_trs_normal_n(out, m, kBatchCount);
+        }
+    }];
+
+    free(m); free(out);
+}
+
+#pragma mark - Transform
+
+- (void)testTransformLazyUpdateMatchesForcedUpdate {
+    NSArray<Transform *> *nodes = makeHierarchy(kHierarchyNodeCount);
+    animateHierarchy(nodes, 1.0f);
+    // read a deep node before the pass, that resolves its ancestors lazily
+    matrix_float4x4 lazy = nodes[kHierarchyNodeCount - 1].modelMatrix;
+    nodes[7].position = (vector_float3){ 3, 2, 1 };
+    [nodes[0] updateModelMatrixIfNeeded];
+
+    matrix_float4x4 *updated = malloc(sizeof(matrix_float4x4) * kHierarchyNodeCount);
+    for (NSUInteger i = 0; i < kHierarchyNodeCount; i++) {
+        updated[i] = nodes[i].modelMatrix;
+    }
+    [nodes[0] forceCalculateModelMatrix];
+    for (NSUInteger i = 0; i < kHierarchyNodeCount; i++) {
+        XCTAssertTrue(simd_equal(updated[i], nodes[i].modelMatrix), @"node %lu", (unsigned long)i);
+    }
+    XCTAssertTrue(simd_equal(lazy, nodes[kHierarchyNodeCount - 1].modelMatrix));
+    free(updated);
+}
+
+- (void)testTransformEvaluatesEachDirtyNodeOnce {
+    NSArray<Transform *> *nodes = makeHierarchy(kHierarchyNodeCount);
+    [nodes[0] updateModelMatrixIfNeeded];
+
+    // three separate setters per node still cost one evaluation per node
+    [Transform resetModelMatrixEvaluationCount];
+    for (Transform *node in nodes) {
+        node.position = (vector_float3){ 1, 2, 3 };
+        node.quaternionVect = quaternion_from_axis_angle((vector_float3){ 0, 1, 0 }, 0.5f);
+        node.scale = (vector_float3){ 2, 2, 2 };
+    }
+    [nodes[0] updateModelMatrixIfNeeded];
+    XCTAssertEqual(Transform.modelMatrixEvaluationCount, (NSInteger)kHierarchyNodeCount);
+
+    // a leaf only touches itself, a clean tree touches nothing
+    [Transform resetModelMatrixEvaluationCount];
+    [nodes[kHierarchyNodeCount - 1] setTRSWithPosition:(vector_float3){ 0, 0, 0 }
+                                            quaternion:quaternion_identity()
+                                                 scale:(vector_float3){ 1, 1, 1 }];
+    [nodes[0] updateModelMatrixIfNeeded];
+    [nodes[0] updateModelMatrixIfNeeded];
+    XCTAssertEqual(Transform.modelMatrixEvaluationCount, 1);
+}
+
+- (void)testPerformanceTransformHierarchyUpdate {
+    NSArray<Transform *> *nodes = makeHierarchy(kHierarchyNodeCount);
+
+    [self measureBlock:^{
+        [Transform resetModelMatrixEvaluationCount];
+        for (int frame = 0; frame < 100; frame++) {
+            animateHierarchy(nodes, frame);
+            [nodes[0] updateModelMatrixIfNeeded];
+        }
+        NSLog(@"%lu nodes, 100 frames: %ld matrix evaluations", (unsigned long)kHierarchyNodeCount,
+              (long)Transform.modelMatrixEvaluationCount);
+    }];
+}
+
+- (void)testTransformHierarchyMatchesObjectGraph {
+    NSArray<Transform *> *nodes = makeHierarchy(kHierarchyNodeCount);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * kHierarchyNodeCount);
+
+    TransformHierarchy *hierarchy = [[TransformHierarchy alloc] initWithRoot:nodes[0] error:nil];
+    XCTAssertEqual(hierarchy.count, (NSInteger)kHierarchyNodeCount);
+    animateHierarchy(nodes, 2.0f);
+    [hierarchy update];
+    for (NSUInteger i = 0; i < kHierarchyNodeCount; i++) {
+        expected[i] = nodes[i].modelMatrix;
+    }
+
+    // the object graph path keeps the TRS values written through the handles
+    [hierarchy unbind];
+    for (NSUInteger i = 0; i < kHierarchyNodeCount; i++) {
+        XCTAssertTrue(simd_almost_equal_elements(expected[i], nodes[i].modelMatrix, 1e-3), @"node %lu", (unsigned long)i);
+    }
+    free(expected);
+}
+
+- (void)testTransformHierarchyRejectsForwardParents {
+    transform_hierarchy *hierarchy = transform_hierarchy_create(1);
+    XCTAssertEqual(transform_hierarchy_add(hierarchy, -1), 0);
+    XCTAssertEqual(transform_hierarchy_add(hierarchy, 0), 1);
+    XCTAssertEqual(transform_hierarchy_add(hierarchy, 5), -1);
+    XCTAssertEqual(transform_hierarchy_add(hierarchy, -2), -1);
+    XCTAssertEqual(hierarchy->count, (size_t)2);
+    transform_hierarchy_destroy(hierarchy);
+}
+
+- (void)testPerformanceTransformHierarchyStoreUpdate {
+    NSArray<Transform *> *nodes = makeHierarchy(kHierarchyNodeCount);
+    TransformHierarchy *hierarchy = [[TransformHierarchy alloc] initWithRoot:nodes[0] error:nil];
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            animateHierarchy(nodes, frame);
+            [hierarchy update];
+        }
+    }];
+}
+
+#pragma mark - Parallel TransformHierarchy
+
+- (void)testTransformHierarchyParallelUpdateIsBitIdentical {
+    transform_hierarchy *hierarchy = makeStoreHierarchy(kCrowdNodeCount);
+    size_t size = sizeof(matrix_float4x4) * kCrowdNodeCount;
+    matrix_float4x4 *serial = malloc(size);
+    transform_hierarchy_update(hierarchy);
+    memcpy(serial, hierarchy->worldMatrices, size);
+
+    for (unsigned threads = 1; threads <= 8; threads++) {
+        job_pool *pool = job_pool_create(threads);
+        memset(hierarchy->worldMatrices, 0, size);
+        transform_hierarchy_update_parallel(hierarchy, pool);
+        XCTAssertEqual(memcmp(serial, hierarchy->worldMatrices, size), 0, @"%u threads", threads);
+        job_pool_destroy(pool);
+    }
+    free(serial);
+    transform_hierarchy_destroy(hierarchy);
+}
+
+- (void)testTransformHierarchyParallelUpdateMatchesForcedUpdate {
+    NSArray<Transform *> *nodes = makeHierarchy(kHierarchyNodeCount);
+    TransformHierarchy *hierarchy = [[TransformHierarchy alloc] initWithRoot:nodes[0] error:nil];
+    hierarchy.jobPool = [[JobPool alloc] initWithThreadCount:4];
+    animateHierarchy(nodes, 3.0f);
+    [hierarchy update];
+
+    matrix_float4x4 *parallel = malloc(sizeof(matrix_float4x4) * kHierarchyNodeCount);
+    for (NSUInteger i = 0; i < kHierarchyNodeCount; i++) {
+        parallel[i] = nodes[i].modelMatrix;
+    }
+    [nodes[0] forceCalculateModelMatrix];
+    for (NSUInteger i = 0; i < kHierarchyNodeCount; i++) {
+        matrix_float4x4 serial = nodes[i].modelMatrix;
+        XCTAssertEqual(memcmp(&parallel[i], &serial, sizeof(serial)), 0, @"node %lu", (unsigned long)i);
+    }
+    free(parallel);
+}
+
+- (void)testTransformHierarchyParallelScaling {
+    transform_hierarchy *hierarchy = makeStoreHierarchy(kCrowdNodeCount);
+    NSUInteger maxThreads = NSProcessInfo.processInfo.activeProcessorCount;
+
+    for (NSUInteger threads = 1; threads <= maxThreads; threads++) {
+        job_pool *pool = job_pool_create((unsigned)threads);
+        transform_hierarchy_update_parallel(hierarchy, pool);
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (int frame = 0; frame < 100; frame++) {
+            transform_hierarchy_update_parallel(hierarchy, pool);
+        }
+        NSLog(@"%zu nodes, %lu threads: %.3f ms per update", kCrowdNodeCount, (unsigned long)threads,
+              (CFAbsoluteTimeGetCurrent() - start) * 10.0);
+        job_pool_destroy(pool);
+    }
+    transform_hierarchy_destroy(hierarchy);
+}
+
+- (void)testPerformanceTransformHierarchySerialUpdate {
+    transform_hierarchy *hierarchy = makeStoreHierarchy(kCrowdNodeCount);
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            transform_hierarchy_update(hierarchy);
+        }
+    }];
+    transform_hierarchy_destroy(hierarchy);
+}
+
+- (void)testPerformanceTransformHierarchyParallelUpdate {
+    transform_hierarchy *hierarchy = makeStoreHierarchy(kCrowdNodeCount);
+    job_pool *pool = job_pool_create(0);
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            transform_hierarchy_update_parallel(hierarchy, pool);
+        }
+    }];
+    job_pool_destroy(pool);
+    transform_hierarchy_destroy(hierarchy);
+}
+
+#pragma mark - AnimationClip
+
+- (void)testAnimationClipRoundTripsThroughFile {
+    animation_clip *clip = animation_clip_create(70, 11, 30);
+    for (size_t i = 0; i < 70 * 11 * 3; i++) {
+        clip->translations[i] = i * 0.5f;
+        clip->scales[i] = 1 + i * 0.001f;
+    }
+    for (size_t i = 0; i < 70 * 11 * 4; i++) {
+        clip->rotations[i] = i * 0.25f;
+    }
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"roundtrip.lmclip"];
+    XCTAssertTrue(animation_clip_write(clip, path.fileSystemRepresentation));
+    animation_clip *loaded = animation_clip_load(path.fileSystemRepresentation);
+    XCTAssertTrue(loaded != NULL);
+    XCTAssertTrue(loaded->mapped);
+    XCTAssertEqual(loaded->boneCount, 70u);
+    XCTAssertEqual(loaded->frameCount, 11u);
+    XCTAssertEqual(loaded->framesPerSecond, 30.0f);
+    XCTAssertEqual(memcmp(clip->storage, loaded->storage, clip->storageSize), 0);
+    animation_clip_destroy(loaded);
+
+    // a corrupted bone count no longer matches the file size
+    NSFileHandle *file = [NSFileHandle fileHandleForUpdatingAtPath:path];
+    uint32_t boneCount = 1000;
+    [file seekToFileOffset:offsetof(animation_clip_header, boneCount)];
+    [file writeData:[NSData dataWithBytes:&boneCount length:sizeof(boneCount)]];
+    [file closeFile];
+    XCTAssertTrue(animation_clip_load(path.fileSystemRepresentation) == NULL);
+
+    // 2^62 keys wrap every section size to 0, leaving a header-only file that fits
+    animation_clip_header wrapped = *(const animation_clip_header *)clip->storage;
+    wrapped.boneCount = wrapped.frameCount = 1u << 31;
+    wrapped.translationsOffset = wrapped.rotationsOffset = wrapped.scalesOffset = (sizeof(wrapped) + 15) & ~(size_t)15;
+    NSMutableData *header = [NSMutableData dataWithLength:wrapped.scalesOffset];
+    memcpy(header.mutableBytes, &wrapped, sizeof(wrapped));
+    XCTAssertTrue([header writeToFile:path atomically:NO]);
+    XCTAssertTrue(animation_clip_load(path.fileSystemRepresentation) == NULL);
+    XCTAssertTrue(animation_clip_create(1u << 31, 1u << 31, 30) == NULL);
+
+    animation_clip_destroy(clip);
+    [NSFileManager.defaultManager removeItemAtPath:path error:nil];
+}
+
+- (void)testAnimationClipMatchesJSONKeys {
+    NSError *error;
+    AnimationClip *clip = [[AnimationClip alloc] initWithJsonURL:snoutAnimationURL() framesPerSecond:6 error:&error];
+    XCTAssertNotNil(clip, @"%@", error);
+    NSData *data = [NSData dataWithContentsOfURL:snoutAnimationURL()];
+    NSArray *frames = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil][@"frames"];
+    XCTAssertEqual(clip.frameCount, (NSInteger)frames.count);
+    XCTAssertEqual(clip.boneCount, (NSInteger)[frames[0][@"position"] count] / 3);
+
+    NSInteger boneCount = clip.boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+    [clip sampleAtFrame:2.25f translations:t rotations:q scales:s];
+    for (int i = 0; i < boneCount; i++) {
+        vector_float4 position = lerpJSONKey(frames[2], frames[3], @"position", i, 3, 0.25f);
+        vector_float4 rotation = lerpJSONKey(frames[2], frames[3], @"quaternion", i, 4, 0.25f);
+        vector_float4 scale = lerpJSONKey(frames[2], frames[3], @"scale", i, 3, 0.25f);
+        XCTAssertTrue(simd_almost_equal_elements(t[i], position.xyz, 1e-4f), @"bone %d", i);
+        XCTAssertTrue(simd_almost_equal_elements(q[i], rotation, 1e-6f), @"bone %d", i);
+        XCTAssertTrue(simd_almost_equal_elements(s[i], scale.xyz, 1e-6f), @"bone %d", i);
+    }
+    free(t); free(q); free(s);
+}
+
+- (void)testPerformanceAnimationJSONSample {
+    NSData *data = [NSData dataWithContentsOfURL:snoutAnimationURL()];
+    NSArray *frames = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil][@"frames"];
+    int boneCount = (int)[frames[0][@"position"] count] / 3;
+    __block vector_float4 sum = 0;
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            float time = fmodf(frame * 0.1f, frames.count - 1);
+            int key = (int)time;
+            for (int i = 0; i < boneCount; i++) {
+                sum += lerpJSONKey(frames[key], frames[key + 1], @"position", i, 3, time - key);
+                sum += lerpJSONKey(frames[key], frames[key + 1], @"quaternion", i, 4, time - key);
+                sum += lerpJSONKey(frames[key], frames[key + 1], @"scale", i, 3, time - key);
+            }
+        }
+    }];
+    NSLog(@"checksum %f", sum.x);
+}
+
+- (void)testPerformanceAnimationClipSample {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    NSInteger boneCount = clip.boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            [clip sampleAtFrame:fmodf(frame * 0.1f, clip.frameCount - 1) translations:t rotations:q scales:s];
+        }
+    }];
+    free(t); free(q); free(s);
+}
+
+#pragma mark - CompressedClip
+
+- (void)testCompressedClipStaysWithinToleranceAtKeys {
+    AnimationClip *source = [[AnimationClip alloc] initWithJsonURL:snoutAnimationURL() framesPerSecond:6 error:nil];
+    const animation_clip *clip = source.clip;
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(clip, &settings);
+    XCTAssertTrue(compressed != NULL);
+    XCTAssertLessThan(compressed->keyCount, (size_t)clip->boneCount * clip->frameCount * 3);
+
+    uint32_t boneCount = clip->boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+    // 15-bit smallest three components step 1.4142 / 32767
+    const float rotationQuantization = 1e-4f;
+
+    for (uint32_t f = 0; f < clip->frameCount; f++) {
+        compressed_clip_sample(compressed, f, t, q, s);
+        for (uint32_t b = 0; b < boneCount; b++) {
+            const compressed_track *tracks = compressed->tracks + b * CompressedTrackChannelCount;
+            const float *key = clip->translations + (b * clip->frameCount + f) * 3;
+            vector_float3 range = { tracks[CompressedTrackTranslation].extent[0],
+                                    tracks[CompressedTrackTranslation].extent[1],
+                                    tracks[CompressedTrackTranslation].extent[2] };
+            float translationBound = fmaxf(settings.translationTolerance, simd_length(range) / 65535);
+            XCTAssertLessThanOrEqual(simd_distance(t[b], (vector_float3){ key[0], key[1], key[2] }), translationBound);
+
+            key = clip->rotations + (b * clip->frameCount + f) * 4;
+            quaternion_float expected = quaternion_normalize((quaternion_float){ key[0], key[1], key[2], key[3] });
+            quaternion_float aligned = simd_dot(expected, q[b]) < 0 ? -q[b] : q[b];
+            float angle = 4 * asinf(fminf(1, 0.5f * simd_distance(expected, aligned)));
+            XCTAssertLessThanOrEqual(angle, settings.rotationTolerance + rotationQuantization);
+
+            key = clip->scales + (b * clip->frameCount + f) * 3;
+            float scaleBound = settings.scaleTolerance + tracks[CompressedTrackScale].extent[0] / 65535;
+            XCTAssertEqualWithAccuracy(s[b].x, key[0], scaleBound);
+        }
+    }
+    free(t); free(q); free(s);
+    compressed_clip_destroy(compressed);
+}
+
+// Chains the bones so the error of every bone adds up at the leaf, the worst
+// case for a rig of this size.
+- (void)testCompressedClipLeafWorldError {
+    AnimationClip *source = [[AnimationClip alloc] initWithJsonURL:snoutAnimationURL() framesPerSecond:6 error:nil];
+    const animation_clip *clip = source.clip;
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(clip, &settings);
+
+    uint32_t boneCount = clip->boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *sampled = malloc(sizeof(matrix_float4x4) * boneCount);
+    float maxError = 0, maxDistance = 0;
+
+    for (uint32_t f = 0; f < clip->frameCount; f++) {
+        animation_clip_sample(clip, f, t, q, s);
+        for (uint32_t b = 0; b < boneCount; b++) {
+            q[b] = quaternion_normalize(q[b]);
+        }
+        matrix4x4_compose_trs_n(expected, t, q, s, boneCount);
+        compressed_clip_sample(compressed, f, t, q, s);
+        matrix4x4_compose_trs_n(sampled, t, q, s, boneCount);
+        for (uint32_t b = 1; b < boneCount; b++) {
+            expected[b] = matrix_multiply(expected[b - 1], expected[b]);
+            sampled[b] = matrix_multiply(sampled[b - 1], sampled[b]);
+        }
+        vector_float3 leaf = expected[boneCount - 1].columns[3].xyz;
+        maxError = fmaxf(maxError, simd_distance(leaf, sampled[boneCount - 1].columns[3].xyz));
+        maxDistance = fmaxf(maxDistance, simd_length(leaf));
+    }
+
+    NSLog(@"%u bones x %u frames: %zu -> %zu bytes, leaf error %f at distance %f", boneCount, clip->frameCount,
+          (size_t)boneCount * clip->frameCount * 10 * sizeof(float), compressed_clip_size(compressed), maxError, maxDistance);
+    XCTAssertLessThan(maxError, maxDistance * 1e-2f);
+    free(t); free(q); free(s); free(expected); free(sampled);
+    compressed_clip_destroy(compressed);
+}
+
+- (void)testPerformanceCompressedClipSample {
+    AnimationClip *source = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(source.clip, &settings);
+    NSInteger boneCount = source.boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            compressed_clip_sample(compressed, fmodf(frame * 0.1f, source.frameCount - 1), t, q, s);
+        }
+    }];
+    free(t); free(q); free(s);
+    compressed_clip_destroy(compressed);
+}
+
+#pragma mark - PoseSampler
+
+- (void)testPoseSamplerBlendsAlongShortestPath {
+    AnimationClip *source = [[AnimationClip alloc] initWithJsonURL:snoutAnimationURL() framesPerSecond:6 error:nil];
+    const animation_clip *clip = source.clip;
+    pose_sampler *sampler = pose_sampler_create(clip);
+    uint32_t boneCount = clip->boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    quaternion_float *slerped = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+
+    for (int i = 0; i < 200; i++) {
+        float seconds = i * 0.0083f;
+        float frame = seconds * clip->framesPerSecond;
+        uint32_t k0 = (uint32_t)frame;
+        float blend = frame - k0;
+
+        sampler->rotationBlend = PoseRotationNlerp;
+        pose_sampler_sample(sampler, seconds, t, q, s);
+        sampler->rotationBlend = PoseRotationSlerp;
+        pose_sampler_sample(sampler, seconds, t, slerped, s);
+
+        for (uint32_t b = 0; b < boneCount; b++) {
+            const float *key = clip->rotations + (b * clip->frameCount + k0) * 4;
+            quaternion_float a = { key[0], key[1], key[2], key[3] };
+            quaternion_float c = { key[4], key[5], key[6], key[7] };
+            c = simd_dot(a, c) < 0 ? -c : c;
+            quaternion_float expected = simd_normalize(a + (c - a) * blend);
+            XCTAssertTrue(simd_almost_equal_elements(q[b], expected, 1e-5f), @"bone %u at %f s", b, seconds);
+            XCTAssertEqualWithAccuracy(simd_length(slerped[b]), 1.0f, 1e-5f);
+            XCTAssertGreaterThan(fabsf(simd_dot(q[b], slerped[b])), 0.9999f);
+        }
+    }
+    free(t); free(q); free(slerped); free(s);
+    pose_sampler_destroy(sampler);
+}
+
+- (void)testPoseSamplerLoopsInSeconds {
+    AnimationClip *source = [[AnimationClip alloc] initWithJsonURL:snoutAnimationURL() framesPerSecond:6 error:nil];
+    pose_sampler *sampler = pose_sampler_create(source.clip);
+    float duration = pose_sampler_duration(sampler);
+    XCTAssertEqualWithAccuracy(duration, (source.frameCount - 1) / 6.0f, 1e-6f);
+
+    NSInteger boneCount = source.boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount * 2);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount * 2);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount * 2);
+    pose_sampler_sample(sampler, 0.25f, t, q, s);
+    pose_sampler_sample(sampler, 0.25f + 3 * duration, t + boneCount, q + boneCount, s + boneCount);
+    for (NSInteger b = 0; b < boneCount; b++) {
+        XCTAssertTrue(simd_almost_equal_elements(t[b], t[boneCount + b], 1e-3f));
+        XCTAssertTrue(simd_almost_equal_elements(q[b], q[boneCount + b], 1e-5f));
+    }
+    free(t); free(q); free(s);
+    pose_sampler_destroy(sampler);
+}
+
+- (void)testPoseSamplerCursorsMatchSearch {
+    AnimationClip *source = [[AnimationClip alloc] initWithJsonURL:snoutAnimationURL() framesPerSecond:6 error:nil];
+    animation_compression_settings settings = animation_compression_settings_default();
+    compressed_clip *compressed = compressed_clip_create(source.clip, &settings);
+    pose_sampler *sampler = pose_sampler_create_compressed(compressed);
+    float duration = pose_sampler_duration(sampler);
+
+    uint32_t boneCount = compressed->boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount * 2);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount * 2);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount * 2);
+    // 60 fps playback over three loops, then a jump backwards
+    for (int i = 0; i <= 300; i++) {
+        float seconds = i == 300 ? 0.1f : i / 60.0f;
+        pose_sampler_sample(sampler, seconds, t, q, s);
+        compressed_clip_sample(compressed, fmodf(seconds, duration) * compressed->framesPerSecond,
+                               t + boneCount, q + boneCount, s + boneCount);
+        for (uint32_t b = 0; b < boneCount; b++) {
+            XCTAssertTrue(simd_equal(t[b], t[boneCount + b]));
+            XCTAssertTrue(simd_equal(q[b], q[boneCount + b]));
+            XCTAssertTrue(simd_equal(s[b], s[boneCount + b]));
+        }
+    }
+    free(t); free(q); free(s);
+    pose_sampler_destroy(sampler);
+    compressed_clip_destroy(compressed);
+}
+
+- (void)testPerformancePoseSamplerNlerp {
+    AnimationClip *source = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    pose_sampler *sampler = pose_sampler_create(source.clip);
+    NSInteger boneCount = source.boneCount;
+    vector_float3 *t = malloc(sizeof(vector_float3) * boneCount);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * boneCount);
+    vector_float3 *s = malloc(sizeof(vector_float3) * boneCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            pose_sampler_sample(sampler, frame / 60.0f, t, q, s);
+        }
+    }];
+    free(t); free(q); free(s);
+    pose_sampler_destroy(sampler);
+}
+
+#pragma mark - BonePalette
+
+- (void)testBonePalettePackMatchesMultiply {
+    const size_t boneCount = 150;
+    matrix_float4x4 *world = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *inverseBind = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    int32_t *nodes = malloc(sizeof(int32_t) * boneCount);
+    fillRandomTRSMatrices(world, boneCount);
+    fillRandomTRSMatrices(inverseBind, boneCount);
+    matrix4x4_trs_inverse_n(inverseBind, inverseBind, boneCount);
+    for (size_t i = 0; i < boneCount; i++) {
+        nodes[i] = (int32_t)((i * 37) % boneCount);
+    }
+
+    bone_palette_pack(palette, world, nodes, inverseBind, boneCount);
+    for (size_t i = 0; i < boneCount; i++) {
+        matrix_float4x4 expected = matrix_multiply(world[nodes[i]], inverseBind[i]);
+        XCTAssertTrue(simd_almost_equal_elements_relative(palette[i], expected, 1e-5f), @"bone %zu", i);
+    }
+    bone_palette_pack(palette, world, NULL, inverseBind, boneCount);
+    XCTAssertTrue(simd_almost_equal_elements_relative(palette[7], matrix_multiply(world[7], inverseBind[7]), 1e-5f));
+    free(world); free(inverseBind); free(palette); free(nodes);
+}
+
+// The old upload: a fresh power of two texture image per frame, transposed element by element.
+- (void)testPerformanceBoneTextureFill {
+    const size_t boneCount = 150;
+    int size = MAX(4, pow(2, ceil(log(sqrt(boneCount * 4)) / M_LN2)));
+    matrix_float4x4 *world = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *inverseBind = malloc(sizeof(matrix_float4x4) * boneCount);
+    fillRandomTRSMatrices(world, boneCount);
+    fillRandomTRSMatrices(inverseBind, boneCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            float *boneMatrices = (float *)malloc(sizeof(float) * 4 * size * size);
+            for (size_t i = 0; i < boneCount; i++) {
+                matrix_float4x4 mat = matrix_multiply(world[i], inverseBind[i]);
+                float *p = boneMatrices + i * 16;
+                for (int j = 0; j < 16; j++) {
+                    p[j] = mat.columns[j % 4][j / 4];
+                }
+            }
+            free(boneMatrices);
+        }
+    }];
+    free(world); free(inverseBind);
+}
+
+- (void)testPerformanceBonePalettePack {
+    const size_t boneCount = 150;
+    matrix_float4x4 *world = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *inverseBind = malloc(sizeof(matrix_float4x4) * boneCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    fillRandomTRSMatrices(world, boneCount);
+    fillRandomTRSMatrices(inverseBind, boneCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            bone_palette_pack(palette, world, NULL, inverseBind, boneCount);
+        }
+    }];
+    free(world); free(inverseBind); free(palette);
+}
+
+#pragma mark - SkinnedVertex
+
+- (void)testSkinnedVertexRoundTrip {
+    XCTAssertEqual(sizeof(skinned_vertex), 32);
+    seedRand(7);
+    for (int k = 0; k < 10000; k++) {
+        vector_float3 n = simd_normalize((vector_float3){ randf(1.0), randf(1.0), randf(1.0) });
+        float position[3] = { randf(10.0), randf(10.0), randf(10.0) };
+        float normal[3] = { n.x, n.y, n.z };
+        float texCoord[2] = { fabsf(randf(1.0)), fabsf(randf(1.0)) };
+        float joints[4] = { (uint32_t)randi() % 70, (uint32_t)randi() % 70, (uint32_t)randi() % 70, (uint32_t)randi() % 70 };
+        float weights[4] = { fabsf(randf(1.0)), fabsf(randf(1.0)), k % 2 ? fabsf(randf(0.1)) : 0.0, 0.0 };
+        float weightSum = weights[0] + weights[1] + weights[2] + weights[3];
+
+        skinned_vertex vertex;
+        XCTAssertTrue(skinned_vertex_pack(&vertex, position, normal, texCoord, joints, weights));
+        XCTAssertEqual(vertex.weights[0] + vertex.weights[1] + vertex.weights[2] + vertex.weights[3], 255);
+
+        float outPosition[3], outNormal[3], outTexCoord[2], outWeights[4];
+        uint32_t outJoints[4];
+        skinned_vertex_unpack(&vertex, outPosition, outNormal, outTexCoord, outJoints, outWeights);
+        for (int i = 0; i < 3; i++) {
+            XCTAssertEqual(outPosition[i], position[i]);
+            XCTAssertEqualWithAccuracy(outNormal[i], normal[i], 1.0 / 32767.0);
+        }
+        for (int i = 0; i < 2; i++) {
+            XCTAssertEqualWithAccuracy(outTexCoord[i], texCoord[i], 1.0 / 2048.0);
+        }
+        for (int i = 0; i < 4; i++) {
+            XCTAssertEqualWithAccuracy(outWeights[i], weights[i] / weightSum, 1.0 / 255.0);
+            if (outWeights[i] > 0) {
+                XCTAssertEqual(outJoints[i], (uint32_t)joints[i]);
+            }
+        }
+    }
+}
+
+- (void)testSkinnedVertexJointRange {
+    float zero[4] = { 0 };
+    float weights[4] = { 1.0, 0.0, 0.0, 0.0 };
+    skinned_vertex vertex;
+
+    XCTAssertFalse(skinned_vertex_pack(&vertex, zero, zero, zero, (float[4]){ 300, 1, 2, 3 }, weights));
+    // an unweighted joint is never fetched, its index doesn't matter
+    XCTAssertTrue(skinned_vertex_pack(&vertex, zero, zero, zero, (float[4]){ 255, 300, 2, 3 }, weights));
+    XCTAssertEqual(vertex.joints[0], 255);
+    XCTAssertEqual(vertex.joints[1], 0);
+
+    // no weight at all binds the vertex to its first joint
+    XCTAssertTrue(skinned_vertex_pack(&vertex, zero, zero, zero, (float[4]){ 9, 1, 2, 3 }, zero));
+    XCTAssertEqual(vertex.joints[0], 9);
+    XCTAssertEqual(vertex.weights[0], 255);
+}
+
+#pragma mark - Skinning
+
+- (void)testSkinningMatchesMatrixMath {
+    matrix_float4x4 palette[kSkinBoneCount];
+    const size_t count = 10000;
+    skinned_vertex *vertices = makeSkinnedMesh(palette, kSkinBoneCount, count);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * count);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * count);
+
+    skinning_linear_blend(positions, normals, vertices, palette, count);
+
+    for (size_t i = 0; i < count; i++) {
+        float position[3], normal[3], weights[4];
+        uint32_t joints[4];
+        skinned_vertex_unpack(&vertices[i], position, normal, NULL, joints, weights);
+        vector_float4 expectedPosition = 0;
+        vector_float4 expectedNormal = 0;
+        for (int k = 0; k < 4; k++) {
+            vector_float4 p = { position[0], position[1], position[2], 1.0 };
+            vector_float4 n = { normal[0], normal[1], normal[2], 0.0 };
+            expectedPosition += weights[k] * matrix_multiply(palette[joints[k]], p);
+            expectedNormal += weights[k] * matrix_multiply(palette[joints[k]], n);
+        }
+        XCTAssertLessThan(simd_distance(positions[i], expectedPosition.xyz), 1e-5f, @"vertex %zu", i);
+        XCTAssertLessThan(simd_distance(normals[i], expectedNormal.xyz), 1e-5f, @"vertex %zu", i);
+    }
+
+    free(vertices); free(positions); free(normals);
+}
+
+- (void)testSkinningParallelIsBitIdentical {
+    matrix_float4x4 palette[kSkinBoneCount];
+    skinned_vertex *vertices = makeSkinnedMesh(palette, kSkinBoneCount, kSkinnedVertexCount);
+    vector_float3 *serial = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    vector_float3 *parallel = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    job_pool *pool = job_pool_create(4);
+
+    skinning_linear_blend(serial, NULL, vertices, palette, kSkinnedVertexCount);
+    skinning_linear_blend_parallel(parallel, NULL, vertices, palette, kSkinnedVertexCount, pool);
+    for (size_t i = 0; i < kSkinnedVertexCount; i++) {
+        XCTAssertTrue(simd_equal(serial[i], parallel[i]), @"vertex %zu", i);
+    }
+
+    job_pool_destroy(pool);
+    free(vertices); free(serial); free(parallel);
+}
+
+- (void)testSkinningThroughput {
+    matrix_float4x4 palette[kSkinBoneCount];
+    skinned_vertex *vertices = makeSkinnedMesh(palette, kSkinBoneCount, kSkinnedVertexCount);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    NSUInteger maxThreads = NSProcessInfo.processInfo.activeProcessorCount;
+
+    for (NSUInteger threads = 1; threads <= maxThreads; threads++) {
+        job_pool *pool = job_pool_create((unsigned)threads);
+        skinning_linear_blend_parallel(positions, normals, vertices, palette, kSkinnedVertexCount, pool);
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (int frame = 0; frame < 100; frame++) {
+            skinning_linear_blend_parallel(positions, normals, vertices, palette, kSkinnedVertexCount, pool);
+        }
+        CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+        NSLog(@"%lu threads: %.1f million vertices per second", (unsigned long)threads,
+              kSkinnedVertexCount * 100 / elapsed / 1e6);
+        job_pool_destroy(pool);
+    }
+
+    free(vertices); free(positions); free(normals);
+}
+
+- (void)testPerformanceSkinning {
+    matrix_float4x4 palette[kSkinBoneCount];
+    skinned_vertex *vertices = makeSkinnedMesh(palette, kSkinBoneCount, kSkinnedVertexCount);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            skinning_linear_blend(positions, normals, vertices, palette, kSkinnedVertexCount);
+        }
+    }];
+
+    free(vertices); free(positions); free(normals);
+}
+
+#pragma mark - DualQuaternionSkinning
+
+// Rotations and translations only, the poses dual quaternions represent exactly.
+static void fillRandomRigidPalette(matrix_float4x4 *palette, dual_quaternion *dualQuaternions, size_t count) {
+    vector_float3 *t = malloc(sizeof(vector_float3) * count);
+    vector_float3 *s = malloc(sizeof(vector_float3) * count);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * count);
+    fillRandomTRS(t, q, s, count);
+    for (size_t i = 0; i < count; i++) {
+        s[i] = (vector_float3){ 1.0, 1.0, 1.0 };
+    }
+    matrix4x4_compose_trs_n(palette, t, q, s, count);
+    dual_quaternion_from_matrix_n(dualQuaternions, palette, count);
+    free(t); free(s); free(q);
+}
+
+- (void)testDualQuaternionFromMatrix {
+    const size_t count = 1000;
+    vector_float3 *t = malloc(sizeof(vector_float3) * count);
+    vector_float3 *s = malloc(sizeof(vector_float3) * count);
+    quaternion_float *q = malloc(sizeof(quaternion_float) * count);
+    matrix_float4x4 *m = malloc(sizeof(matrix_float4x4) * count);
+    dual_quaternion *dq = malloc(sizeof(dual_quaternion) * count);
+    fillRandomTRS(t, q, s, count);
+    matrix4x4_compose_trs_n(m, t, q, s, count);
+
+    dual_quaternion_from_matrix_n(dq, m, count);
+
+    for (size_t i = 0; i < count; i++) {
+        // the scale is dropped, the rotation comes back up to sign
+        XCTAssertEqualWithAccuracy(fabsf(simd_dot(dq[i].real, q[i])), 1.0f, 1e-5f, @"matrix %zu", i);
+        // t = 2 * dual * conjugate(real)
+        quaternion_float conjugate = { -dq[i].real.x, -dq[i].real.y, -dq[i].real.z, dq[i].real.w };
+        vector_float3 translation = 2.0f * quaternion_multiply(dq[i].dual, conjugate).xyz;
+        XCTAssertLessThan(simd_distance(translation, t[i]), 1e-3f, @"matrix %zu", i);
+    }
+
+    free(t); free(s); free(q); free(m); free(dq);
+}
+
+- (void)testDualQuaternionSkinningMatchesMatrixForRigidPoses {
+    matrix_float4x4 palette[kSkinBoneCount];
+    dual_quaternion dualQuaternions[kSkinBoneCount];
+    const size_t count = 10000;
+    skinned_vertex *vertices = makeSkinnedMesh(palette, kSkinBoneCount, count);
+    fillRandomRigidPalette(palette, dualQuaternions, kSkinBoneCount);
+    // one joint per vertex, every vertex follows a rigid bone
+    for (size_t i = 0; i < count; i++) {
+        vertices[i].weights[0] = 255;
+        vertices[i].weights[1] = vertices[i].weights[2] = vertices[i].weights[3] = 0;
+    }
+    vector_float3 *matrixPositions = malloc(sizeof(vector_float3) * count);
+    vector_float3 *matrixNormals = malloc(sizeof(vector_float3) * count);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * count);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * count);
+
+    skinning_linear_blend(matrixPositions, matrixNormals, vertices, palette, count);
+    skinning_dual_quaternion(positions, normals, vertices, dualQuaternions, count);
+    for (size_t i = 0; i < count; i++) {
+        XCTAssertLessThan(simd_distance(positions[i], matrixPositions[i]), 1e-3f, @"vertex %zu", i);
+        XCTAssertLessThan(simd_distance(normals[i], matrixNormals[i]), 1e-5f, @"vertex %zu", i);
+    }
+
+    // joints sharing one transform blend to it, even when stored on opposite hemispheres
+    for (size_t i = 0; i < count; i++) {
+        vertices[i].joints[0] = 1; vertices[i].joints[1] = 2; vertices[i].joints[2] = 3;
+        vertices[i].weights[0] = 100; vertices[i].weights[1] = 90; vertices[i].weights[2] = 65;
+    }
+    palette[2] = palette[3] = palette[1];
+    dualQuaternions[2] = dualQuaternions[1];
+    dualQuaternions[3] = (dual_quaternion){ -dualQuaternions[1].real, -dualQuaternions[1].dual };
+    skinning_linear_blend(matrixPositions, matrixNormals, vertices, palette, count);
+    skinning_dual_quaternion(positions, normals, vertices, dualQuaternions, count);
+    for (size_t i = 0; i < count; i++) {
+        XCTAssertLessThan(simd_distance(positions[i], matrixPositions[i]), 1e-3f, @"vertex %zu", i);
+    }
+
+    free(vertices); free(matrixPositions); free(matrixNormals); free(positions); free(normals);
+}
+
+- (void)testPerformanceDualQuaternionSkinning {
+    matrix_float4x4 palette[kSkinBoneCount];
+    dual_quaternion dualQuaternions[kSkinBoneCount];
+    skinned_vertex *vertices = makeSkinnedMesh(palette, kSkinBoneCount, kSkinnedVertexCount);
+    fillRandomRigidPalette(palette, dualQuaternions, kSkinBoneCount);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            skinning_dual_quaternion(positions, normals, vertices, dualQuaternions, kSkinnedVertexCount);
+        }
+    }];
+
+    free(vertices); free(positions); free(normals);
+}
+
+#pragma mark - Crowd
+
+static const size_t kCrowdCharacterCount = 500;
+
+// Binary tree skeleton with the clip's bone count, parents come first.
+static crowd_skeleton *makeCrowdSkeleton(size_t boneCount) {
+    int32_t *parents = malloc(sizeof(int32_t) * boneCount);
+    matrix_float4x4 *inverseBind = malloc(sizeof(matrix_float4x4) * boneCount);
+    for (size_t i = 0; i < boneCount; i++) {
+        parents[i] = i == 0 ? -1 : (int32_t)(i - 1) / 2;
+    }
+    fillRandomTRSMatrices(inverseBind, boneCount);
+    matrix4x4_trs_inverse_n(inverseBind, inverseBind, boneCount);
+    crowd_skeleton *skeleton = crowd_skeleton_create(parents, inverseBind, boneCount);
+    free(parents); free(inverseBind);
+    return skeleton;
+}
+
+// Every character plays the shared clip from its own time at its own speed.
+static crowd *makeCrowd(const crowd_skeleton *skeleton, const animation_clip *clip, size_t count) {
+    crowd *characters = crowd_create(skeleton, count);
+    for (size_t i = 0; i < count; i++) {
+        crowd_add_instance(characters, pose_sampler_create(clip), i * 0.013f, 0.5f + (i % 7) * 0.1f);
+    }
+    return characters;
+}
+
+- (void)testCrowdMatchesSingleCharacter {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    XCTAssertTrue(skeleton != NULL);
+    crowd *characters = makeCrowd(skeleton, clip.clip, 16);
+    size_t boneCount = skeleton->boneCount;
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount * characters->count);
+
+    crowd_update(characters, 0.7f, palette, NULL);
+
+    // the same pose evaluated by hand for every character
+    transform_hierarchy *pose = transform_hierarchy_create(boneCount);
+    for (size_t i = 0; i < boneCount; i++) {
+        transform_hierarchy_add(pose, skeleton->parents[i]);
+    }
+    pose_sampler *sampler = pose_sampler_create(clip.clip);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * boneCount);
+    for (size_t i = 0; i < characters->count; i++) {
+        float time = fmodf(i * 0.013f + 0.7f * (0.5f + (i % 7) * 0.1f), pose_sampler_duration(sampler));
+        XCTAssertEqualWithAccuracy(characters->instances[i].time, time, 1e-6f);
+        pose_sampler_sample(sampler, characters->instances[i].time, pose->translations, pose->rotations, pose->scales);
+        pose->needsUpdate = true;
+        transform_hierarchy_update(pose);
+        bone_palette_pack(expected, pose->worldMatrices, NULL, skeleton->inverseBind, boneCount);
+        XCTAssertEqual(memcmp(expected, palette + i * boneCount, sizeof(matrix_float4x4) * boneCount), 0, @"character %zu", i);
+    }
+
+    free(expected); free(palette);
+    pose_sampler_destroy(sampler);
+    transform_hierarchy_destroy(pose);
+    crowd_destroy(characters);
+    crowd_skeleton_destroy(skeleton);
+}
+
+- (void)testCrowdRejectsMismatchedSkeletons {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    int32_t childFirst[3] = { 1, -1, 1 };
+    matrix_float4x4 inverseBind[3] = { matrix_identity_float4x4, matrix_identity_float4x4, matrix_identity_float4x4 };
+    XCTAssertTrue(crowd_skeleton_create(childFirst, inverseBind, 3) == NULL);
+
+    int32_t parents[3] = { -1, 0, 0 };
+    crowd_skeleton *skeleton = crowd_skeleton_create(parents, inverseBind, 3);
+    crowd *characters = crowd_create(skeleton, 1);
+    pose_sampler *sampler = pose_sampler_create(clip.clip);
+    XCTAssertEqual(crowd_add_instance(characters, sampler, 0, 1), -1);
+
+    pose_sampler_destroy(sampler);
+    crowd_destroy(characters);
+    crowd_skeleton_destroy(skeleton);
+}
+
+- (void)testCrowdParallelUpdateIsBitIdentical {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    crowd *serial = makeCrowd(skeleton, clip.clip, kCrowdCharacterCount);
+    crowd *parallel = makeCrowd(skeleton, clip.clip, kCrowdCharacterCount);
+    size_t paletteSize = sizeof(matrix_float4x4) * skeleton->boneCount * kCrowdCharacterCount;
+    matrix_float4x4 *serialPalette = malloc(paletteSize);
+    matrix_float4x4 *parallelPalette = malloc(paletteSize);
+    job_pool *pool = job_pool_create(4);
+
+    for (int frame = 0; frame < 10; frame++) {
+        crowd_update(serial, 1.0f / 60.0f, serialPalette, NULL);
+        crowd_update(parallel, 1.0f / 60.0f, parallelPalette, pool);
+    }
+    XCTAssertEqual(memcmp(serialPalette, parallelPalette, paletteSize), 0);
+
+    job_pool_destroy(pool);
+    free(serialPalette); free(parallelPalette);
+    crowd_destroy(serial); crowd_destroy(parallel);
+    crowd_skeleton_destroy(skeleton);
+}
+
+- (void)testCrowdThroughput {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    crowd *characters = makeCrowd(skeleton, clip.clip, kCrowdCharacterCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * skeleton->boneCount * kCrowdCharacterCount);
+    NSUInteger maxThreads = NSProcessInfo.processInfo.activeProcessorCount;
+
+    for (NSUInteger threads = 1; threads <= maxThreads; threads++) {
+        job_pool *pool = job_pool_create((unsigned)threads);
+        crowd_update(characters, 1.0f / 60.0f, palette, pool);
+        clock_t cpuStart = clock();
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (int frame = 0; frame < 100; frame++) {
+            crowd_update(characters, 1.0f / 60.0f, palette, pool);
+        }
+        double cpuMilliseconds = (double)(clock() - cpuStart) * 1000.0 / CLOCKS_PER_SEC;
+        NSLog(@"%zu characters, %lu threads: %.3f ms per update, %.1f characters per ms of CPU time",
+              kCrowdCharacterCount, (unsigned long)threads, (CFAbsoluteTimeGetCurrent() - start) * 10.0,
+              kCrowdCharacterCount * 100 / cpuMilliseconds);
+        job_pool_destroy(pool);
+    }
+
+    free(palette);
+    crowd_destroy(characters);
+    crowd_skeleton_destroy(skeleton);
+}
+
+- (void)testPerformanceCrowdUpdate {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    crowd *characters = makeCrowd(skeleton, clip.clip, kCrowdCharacterCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * skeleton->boneCount * kCrowdCharacterCount);
+    job_pool *pool = job_pool_create(0);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            crowd_update(characters, 1.0f / 60.0f, palette, pool);
+        }
+    }];
+
+    job_pool_destroy(pool);
+    free(palette);
+    crowd_destroy(characters);
+    crowd_skeleton_destroy(skeleton);
+}
+
+#pragma mark - CrowdLOD
+
+// Near characters every frame, the middle every 4th frame, far ones every 8th
+// frame down to the third level of the skeleton.
+static const crowd_lod_band kCrowdLODBands[3] = {
+    { 10.0f, 1, UINT32_MAX },
+    { 30.0f, 4, UINT32_MAX },
+    { 100.0f, 8, 2 },
+};
+
+static void setCrowdDistances(crowd *characters, float step) {
+    for (size_t i = 0; i < characters->count; i++) {
+        characters->instances[i].lodDistance = (i + 0.5f) * step;
+    }
+}
+
+- (void)testCrowdLODFirstUpdateMatchesFullEvaluation {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    crowd *reference = makeCrowd(skeleton, clip.clip, 48);
+    crowd *characters = makeCrowd(skeleton, clip.clip, 48);
+    XCTAssertTrue(crowd_set_lod_bands(characters, kCrowdLODBands, 3));
+    setCrowdDistances(characters, 1.0f);
+    size_t boneCount = skeleton->boneCount;
+    size_t paletteSize = sizeof(matrix_float4x4) * boneCount * characters->count;
+    matrix_float4x4 *expected = malloc(paletteSize);
+    matrix_float4x4 *palette = malloc(paletteSize);
+
+    // throttled characters start their span from a pose evaluated this frame
+    crowd_update(reference, 1.0f / 60.0f, expected, NULL);
+    crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+    size_t exactCount = 30 * boneCount;
+    XCTAssertEqual(memcmp(expected, palette, sizeof(matrix_float4x4) * exactCount), 0);
+
+    // every bone of the far band within depth 2 is evaluated, deeper ones reuse their ancestor.
+    // The short batch takes the kernels' tail path, so it only matches to rounding.
+    size_t evaluated = characters->bandBoneCounts[2];
+    XCTAssertEqual(evaluated, (size_t)7);
+    for (size_t i = 30; i < characters->count; i++) {
+        const matrix_float4x4 *far = palette + i * boneCount;
+        const float *a = (const float *)(expected + i * boneCount);
+        const float *b = (const float *)far;
+        for (size_t k = 0; k < 16 * evaluated; k++) {
+            XCTAssertEqualWithAccuracy(a[k], b[k], 1e-4f * fmaxf(1.0f, fabsf(a[k])));
+        }
+        for (size_t bone = evaluated; bone < boneCount; bone++) {
+            int32_t ancestor = skeleton->parents[bone];
+            while (ancestor >= (int32_t)evaluated) {
+                ancestor = skeleton->parents[ancestor];
+            }
+            XCTAssertEqual(memcmp(far + bone, far + ancestor, sizeof(matrix_float4x4)), 0);
+        }
+    }
+
+    free(expected); free(palette);
+    crowd_destroy(reference); crowd_destroy(characters);
+    crowd_skeleton_destroy(skeleton);
+}
+
+- (void)testCrowdLODThrottledBandsFollowFullEvaluation {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    crowd *reference = makeCrowd(skeleton, clip.clip, 30);
+    crowd *characters = makeCrowd(skeleton, clip.clip, 30);
+    crowd *parallel = makeCrowd(skeleton, clip.clip, 30);
+    crowd_set_lod_bands(characters, kCrowdLODBands, 2);
+    crowd_set_lod_bands(parallel, kCrowdLODBands, 2);
+    setCrowdDistances(characters, 1.0f);
+    setCrowdDistances(parallel, 1.0f);
+    size_t boneCount = skeleton->boneCount;
+    size_t paletteSize = sizeof(matrix_float4x4) * boneCount * characters->count;
+    matrix_float4x4 *expected = malloc(paletteSize);
+    matrix_float4x4 *palette = malloc(paletteSize);
+    matrix_float4x4 *parallelPalette = malloc(paletteSize);
+    job_pool *pool = job_pool_create(4);
+
+    float maxError = 0.0f, maxMagnitude = 0.0f;
+    for (int frame = 0; frame < 60; frame++) {
+        crowd_update(reference, 1.0f / 60.0f, expected, NULL);
+        crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+        crowd_update(parallel, 1.0f / 60.0f, parallelPalette, pool);
+        XCTAssertEqual(memcmp(palette, parallelPalette, paletteSize), 0);
+        // the near band is never throttled
+        XCTAssertEqual(memcmp(expected, palette, sizeof(matrix_float4x4) * 10 * boneCount), 0);
+        for (size_t i = 10 * boneCount; i < characters->count * boneCount; i++) {
+            const float *a = (const float *)&expected[i];
+            const float *b = (const float *)&palette[i];
+            for (int k = 0; k < 16; k++) {
+                maxError = fmaxf(maxError, fabsf(a[k] - b[k]));
+                maxMagnitude = fmaxf(maxMagnitude, fabsf(a[k]));
+            }
+        }
+    }
+    // interpolating a 4 frame span stays close to the sampled pose
+    XCTAssertLessThan(maxError, 0.01f * maxMagnitude);
+
+    job_pool_destroy(pool);
+    free(expected); free(palette); free(parallelPalette);
+    crowd_destroy(reference); crowd_destroy(characters); crowd_destroy(parallel);
+    crowd_skeleton_destroy(skeleton);
+}
+
+- (void)testCrowdLODThroughput {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    crowd_skeleton *skeleton = makeCrowdSkeleton(clip.clip->boneCount);
+    crowd *characters = makeCrowd(skeleton, clip.clip, kCrowdCharacterCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * skeleton->boneCount * kCrowdCharacterCount);
+    const char *names[4] = { "no LOD", "near band", "every 4th frame", "far band" };
+    float distances[4] = { 0.0f, 5.0f, 20.0f, 50.0f };
+
+    for (int mode = 0; mode < 4; mode++) {
+        crowd_set_lod_bands(characters, kCrowdLODBands, mode == 0 ? 0 : 3);
+        for (size_t i = 0; i < kCrowdCharacterCount; i++) {
+            characters->instances[i].lodDistance = distances[mode];
+        }
+        crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+        clock_t cpuStart = clock();
+        for (int frame = 0; frame < 100; frame++) {
+            crowd_update(characters, 1.0f / 60.0f, palette, NULL);
+        }
+        double cpuMilliseconds = (double)(clock() - cpuStart) * 1000.0 / CLOCKS_PER_SEC;
+        NSLog(@"%zu characters, %s: %.1f characters per ms of CPU time",
+              kCrowdCharacterCount, names[mode], kCrowdCharacterCount * 100 / cpuMilliseconds);
+    }
+
+    free(palette);
+    crowd_destroy(characters);
+    crowd_skeleton_destroy(skeleton);
+}
+
+#pragma mark - VertexAnimation
+
+- (void)testVertexAnimationBakeMatchesSkinning {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    size_t boneCount = clip.clip->boneCount;
+    size_t vertexCount = 10000;
+    crowd_skeleton *skeleton = makeCrowdSkeleton(boneCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    skinned_vertex *vertices = makeSkinnedMesh(palette, boneCount, vertexCount);
+
+    vertex_animation *animation = vertex_animation_bake(vertices, vertexCount, skeleton, clip.clip, NULL);
+    XCTAssertTrue(animation != NULL);
+    XCTAssertEqual(animation->frameCount, clip.clip->frameCount);
+
+    // every key skinned by hand, the bake only differs by the halfs
+    transform_hierarchy *pose = transform_hierarchy_create(boneCount);
+    for (size_t i = 0; i < boneCount; i++) {
+        transform_hierarchy_add(pose, skeleton->parents[i]);
+    }
+    vector_float3 *positions = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *baked = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *bakedNormals = malloc(sizeof(vector_float3) * vertexCount);
+    for (uint32_t frame = 0; frame < animation->frameCount; frame++) {
+        animation_clip_sample(clip.clip, frame, pose->translations, pose->rotations, pose->scales);
+        transform_hierarchy_update(pose);
+        bone_palette_pack(palette, pose->worldMatrices, NULL, skeleton->inverseBind, boneCount);
+        skinning_linear_blend(positions, normals, vertices, palette, vertexCount);
+        vertex_animation_sample(animation, frame, baked, bakedNormals);
+
+        for (size_t i = 0; i < vertexCount; i++) {
+            vector_float3 p = positions[i];
+            float tolerance = 1e-3f * fmaxf(1.0f, fmaxf(fabsf(p.x), fmaxf(fabsf(p.y), fabsf(p.z))));
+            XCTAssertEqualWithAccuracy(baked[i].x, p.x, tolerance);
+            XCTAssertEqualWithAccuracy(baked[i].y, p.y, tolerance);
+            XCTAssertEqualWithAccuracy(baked[i].z, p.z, tolerance);
+            vector_float3 n = vector_normalize(normals[i]);
+            XCTAssertEqualWithAccuracy(bakedNormals[i].x, n.x, 2e-3f);
+            XCTAssertEqualWithAccuracy(bakedNormals[i].y, n.y, 2e-3f);
+            XCTAssertEqualWithAccuracy(bakedNormals[i].z, n.z, 2e-3f);
+        }
+    }
+
+    free(positions); free(normals); free(baked); free(bakedNormals);
+    free(vertices); free(palette);
+    transform_hierarchy_destroy(pose);
+    vertex_animation_destroy(animation);
+    crowd_skeleton_destroy(skeleton);
+}
+
+// Moves every bone by the frame number along x.
+static void translatedPalette(void *context, uint32_t frame, matrix_float4x4 *palette) {
+    size_t boneCount = *(const size_t *)context;
+    for (size_t i = 0; i < boneCount; i++) {
+        palette[i] = matrix4x4_translation((float)frame, 0.0f, 0.0f);
+    }
+}
+
+- (void)testVertexAnimationBakesPalettesFromFunction {
+    size_t boneCount = 8;
+    size_t vertexCount = 1000;
+    uint32_t frameCount = 5;
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    skinned_vertex *vertices = makeSkinnedMesh(palette, boneCount, vertexCount);
+
+    vertex_animation *animation = vertex_animation_bake_palettes(vertices, vertexCount, boneCount, frameCount, 6.0f,
+                                                                 translatedPalette, &boneCount, NULL);
+    XCTAssertTrue(animation != NULL);
+    XCTAssertEqual(animation->frameCount, frameCount);
+    XCTAssertEqual(animation->framesPerSecond, 6.0f);
+
+    vector_float3 *first = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *moved = malloc(sizeof(vector_float3) * vertexCount);
+    vertex_animation_sample(animation, 0, first, NULL);
+    for (uint32_t frame = 1; frame < frameCount; frame++) {
+        vertex_animation_sample(animation, frame, moved, NULL);
+        for (size_t i = 0; i < vertexCount; i++) {
+            XCTAssertEqualWithAccuracy(moved[i].x - first[i].x, (float)frame, 1e-2f);
+            XCTAssertEqualWithAccuracy(moved[i].y, first[i].y, 1e-3f);
+            XCTAssertEqualWithAccuracy(moved[i].z, first[i].z, 1e-3f);
+        }
+    }
+
+    free(first); free(moved);
+    free(vertices); free(palette);
+    vertex_animation_destroy(animation);
+}
+
+- (void)testVertexAnimationRoundTripsThroughFile {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    size_t boneCount = clip.clip->boneCount;
+    size_t vertexCount = 1000;
+    crowd_skeleton *skeleton = makeCrowdSkeleton(boneCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    skinned_vertex *vertices = makeSkinnedMesh(palette, boneCount, vertexCount);
+    vertex_animation *animation = vertex_animation_bake(vertices, vertexCount, skeleton, clip.clip, NULL);
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"roundtrip.lmvat"];
+    XCTAssertTrue(vertex_animation_write(animation, path.fileSystemRepresentation));
+    vertex_animation *loaded = vertex_animation_load(path.fileSystemRepresentation);
+    XCTAssertTrue(loaded != NULL);
+    XCTAssertTrue(loaded->mapped);
+    XCTAssertEqual(loaded->vertexCount, (uint32_t)vertexCount);
+    XCTAssertEqual(loaded->frameCount, clip.clip->frameCount);
+    XCTAssertEqual(loaded->framesPerSecond, 6.0f);
+    XCTAssertEqual(memcmp(animation->storage, loaded->storage, animation->storageSize), 0);
+
+    // halfway between two frames is their average
+    vector_float3 *first = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *second = malloc(sizeof(vector_float3) * vertexCount);
+    vector_float3 *halfway = malloc(sizeof(vector_float3) * vertexCount);
+    vertex_animation_sample(loaded, 2.0f, first, NULL);
+    vertex_animation_sample(loaded, 3.0f, second, NULL);
+    vertex_animation_sample(loaded, 2.5f, halfway, NULL);
+    for (size_t i = 0; i < vertexCount; i++) {
+        XCTAssertEqualWithAccuracy(halfway[i].x, (first[i].x + second[i].x) * 0.5f, 1e-3f);
+        XCTAssertEqualWithAccuracy(halfway[i].y, (first[i].y + second[i].y) * 0.5f, 1e-3f);
+        XCTAssertEqualWithAccuracy(halfway[i].z, (first[i].z + second[i].z) * 0.5f, 1e-3f);
+    }
+    vertex_animation_destroy(loaded);
+
+    // a corrupted vertex count no longer matches the file size
+    NSFileHandle *file = [NSFileHandle fileHandleForUpdatingAtPath:path];
+    uint32_t corruptCount = 1000000;
+    [file seekToFileOffset:offsetof(vertex_animation_header, vertexCount)];
+    [file writeData:[NSData dataWithBytes:&corruptCount length:sizeof(corruptCount)]];
+    [file closeFile];
+    XCTAssertTrue(vertex_animation_load(path.fileSystemRepresentation) == NULL);
+
+    free(first); free(second); free(halfway);
+    free(vertices); free(palette);
+    vertex_animation_destroy(animation);
+    crowd_skeleton_destroy(skeleton);
+    [NSFileManager.defaultManager removeItemAtPath:path error:nil];
+}
+
+- (void)testPerformanceVertexAnimationSample {
+    AnimationClip *clip = [AnimationClip compiledFromJSON:snoutAnimationURL() framesPerSecond:6 error:nil];
+    size_t boneCount = clip.clip->boneCount;
+    crowd_skeleton *skeleton = makeCrowdSkeleton(boneCount);
+    matrix_float4x4 *palette = malloc(sizeof(matrix_float4x4) * boneCount);
+    skinned_vertex *vertices = makeSkinnedMesh(palette, boneCount, kSkinnedVertexCount);
+    vertex_animation *animation = vertex_animation_bake(vertices, kSkinnedVertexCount, skeleton, clip.clip, NULL);
+    vector_float3 *positions = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+    vector_float3 *normals = malloc(sizeof(vector_float3) * kSkinnedVertexCount);
+
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            vertex_animation_sample(animation, frame * 0.1f, positions, normals);
+        }
+    }];
+
+    free(positions); free(normals);
+    free(vertices); free(palette);
+    vertex_animation_destroy(animation);
+    crowd_skeleton_destroy(skeleton);
+}
+
+#pragma mark - JsonFloatParser
+
+static NSURL *foxJSONURL(void) {
+    return [NSBundle.common URLForResource:@"fox.json" withExtension:nil subdirectory:@"fox"];
+}
+
+- (void)testJsonParseFloatMatchesStrtof {
+    seedRand(42);
+    char text[64];
+    for (int i = 0; i < 1000000; i++) {
+        switch (i % 5) {
+            case 0: snprintf(text, sizeof(text), "%.3f", randf(100.0)); break;
+            case 1: snprintf(text, sizeof(text), "%.6g", randf(1.0)); break;
+            case 2: snprintf(text, sizeof(text), "%.9g", randf(1.0) * powf(10.0f, (int)((uint32_t)randi() % 60) - 30)); break;
+            case 3: snprintf(text, sizeof(text), "%.17g", (double)randf(1.0) * pow(10.0, (int)((uint32_t)randi() % 40) - 20)); break;
+            default: snprintf(text, sizeof(text), "%de%d", randi() % 100000, (int)((uint32_t)randi() % 50) - 25); break;
+        }
+        size_t length = strlen(text);
+        float expected = strtof(text, NULL);
+        float value;
+        const char *end = json_parse_float(text, text + length, &value);
+        XCTAssertTrue(end == text + length, @"%s", text);
+        XCTAssertEqual(memcmp(&value, &expected, sizeof(float)), 0, @"%s: %.9g, expected %.9g", text, value, expected);
+    }
+
+    const char *malformed[] = { "-", "01", "1.", "1e", ".5", "1.e3", "+1", "nan" };
+    for (int i = 0; i < 8; i++) {
+        float value;
+        XCTAssertTrue(json_parse_float(malformed[i], malformed[i] + strlen(malformed[i]), &value) == NULL, @"%s", malformed[i]);
+    }
+}
+
+- (void)testJsonIndexMembers {
+    const char *json = "{ \"position\": [1, 2.5, -3e2 ,4], \"rig\": {\"bones\": [{\"parent\": -1}], \"name\": \"]\"},"
+                       " \"empty\": [], \"mixed\": [1, \"x\"], \"flag\": true }";
+    json_member members[8];
+    ptrdiff_t count = json_index_members(json, strlen(json), members, 8);
+    XCTAssertEqual(count, 5);
+
+    const json_member *position = json_find_member(members, count, "position");
+    XCTAssertTrue(position && position->isFloatArray);
+    XCTAssertEqual(position->floatCount, (size_t)4);
+    const json_member *rig = json_find_member(members, count, "rig");
+    XCTAssertTrue(rig && !rig->isFloatArray);
+    XCTAssertEqualObjects([[NSString alloc] initWithBytes:rig->value length:rig->valueLength encoding:NSUTF8StringEncoding],
+                          @"{\"bones\": [{\"parent\": -1}], \"name\": \"]\"}");
+    XCTAssertTrue(json_find_member(members, count, "empty")->isFloatArray);
+    XCTAssertEqual(json_find_member(members, count, "empty")->floatCount, (size_t)0);
+    XCTAssertFalse(json_find_member(members, count, "mixed")->isFloatArray);
+    XCTAssertFalse(json_find_member(members, count, "flag")->isFloatArray);
+    XCTAssertTrue(json_find_member(members, count, "normal") == NULL);
+
+    // two components in every 16 byte tuple
+    float tuples[8] = { 0 };
+    XCTAssertEqual(json_decode_floats(position, tuples, 2, 16), (size_t)4);
+    XCTAssertEqual(tuples[0], 1.0f);
+    XCTAssertEqual(tuples[1], 2.5f);
+    XCTAssertEqual(tuples[4], -300.0f);
+    XCTAssertEqual(tuples[5], 4.0f);
+
+    const char *truncated = "{ \"position\": [1, 2";
+    XCTAssertEqual(json_index_members(truncated, strlen(truncated), members, 8), -1);
+}
+
+- (void)testJsonDecodeFloatsMatchesJSONSerialization {
+    NSData *data = [NSData dataWithContentsOfURL:foxJSONURL() options:NSDataReadingMappedIfSafe error:nil];
+    NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    json_member members[8];
+    ptrdiff_t count = json_index_members(data.bytes, data.length, members, 8);
+    XCTAssertEqual(count, 3);
+
+    for (NSString *key in @[ @"position", @"normal", @"uv" ]) {
+        NSArray<NSNumber *> *expected = dict[key];
+        const json_member *member = json_find_member(members, count, key.UTF8String);
+        XCTAssertEqual(member->floatCount, expected.count);
+        float *values = malloc(sizeof(float) * expected.count);
+        XCTAssertEqual(json_decode_floats(member, values, 1, sizeof(float)), expected.count);
+        for (NSUInteger i = 0; i < expected.count; i++) {
+            XCTAssertEqual(values[i], expected[i].floatValue, @"%@[%lu]", key, (unsigned long)i);
+        }
+        free(values);
+    }
+}
+
+- (void)testJsonFloatParserThroughput {
+    // a mesh of a million vertices in the layout of fox.json
+    const size_t vertexCount = 1000000;
+    NSMutableData *json = [NSMutableData dataWithCapacity:vertexCount * 64];
+    seedRand(42);
+    const char *keys[3] = { "position", "normal", "uv" };
+    const size_t widths[3] = { 3, 3, 2 };
+    [json appendBytes:"{" length:1];
+    for (int a = 0; a < 3; a++) {
+        char text[64];
+        int length = snprintf(text, sizeof(text), "%s\"%s\": [", a ? ", " : "", keys[a]);
+        [json appendBytes:text length:length];
+        for (size_t i = 0; i < vertexCount * widths[a]; i++) {
+            length = a == 0 ? snprintf(text, sizeof(text), "%s%.3f", i ? ", " : "", randf(10.0))
+                            : snprintf(text, sizeof(text), "%s%.6g", i ? ", " : "", randf(1.0));
+            [json appendBytes:text length:length];
+        }
+        [json appendBytes:"]" length:1];
+    }
+    [json appendBytes:"}" length:1];
+    double megabytes = json.length / 1e6;
+
+    // interleaved like JsonMesh, 16 bytes per attribute
+    float *vertices = calloc(vertexCount, 48);
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    json_member members[3];
+    ptrdiff_t count = json_index_members(json.bytes, json.length, members, 3);
+    size_t decoded = 0;
+    for (int a = 0; a < 3; a++) {
+        decoded += json_decode_floats(&members[a], vertices + a * 4, widths[a], 48);
+    }
+    CFAbsoluteTime streaming = CFAbsoluteTimeGetCurrent() - start;
+    XCTAssertEqual(count, 3);
+    XCTAssertEqual(decoded, vertexCount * 8);
+
+    start = CFAbsoluteTimeGetCurrent();
+    NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:json options:0 error:nil];
+    for (int a = 0; a < 3; a++) {
+        NSArray<NSNumber *> *values = dict[@(keys[a])];
+        for (NSUInteger i = 0; i < values.count; i++) {
+            vertices[(i / widths[a]) * 12 + a * 4 + i % widths[a]] = values[i].floatValue;
+        }
+    }
+    CFAbsoluteTime serialization = CFAbsoluteTimeGetCurrent() - start;
+
+    NSLog(@"%.1f MB mesh JSON: streaming %.1f ms (%.0f MB/s), NSJSONSerialization %.1f ms (%.0f MB/s)",
+          megabytes, streaming * 1000.0, megabytes / streaming, serialization * 1000.0, megabytes / serialization);
+    free(vertices);
+}
+
+#pragma mark - MeshCache
+
+- (void)testMeshCacheHashMatchesXXH64 {
+    XCTAssertEqual(mesh_cache_hash("", 0, 0), 0xEF46DB3751D8E999ull);
+    XCTAssertEqual(mesh_cache_hash("abc", 3, 0), 0x44BC2CF5AD770999ull);
+
+    // every tail length after the 32 byte lanes
+    uint8_t bytes[100];
+    for (int i = 0; i < 100; i++) {
+        bytes[i] = (uint8_t)i;
+    }
+    XCTAssertEqual(mesh_cache_hash(bytes, 100, 0), 0x6AC1E58032166597ull);
+    XCTAssertNotEqual(mesh_cache_hash(bytes, 100, 1), mesh_cache_hash(bytes, 100, 0));
+    XCTAssertNotEqual(mesh_cache_hash(bytes, 99, 0), mesh_cache_hash(bytes, 100, 0));
+}
+
+- (void)testMeshCacheRoundTripsThroughFile {
+    const char strings[] = "body\0textures/body.png\0/absolute/specular.png\0";
+    const mesh_cache_buffer buffers[2] = {
+        { .stride = 48, .length = 48 * 100 },
+        { .stride = 8, .length = 8 * 100 },
+    };
+    const mesh_cache_submesh submeshes[2] = {
+        { .geometryType = 2, .indexSize = 4, .indexCount = 90, .name = 0, .baseColorTexture = 5,
+          .specularTexture = 23, .indexOffset = 0 },
+        { .geometryType = 2, .indexSize = 2, .indexCount = 30, .name = MESH_CACHE_NO_STRING,
+          .baseColorTexture = MESH_CACHE_NO_STRING, .specularTexture = MESH_CACHE_NO_STRING, .indexOffset = 368 },
+    };
+    mesh_cache_desc desc = {
+        .sourceHash = 1,
+        .layoutHash = 2,
+        .vertexCount = 100,
+        .bufferCount = 2,
+        .buffers = buffers,
+        .submeshCount = 2,
+        .submeshes = submeshes,
+        .indicesLength = 428,
+        .strings = strings,
+        .stringsLength = sizeof(strings),
+        .boundsMin = { -1, -2, -3 },
+        .boundsMax = { 1, 2, 3 },
+    };
+    mesh_cache *cache = mesh_cache_create(&desc);
+    XCTAssertTrue(cache != NULL);
+    seedRand(42);
+    for (uint32_t b = 0; b < 2; b++) {
+        for (uint64_t i = 0; i < cache->buffers[b].length; i++) {
+            ((uint8_t *)cache->vertices[b])[i] = (uint8_t)randi();
+        }
+        XCTAssertEqual((uintptr_t)cache->vertices[b] % 16, (uintptr_t)0);
+    }
+    for (uint64_t i = 0; i < cache->indicesLength; i++) {
+        ((uint8_t *)cache->indices)[i] = (uint8_t)randi();
+    }
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"roundtrip.lmmesh"];
+    XCTAssertTrue(mesh_cache_write(cache, path.fileSystemRepresentation));
+    mesh_cache *loaded = mesh_cache_load(path.fileSystemRepresentation, 1, 2);
+    XCTAssertTrue(loaded != NULL);
+    XCTAssertTrue(loaded->mapped);
+    XCTAssertEqual(loaded->vertexCount, 100u);
+    XCTAssertEqual(loaded->bufferCount, 2u);
+    XCTAssertEqual(loaded->submeshCount, 2u);
+    XCTAssertEqual(loaded->boundsMax[2], 3.0f);
+    XCTAssertEqual(loaded->storageSize, cache->storageSize);
+    XCTAssertEqual(memcmp(loaded->storage, cache->storage, cache->storageSize), 0);
+    XCTAssertEqual(memcmp(loaded->vertices[1], cache->vertices[1], 8 * 100), 0);
+    XCTAssertEqual(strcmp(mesh_cache_string(loaded, loaded->submeshes[0].name), "body"), 0);
+    XCTAssertEqual(strcmp(mesh_cache_string(loaded, loaded->submeshes[0].specularTexture), "/absolute/specular.png"), 0);
+    XCTAssertTrue(mesh_cache_string(loaded, loaded->submeshes[1].name) == NULL);
+    mesh_cache_destroy(loaded);
+
+    // another source or vertex layout is a miss
+    XCTAssertTrue(mesh_cache_load(path.fileSystemRepresentation, 3, 2) == NULL);
+    XCTAssertTrue(mesh_cache_load(path.fileSystemRepresentation, 1, 3) == NULL);
+
+    // a cluster past its submesh is rejected
+    meshlet clusters[2] = { { .indexOffset = 0, .triangleCount = 20 }, { .indexOffset = 60, .triangleCount = 11 } };
+    mesh_cache_submesh clustered[2] = { submeshes[0], submeshes[1] };
+    clustered[0].clusterCount = 2;
+    desc.submeshes = clustered;
+    desc.clusterCount = 2;
+    desc.clusters = clusters;
+    XCTAssertTrue(mesh_cache_create(&desc) == NULL);
+    clusters[1].triangleCount = 10;
+    mesh_cache *withClusters = mesh_cache_create(&desc);
+    XCTAssertTrue(withClusters != NULL);
+    XCTAssertEqual(withClusters->clusterCount, 2u);
+    XCTAssertEqual(withClusters->clusters[1].indexOffset, 60u);
+    XCTAssertEqual(withClusters->submeshes[0].clusterCount, 2u);
+    mesh_cache_destroy(withClusters);
+    desc.clusterCount = 0;
+    desc.clusters = NULL;
+
+    // so is a level of detail the header doesn't count
+    mesh_cache_submesh levels[2] = { submeshes[0], submeshes[1] };
+    levels[1].lod = 1;
+    levels[1].lodError = 0.25f;
+    desc.submeshes = levels;
+    XCTAssertTrue(mesh_cache_create(&desc) == NULL);
+    desc.lodCount = 1;
+    mesh_cache *withLevels = mesh_cache_create(&desc);
+    XCTAssertTrue(withLevels != NULL);
+    XCTAssertEqual(withLevels->lodCount, 1u);
+    XCTAssertEqual(withLevels->submeshes[1].lod, 1u);
+    XCTAssertEqual(withLevels->submeshes[1].lodError, 0.25f);
+    mesh_cache_destroy(withLevels);
+    desc.lodCount = 0;
+
+    // a submesh past the indices is rejected when created and when loaded
+    mesh_cache_submesh outside[2] = { submeshes[0], submeshes[1] };
+    outside[1].indexOffset = 400;
+    desc.submeshes = outside;
+    XCTAssertTrue(mesh_cache_create(&desc) == NULL);
+    NSFileHandle *file = [NSFileHandle fileHandleForUpdatingAtPath:path];
+    [file seekToFileOffset:((mesh_cache_header *)cache->storage)->submeshesOffset + sizeof(mesh_cache_submesh)];
+    [file writeData:[NSData dataWithBytes:&outside[1] length:sizeof(mesh_cache_submesh)]];
+    [file closeFile];
+    XCTAssertTrue(mesh_cache_load(path.fileSystemRepresentation, 1, 2) == NULL);
+
+    // so is a truncated file
+    XCTAssertTrue(mesh_cache_write(cache, path.fileSystemRepresentation));
+    file = [NSFileHandle fileHandleForUpdatingAtPath:path];
+    [file truncateFileAtOffset:cache->storageSize - 16];
+    [file closeFile];
+    XCTAssertTrue(mesh_cache_load(path.fileSystemRepresentation, 1, 2) == NULL);
+
+    mesh_cache_destroy(cache);
+    [NSFileManager.defaultManager removeItemAtPath:path error:nil];
+}
+
+- (void)testMeshCacheWarmLoadVersusJsonParse {
+    NSData *data = [NSData dataWithContentsOfURL:foxJSONURL() options:NSDataReadingMappedIfSafe error:nil];
+    json_member members[8];
+    ptrdiff_t count = json_index_members(data.bytes, data.length, members, 8);
+    const json_member *position = json_find_member(members, count, "position");
+    uint32_t vertexCount = (uint32_t)(position->floatCount / 3);
+
+    // the JsonMesh layout: position, normal and uv 16 bytes apart, identity indices
+    const mesh_cache_buffer buffer = { .stride = 48, .length = (uint64_t)vertexCount * 48 };
+    const mesh_cache_submesh submesh = {
+        .geometryType = 2, .indexSize = 4, .indexCount = vertexCount, .name = MESH_CACHE_NO_STRING,
+        .baseColorTexture = MESH_CACHE_NO_STRING, .specularTexture = MESH_CACHE_NO_STRING,
+    };
+    uint64_t sourceHash = mesh_cache_hash(data.bytes, data.length, 0);
+    mesh_cache_desc desc = {
+        .sourceHash = sourceHash,
+        .vertexCount = vertexCount,
+        .bufferCount = 1,
+        .buffers = &buffer,
+        .submeshCount = 1,
+        .submeshes = &submesh,
+        .indicesLength = (uint64_t)vertexCount * 4,
+    };
+    mesh_cache *cache = mesh_cache_create(&desc);
+    const char *keys[3] = { "position", "normal", "uv" };
+    const size_t widths[3] = { 3, 3, 2 };
+    for (int a = 0; a < 3; a++) {
+        json_decode_floats(json_find_member(members, count, keys[a]), (char *)cache->vertices[0] + a * 16, widths[a], 48);
+    }
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        ((uint32_t *)cache->indices)[i] = i;
+    }
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"fox.lmmesh"];
+    XCTAssertTrue(mesh_cache_write(cache, path.fileSystemRepresentation));
+
+    const int iterations = 100;
+    float *vertices = calloc(vertexCount, 48);
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int k = 0; k < iterations; k++) {
+        ptrdiff_t indexed = json_index_members(data.bytes, data.length, members, 8);
+        for (int a = 0; a < 3; a++) {
+            json_decode_floats(json_find_member(members, indexed, keys[a]), vertices + a * 4, widths[a], 48);
+        }
+    }
+    CFAbsoluteTime parse = (CFAbsoluteTimeGetCurrent() - start) / iterations;
+
+    // a load hashes the source to find its key, then maps and reads the cache
+    uint64_t checksum = 0;
+    start = CFAbsoluteTimeGetCurrent();
+    for (int k = 0; k < iterations; k++) {
+        uint64_t key = mesh_cache_hash(data.bytes, data.length, 0);
+        mesh_cache *loaded = mesh_cache_load(path.fileSystemRepresentation, key, 0);
+        checksum += mesh_cache_hash(loaded->vertices[0], (size_t)loaded->buffers[0].length, 0);
+        mesh_cache_destroy(loaded);
+    }
+    CFAbsoluteTime load = (CFAbsoluteTimeGetCurrent() - start) / iterations;
+    XCTAssertEqual(checksum, mesh_cache_hash(cache->vertices[0], (size_t)buffer.length, 0) * iterations);
+    XCTAssertEqual(memcmp(vertices, cache->vertices[0], (size_t)buffer.length), 0);
+
+    NSLog(@"fox.json, %u vertices: parse %.3f ms, cached load %.3f ms (%.1fx)",
+          vertexCount, parse * 1000.0, load * 1000.0, parse / load);
+    free(vertices);
+    mesh_cache_destroy(cache);
+    [NSFileManager.defaultManager removeItemAtPath:path error:nil];
+}
+
+#pragma mark - VertexWeld
+
+- (void)testVertexWeldFoxJSON {
+    NSData *data = [NSData dataWithContentsOfURL:foxJSONURL() options:NSDataReadingMappedIfSafe error:nil];
+    json_member members[8];
+    ptrdiff_t count = json_index_members(data.bytes, data.length, members, 8);
+    size_t cornerCount = json_find_member(members, count, "position")->floatCount / 3;
+
+    // the JsonMesh layout, position, normal and uv 16 bytes apart
+    const size_t stride = 48;
+    float *corners = calloc(cornerCount, stride);
+    const char *keys[3] = { "position", "normal", "uv" };
+    const size_t widths[3] = { 3, 3, 2 };
+    for (int a = 0; a < 3; a++) {
+        json_decode_floats(json_find_member(members, count, keys[a]), corners + a * 4, widths[a], stride);
+    }
+
+    uint32_t *remap = malloc(sizeof(uint32_t) * cornerCount);
+    size_t vertexCount = vertex_weld_remap(remap, corners, cornerCount, stride, 0.0f);
+    XCTAssertGreaterThan(vertexCount, (size_t)0);
+    XCTAssertLessThan(vertexCount, cornerCount);
+    float *vertices = malloc(stride * vertexCount);
+    vertex_weld_apply(vertices, corners, cornerCount, stride, remap);
+
+    // every corner is its welded vertex, bit for bit
+    for (size_t i = 0; i < cornerCount; i++) {
+        XCTAssertLessThan(remap[i], (uint32_t)vertexCount);
+        XCTAssertEqual(memcmp(vertices + remap[i] * 12, corners + i * 12, stride), 0, @"corner %zu", i);
+    }
+
+    size_t indexSize = vertexCount <= UINT16_MAX ? 2 : 4;
+    size_t before = cornerCount * stride + cornerCount * 4;
+    size_t after = vertexCount * stride + cornerCount * indexSize;
+    XCTAssertEqual(indexSize, (size_t)2);
+    NSLog(@"fox.json welded %zu corners into %zu vertices (%.1f%%), vertex and index memory %zu -> %zu bytes (%.1f%%)",
+          cornerCount, vertexCount, 100.0 * vertexCount / cornerCount, before, after, 100.0 * after / before);
+
+    free(vertices);
+    free(remap);
+    free(corners);
+}
+
+- (void)testVertexWeldEpsilon {
+    // three noisy copies of distinct vertices, the noise well inside a grid cell
+    const size_t baseCount = 1000;
+    const float epsilon = 1e-3f;
+    float *corners = calloc(baseCount * 3, sizeof(float) * 4);
+    seedRand(42);
+    for (size_t i = 0; i < baseCount * 3; i++) {
+        size_t base = i % baseCount;
+        corners[i * 4 + 0] = base * epsilon + randf(epsilon * 0.25f);
+        corners[i * 4 + 1] = (base % 7) * epsilon + randf(epsilon * 0.25f);
+        corners[i * 4 + 2] = -(float)(base % 13) * epsilon + randf(epsilon * 0.25f);
+    }
+
+    uint32_t *remap = malloc(sizeof(uint32_t) * baseCount * 3);
+    XCTAssertEqual(vertex_weld_remap(remap, corners, baseCount * 3, sizeof(float) * 4, 0.0f), baseCount * 3);
+    XCTAssertEqual(vertex_weld_remap(remap, corners, baseCount * 3, sizeof(float) * 4, epsilon), baseCount);
+    for (size_t i = 0; i < baseCount * 3; i++) {
+        XCTAssertEqual(remap[i], (uint32_t)(i % baseCount));
+    }
+
+    // the first copy is the one kept
+    float *vertices = malloc(sizeof(float) * 4 * baseCount);
+    vertex_weld_apply(vertices, corners, baseCount * 3, sizeof(float) * 4, remap);
+    XCTAssertEqual(memcmp(vertices, corners, sizeof(float) * 4 * baseCount), 0);
+
+    free(vertices);
+    free(remap);
+    free(corners);
+}
+
+#pragma mark - MeshOptimizer
+
+// Rotates every triangle to start at its smallest index, keeping the winding,
+// and sorts them, so two orders of one triangle set compare equal.
+static int compareTriangles(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(uint32_t) * 3);
+}
+
+static void canonicalTriangles(uint32_t *indices, size_t indexCount) {
+    for (size_t t = 0; t < indexCount; t += 3) {
+        uint32_t *tri = indices + t;
+        while (tri[0] > tri[1] || tri[0] > tri[2]) {
+            uint32_t first = tri[0];
+            tri[0] = tri[1];
+            tri[1] = tri[2];
+            tri[2] = first;
+        }
+    }
+    qsort(indices, indexCount / 3, sizeof(uint32_t) * 3, compareTriangles);
+}
+
+- (void)testMeshOptimizerGridKeepsTrianglesAndImprovesACMR {
+    // a row-major grid, the order GeometryMesh builds its tori and planes in
+    const uint32_t side = 64;
+    const size_t vertexCount = (side + 1) * (side + 1);
+    const size_t indexCount = side * side * 6;
+    float *positions = malloc(sizeof(float) * 4 * vertexCount);
+    for (uint32_t y = 0; y <= side; y++) {
+        for (uint32_t x = 0; x <= side; x++) {
+            float *p = positions + (y * (side + 1) + x) * 4;
+            p[0] = x;
+            p[1] = y;
+            p[2] = sinf(x * 0.2f) * cosf(y * 0.2f);
+            p[3] = 1.0f;
+        }
+    }
+    uint32_t *indices = malloc(sizeof(uint32_t) * indexCount);
+    size_t i = 0;
+    for (uint32_t y = 0; y < side; y++) {
+        for (uint32_t x = 0; x < side; x++) {
+            uint32_t a = y * (side + 1) + x, b = a + 1, d = a + side + 1, c = d + 1;
+            uint32_t quad[6] = { a, b, d, b, c, d };
+            memcpy(indices + i, quad, sizeof(quad));
+            i += 6;
+        }
+    }
+
+    mesh_vertex_cache_stats before = mesh_analyze_vertex_cache(indices, indexCount, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+    uint32_t *optimized = malloc(sizeof(uint32_t) * indexCount);
+    XCTAssertTrue(mesh_optimize_vertex_cache(optimized, indices, indexCount, vertexCount));
+    mesh_vertex_cache_stats cache = mesh_analyze_vertex_cache(optimized, indexCount, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+    XCTAssertTrue(mesh_optimize_overdraw(optimized, optimized, indexCount, positions, sizeof(float) * 4, vertexCount, 1.05f));
+    mesh_vertex_cache_stats overdraw = mesh_analyze_vertex_cache(optimized, indexCount, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+    XCTAssertLessThan(cache.acmr, before.acmr);
+    XCTAssertLessThan(overdraw.acmr, before.acmr);
+
+    // renumbering by first use keeps the triangles once mapped back
+    uint32_t *remap = malloc(sizeof(uint32_t) * vertexCount);
+    XCTAssertEqual(mesh_optimize_vertex_fetch_remap(remap, optimized, indexCount, vertexCount), vertexCount);
+    float *remapped = malloc(sizeof(float) * 4 * vertexCount);
+    mesh_remap_vertices(remapped, positions, vertexCount, sizeof(float) * 4, remap);
+    mesh_remap_indices(optimized, optimized, indexCount, remap);
+    XCTAssertEqual(optimized[0], 0u);
+    for (size_t v = 0; v < vertexCount; v++) {
+        XCTAssertEqual(memcmp(remapped + remap[v] * 4, positions + v * 4, sizeof(float) * 4), 0);
+    }
+    mesh_remap_indices(indices, indices, indexCount, remap);
+    canonicalTriangles(indices, indexCount);
+    canonicalTriangles(optimized, indexCount);
+    XCTAssertEqual(memcmp(indices, optimized, sizeof(uint32_t) * indexCount), 0);
+
+    NSLog(@"%ux%u grid ACMR %.3f -> %.3f (%.3f after overdraw), ATVR %.3f -> %.3f (%.3f)",
+          side, side, before.acmr, cache.acmr, overdraw.acmr, before.atvr, cache.atvr, overdraw.atvr);
+
+    free(remapped);
+    free(remap);
+    free(optimized);
+    free(indices);
+    free(positions);
+}
+
+- (void)testMeshOptimizerImportedMeshes {
+    MDLVertexDescriptor *descriptor = [[MDLVertexDescriptor alloc] init];
+    descriptor.attributes[0] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributePosition format:MDLVertexFormatFloat3 offset:0 bufferIndex:0];
+    descriptor.attributes[1] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributeNormal format:MDLVertexFormatFloat3 offset:12 bufferIndex:0];
+    descriptor.attributes[2] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributeTextureCoordinate format:MDLVertexFormatFloat2 offset:24 bufferIndex:0];
+    descriptor.layouts[0] = [[MDLVertexBufferLayout alloc] initWithStride:32];
+    MDLMeshBufferDataAllocator *allocator = [[MDLMeshBufferDataAllocator alloc] init];
+
+    for (NSString *name in @[ @"nanosuit", @"planet", @"rock" ]) {
+        NSURL *url = [NSBundle.common URLForResource:[name stringByAppendingPathExtension:@"obj"] withExtension:nil subdirectory:name];
+        MDLAsset *asset = [[MDLAsset alloc] initWithURL:url vertexDescriptor:descriptor bufferAllocator:allocator];
+        MDLMesh *mesh = (MDLMesh *)[asset objectAtIndex:0];
+        XCTAssertTrue([mesh isKindOfClass:MDLMesh.class]);
+
+        MDLMesh *optimized = [MeshOptimizer optimize:mesh allocator:allocator];
+        XCTAssertEqual(optimized.submeshes.count, mesh.submeshes.count);
+        XCTAssertLessThanOrEqual(optimized.vertexCount, mesh.vertexCount);
+        for (NSUInteger s = 0; s < mesh.submeshes.count; s++) {
+            XCTAssertEqualObjects(optimized.submeshes[s].name, mesh.submeshes[s].name);
+            XCTAssertEqual(optimized.submeshes[s].indexCount, mesh.submeshes[s].indexCount);
+        }
+
+        mesh_vertex_cache_stats before = [MeshOptimizer vertexCacheStatisticsOf:mesh cacheSize:MESH_OPTIMIZER_FIFO_SIZE];
+        mesh_vertex_cache_stats after = [MeshOptimizer vertexCacheStatisticsOf:optimized cacheSize:MESH_OPTIMIZER_FIFO_SIZE];
+        XCTAssertLessThan(after.acmr, before.acmr);
+        NSLog(@"%@.obj %lu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+              name, (unsigned long)mesh.vertexCount, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+}
+
+#pragma mark - VertexPacking
+
+- (void)testVertexPackingErrorBounds {
+    // the 48 byte layout the samples load, normals include the six axes where
+    // the octahedral fold has its edges
+    const size_t vertexCount = 100000;
+    const size_t stride = 48;
+    float *vertices = calloc(vertexCount, stride);
+    seedRand(7);
+    for (size_t i = 0; i < vertexCount; i++) {
+        float *v = vertices + i * 12;
+        v[0] = 3.0f + randf(20.0f);
+        v[1] = randf(0.5f);
+        v[2] = -40.0f + randf(2.0f);
+        v[4] = 0.5f + randf(0.5f);
+        v[5] = 0.5f + randf(0.5f);
+        simd_float3 n = i < 6 ? (simd_float3){ 0, 0, 0 } : simd_make_float3(randf(1.0f), randf(1.0f), randf(1.0f));
+        if (i < 6) n[i / 2] = i % 2 ? -1.0f : 1.0f;
+        if (simd_length(n) < 1e-3f) n = simd_make_float3(0.0f, 0.0f, -1.0f);
+        n = simd_normalize(n);
+        memcpy(v + 8, &n, sizeof(float) * 3);
+    }
+    vertex_packing_source source = { vertices, vertexCount, stride, 0, 32, 16 };
+    vertex_packing_constants constants = vertex_packing_compute_constants(&source);
+
+    uint8_t *packed = malloc(VERTEX_PACKING_STRIDE * vertexCount);
+    const vertex_packing_position_format formats[2] = { VertexPackingPositionSnorm16, VertexPackingPositionHalf };
+    const float positionBounds[2] = { 1.0f / 60000.0f, 1.0f / 4000.0f };
+    for (int f = 0; f < 2; f++) {
+        vertex_pack(packed, &source, formats[f], &constants);
+        float positionError = 0.0f, normalError = 0.0f, texcoordError = 0.0f;
+        for (size_t i = 0; i < vertexCount; i++) {
+            const float *v = vertices + i * 12;
+            float position[3], normal[3], texcoord[2];
+            vertex_unpack(position, normal, texcoord, packed + i * VERTEX_PACKING_STRIDE, formats[f], &constants);
+            for (int k = 0; k < 3; k++) {
+                positionError = fmaxf(positionError, fabsf(position[k] - v[k]) / constants.positionScale[k]);
+            }
+            float cosine = fminf(normal[0] * v[8] + normal[1] * v[9] + normal[2] * v[10], 1.0f);
+            normalError = fmaxf(normalError, acosf(cosine) * 180.0f / M_PI);
+            texcoordError = fmaxf(texcoordError, fmaxf(fabsf(texcoord[0] - v[4]), fabsf(texcoord[1] - v[5])));
+        }
+        XCTAssertLessThan(positionError, positionBounds[f]);
+        XCTAssertLessThan(normalError, 0.05f);
+        XCTAssertLessThanOrEqual(texcoordError, 1.0f / 4096.0f);
+        NSLog(@"%@ positions: max error %.2g of half the bounds, normals %.4f degrees, texture coordinates %.2g",
+              f == 0 ? @"snorm16" : @"half", positionError, normalError, texcoordError);
+    }
+
+    free(packed);
+    free(vertices);
+}
+
+- (void)testVertexPackingImportedMesh {
+    VertexPacking *packing = [[VertexPacking alloc] initWithPositionFormat:VertexPackingPositionSnorm16
+                                                         positionAttribute:0
+                                                         texcoordAttribute:1
+                                                           normalAttribute:2
+                                                               bufferIndex:0];
+    XCTAssertEqual(packing.vertexDescriptor.layouts[0].stride, (NSUInteger)VERTEX_PACKING_STRIDE);
+    XCTAssertEqual(packing.vertexDescriptor.attributes[0].format, MTLVertexFormatShort4Normalized);
+    XCTAssertEqual(packing.vertexDescriptor.attributes[2].format, MTLVertexFormatShort2Normalized);
+
+    MDLVertexDescriptor *descriptor = MTKModelIOVertexDescriptorFromMetal(packing.loadingVertexDescriptor);
+    for (NSNumber *index in packing.attributeMap) {
+        descriptor.attributes[index.integerValue].name = packing.attributeMap[index];
+    }
+    MDLMeshBufferDataAllocator *allocator = [[MDLMeshBufferDataAllocator alloc] init];
+    NSURL *url = [NSBundle.common URLForResource:@"nanosuit.obj" withExtension:nil subdirectory:@"nanosuit"];
+    MDLAsset *asset = [[MDLAsset alloc] initWithURL:url vertexDescriptor:descriptor bufferAllocator:allocator];
+    MDLMesh *mesh = (MDLMesh *)[asset objectAtIndex:0];
+
+    vertex_packing_constants constants;
+    MDLMesh *packed = [packing pack:mesh allocator:allocator constants:&constants];
+    XCTAssertNotNil(packed);
+    XCTAssertEqual(packed.vertexCount, mesh.vertexCount);
+    XCTAssertEqual(packed.submeshes.count, mesh.submeshes.count);
+    XCTAssertEqual(packed.vertexBuffers[0].length, mesh.vertexCount * VERTEX_PACKING_STRIDE);
+
+    // every vertex decodes back into the bounds
+    MDLAxisAlignedBoundingBox box = mesh.boundingBox;
+    MDLMeshBufferMap *map = [packed.vertexBuffers[0] map];
+    const uint8_t *bytes = map.bytes;
+    for (NSUInteger i = 0; i < packed.vertexCount; i++) {
+        float position[3], normal[3], texcoord[2];
+        vertex_unpack(position, normal, texcoord, bytes + i * VERTEX_PACKING_STRIDE, VertexPackingPositionSnorm16, &constants);
+        for (int k = 0; k < 3; k++) {
+            XCTAssertGreaterThanOrEqual(position[k], box.minBounds[k] - 1e-3f);
+            XCTAssertLessThanOrEqual(position[k], box.maxBounds[k] + 1e-3f);
+        }
+    }
+
+    NSLog(@"nanosuit.obj %lu vertices, vertex memory %lu -> %lu bytes",
+          (unsigned long)mesh.vertexCount,
+          (unsigned long)mesh.vertexBuffers[0].length,
+          (unsigned long)packed.vertexBuffers[0].length);
+}
+
+#pragma mark - Meshlet
+
+// A torus around the z axis, counter-clockwise seen from outside.
+static float *makeTorus(uint32_t **indices, size_t *indexCount, size_t *vertexCount, int radial, int tubular) {
+    *vertexCount = (size_t)(radial + 1) * (tubular + 1);
+    *indexCount = (size_t)radial * tubular * 6;
+    float *positions = malloc(sizeof(float) * 3 * *vertexCount);
+    *indices = malloc(sizeof(uint32_t) * *indexCount);
+    size_t v = 0;
+    for (int j = 0; j <= radial; j++) {
+        for (int i = 0; i <= tubular; i++, v++) {
+            float u = i * 2.0f * M_PI / tubular, w = j * 2.0f * M_PI / radial;
+            positions[v * 3 + 0] = (0.6f + 0.2f * cosf(w)) * cosf(u);
+            positions[v * 3 + 1] = (0.6f + 0.2f * cosf(w)) * sinf(u);
+            positions[v * 3 + 2] = 0.2f * sinf(w);
+        }
+    }
+    size_t x = 0;
+    for (int j = 1; j <= radial; j++) {
+        for (int i = 1; i <= tubular; i++) {
+            uint32_t a = (tubular + 1) * j + i - 1, b = (tubular + 1) * (j - 1) + i - 1;
+            uint32_t c = (tubular + 1) * (j - 1) + i, d = (tubular + 1) * j + i;
+            uint32_t quad[6] = { a, b, d, b, c, d };
+            memcpy(*indices + x, quad, sizeof(quad));
+            x += 6;
+        }
+    }
+    return positions;
+}
+
+// Checks the limits, the bounding spheres and that the clusters are the
+// regrouped triangles back to back.
+static void checkMeshlets(const meshlet *meshlets, size_t count,
+                          const uint32_t *regrouped, const uint32_t *indices, size_t indexCount,
+                          const float *positions) {
+    uint32_t next = 0;
+    for (size_t m = 0; m < count; m++) {
+        XCTAssertEqual(meshlets[m].indexOffset, next);
+        XCTAssertGreaterThan(meshlets[m].triangleCount, 0u);
+        XCTAssertLessThanOrEqual(meshlets[m].triangleCount, (uint32_t)MESHLET_MAX_TRIANGLES);
+        XCTAssertLessThanOrEqual(meshlets[m].vertexCount, (uint32_t)MESHLET_MAX_VERTICES);
+        for (uint32_t i = 0; i < meshlets[m].triangleCount * 3; i++) {
+            const float *p = positions + regrouped[next + i] * 3;
+            simd_float3 offset = simd_make_float3(p[0] - meshlets[m].center[0],
+                                                  p[1] - meshlets[m].center[1],
+                                                  p[2] - meshlets[m].center[2]);
+            XCTAssertLessThanOrEqual(simd_length(offset), meshlets[m].radius * 1.0001f + 1e-6f);
+        }
+        next += meshlets[m].triangleCount * 3;
+    }
+    XCTAssertEqual((size_t)next, indexCount);
+
+    uint32_t *before = malloc(sizeof(uint32_t) * indexCount), *after = malloc(sizeof(uint32_t) * indexCount);
+    memcpy(before, indices, sizeof(uint32_t) * indexCount);
+    memcpy(after, regrouped, sizeof(uint32_t) * indexCount);
+    canonicalTriangles(before, indexCount);
+    canonicalTriangles(after, indexCount);
+    XCTAssertEqual(memcmp(before, after, sizeof(uint32_t) * indexCount), 0);
+    free(before);
+    free(after);
+}
+
+- (void)testMeshletCullingNeverDropsVisibleTriangles {
+    uint32_t *indices;
+    size_t indexCount, vertexCount;
+    float *positions = makeTorus(&indices, &indexCount, &vertexCount, 20, 60);
+    mesh_optimize_vertex_cache(indices, indices, indexCount, vertexCount);
+
+    meshlet *meshlets = malloc(sizeof(meshlet) * meshlet_bound(indexCount));
+    uint32_t *regrouped = malloc(sizeof(uint32_t) * indexCount);
+    size_t count = meshlet_build(meshlets, regrouped, indices, indexCount, positions, sizeof(float) * 3, vertexCount);
+    XCTAssertGreaterThan(count, 0u);
+    checkMeshlets(meshlets, count, regrouped, indices, indexCount, positions);
+
+    // a culled triangle faces away from the camera or is outside a plane
+    meshlet_draw *draws = malloc(sizeof(meshlet_draw) * count);
+    char *drawn = malloc(indexCount / 3);
+    size_t culled = 0, triangles = 0;
+    seedRand(23);
+    for (int c = 0; c < 200; c++) {
+        vector_float3 eye = simd_make_float3(randf(4.0f) - 2.0f, randf(4.0f) - 2.0f, randf(4.0f) - 2.0f);
+        vector_float3 target = simd_make_float3(randf(1.0f) - 0.5f, randf(1.0f) - 0.5f, randf(1.0f) - 0.5f);
+        matrix_float4x4 viewProjection = matrix_multiply(matrix_perspective_left_hand(M_PI / 4.0f, 1.5f, 0.1f, 100.0f),
+                                                         matrix_look_at_left_hand(eye, target, simd_make_float3(0, 0, 1)));
+        vector_float4 planes[FRUSTUM_PLANE_COUNT];
+        frustum_planes_from_matrix(planes, viewProjection);
+
+        size_t runCount = meshlet_cull(draws, meshlets, count, planes, eye);
+        memset(drawn, 0, indexCount / 3);
+        for (size_t r = 0; r < runCount; r++) {
+            memset(drawn + draws[r].indexOffset / 3, 1, draws[r].indexCount / 3);
+        }
+        for (size_t t = 0; t < indexCount / 3; t++, triangles++) {
+            if (drawn[t]) {
+                continue;
+            }
+            culled++;
+            simd_float3 p[3];
+            for (int k = 0; k < 3; k++) {
+                const float *v = positions + regrouped[t * 3 + k] * 3;
+                p[k] = simd_make_float3(v[0], v[1], v[2]);
+            }
+            simd_float3 normal = simd_normalize(simd_cross(p[1] - p[0], p[2] - p[0]));
+            bool backFacing = simd_dot(eye - p[0], normal) <= 1e-4f;
+            bool outside = false;
+            for (int plane = 0; plane < FRUSTUM_PLANE_COUNT; plane++) {
+                bool allOutside = true;
+                for (int k = 0; k < 3; k++) {
+                    allOutside &= simd_dot(planes[plane].xyz, p[k]) + planes[plane].w < 0.0f;
+                }
+                outside |= allOutside;
+            }
+            XCTAssertTrue(backFacing || outside);
+        }
+    }
+    XCTAssertGreaterThan(culled, 0u);
+    NSLog(@"torus %zu triangles in %zu clusters, %.1f%% culled over 200 cameras",
+          indexCount / 3, count, 100.0 * culled / triangles);
+
+    free(drawn);
+    free(draws);
+    free(regrouped);
+    free(meshlets);
+    free(indices);
+    free(positions);
+}
+
+- (void)testMeshletImportedMeshes {
+    MDLVertexDescriptor *descriptor = [[MDLVertexDescriptor alloc] init];
+    descriptor.attributes[0] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributePosition format:MDLVertexFormatFloat3 offset:0 bufferIndex:0];
+    descriptor.layouts[0] = [[MDLVertexBufferLayout alloc] initWithStride:12];
+    MDLMeshBufferDataAllocator *allocator = [[MDLMeshBufferDataAllocator alloc] init];
+
+    for (NSString *name in @[ @"nanosuit", @"planet", @"rock" ]) {
+        NSURL *url = [NSBundle.common URLForResource:[name stringByAppendingPathExtension:@"obj"] withExtension:nil subdirectory:name];
+        MDLAsset *asset = [[MDLAsset alloc] initWithURL:url vertexDescriptor:descriptor bufferAllocator:allocator];
+        MDLMesh *mesh = [MeshOptimizer optimize:(MDLMesh *)[asset objectAtIndex:0] allocator:allocator];
+        const float *positions = [mesh.vertexBuffers[0] map].bytes;
+
+        size_t meshletCount = 0, coneCount = 0, triangleCount = 0;
+        for (MDLSubmesh *submesh in mesh.submeshes) {
+            size_t indexCount = submesh.indexCount;
+            uint32_t *indices = malloc(sizeof(uint32_t) * indexCount);
+            const void *source = [submesh.indexBuffer map].bytes;
+            for (size_t i = 0; i < indexCount; i++) {
+                indices[i] = submesh.indexType == MDLIndexBitDepthUInt16 ? ((const uint16_t *)source)[i] : ((const uint32_t *)source)[i];
+            }
+            meshlet *meshlets = malloc(sizeof(meshlet) * meshlet_bound(indexCount));
+            uint32_t *regrouped = malloc(sizeof(uint32_t) * indexCount);
+            size_t count = meshlet_build(meshlets, regrouped, indices, indexCount, positions, 12, mesh.vertexCount);
+            checkMeshlets(meshlets, count, regrouped, indices, indexCount, positions);
+            for (size_t m = 0; m < count; m++) {
+                coneCount += meshlets[m].coneCutoff <= 1.0f;
+            }
+            meshletCount += count;
+            triangleCount += indexCount / 3;
+            free(regrouped);
+            free(meshlets);
+            free(indices);
+        }
+        NSLog(@"%@.obj %zu triangles in %zu clusters, %.1f triangles each, %zu with a normal cone",
+              name, triangleCount, meshletCount, (double)triangleCount / meshletCount, coneCount);
+    }
+}
+
+#pragma mark - MeshSimplifier
+
+- (void)testMeshSimplifierKeepsBordersOfAFlatGrid {
+    // a 20x20 grid of unit quads, anything inside can collapse for free
+    const int n = 20;
+    size_t vertexCount = (n + 1) * (n + 1), indexCount = n * n * 6;
+    float *positions = malloc(sizeof(float) * 3 * vertexCount);
+    uint32_t *indices = malloc(sizeof(uint32_t) * indexCount);
+    for (int y = 0, v = 0; y <= n; y++) {
+        for (int x = 0; x <= n; x++, v++) {
+            positions[v * 3 + 0] = x;
+            positions[v * 3 + 1] = y;
+            positions[v * 3 + 2] = 0.0f;
+        }
+    }
+    for (int y = 0, i = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            uint32_t a = y * (n + 1) + x, b = a + 1, c = a + n + 1, d = c + 1;
+            uint32_t quad[6] = { a, b, d, a, d, c };
+            memcpy(indices + i, quad, sizeof(quad));
+            i += 6;
+        }
+    }
+    mesh_simplify_source source = {
+        .vertices = positions, .vertexCount = vertexCount, .stride = sizeof(float) * 3,
+    };
+    XCTAssertEqual(mesh_simplify_extent(&source), (float)n);
+
+    float error = -1.0f;
+    size_t simplified = mesh_simplify(indices, indices, indexCount, &source, 0, 0.01f, &error);
+    XCTAssertGreaterThan(simplified, 0u);
+    XCTAssertLessThan(simplified, indexCount / 4);
+    XCTAssertEqual(simplified % 3, 0u);
+    XCTAssertLessThanOrEqual(error, 0.01f);
+
+    // every border vertex stays, the area neither shrinks nor folds over
+    char *used = calloc(vertexCount, 1);
+    double area = 0.0;
+    for (size_t t = 0; t < simplified; t += 3) {
+        const float *a = positions + indices[t] * 3, *b = positions + indices[t + 1] * 3, *c = positions + indices[t + 2] * 3;
+        float signedArea = ((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0])) * 0.5f;
+        XCTAssertGreaterThan(signedArea, 0.0f);
+        area += signedArea;
+        used[indices[t]] = used[indices[t + 1]] = used[indices[t + 2]] = 1;
+    }
+    XCTAssertEqualWithAccuracy(area, (double)(n * n), 1e-3);
+    for (int y = 0; y <= n; y++) {
+        for (int x = 0; x <= n; x++) {
+            if (x == 0 || y == 0 || x == n || y == n) {
+                XCTAssertTrue(used[y * (n + 1) + x]);
+            }
+        }
+    }
+
+    free(used);
+    free(indices);
+    free(positions);
+}
+
+- (void)testMeshSimplifierTorusErrorGrowsWithTarget {
+    uint32_t *indices;
+    size_t indexCount, vertexCount;
+    float *positions = makeTorus(&indices, &indexCount, &vertexCount, 20, 60);
+    mesh_simplify_source source = {
+        .vertices = positions, .vertexCount = vertexCount, .stride = sizeof(float) * 3,
+    };
+    uint32_t *simplified = malloc(sizeof(uint32_t) * indexCount);
+
+    size_t previous = indexCount;
+    const float targets[4] = { 0.002f, 0.01f, 0.05f, 0.2f };
+    for (int l = 0; l < 4; l++) {
+        float error;
+        size_t count = mesh_simplify(simplified, indices, indexCount, &source, 0, targets[l], &error);
+        XCTAssertGreaterThan(count, 0u);
+        XCTAssertLessThanOrEqual(count, previous);
+        XCTAssertLessThanOrEqual(error, targets[l]);
+        for (size_t i = 0; i < count; i++) {
+            XCTAssertLessThan(simplified[i], (uint32_t)vertexCount);
+        }
+        previous = count;
+    }
+    XCTAssertLessThan(previous, indexCount / 4);
+
+    // a triangle target stops earlier than a loose error target
+    float error;
+    size_t half = mesh_simplify(simplified, indices, indexCount, &source, indexCount / 2, 1.0f, &error);
+    XCTAssertLessThanOrEqual(half, indexCount / 2);
+    XCTAssertGreaterThan(half, indexCount / 4);
+
+    free(simplified);
+    free(indices);
+    free(positions);
+}
+
+- (void)testMeshLODSelection {
+    const float errors[4] = { 0.0f, 0.01f, 0.05f, 0.2f };
+    float projectionScale = mesh_lod_projection_scale(M_PI / 4.0f, 1000.0f);
+    XCTAssertEqualWithAccuracy(projectionScale, 1207.1f, 0.1f);
+
+    // further or smaller never picks a finer level
+    uint32_t previous = 0;
+    for (float distance = 0.1f; distance < 1000.0f; distance *= 1.5f) {
+        uint32_t level = mesh_lod_select(errors, 4, 1.0f, distance, projectionScale, 1.0f);
+        XCTAssertGreaterThanOrEqual(level, previous);
+        XCTAssertLessThanOrEqual(errors[level] * projectionScale / distance, 1.0f);
+        previous = level;
+    }
+    XCTAssertEqual(previous, 3u);
+    XCTAssertEqual(mesh_lod_select(errors, 4, 1.0f, 0.1f, projectionScale, 1.0f), 0u);
+    XCTAssertGreaterThanOrEqual(mesh_lod_select(errors, 4, 0.1f, 20.0f, projectionScale, 1.0f),
+                                mesh_lod_select(errors, 4, 1.0f, 20.0f, projectionScale, 1.0f));
+
+    // instances take their scale and distance from the model matrix
+    matrix_float4x4 models[3] = {
+        matrix4x4_translation(0.0f, 0.0f, 5.0f),
+        matrix4x4_translation(0.0f, 0.0f, 500.0f),
+        matrix_multiply(matrix4x4_translation(0.0f, 0.0f, 500.0f), matrix4x4_scale(50.0f, 50.0f, 50.0f)),
+    };
+    uint8_t levels[3];
+    mesh_lod_select_n(levels, models, 3, errors, 4, simd_make_float3(0, 0, 0), projectionScale, 1.0f);
+    for (int i = 0; i < 3; i++) {
+        float scale = simd_length(models[i].columns[0].xyz);
+        XCTAssertEqual(levels[i], mesh_lod_select(errors, 4, scale, simd_length(models[i].columns[3].xyz), projectionScale, 1.0f));
+    }
+    XCTAssertLessThan(levels[0], levels[1]);
+    XCTAssertLessThan(levels[2], levels[1]);
+}
+
+- (void)testMeshSimplifierImportedMeshes {
+    MDLVertexDescriptor *descriptor = [[MDLVertexDescriptor alloc] init];
+    descriptor.attributes[0] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributePosition format:MDLVertexFormatFloat3 offset:0 bufferIndex:0];
+    descriptor.attributes[1] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributeNormal format:MDLVertexFormatFloat3 offset:12 bufferIndex:0];
+    descriptor.attributes[2] = [[MDLVertexAttribute alloc] initWithName:MDLVertexAttributeTextureCoordinate format:MDLVertexFormatFloat2 offset:24 bufferIndex:0];
+    descriptor.layouts[0] = [[MDLVertexBufferLayout alloc] initWithStride:32];
+    MDLMeshBufferDataAllocator *allocator = [[MDLMeshBufferDataAllocator alloc] init];
+
+    for (NSString *name in @[ @"nanosuit", @"planet", @"rock" ]) {
+        NSURL *url = [NSBundle.common URLForResource:[name stringByAppendingPathExtension:@"obj"] withExtension:nil subdirectory:name];
+        MDLAsset *asset = [[MDLAsset alloc] initWithURL:url vertexDescriptor:descriptor bufferAllocator:allocator];
+        MDLMesh *mesh = [MeshOptimizer optimize:(MDLMesh *)[asset objectAtIndex:0] allocator:allocator];
+
+        size_t fullCount = 0;
+        for (MDLSubmesh *submesh in mesh.submeshes) {
+            fullCount += submesh.indexCount;
+        }
+
+        NSDate *start = [NSDate date];
+        NSArray<MeshLOD *> *lods = [MeshSimplifier buildLODs:mesh errorTargets:MeshSimplifier.defaultErrorTargets allocator:allocator];
+        NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+        XCTAssertGreaterThan(lods.count, 0u);
+
+        NSMutableString *summary = [NSMutableString string];
+        size_t previousCount = fullCount;
+        float previousError = 0.0f;
+        for (MeshLOD *lod in lods) {
+            XCTAssertEqual(lod.submeshes.count, mesh.submeshes.count);
+            XCTAssertGreaterThanOrEqual(lod.error, previousError);
+            size_t indexCount = 0;
+            for (MDLSubmesh *submesh in lod.submeshes) {
+                const void *bytes = [submesh.indexBuffer map].bytes;
+                for (NSUInteger i = 0; i < submesh.indexCount; i++) {
+                    uint32_t index = submesh.indexType == MDLIndexBitDepthUInt16 ? ((const uint16_t *)bytes)[i] : ((const uint32_t *)bytes)[i];
+                    XCTAssertLessThan(index, (uint32_t)mesh.vertexCount);
+                }
+                indexCount += submesh.indexCount;
+            }
+            XCTAssertLessThanOrEqual(indexCount, previousCount * 3 / 4);
+            [summary appendFormat:@" %zu (%.3g)", indexCount / 3, lod.error];
+            previousCount = indexCount;
+            previousError = lod.error;
+        }
+        NSLog(@"%@.obj %zu triangles, levels%@ in %.0f ms", name, fullCount / 3, summary, elapsed * 1000.0);
+    }
+}
+
+#pragma mark - InstanceCull
+
+// Rocks on a ring of radius 150 around the y axis, like the Asteroids belt.
+static void makeRockRing(matrix_float4x4 *models, size_t count) {
+    seedRand(7);
+    for (size_t i = 0; i < count; i++) {
+        float angle = randf(2.0f * M_PI), radius = 125.0f + randf(50.0f), scale = 0.05f + randf(0.4f);
+        models[i] = matrix_multiply(matrix4x4_translation(sinf(angle) * radius, randf(20.0f) - 10.0f, cosf(angle) * radius),
+                                    matrix_multiply(matrix4x4_rotation(randf(2.0f * M_PI), simd_normalize(simd_make_float3(0.4f, 0.6f, 0.8f))),
+                                                    matrix4x4_scale(scale, scale, scale)));
+    }
+}
+
+// Looks at the ring from above its rim, a narrower field of view sees fewer rocks.
+static instance_cull_view makeRingView(float fovy, const float *levelErrors, uint32_t levelCount) {
+    instance_cull_view view = {
+        .cameraPosition = simd_make_float3(0.0f, 40.0f, 300.0f),
+        .levelErrors = levelErrors,
+        .levelCount = levelCount,
+        .projectionScale = mesh_lod_projection_scale(M_PI / 4.0f, 1000.0f),
+        .thresholdPixels = 1.0f,
+    };
+    matrix_float4x4 viewProjection = matrix_multiply(matrix_perspective_left_hand(fovy, 1.5f, 0.1f, 1000.0f),
+                                                     matrix_look_at_left_hand(view.cameraPosition, simd_make_float3(0, 0, 0),
+                                                                              simd_make_float3(0, 1, 0)));
+    frustum_planes_from_matrix(view.planes, viewProjection);
+    return view;
+}
+
+static const float kRockLevelErrors[4] = { 0.0f, 0.3f, 1.0f, 3.0f };
+
+- (void)testInstanceCullMatchesBruteForce {
+    const size_t count = 50001;
+    matrix_float4x4 *models = malloc(sizeof(matrix_float4x4) * count);
+    matrix_float4x4 *instances = malloc(sizeof(matrix_float4x4) * count);
+    matrix_float4x4 *expected = malloc(sizeof(matrix_float4x4) * count);
+    makeRockRing(models, count);
+    instance_cull *cull = instance_cull_create(count);
+    XCTAssertFalse(instance_cull_set_bounds(cull, models, count + 1, simd_make_float4(0, 0, 0, 1)));
+    XCTAssertFalse(instance_cull_set_bounds(cull, models, count, simd_make_float4(0, 0, 0, 0)));
+    XCTAssertTrue(instance_cull_set_bounds(cull, models, count, simd_make_float4(0.0f, 0.1f, 0.0f, 1.2f)));
+    job_pool *pool = job_pool_create(4);
+
+    for (float fovy = 0.05f; fovy < 1.5f; fovy += 0.35f) {
+        instance_cull_view view = makeRingView(fovy, kRockLevelErrors, 4);
+
+        // every visible sphere, level by level in instance order
+        size_t visible = 0;
+        uint32_t expectedCounts[4] = { 0 };
+        for (uint32_t level = 0; level < 4; level++) {
+            for (size_t i = 0; i < count; i++) {
+                if (!frustum_contains_sphere(view.planes, cull->centerX[i], cull->centerY[i], cull->centerZ[i], cull->radius[i])) {
+                    continue;
+                }
+                float dx = cull->centerX[i] - view.cameraPosition.x;
+                float dy = cull->centerY[i] - view.cameraPosition.y;
+                float dz = cull->centerZ[i] - view.cameraPosition.z;
+                uint32_t instanceLevel = mesh_lod_select(kRockLevelErrors, 4, cull->radius[i] / 1.2f,
+                                                         sqrtf(dx * dx + dy * dy + dz * dz),
+                                                         view.projectionScale, view.thresholdPixels);
+                if (instanceLevel == level) {
+                    expected[visible++] = models[i];
+                    expectedCounts[level]++;
+                }
+            }
+        }
+
+        uint32_t counts[4];
+        XCTAssertEqual(instance_cull_run(cull, instances, counts, models, &view, NULL), visible);
+        XCTAssertEqual(memcmp(counts, expectedCounts, sizeof(counts)), 0);
+        XCTAssertEqual(memcmp(instances, expected, sizeof(matrix_float4x4) * visible), 0);
+
+        // the same on any number of threads
+        memset(instances, 0, sizeof(matrix_float4x4) * count);
+        XCTAssertEqual(instance_cull_run(cull, instances, counts, models, &view, pool), visible);
+        XCTAssertEqual(memcmp(counts, expectedCounts, sizeof(counts)), 0);
+        XCTAssertEqual(memcmp(instances, expected, sizeof(matrix_float4x4) * visible), 0);
+    }
+
+    // too many levels is nothing visible
+    float manyLevels[INSTANCE_CULL_MAX_LEVELS + 1] = { 0 };
+    instance_cull_view view = makeRingView(1.0f, manyLevels, INSTANCE_CULL_MAX_LEVELS + 1);
+    uint32_t counts[INSTANCE_CULL_MAX_LEVELS + 1];
+    XCTAssertEqual(instance_cull_run(cull, instances, counts, models, &view, pool), 0u);
+
+    job_pool_destroy(pool);
+    instance_cull_destroy(cull);
+    free(expected);
+    free(instances);
+    free(models);
+}
+
+- (void)testInstanceCullScalesWithVisibleCount {
+    NSUInteger maxThreads = NSProcessInfo.processInfo.activeProcessorCount;
+    job_pool *pool = job_pool_create(0);
+
+    for (size_t count = 10000; count <= 1000000; count *= 10) {
+        matrix_float4x4 *models = malloc(sizeof(matrix_float4x4) * count);
+        matrix_float4x4 *instances = malloc(sizeof(matrix_float4x4) * count);
+        makeRockRing(models, count);
+        instance_cull *cull = instance_cull_create(count);
+        instance_cull_set_bounds(cull, models, count, simd_make_float4(0.0f, 0.1f, 0.0f, 1.2f));
+
+        for (float fovy = 0.05f; fovy < 1.5f; fovy += 0.35f) {
+            instance_cull_view view = makeRingView(fovy, kRockLevelErrors, 4);
+            uint32_t counts[4];
+            size_t visible = instance_cull_run(cull, instances, counts, models, &view, NULL);
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            for (int frame = 0; frame < 10; frame++) {
+                instance_cull_run(cull, instances, counts, models, &view, NULL);
+            }
+            double serial = (CFAbsoluteTimeGetCurrent() - start) * 100.0;
+            start = CFAbsoluteTimeGetCurrent();
+            for (int frame = 0; frame < 10; frame++) {
+                instance_cull_run(cull, instances, counts, models, &view, pool);
+            }
+            double parallel = (CFAbsoluteTimeGetCurrent() - start) * 100.0;
+            NSLog(@"%zu instances, %zu visible (%.1f%%, levels %u %u %u %u): %.3f ms on 1 thread, %.3f ms on %lu",
+                  count, visible, 100.0 * visible / count, counts[0], counts[1], counts[2], counts[3],
+                  serial, parallel, (unsigned long)maxThreads);
+        }
+
+        instance_cull_destroy(cull);
+        free(instances);
+        free(models);
+    }
+
+    job_pool_destroy(pool);
+}
+
+- (void)testPerformanceInstanceCull {
+    const size_t count = 1000000;
+    matrix_float4x4 *models = malloc(sizeof(matrix_float4x4) * count);
+    matrix_float4x4 *instances = malloc(sizeof(matrix_float4x4) * count);
+    makeRockRing(models, count);
+    instance_cull *cull = instance_cull_create(count);
+    instance_cull_set_bounds(cull, models, count, simd_make_float4(0.0f, 0.1f, 0.0f, 1.2f));
+    instance_cull_view view = makeRingView(M_PI / 4.0f, kRockLevelErrors, 4);
+    job_pool *pool = job_pool_create(0);
+
+    [self measureBlock:^{
+        uint32_t counts[4];
+        for (int frame = 0; frame < 10; frame++) {
+            instance_cull_run(cull, instances, counts, models, &view, pool);
+        }
+    }];
+
+    job_pool_destroy(pool);
+    instance_cull_destroy(cull);
+    free(instances);
+    free(models);
+}
+
+#pragma mark - HalfFloat
+
+- (void)testHalfFloatRoundTripsEveryHalf {
+    const size_t count = 1 << 16;
+    uint16_t *halfs = malloc(sizeof(uint16_t) * count);
+    uint16_t *halfsBack = malloc(sizeof(uint16_t) * count);
+    float *floats = malloc(sizeof(float) * count);
+    for (size_t i = 0; i < count; i++) {
+        halfs[i] = (uint16_t)i;
+    }
+
+    float32_from_float16_n(floats, halfs, count);
+    float16_from_float32_n(halfsBack, floats, count);
+
+    for (size_t i = 0; i < count; i++) {
+        BOOL isNaN = (halfs[i] & 0x7C00) == 0x7C00 && (halfs[i] & 0x3FF) != 0;
+        if (isNaN) {
+            XCTAssertTrue(isnan(floats[i]), @"half %04zx", i);
+            XCTAssertEqual(halfsBack[i], halfs[i] | 0x200, @"half %04zx comes back as quiet NaN", i);
+        } else {
+            XCTAssertEqual(floats[i], float32_from_float16(halfs[i]), @"half %04zx", i);
+            XCTAssertEqual(halfsBack[i], halfs[i], @"half %04zx", i);
+        }
+    }
+
+    free(halfs); free(halfsBack); free(floats);
+}
+
+- (void)testHalfFloatRounding {
+    const float values[] = {
+        65504.0f, 65519.0f, 65520.0f, 1e10f, -INFINITY, INFINITY,
+        1.0f + 1.0f / 2048.0f,              // tie, rounds down to even
+        1.0f + 3.0f / 2048.0f,              // tie, rounds up to even
+        5.9604644775390625e-8f,             // smallest subnormal
+        2.98023223876953125e-8f,            // half of it, ties to zero
+        6.1035156e-5f, -0.0f, 0.1f, -3.14159f,
+    };
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint16_t halfs[count];
+
+    float16_from_float32_n(halfs, values, count);
+
+    for (size_t i = 0; i < count; i++) {
+        XCTAssertEqual(halfs[i], float16_from_float32(values[i]), @"value %g", values[i]);
+    }
+}
+
+- (void)testHalfFloatClampedSaturatesAtLargestHalf {
+    const float values[] = { 65504.0f, 65520.0f, 1e10f, INFINITY, -1e10f, -INFINITY, 1.5f, NAN };
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint16_t halfs[count];
+
+    float16_from_float32_clamped_n(halfs, values, count);
+
+    XCTAssertEqual(halfs[0], 0x7BFF);
+    XCTAssertEqual(halfs[1], 0x7BFF);
+    XCTAssertEqual(halfs[2], 0x7BFF);
+    XCTAssertEqual(halfs[3], 0x7BFF);
+    XCTAssertEqual(halfs[4], 0xFBFF);
+    XCTAssertEqual(halfs[5], 0xFBFF);
+    XCTAssertEqual(halfs[6], float16_from_float32(1.5f));
+    XCTAssertTrue((halfs[7] & 0x7C00) == 0x7C00 && (halfs[7] & 0x3FF) != 0);
+}
+
+- (void)testPerformanceFloat16FromFloat32ScalarLoop {
+    float *src = malloc(sizeof(float) * kHDRImageFloatCount);
+    uint16_t *dst = malloc(sizeof(uint16_t) * kHDRImageFloatCount);
+    for (size_t i = 0; i < kHDRImageFloatCount; i++) {
+        src[i] = (i % 1000) * 0.37f;
+    }
+
+    [self measureBlock:^{
+        for (size_t i = 0; i < kHDRImageFloatCount; i++) {
+            dst[i] = float16_from_float32(src[i]);
+        }
+    }];
+
+    free(src); free(dst);
+}
+
+- (void)testPerformanceFloat16FromFloat32Bulk {
+    float *src = malloc(sizeof(float) * kHDRImageFloatCount);
+    uint16_t *dst = malloc(sizeof(uint16_t) * kHDRImageFloatCount);
+    for (size_t i = 0; i < kHDRImageFloatCount; i++) {
+        src[i] = (i % 1000) * 0.37f;
+    }
+
+    [self measureBlock:^{
+        float16_from_float32_n(dst, src, kHDRImageFloatCount);
+    }];
+
+    free(src); free(dst);
+}
+
+- (void)testPerformanceFloat32FromFloat16Bulk {
+    uint16_t *src = malloc(sizeof(uint16_t) * kHDRImageFloatCount);
+    float *dst = malloc(sizeof(float) * kHDRImageFloatCount);
+    for (size_t i = 0; i < kHDRImageFloatCount; i++) {
+        src[i] = (uint16_t)(i % 0x7C00);
+    }
+
+    [self measureBlock:^{
+        float32_from_float16_n(dst, src, kHDRImageFloatCount);
+    }];
+
+    free(src); free(dst);
+}
+
+#pragma mark - RandomStream
+
+- (void)testRandomStreamKnownAnswer {
+    // Philox4x32-10 vectors from the Random123 distribution
+    random_stream stream;
+    random_stream_init(&stream, 0, 0);
+    XCTAssertEqual(random_stream_next_u32(&stream), 0x6627e8d5u);
+    XCTAssertEqual(random_stream_next_u32(&stream), 0xe169c58du);
+    XCTAssertEqual(random_stream_next_u32(&stream), 0xbc57ac4cu);
+    XCTAssertEqual(random_stream_next_u32(&stream), 0x9b00dbd8u);
+}
+
+- (void)testRandomStreamFillMatchesNext {
+    float filled[203];
+    for (uint64_t start = 0; start < 8; start++) {
+        random_stream a, b;
+        random_stream_init(&a, 1234, 7);
+        random_stream_init(&b, 1234, 7);
+        random_stream_skip(&a, start);
+        random_stream_skip(&b, start);
+
+        random_stream_fill_float(&a, filled, 203, -3.0f, 5.0f);
+        for (size_t i = 0; i < 203; i++) {
+            float value = random_stream_next_float(&b, -3.0f, 5.0f);
+            XCTAssertEqual(filled[i], value, @"start %llu index %zu", start, i);
+            XCTAssertTrue(value >= -3.0f && value <= 5.0f);
+        }
+        XCTAssertEqual(random_stream_next_u32(&a), random_stream_next_u32(&b));
+    }
+}
+
+- (void)testRandomStreamsAreIndependent {
+    random_stream a, b, c;
+    random_stream_init(&a, 42, 0);
+    random_stream_init(&b, 42, 1);
+    random_stream_init(&c, 43, 0);
+
+    size_t sameB = 0, sameC = 0;
+    for (size_t i = 0; i < 1024; i++) {
+        uint32_t value = random_stream_next_u32(&a);
+        sameB += value == random_stream_next_u32(&b);
+        sameC += value == random_stream_next_u32(&c);
+    }
+    XCTAssertEqual(sameB, 0);
+    XCTAssertEqual(sameC, 0);
+}
+
+- (void)testPerformanceRandfLoop {
+    float *values = malloc(sizeof(float) * kHDRImageFloatCount);
+
+    [self measureBlock:^{
+        seedRand(42);
+        for (size_t i = 0; i < kHDRImageFloatCount; i++) {
+            values[i] = randf(1.0f);
+        }
+    }];
+
+    free(values);
+}
+
+- (void)testPerformanceRandomStreamFill {
+    float *values = malloc(sizeof(float) * kHDRImageFloatCount);
+
+    [self measureBlock:^{
+        random_stream stream;
+        random_stream_init(&stream, 42, 0);
+        random_stream_fill_float(&stream, values, kHDRImageFloatCount, 0.0f, 1.0f);
+    }];
+
+    free(values);
+}
+
 @end